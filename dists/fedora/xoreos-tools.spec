@@ -47,6 +47,9 @@ Currently, the following tools are included:
 * unnds: Extract Nintendo DS roms
 * unnsbtx: Extract Nintendo NSBTX textures into TGA images
 * unkeybif: Extract BioWare KEY/BIF archives
+* erf: Pack BioWare ERF archives
+* rim: Pack BioWare RIM archives
+* keybif: Pack BioWare KEY/BIF archives
 * desmall: Decompress "small" (Nintendo DS LZSS, types 0x00 and 0x10) files
 * xoreostex2tga: Convert BioWare's texture formats into TGA
 * nbfs2tga: Convert Nintendo's raw NBFS images into TGA
@@ -82,9 +85,12 @@ rm %{buildroot}%{_pkgdocdir}/*
 %{_bindir}/desmall
 %{_bindir}/fixpremiumgff
 %{_bindir}/gff2xml
+%{_bindir}/erf
+%{_bindir}/keybif
 %{_bindir}/nbfs2tga
 %{_bindir}/ncgr2tga
 %{_bindir}/ncsdis
+%{_bindir}/rim
 %{_bindir}/tlk2xml
 %{_bindir}/ssf2xml
 %{_bindir}/unerf
@@ -102,11 +108,14 @@ rm %{buildroot}%{_pkgdocdir}/*
 %{_mandir}/man1/cdpth2tga.1*
 %{_mandir}/man1/convert2da.1*
 %{_mandir}/man1/desmall.1*
+%{_mandir}/man1/erf.1.*
 %{_mandir}/man1/fixpremiumgff.1.*
 %{_mandir}/man1/gff2xml.1.*
+%{_mandir}/man1/keybif.1.*
 %{_mandir}/man1/nbfs2tga.1.*
 %{_mandir}/man1/ncgr2tga.1.*
 %{_mandir}/man1/ncsdis.1.*
+%{_mandir}/man1/rim.1.*
 %{_mandir}/man1/tlk2xml.1.*
 %{_mandir}/man1/ssf2xml.1.*
 %{_mandir}/man1/unerf.1.*
@@ -27,6 +27,11 @@
  */
 
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cctype>
 
 #include "src/common/util.h"
 #include "src/common/error.h"
@@ -49,89 +54,110 @@ static const uint32 kVersion2b = MKTAG('V', '2', '.', 'b');
 
 namespace Aurora {
 
-TwoDARow::TwoDARow(TwoDAFile &parent) : _parent(&parent) {
+/** Hash a cell string (byte-wise, since we're only looking for exact matches). */
+static inline uint32 getStringHash(const Common::UString &str) {
+	uint32 hash = 0x811C9DC5;
+	for (const char *s = str.c_str(); *s; s++)
+		hash = (hash ^ (byte) *s) * 16777619;
+
+	return hash;
 }
 
-TwoDARow::~TwoDARow() {
+/** Hash a cell string case-insensitively, to match UString::equalsIgnoreCase(). */
+static inline uint32 getStringHashIgnoreCase(const Common::UString &str) {
+	uint32 hash = 0x811C9DC5;
+	for (Common::UString::iterator it = str.begin(); it != str.end(); ++it)
+		hash = (hash ^ Common::UString::toLower(*it)) * 16777619;
+
+	return hash;
+}
+
+/** Is the string at this position exactly the given string? */
+struct StringEquals {
+	const std::vector<Common::UString> &strings;
+	const Common::UString &str;
+
+	StringEquals(const std::vector<Common::UString> &s, const Common::UString &t) : strings(s), str(t) {
+	}
+
+	bool operator()(uint32 i) const {
+		return !strcmp(strings[i].c_str(), str.c_str());
+	}
+};
+
+/** Does the row at this position have the given cell value, ignoring case? */
+struct CellEqualsIgnoreCase {
+	const std::vector<TwoDARow> &rows;
+	size_t column;
+	const Common::UString &value;
+
+	CellEqualsIgnoreCase(const std::vector<TwoDARow> &r, size_t c, const Common::UString &v) :
+		rows(r), column(c), value(v) {
+	}
+
+	bool operator()(uint32 i) const {
+		return rows[i].getString(column).equalsIgnoreCase(value);
+	}
+};
+
+TwoDARow::TwoDARow(TwoDAFile &parent, size_t row) : _parent(&parent), _row(row) {
 }
 
 const Common::UString &TwoDARow::getString(size_t column) const {
 	const Common::UString &cell = getCell(column);
-	if (cell.empty() || (cell == "****"))
+	if (TwoDAFile::isEmptyCell(cell))
 		return _parent->_defaultString;
 
 	return cell;
 }
 
 const Common::UString &TwoDARow::getString(const Common::UString &column) const {
-	const Common::UString &cell = getCell(_parent->headerToColumn(column));
-	if (cell.empty() || (cell == "****"))
-		return _parent->_defaultString;
-
-	return cell;
+	return getString(_parent->headerToColumn(column));
 }
 
 int32 TwoDARow::getInt(size_t column) const {
-	const Common::UString &cell = getCell(column);
-	if (cell.empty() || (cell == "****"))
+	if ((column >= _parent->_columns.size()) || (_row >= _parent->_columns[column].ints.size()))
 		return _parent->_defaultInt;
 
-	return _parent->parseInt(cell);
+	return _parent->_columns[column].ints[_row];
 }
 
 int32 TwoDARow::getInt(const Common::UString &column) const {
-	const Common::UString &cell = getCell(_parent->headerToColumn(column));
-	if (cell.empty() || (cell == "****"))
-		return _parent->_defaultInt;
-
-	return _parent->parseInt(cell);
+	return getInt(_parent->headerToColumn(column));
 }
 
 float TwoDARow::getFloat(size_t column) const {
-	const Common::UString &cell = getCell(column);
-	if (cell.empty() || (cell == "****"))
+	if ((column >= _parent->_columns.size()) || (_row >= _parent->_columns[column].floats.size()))
 		return _parent->_defaultFloat;
 
-	return _parent->parseFloat(cell);
+	return _parent->_columns[column].floats[_row];
 }
 
 float TwoDARow::getFloat(const Common::UString &column) const {
-	const Common::UString &cell = getCell(_parent->headerToColumn(column));
-	if (cell.empty() || (cell == "****"))
-		return _parent->_defaultFloat;
-
-	return _parent->parseFloat(cell);
+	return getFloat(_parent->headerToColumn(column));
 }
 
 bool TwoDARow::empty(size_t column) const {
-	const Common::UString &cell = getCell(column);
-	if (cell.empty() || (cell == "****"))
-		return true;
-
-	return false;
+	return TwoDAFile::isEmptyCell(getCell(column));
 }
 
 bool TwoDARow::empty(const Common::UString &column) const {
 	return empty(_parent->headerToColumn(column));
 }
 
-static const Common::UString kEmpty;
 const Common::UString &TwoDARow::getCell(size_t n) const {
-	if (n >= _data.size())
-		return kEmpty;
-
-	return _data[n];
+	return _parent->getCell(_row, n);
 }
 
 
 TwoDAFile::TwoDAFile(Common::SeekableReadStream &twoda) :
-	_defaultInt(0), _defaultFloat(0.0f), _emptyRow(*this) {
+	_defaultInt(0), _defaultFloat(0.0f), _emptyRow(*this, SIZE_MAX) {
 
 	load(twoda);
 }
 
 TwoDAFile::TwoDAFile(const GDAFile &gda) :
-	_defaultInt(0), _defaultFloat(0.0f), _emptyRow(*this) {
+	_defaultInt(0), _defaultFloat(0.0f), _emptyRow(*this, SIZE_MAX) {
 
 	load(gda);
 }
@@ -145,8 +171,9 @@ void TwoDAFile::clear() {
 
 	_headers.clear();
 
-	for (std::vector<TwoDARow *>::iterator row = _rows.begin(); row != _rows.end(); ++row)
-		delete *row;
+	_strings.clear();
+	_stringIndex.clear();
+	_columns.clear();
 	_rows.clear();
 
 	_headerMap.clear();
@@ -207,8 +234,8 @@ void TwoDAFile::read2a(Common::SeekableReadStream &twoda) {
 
 void TwoDAFile::read2b(Common::SeekableReadStream &twoda) {
 	readHeaders2b(twoda);
-	skipRowNames2b(twoda);
-	readRows2b(twoda);
+	const size_t rowCount = skipRowNames2b(twoda);
+	readRows2b(twoda, rowCount);
 }
 
 void TwoDAFile::readDefault2a(Common::SeekableReadStream &twoda,
@@ -248,10 +275,12 @@ void TwoDAFile::readRows2a(Common::SeekableReadStream &twoda,
 	/* And now read the individual cells in the rows. */
 
 	size_t columnCount = _headers.size();
+	size_t rowCount    = 0;
 
-	while (!twoda.eos()) {
-		TwoDARow *row = new TwoDARow(*this);
+	_columns.resize(columnCount);
 
+	std::vector<Common::UString> row;
+	while (!twoda.eos()) {
 		/* Skip the first token, which is the row index, possibly indented.
 		 * The row index is implicit in the data and its use in the 2DA
 		 * file is only meant as a guideline for people editing the file by
@@ -260,19 +289,22 @@ void TwoDAFile::readRows2a(Common::SeekableReadStream &twoda,
 		tokenize.skipToken(twoda);
 
 		// Read all the cells in the row
-		size_t count = tokenize.getTokens(twoda, row->_data, columnCount, columnCount, "****");
+		size_t count = tokenize.getTokens(twoda, row, columnCount, columnCount, "****");
 
 		// And move to the next line
 		tokenize.nextChunk(twoda);
 
-		if (count == 0) {
+		if (count == 0)
 			// Ignore empty lines
-			delete row;
 			continue;
-		}
 
-		_rows.push_back(row);
+		for (size_t i = 0; i < columnCount; i++)
+			addCell(i, row[i]);
+
+		rowCount++;
 	}
+
+	finishLoad(rowCount);
 }
 
 void TwoDAFile::readHeaders2b(Common::SeekableReadStream &twoda) {
@@ -292,7 +324,7 @@ void TwoDAFile::readHeaders2b(Common::SeekableReadStream &twoda) {
 	}
 }
 
-void TwoDAFile::skipRowNames2b(Common::SeekableReadStream &twoda) {
+size_t TwoDAFile::skipRowNames2b(Common::SeekableReadStream &twoda) {
 	/* Next up are the row names / indices. Like for the ASCII 2DA files,
 	 * the actual row indices are implicit in the data, so we're just
 	 * ignoring them. The only information we care about is how many rows
@@ -300,7 +332,6 @@ void TwoDAFile::skipRowNames2b(Common::SeekableReadStream &twoda) {
 	 */
 
 	const uint32 rowCount = twoda.readUint32LE();
-	_rows.resize(rowCount, 0);
 
 	Common::StreamTokenizer tokenize(Common::StreamTokenizer::kRuleHeed);
 
@@ -309,9 +340,11 @@ void TwoDAFile::skipRowNames2b(Common::SeekableReadStream &twoda) {
 	tokenize.addSeparator('\0');
 
 	tokenize.skipToken(twoda, rowCount);
+
+	return rowCount;
 }
 
-void TwoDAFile::readRows2b(Common::SeekableReadStream &twoda) {
+void TwoDAFile::readRows2b(Common::SeekableReadStream &twoda, size_t rowCount) {
 	/* And now read the cells. In binary 2DA files, each cell only
 	 * stores a single 16-bit number, the offset into the data segment
 	 * where the data for this cell can be found. Moreover, a single
@@ -320,44 +353,48 @@ void TwoDAFile::readRows2b(Common::SeekableReadStream &twoda) {
 	 */
 
 	size_t columnCount = _headers.size();
-	size_t rowCount    = _rows.size();
 	size_t cellCount   = columnCount * rowCount;
 
-	uint32 *offsets = new uint32[cellCount];
+	std::vector<uint16> offsets(cellCount);
 
 	Common::StreamTokenizer tokenize(Common::StreamTokenizer::kRuleHeed);
 
 	tokenize.addSeparator('\0');
 
-	for (size_t i = 0; i < cellCount; i++)
-		offsets[i] = twoda.readUint16LE();
+	if (cellCount > 0)
+		twoda.readArrayLE(&offsets[0], cellCount);
 
 	twoda.skip(2); // Size of the data segment in bytes
 
 	size_t dataOffset = twoda.pos();
 
-	for (size_t i = 0; i < rowCount; i++) {
-		_rows[i] = new TwoDARow(*this);
+	_columns.resize(columnCount);
 
-		_rows[i]->_data.resize(columnCount);
+	// Cells sharing the same data offset also share the same string
+	std::map<uint16, uint32> offsetStrings;
 
+	for (size_t i = 0; i < rowCount; i++) {
 		for (size_t j = 0; j < columnCount; j++) {
-			size_t offset = dataOffset + offsets[i * columnCount + j];
+			const uint16 offset = offsets[i * columnCount + j];
 
-			try {
-				twoda.seek(offset);
-			} catch (...) {
-				delete[] offsets;
-				throw;
+			std::map<uint16, uint32>::const_iterator string = offsetStrings.find(offset);
+			if (string != offsetStrings.end()) {
+				_columns[j].cells.push_back(string->second);
+				continue;
 			}
 
-			_rows[i]->_data[j] = tokenize.getToken(twoda);
-			if (_rows[i]->_data[j].empty())
-				_rows[i]->_data[j] = "****";
+			twoda.seek(dataOffset + offset);
+
+			Common::UString cell = tokenize.getToken(twoda);
+			if (cell.empty())
+				cell = "****";
+
+			_columns[j].cells.push_back(addString(cell));
+			offsetStrings.insert(std::make_pair(offset, _columns[j].cells.back()));
 		}
 	}
 
-	delete[] offsets;
+	finishLoad(rowCount);
 }
 
 void TwoDAFile::createHeaderMap() {
@@ -365,6 +402,67 @@ void TwoDAFile::createHeaderMap() {
 		_headerMap.insert(std::make_pair(_headers[i], i));
 }
 
+void TwoDAFile::addCell(size_t column, const Common::UString &cell) {
+	assert(column < _columns.size());
+
+	_columns[column].cells.push_back(addString(cell));
+}
+
+uint32 TwoDAFile::addString(const Common::UString &str) {
+	const uint32 index = _stringIndex.insert(getStringHash(str), _strings.size(), StringEquals(_strings, str));
+	if (index == _strings.size())
+		_strings.push_back(str);
+
+	return index;
+}
+
+void TwoDAFile::finishLoad(size_t rowCount) {
+	// We don't need the string index anymore
+	_stringIndex.clear();
+
+	_rows.reserve(rowCount);
+	for (size_t i = 0; i < rowCount; i++)
+		_rows.push_back(TwoDARow(*this, i));
+
+	/* Parse every distinct string only once, and then spread the values
+	 * over the cells using them. */
+
+	std::vector<int32> ints(_strings.size(), _defaultInt);
+	std::vector<float> floats(_strings.size(), _defaultFloat);
+
+	for (size_t i = 0; i < _strings.size(); i++) {
+		if (isEmptyCell(_strings[i]))
+			continue;
+
+		ints  [i] = parseInt  (_strings[i]);
+		floats[i] = parseFloat(_strings[i]);
+	}
+
+	for (std::vector<Column>::iterator c = _columns.begin(); c != _columns.end(); ++c) {
+		assert(c->cells.size() == rowCount);
+
+		c->ints.resize(rowCount);
+		c->floats.resize(rowCount);
+
+		for (size_t i = 0; i < rowCount; i++) {
+			c->ints  [i] = ints  [c->cells[i]];
+			c->floats[i] = floats[c->cells[i]];
+		}
+	}
+}
+
+static const Common::UString kEmpty;
+const Common::UString &TwoDAFile::getCell(size_t row, size_t column) const {
+	if ((column >= _columns.size()) || (row >= _columns[column].cells.size()))
+		return kEmpty;
+
+	return _strings[_columns[column].cells[row]];
+}
+
+bool TwoDAFile::isEmptyCell(const Common::UString &cell) {
+	return cell.empty() || !strcmp(cell.c_str(), "****");
+}
+
 void TwoDAFile::load(const GDAFile &gda) {
 	try {
 
@@ -378,31 +476,30 @@ void TwoDAFile::load(const GDAFile &gda) {
 			_headers[i] = headerString ? headerString : Common::UString::format("[%u]", headers[i].hash);
 		}
 
-		_rows.resize(gda.getRowCount(), 0);
+		_columns.resize(gda.getColumnCount());
 		for (size_t i = 0; i < gda.getRowCount(); i++) {
 			const GFF4Struct *row = gda.getRow(i);
 
-			_rows[i] = new TwoDARow(*this);
-			_rows[i]->_data.resize(gda.getColumnCount());
-
 			for (size_t j = 0; j < gda.getColumnCount(); j++) {
+				Common::UString cell;
+
 				if (row) {
 					switch (headers[j].type) {
 						case GDAFile::kTypeString:
 						case GDAFile::kTypeResource:
-							_rows[i]->_data[j] = row->getString(headers[j].field);
+							cell = row->getString(headers[j].field);
 							break;
 
 						case GDAFile::kTypeInt:
-							_rows[i]->_data[j] = Common::UString::format("%d", (int) row->getSint(headers[j].field));
+							cell = Common::UString::format("%d", (int) row->getSint(headers[j].field));
 							break;
 
 						case GDAFile::kTypeFloat:
-							_rows[i]->_data[j] = Common::UString::format("%f", row->getDouble(headers[j].field));
+							cell = Common::UString::format("%f", row->getDouble(headers[j].field));
 							break;
 
 						case GDAFile::kTypeBool:
-							_rows[i]->_data[j] = Common::UString::format("%u", (uint) row->getUint(headers[j].field));
+							cell = Common::UString::format("%u", (uint) row->getUint(headers[j].field));
 							break;
 
 						default:
@@ -410,12 +507,15 @@ void TwoDAFile::load(const GDAFile &gda) {
 					}
 				}
 
-				if (_rows[i]->_data[j].empty())
-					_rows[i]->_data[j] = "****";
+				if (cell.empty())
+					cell = "****";
 
+				addCell(j, cell);
 			}
 		}
 
+		finishLoad(gda.getRowCount());
+
 	} catch (Common::Exception &e) {
 		clear();
 
@@ -448,11 +548,11 @@ size_t TwoDAFile::headerToColumn(const Common::UString &header) const {
 }
 
 const TwoDARow &TwoDAFile::getRow(size_t row) const {
-	if ((row >= _rows.size()) || !_rows[row])
+	if (row >= _rows.size())
 		// No such row
 		return _emptyRow;
 
-	return *_rows[row];
+	return _rows[row];
 }
 
 const TwoDARow &TwoDAFile::getRow(const Common::UString &header, const Common::UString &value) const {
@@ -460,13 +560,51 @@ const TwoDARow &TwoDAFile::getRow(const Common::UString &header, const Common::U
 	if (columnIndex == kFieldIDInvalid)
 		return _emptyRow;
 
-	for (std::vector<TwoDARow *>::const_iterator row = _rows.begin(); row != _rows.end(); ++row) {
-		if ((*row)->getString(columnIndex).equalsIgnoreCase(value))
-			return **row;
+	const uint32 row = getRowIndex(columnIndex).find(getStringHashIgnoreCase(value),
+	                                                 CellEqualsIgnoreCase(_rows, columnIndex, value));
+	if (row == Common::HashIndex::kNone)
+		// No such row
+		return _emptyRow;
+
+	return _rows[row];
+}
+
+const Common::HashIndex &TwoDAFile::getRowIndex(size_t column) const {
+	assert(column < _columns.size());
+
+	Common::HashIndex &index = _columns[column].rowIndex;
+	if (!index.empty() || _rows.empty())
+		return index;
+
+	index.reset(_rows.size());
+
+	/* We only add the first row of each value, to mimic the order of a linear
+	 * search. Note that empty cells are indexed by the default string, since
+	 * that's what TwoDARow::getString() returns for them. */
+
+	for (size_t i = 0; i < _rows.size(); i++) {
+		const Common::UString &cell = _rows[i].getString(column);
+
+		index.insert(getStringHashIgnoreCase(cell), i, CellEqualsIgnoreCase(_rows, column, cell));
 	}
 
-	// No such row
-	return _emptyRow;
+	return index;
+}
+
+template<>
+const std::vector<int32> &TwoDAFile::getColumn<int32>(size_t column) const {
+	if (column >= _columns.size())
+		throw Common::Exception("TwoDAFile: Column %u out of range (%u)", (uint) column, (uint) _columns.size());
+
+	return _columns[column].ints;
+}
+
+template<>
+const std::vector<float> &TwoDAFile::getColumn<float>(size_t column) const {
+	if (column >= _columns.size())
+		throw Common::Exception("TwoDAFile: Column %u out of range (%u)", (uint) column, (uint) _columns.size());
+
+	return _columns[column].floats;
 }
 
 void TwoDAFile::writeASCII(Common::WriteStream &out) const {
@@ -489,9 +627,9 @@ void TwoDAFile::writeASCII(Common::WriteStream &out) const {
 		colLength[i + 1] = _headers[i].size();
 
 	for (size_t i = 0; i < _rows.size(); i++) {
-		for (size_t j = 0; j < _rows[i]->_data.size(); j++) {
-			const bool   needQuote = _rows[i]->_data[j].contains(' ');
-			const size_t length    = needQuote ? _rows[i]->_data[j].size() + 2 : _rows[i]->_data[j].size();
+		for (size_t j = 0; j < _columns.size(); j++) {
+			const bool   needQuote = getCell(i, j).contains(' ');
+			const size_t length    = needQuote ? getCell(i, j).size() + 2 : getCell(i, j).size();
 
 			colLength[j + 1] = MAX<size_t>(colLength[j + 1], length);
 		}
@@ -511,14 +649,14 @@ void TwoDAFile::writeASCII(Common::WriteStream &out) const {
 	for (size_t i = 0; i < _rows.size(); i++) {
 		out.writeString(Common::UString::format("%*u", (int)colLength[0], (uint)i));
 
-		for (size_t j = 0; j < _rows[i]->_data.size(); j++) {
-			const bool needQuote = _rows[i]->_data[j].contains(' ');
+		for (size_t j = 0; j < _columns.size(); j++) {
+			const bool needQuote = getCell(i, j).contains(' ');
 
 			Common::UString cellString;
 			if (needQuote)
-				cellString = Common::UString::format("\"%s\"", _rows[i]->_data[j].c_str());
+				cellString = Common::UString::format("\"%s\"", getCell(i, j).c_str());
 			else
-				cellString = _rows[i]->_data[j];
+				cellString = getCell(i, j);
 
 			out.writeString(Common::UString::format(" %-*s", (int)colLength[j + 1], cellString.c_str()));
 
@@ -591,10 +729,8 @@ void TwoDAFile::writeBinary(Common::WriteStream &out) const {
 	cells.reserve(cellCount);
 
 	for (size_t i = 0; i < rowCount; i++) {
-		assert(_rows[i]);
-
 		for (size_t j = 0; j < columnCount; j++) {
-			const Common::UString cell = _rows[i]->getString(j);
+			const Common::UString cell = _rows[i].getString(j);
 
 			// Do we already know about this cell data string?
 			size_t foundCell = SIZE_MAX;
@@ -670,19 +806,19 @@ void TwoDAFile::writeCSV(Common::WriteStream &out) const {
 	// Write array
 
 	for (size_t i = 0; i < _rows.size(); i++) {
-		for (size_t j = 0; j < _rows[i]->_data.size(); j++) {
-			const bool needQuote = _rows[i]->_data[j].contains(',');
+		for (size_t j = 0; j < _columns.size(); j++) {
+			const bool needQuote = getCell(i, j).contains(',');
 
 			if (needQuote)
 				out.writeByte('"');
 
-			if (_rows[i]->_data[j] != "****")
-				out.writeString(_rows[i]->_data[j]);
+			if (getCell(i, j) != "****")
+				out.writeString(getCell(i, j));
 
 			if (needQuote)
 				out.writeByte('"');
 
-			if (j < (_rows[i]->_data.size() - 1))
+			if (j < (_columns.size() - 1))
 				out.writeByte(',');
 		}
 
@@ -703,30 +839,45 @@ bool TwoDAFile::writeCSV(const Common::UString &fileName) const {
 	return true;
 }
 
+/* The parsers below behave like Common::parseString(), returning 0 when the
+ * string can't be parsed, but without going through an exception. Every
+ * distinct cell string is parsed when loading, and nearly all the cells in
+ * string columns would throw. */
+
 int32 TwoDAFile::parseInt(const Common::UString &str) {
 	if (str.empty())
 		return 0;
 
-	int32 v = 0;
+	const char *nptr   = str.c_str();
+	char       *endptr = 0;
 
-	try {
-		Common::parseString(str, v);
-	} catch (...) {
-	}
+	errno = 0;
+	const long v = strtol(nptr, &endptr, 0);
 
-	return v;
+	while (endptr && isspace(*endptr))
+		endptr++;
+
+	if ((endptr && (*endptr != '\0')) || (errno == ERANGE) || (v < INT_MIN) || (v > INT_MAX))
+		return 0;
+
+	return (int32) v;
 }
 
 float TwoDAFile::parseFloat(const Common::UString &str) {
 	if (str.empty())
 		return 0;
 
-	float v = 0.0f;
+	const char *nptr   = str.c_str();
+	char       *endptr = 0;
 
-	try {
-		Common::parseString(str, v);
-	} catch (...) {
-	}
+	errno = 0;
+	const float v = strtof(nptr, &endptr);
+
+	while (endptr && isspace(*endptr))
+		endptr++;
+
+	if ((endptr && (*endptr != '\0')) || (errno == ERANGE))
+		return 0.0f;
 
 	return v;
 }
@@ -30,6 +30,7 @@
 
 #include "src/common/types.h"
 #include "src/common/ustring.h"
+#include "src/common/hashindex.h"
 
 #include "src/aurora/aurorafile.h"
 
@@ -53,6 +54,9 @@ class GDAFile;
  *  For convenience's sake, there are also methods to directly parse
  *  the cell strings into integer or floating point values.
  *
+ *  A row does not hold any data itself. It is merely a view into
+ *  the columns of its parent 2DA.
+ *
  *  See also class TwoDAFile.
  */
 class TwoDARow {
@@ -79,11 +83,9 @@ public:
 
 private:
 	TwoDAFile *_parent; ///< The parent 2DA.
+	size_t     _row;    ///< The index of this row within the parent 2DA.
 
-	std::vector<Common::UString> _data;
-
-	TwoDARow(TwoDAFile &parent);
-	~TwoDARow();
+	TwoDARow(TwoDAFile &parent, size_t row);
 
 	const Common::UString &getCell(size_t n) const;
 
@@ -113,6 +115,12 @@ private:
  *  be read and modified with a simple text editor. The binary
  *  version cannot.
  *
+ *  Internally, the cells are stored column by column. Each distinct
+ *  cell string is only stored once, and every column is parsed into
+ *  ints and floats once, when the 2DA is loaded. getColumn() gives
+ *  direct access to these parsed columns, for code that needs to
+ *  scan over a whole column.
+ *
  *  See also classes TwoDARow and TwoDARegistry.
  */
 class TwoDAFile : public AuroraFile {
@@ -136,9 +144,30 @@ public:
 	/** Get a row. */
 	const TwoDARow &getRow(size_t row) const;
 
-	/** Get a row whose value in the column named header is the given string value. */
+	/** Get a row whose value in the column named header is the given string value.
+	 *
+	 *  The value is compared case-insensitively. If several rows match, the
+	 *  first one is returned. The first lookup in a column builds a hash
+	 *  index for that column, making subsequent lookups cheap.
+	 */
 	const TwoDARow &getRow(const Common::UString &header, const Common::UString &value) const;
 
+	/** Return the contents of all cells in a column, parsed as int32 or float.
+	 *
+	 *  The returned array has one entry per row. Empty cells hold the default
+	 *  value, just like TwoDARow::getInt() and TwoDARow::getFloat() return.
+	 *
+	 *  Only int32 and float are supported for T.
+	 */
+	template<typename T>
+	const std::vector<T> &getColumn(size_t column) const;
+
+	/** Return the contents of all cells in a column, parsed as int32 or float. */
+	template<typename T>
+	const std::vector<T> &getColumn(const Common::UString &header) const {
+		return getColumn<T>(headerToColumn(header));
+	}
+
 	// .--- 2DA file writers
 	/** Write the 2DA data into an V2.0 ASCII 2DA. */
 	void writeASCII(Common::WriteStream &out) const;
@@ -159,6 +188,16 @@ public:
 private:
 	typedef std::map<Common::UString, size_t, Common::UString::iless> HeaderMap;
 
+	/** A column of cells. */
+	struct Column {
+		std::vector<uint32> cells;  ///< The cells, as indices into the string table.
+		std::vector<int32>  ints;   ///< The cells parsed as ints.
+		std::vector<float>  floats; ///< The cells parsed as floats.
+
+		/** Index of the rows, keyed by the lower-cased cell strings. Built on first use. */
+		mutable Common::HashIndex rowIndex;
+	};
+
 	Common::UString _defaultString; ///< The default string to return should a cell not exist.
 	int32           _defaultInt;    ///< The default int to return should a cell not exist.
 	float           _defaultFloat;  ///< The default float to return should a cell not exist.
@@ -166,8 +205,15 @@ private:
 	std::vector<Common::UString> _headers;
 	HeaderMap _headerMap;
 
+	/** All distinct cell strings. */
+	std::vector<Common::UString> _strings;
+	/** Index of positions within _strings, only used while loading. */
+	Common::HashIndex _stringIndex;
+
+	std::vector<Column> _columns;
+
 	TwoDARow _emptyRow;
-	std::vector<TwoDARow *> _rows;
+	std::vector<TwoDARow> _rows;
 
 	// Loading helpers
 	void load(Common::SeekableReadStream &twoda);
@@ -181,21 +227,41 @@ private:
 	void readRows2a   (Common::SeekableReadStream &twoda, Common::StreamTokenizer &tokenize);
 
 	// Binary loading helpers
-	void readHeaders2b (Common::SeekableReadStream &twoda);
-	void skipRowNames2b(Common::SeekableReadStream &twoda);
-	void readRows2b    (Common::SeekableReadStream &twoda);
+	void   readHeaders2b (Common::SeekableReadStream &twoda);
+	size_t skipRowNames2b(Common::SeekableReadStream &twoda);
+	void   readRows2b    (Common::SeekableReadStream &twoda, size_t rowCount);
 
 	// GDA loading/conversion helpers
 	void load(const GDAFile &gda);
 
 	void createHeaderMap();
 
+	/** Add a cell to the bottom of a column. */
+	void addCell(size_t column, const Common::UString &cell);
+	/** Return the index of this string in the string table, adding it if necessary. */
+	uint32 addString(const Common::UString &str);
+
+	/** Create the rows and parse all cells, once all cells have been added. */
+	void finishLoad(size_t rowCount);
+
+	const Common::UString &getCell(size_t row, size_t column) const;
+
+	/** Return the row index of this column, building it if necessary. */
+	const Common::HashIndex &getRowIndex(size_t column) const;
+
+	static bool isEmptyCell(const Common::UString &cell);
+
 	static int32 parseInt(const Common::UString &str);
 	static float parseFloat(const Common::UString &str);
 
 	friend class TwoDARow;
 };
 
+template<>
+const std::vector<int32> &TwoDAFile::getColumn<int32>(size_t column) const;
+template<>
+const std::vector<float> &TwoDAFile::getColumn<float>(size_t column) const;
+
 } // End of namespace Aurora
 
 #endif // AURORA_2DAFILE_H
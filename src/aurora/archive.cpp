@@ -23,15 +23,55 @@
  */
 
 #include "src/common/system.h"
+#include "src/common/util.h"
+#include "src/common/error.h"
+#include "src/common/memreadstream.h"
 
 #include "src/aurora/archive.h"
 
 namespace Aurora {
 
+/** Hash a resource name (byte-wise, since we're only looking for exact matches) and type. */
+static inline uint32 getIndexHash(const Common::UString &name, FileType type) {
+	uint32 hash = 0x811C9DC5;
+	for (const char *s = name.c_str(); *s; s++)
+		hash = (hash ^ (byte) *s) * 16777619;
+
+	return (hash ^ (uint32) type) * 16777619;
+}
+
+/** Does the resource at this position have the given hash? */
+struct ResourceHashEquals {
+	const Archive::ResourceList &resources;
+	uint64 hash;
+
+	ResourceHashEquals(const Archive::ResourceList &r, uint64 h) : resources(r), hash(h) {
+	}
+
+	bool operator()(uint32 i) const {
+		return resources[i].hash == hash;
+	}
+};
+
+/** Does the resource at this position have the given name and type? */
+struct ResourceNameEquals {
+	const Archive::ResourceList &resources;
+	const Common::UString &name;
+	FileType type;
+
+	ResourceNameEquals(const Archive::ResourceList &r, const Common::UString &n, FileType t) :
+		resources(r), name(n), type(t) {
+	}
+
+	bool operator()(uint32 i) const {
+		return (resources[i].type == type) && (resources[i].name == name);
+	}
+};
+
 Archive::Resource::Resource() : hash(0), type(kFileTypeNone), index(0xFFFFFFFF) {
 }
 
-Archive::Archive() {
+Archive::Archive() : _indexedCount(0), _indexValid(false) {
 }
 
 Archive::~Archive() {
@@ -45,20 +85,91 @@ Common::HashAlgo Archive::getNameHashAlgo() const {
 	return Common::kHashNone;
 }
 
+void Archive::invalidateResourceIndex() {
+	Common::StackLock lock(_indexMutex);
+
+	_indexValid = false;
+}
+
+void Archive::buildResourceIndex() const {
+	const ResourceList &resources = getResources();
+
+	_indexByHash.reset(resources.size());
+	_indexByName.reset(resources.size());
+
+	/* We only add the first resource of each key, to mimic the order of a linear
+	 * search. This also keeps archives without any hashes (where they're all 0)
+	 * from degenerating the hash table into one long probe sequence. */
+
+	for (size_t i = 0; i < resources.size(); i++) {
+		const Resource &res = resources[i];
+
+		_indexByHash.insert(Common::HashIndex::hash(res.hash), i,
+		                    ResourceHashEquals(resources, res.hash));
+		_indexByName.insert(getIndexHash(res.name, res.type), i,
+		                    ResourceNameEquals(resources, res.name, res.type));
+	}
+
+	_indexedCount = resources.size();
+	_indexValid   = true;
+}
+
+void Archive::checkResourceIndex() const {
+	if (!_indexValid || (_indexedCount != getResources().size()))
+		buildResourceIndex();
+}
+
 uint32 Archive::findResource(uint64 hash) const {
-	for (ResourceList::const_iterator r = getResources().begin(); r != getResources().end(); ++r)
-		if (r->hash == hash)
-			return r->index;
+	Common::StackLock lock(_indexMutex);
+	checkResourceIndex();
 
-	return 0xFFFFFFFF;
+	const ResourceList &resources = getResources();
+
+	const uint32 i = _indexByHash.find(Common::HashIndex::hash(hash), ResourceHashEquals(resources, hash));
+	if (i == Common::HashIndex::kNone)
+		return 0xFFFFFFFF;
+
+	return resources[i].index;
 }
 
 uint32 Archive::findResource(const Common::UString &name, FileType type) const {
-	for (ResourceList::const_iterator r = getResources().begin(); r != getResources().end(); ++r)
-		if ((r->type == type) && (r->name == name))
-			return r->index;
+	Common::StackLock lock(_indexMutex);
+	checkResourceIndex();
 
-	return 0xFFFFFFFF;
+	const ResourceList &resources = getResources();
+
+	const uint32 i = _indexByName.find(getIndexHash(name, type), ResourceNameEquals(resources, name, type));
+	if (i == Common::HashIndex::kNone)
+		return 0xFFFFFFFF;
+
+	return resources[i].index;
+}
+
+Common::SeekableReadStream *Archive::getArchiveData(Common::SeekableReadStream &archive,
+                                                    uint32 offset, uint32 size, bool tryNoCopy) const {
+
+	if (tryNoCopy && !dynamic_cast<Common::MemoryReadStream *>(&archive))
+		return new Common::SeekableSubReadStream(&archive, offset, offset + size);
+
+	return getArchiveMemory(archive, offset, size);
+}
+
+Common::MemoryReadStream *Archive::getArchiveMemory(Common::SeekableReadStream &archive,
+                                                    uint32 offset, uint32 size) const {
+
+	Common::MemoryReadStream *memory = dynamic_cast<Common::MemoryReadStream *>(&archive);
+	if (memory) {
+		if (((size_t)offset > memory->size()) || ((size_t)size > (memory->size() - offset)))
+			throw Common::Exception(Common::kReadError);
+
+		return new Common::MemoryReadStream(memory->getData() + offset, size);
+	}
+
+	Common::StackLock lock(_archiveMutex);
+
+	archive.seek(offset);
+
+	return archive.readStream(size);
 }
 
 } // End of namespace Aurora
@@ -25,21 +25,32 @@
 #ifndef AURORA_ARCHIVE_H
 #define AURORA_ARCHIVE_H
 
-#include <list>
+#include <vector>
 
 #include "src/common/types.h"
 #include "src/common/ustring.h"
 #include "src/common/hash.h"
+#include "src/common/hashindex.h"
+#include "src/common/mutex.h"
 
 #include "src/aurora/types.h"
 
 namespace Common {
 	class SeekableReadStream;
+	class MemoryReadStream;
 }
 
 namespace Aurora {
 
-/** An abstract file archive. */
+/** An abstract file archive.
+ *
+ *  Copying resources out of an archive, i.e. getResource() with tryNoCopy
+ *  set to false, may be done from several threads at the same time.
+ *
+ *  To find resources, findResource() uses an index into the resource list,
+ *  which is created on the first call. Archives that change their resource
+ *  list after that need to call invalidateResourceIndex().
+ */
 class Archive {
 public:
 	/** A resource within the archive. */
@@ -52,7 +63,7 @@ public:
 		Resource();
 	};
 
-	typedef std::list<Resource> ResourceList;
+	typedef std::vector<Resource> ResourceList;
 
 	Archive();
 	virtual ~Archive();
@@ -78,6 +89,51 @@ public:
 	uint32 findResource(uint64 hash) const;
 	/** Return the index of the resource matching the name and type, or 0xFFFFFFFF if not found. */
 	uint32 findResource(const Common::UString &name, FileType type) const;
+
+protected:
+	/** Signal that the resource list changed, and the index needs to be rebuilt. */
+	void invalidateResourceIndex();
+
+	/** Return a stream of the size bytes found at offset within the archive stream.
+	 *
+	 *  If the archive stream is a MemoryReadStream (for example a MappedReadFile),
+	 *  this returns a MemoryReadStream view into the archive data, without copying
+	 *  or seeking. The view is only valid as long as the archive stream exists.
+	 *
+	 *  Otherwise, the data is either copied into a new MemoryReadStream, or, when
+	 *  tryNoCopy is true, a SeekableSubReadStream of the archive stream is returned.
+	 *  Since these share the archive stream's position, they are not thread-safe.
+	 */
+	Common::SeekableReadStream *getArchiveData(Common::SeekableReadStream &archive,
+	                                           uint32 offset, uint32 size, bool tryNoCopy) const;
+
+	/** Return a MemoryReadStream of the size bytes found at offset within the archive stream.
+	 *
+	 *  Just like getArchiveData(), this is a view into the archive data if the archive
+	 *  stream is itself a MemoryReadStream, and a copy otherwise.
+	 */
+	Common::MemoryReadStream *getArchiveMemory(Common::SeekableReadStream &archive,
+	                                           uint32 offset, uint32 size) const;
+
+private:
+	/** Serializes copying resources out of archive streams that aren't in memory. */
+	mutable Common::Mutex _archiveMutex;
+
+	/** Index of positions within the resource list, keyed by the hash. */
+	mutable Common::HashIndex _indexByHash;
+	/** Index of positions within the resource list, keyed by name and type. */
+	mutable Common::HashIndex _indexByName;
+
+	/** Number of resources in the list when the index was built. */
+	mutable size_t _indexedCount;
+	/** Is the index up-to-date? */
+	mutable bool _indexValid;
+
+	/** Guards the lazy creation of the index. */
+	mutable Common::Mutex _indexMutex;
+
+	void buildResourceIndex() const;
+	void checkResourceIndex() const;
 };
 
 } // End of namespace Aurora
@@ -127,6 +127,7 @@ void BIFFile::mergeKEY(const KEYFile &key, uint32 bifIndex) {
 		_resources.push_back(res);
 	}
 
+	invalidateResourceIndex();
 }
 
 uint32 BIFFile::getInternalResourceCount() const {
@@ -151,12 +152,7 @@ uint32 BIFFile::getResourceSize(uint32 index) const {
 Common::SeekableReadStream *BIFFile::getResource(uint32 index, bool tryNoCopy) const {
 	const IResource &res = getIResource(index);
 
-	if (tryNoCopy)
-		return new Common::SeekableSubReadStream(_bif, res.offset, res.offset + res.size);
-
-	_bif->seek(res.offset);
-
-	return _bif->readStream(res.size);
+	return getArchiveData(*_bif, res.offset, res.size, tryNoCopy);
 }
 
 } // End of namespace Aurora
@@ -0,0 +1,97 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's BIFs (resource data files).
+ */
+
+#include "src/common/util.h"
+#include "src/common/error.h"
+#include "src/common/writestream.h"
+
+#include "src/aurora/bifwriter.h"
+
+static const uint32 kBIFID     = MKTAG('B', 'I', 'F', 'F');
+static const uint32 kVersion1  = MKTAG('V', '1', ' ', ' ');
+
+static const uint32 kHeaderSize = 20;
+static const uint32 kResSize    = 16;
+
+namespace Aurora {
+
+BIFWriter::BIFWriter(uint32 bifIndex) : _bifIndex(bifIndex), _dataSize(0) {
+	if (_bifIndex > 0xFFF)
+		throw Common::Exception("Invalid BIF index %u", _bifIndex);
+}
+
+size_t BIFWriter::getResourceCount() const {
+	return _resources.size();
+}
+
+uint32 BIFWriter::add(FileType type, uint32 size) {
+	if (type == kFileTypeNone)
+		throw Common::Exception("BIF resource has no valid type");
+
+	if (_resources.size() > 0xFFFFF)
+		throw Common::Exception("Too many resources in BIF");
+
+	_resources.push_back(Resource());
+
+	_resources.back().type = type;
+	_resources.back().size = size;
+
+	_dataSize += size;
+
+	return _resources.size() - 1;
+}
+
+uint32 BIFWriter::getDataOffset() const {
+	const uint64 offset = kHeaderSize + (uint64)_resources.size() * kResSize;
+	if ((offset + _dataSize) > 0xFFFFFFFF)
+		throw Common::Exception("BIF too big: resource data exceeds 4GB");
+
+	return (uint32) offset;
+}
+
+uint32 BIFWriter::getFileSize() const {
+	return getDataOffset() + (uint32) _dataSize;
+}
+
+void BIFWriter::write(Common::WriteStream &stream) const {
+	stream.writeUint32BE(kBIFID);
+	stream.writeUint32BE(kVersion1);
+
+	stream.writeUint32LE(_resources.size()); // Number of variable resources
+	stream.writeUint32LE(0);                 // Number of fixed resources
+	stream.writeUint32LE(kHeaderSize);       // Offset to the variable resource table
+
+	uint32 offset = getDataOffset();
+	uint32 index  = 0;
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r, ++index) {
+		stream.writeUint32LE((_bifIndex << 20) | index); // ID
+		stream.writeUint32LE(offset);
+		stream.writeUint32LE(r->size);
+		stream.writeUint32LE((uint32) r->type);
+
+		offset += r->size;
+	}
+}
+
+} // End of namespace Aurora
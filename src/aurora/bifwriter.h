@@ -0,0 +1,87 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's BIFs (resource data files).
+ */
+
+#ifndef AURORA_BIFWRITER_H
+#define AURORA_BIFWRITER_H
+
+#include <vector>
+
+#include "src/common/types.h"
+
+#include "src/aurora/types.h"
+
+namespace Common {
+	class WriteStream;
+}
+
+namespace Aurora {
+
+/** Class to write V1 BIF files.
+ *
+ *  A BIF file only holds the types and the data of the resources. Their
+ *  names are stored in a KEY file, written by KEYWriter.
+ *
+ *  Just like with ERFWriter, first add() all resources, then write() the
+ *  header and resource table, and afterwards write the data of all
+ *  resources, in the order they were added.
+ *
+ *  See also class BIFFile in biffile.h.
+ */
+class BIFWriter {
+public:
+	/** Create a BIF that's the bifIndex-th BIF file in its KEY. */
+	BIFWriter(uint32 bifIndex = 0);
+
+	/** Return the number of resources added to this BIF. */
+	size_t getResourceCount() const;
+
+	/** Add a resource of this type and size. Return its index within the BIF. */
+	uint32 add(FileType type, uint32 size);
+
+	/** Return the size of the complete BIF file, including all resource data. */
+	uint32 getFileSize() const;
+
+	/** Write the BIF header and resource table. */
+	void write(Common::WriteStream &stream) const;
+
+private:
+	/** A resource within the BIF. */
+	struct Resource {
+		FileType type; ///< The resource's type.
+		uint32 size;   ///< The resource's size.
+	};
+
+	uint32 _bifIndex;
+
+	std::vector<Resource> _resources;
+
+	/** The total size of all resource data. */
+	uint64 _dataSize;
+
+	uint32 getDataOffset() const;
+};
+
+} // End of namespace Aurora
+
+#endif // AURORA_BIFWRITER_H
@@ -37,6 +37,9 @@
 #include "src/common/md5.h"
 #include "src/common/blowfish.h"
 #include "src/common/deflate.h"
+#include "src/common/thread.h"
+#include "src/common/mutex.h"
+#include "src/common/jobqueue.h"
 
 #include "src/aurora/erffile.h"
 #include "src/aurora/util.h"
@@ -51,6 +54,9 @@ static const uint32 kVersion20 = MKTAG('V', '2', '.', '0');
 static const uint32 kVersion22 = MKTAG('V', '2', '.', '2');
 static const uint32 kVersion30 = MKTAG('V', '3', '.', '0');
 
+/** Compressed resources at least this big are decompressed on demand while reading. */
+static const uint32 kStreamingDecompressionSize = 1024 * 1024;
+
 namespace Aurora {
 
 static const size_t kNWNPremiumKeyLength = 56;
@@ -89,6 +95,95 @@ static const byte kNWNPremiumKeys[][kNWNPremiumKeyLength] = {
 	}
 };
 
+static const size_t kNWNPremiumKeyCount = ARRAYSIZE(kNWNPremiumKeys);
+
+/** The size of the encrypted part of an NWN premium module's header. */
+static const size_t kNWNPremiumHeaderSize = 152;
+/** The maximum language count of a sensible ERF header. See ERFHeader::isSensible(). */
+static const uint32 kNWNPremiumMaxLanguageCount = 32;
+
+/** Create the full password of an NWN premium key, with the module MD5 mixed in. */
+static void getNWNPremiumKey(size_t index, const std::vector<byte> &md5, std::vector<byte> &password) {
+	password.resize(kNWNPremiumKeyLength);
+
+	std::memcpy(&password[0], kNWNPremiumKeys[index], kNWNPremiumKeyLength);
+	if (!md5.empty())
+		std::memcpy(&password[0] + kNWNPremiumKeyLength - Common::kMD5Length, &md5[0], Common::kMD5Length);
+}
+
+/** The precomputed Blowfish key schedules of all NWN premium keys, for one module MD5. */
+struct NWNPremiumKeySchedules {
+	std::vector<byte> md5;
+	Common::BlowfishKey *keys[kNWNPremiumKeyCount];
+
+	NWNPremiumKeySchedules() {
+		std::memset(keys, 0, sizeof(keys));
+	}
+
+	~NWNPremiumKeySchedules() {
+		clear();
+	}
+
+	void clear() {
+		for (size_t i = 0; i < kNWNPremiumKeyCount; i++) {
+			delete keys[i];
+			keys[i] = 0;
+		}
+	}
+
+	bool empty() const {
+		return keys[0] == 0;
+	}
+};
+
+/** Set up the key schedules of all NWN premium keys in parallel. */
+class NWNPremiumKeyJobs : public Common::JobQueue {
+public:
+	NWNPremiumKeyJobs(NWNPremiumKeySchedules &schedules) : _schedules(&schedules) {
+	}
+
+protected:
+	void runJob(size_t job) {
+		std::vector<byte> password;
+		getNWNPremiumKey(job, _schedules->md5, password);
+
+		_schedules->keys[job] = new Common::BlowfishKey(password);
+	}
+
+private:
+	NWNPremiumKeySchedules *_schedules;
+};
+
+/** Key schedules for premium modules without an MD5, and for the last seen MD5.
+ *
+ *  Batch-processing premium modules tries the same keys again and again. The
+ *  modules belonging to one .nwm (and its HAKs) share the same MD5 as well.
+ */
+static NWNPremiumKeySchedules nwnPremiumKeysPlain, nwnPremiumKeysMD5;
+static Common::Mutex nwnPremiumKeyMutex;
+
+/** Return the key schedules for this MD5, setting them up if necessary.
+ *  nwnPremiumKeyMutex needs to be locked. */
+static const NWNPremiumKeySchedules &getNWNPremiumKeySchedules(const std::vector<byte> &md5) {
+	NWNPremiumKeySchedules &schedules = md5.empty() ? nwnPremiumKeysPlain : nwnPremiumKeysMD5;
+	if (!schedules.empty() && (schedules.md5 == md5))
+		return schedules;
+
+	schedules.clear();
+	schedules.md5 = md5;
+
+	try {
+		NWNPremiumKeyJobs jobs(schedules);
+
+		jobs.run(kNWNPremiumKeyCount, Common::Thread::getCPUCount());
+	} catch (...) {
+		schedules.clear();
+		throw;
+	}
+
+	return schedules;
+}
+
 
 ERFFile::ERFHeader::ERFHeader() : stringTable(0) {
 	clear();
@@ -236,23 +331,24 @@ void ERFFile::verifyPasswordDigest() {
 	throw Common::Exception("Invalid encryption type %u", (uint)_header.encryption);
 }
 
-bool ERFFile::decryptNWNPremiumHeader(Common::SeekableReadStream &erf, ERFHeader &header,
-                                      const std::vector<byte> &password) {
+bool ERFFile::decryptNWNPremiumHeader(const byte *encryptedHeader, size_t fileSize, ERFHeader &header,
+                                      const Common::BlowfishKey &key) {
 
-	Common::SeekableReadStream *decryptERF = decrypt(erf, erf.pos(), 152, kEncryptionBlowfishNWN, password);
+	byte decryptedHeader[kNWNPremiumHeaderSize];
 
-	try {
-
-		readV11Header(*decryptERF, header);
+	/* Decrypt only the first block and look at the language count, before
+	 * decrypting and parsing the whole header. With a wrong key, this is
+	 * garbage and nearly always way too big. */
+	key.decrypt(encryptedHeader, decryptedHeader, 8);
+	if (READ_LE_UINT32(decryptedHeader) > kNWNPremiumMaxLanguageCount)
+		return false;
 
-	} catch (...) {
-		delete decryptERF;
-		throw;
-	}
+	key.decrypt(encryptedHeader, decryptedHeader, kNWNPremiumHeaderSize);
 
-	delete decryptERF;
+	Common::MemoryReadStream decryptERF(decryptedHeader, kNWNPremiumHeaderSize);
+	readV11Header(decryptERF, header);
 
-	return header.isSensible(erf.size());
+	return header.isSensible(fileSize);
 }
 
 bool ERFFile::findNWNPremiumKey(Common::SeekableReadStream &erf, ERFHeader &header,
@@ -260,17 +356,22 @@ bool ERFFile::findNWNPremiumKey(Common::SeekableReadStream &erf, ERFHeader &head
 
 	assert(md5.empty() || (md5.size() == Common::kMD5Length));
 
-	password.resize(kNWNPremiumKeyLength);
-	const size_t headerPos = erf.pos();
+	byte encryptedHeader[kNWNPremiumHeaderSize];
+	if (erf.read(encryptedHeader, kNWNPremiumHeaderSize) != kNWNPremiumHeaderSize)
+		throw Common::Exception(Common::kReadError);
+
+	const size_t fileSize = erf.size();
+
+	Common::StackLock lock(nwnPremiumKeyMutex);
 
-	for (size_t i = 0; i < ARRAYSIZE(kNWNPremiumKeys); i++) {
-		std::memcpy(&password[0], kNWNPremiumKeys[i], kNWNPremiumKeyLength);
-		if (!md5.empty())
-			std::memcpy(&password[0] + kNWNPremiumKeyLength - Common::kMD5Length, &md5[0], Common::kMD5Length);
+	const NWNPremiumKeySchedules &keys = getNWNPremiumKeySchedules(md5);
 
-		erf.seek(headerPos);
-		if (decryptNWNPremiumHeader(erf, header, password))
-			return true;
+	for (size_t i = 0; i < kNWNPremiumKeyCount; i++) {
+		if (!decryptNWNPremiumHeader(encryptedHeader, fileSize, header, *keys.keys[i]))
+			continue;
+
+		getNWNPremiumKey(i, md5, password);
+		return true;
 	}
 
 	return false;
@@ -326,7 +427,10 @@ void ERFFile::decryptNWNPremium() {
 
 	_erf->seek(0);
 
-	Common::SeekableReadStream *decryptERF = decrypt(*_erf, kEncryptionBlowfishNWN, _password);
+	/* The whole file is decrypted in one go, so spread it over all CPUs.
+	 * Blowfish in ECB mode decrypts every block independently. */
+	Common::SeekableReadStream *decryptERF =
+		decrypt(*_erf, kEncryptionBlowfishNWN, _password, Common::Thread::getCPUCount());
 
 	delete _erf;
 	_erf = decryptERF;
@@ -688,13 +792,12 @@ uint32 ERFFile::getResourceSize(uint32 index) const {
 Common::SeekableReadStream *ERFFile::getResource(uint32 index, bool tryNoCopy) const {
 	const IResource &res = getIResource(index);
 
-	if (tryNoCopy && (_header.encryption == kEncryptionNone) && (_header.compression == kCompressionNone))
-		return new Common::SeekableSubReadStream(_erf, res.offset, res.offset + res.packedSize);
-
-	_erf->seek(res.offset);
+	if ((_header.encryption == kEncryptionNone) && (_header.compression == kCompressionNone) &&
+	    (res.packedSize == res.unpackedSize))
+		return getArchiveData(*_erf, res.offset, res.packedSize, tryNoCopy);
 
-	// Read
-	Common::MemoryReadStream *stream = _erf->readStream(res.packedSize);
+	// Read (or create a view into the ERF, if it's already in memory)
+	Common::MemoryReadStream *stream = getArchiveMemory(*_erf, res.offset, res.packedSize);
 
 	// Decrypt
 	if (_header.encryption != kEncryptionNone)
@@ -705,12 +808,13 @@ Common::SeekableReadStream *ERFFile::getResource(uint32 index, bool tryNoCopy) c
 }
 
 Common::MemoryReadStream *ERFFile::decrypt(Common::SeekableReadStream &cryptStream,
-                                           Encryption encryption, const std::vector<byte> &password) {
+                                           Encryption encryption, const std::vector<byte> &password,
+                                           size_t threadCount) {
 	switch (encryption) {
 		case kEncryptionBlowfishDAO:
 		case kEncryptionBlowfishDA2:
 		case kEncryptionBlowfishNWN:
-			return Common::decryptBlowfishEBC(cryptStream, password);
+			return Common::decryptBlowfishEBC(cryptStream, password, threadCount);
 
 		default:
 			throw Common::Exception("Invalid ERF encryption %u", (uint) encryption);
@@ -735,18 +839,6 @@ Common::MemoryReadStream *ERFFile::decrypt(Common::SeekableReadStream *cryptStre
 	return decryptStream;
 }
 
-Common::SeekableReadStream *ERFFile::decrypt(Common::SeekableReadStream &erf, size_t pos, size_t size,
-                                             Encryption encryption, const std::vector<byte> &password) {
-
-	return decrypt(new Common::SeekableSubReadStream(&erf, pos, pos + size), encryption, password);
-}
-
-Common::SeekableReadStream *ERFFile::decrypt(Common::SeekableReadStream &erf, size_t size,
-                                             Encryption encryption, const std::vector<byte> &password) {
-
-	return decrypt(erf, erf.pos(), size, encryption, password);
-}
-
 Common::SeekableReadStream *ERFFile::decompress(Common::MemoryReadStream *packedStream,
                                                 uint32 unpackedSize) const {
 	switch (_header.compression) {
@@ -773,19 +865,14 @@ Common::SeekableReadStream *ERFFile::decompressBiowareZlib(Common::MemoryReadStr
 
 	/* Decompress using raw inflate. An extra one byte header specifies the window size. */
 
-	const byte * const compressedData = packedStream->getData();
-	const uint32 packedSize = packedStream->size();
-
-	Common::SeekableReadStream *stream = 0;
-	try {
-		stream = decompressZlib(compressedData + 1, packedSize - 1, unpackedSize, *compressedData >> 4);
-	} catch (...) {
+	if (packedStream->size() < 1) {
 		delete packedStream;
-		throw;
+		throw Common::Exception(Common::kReadError);
 	}
 
-	delete packedStream;
-	return stream;
+	const int windowBits = *packedStream->getData() >> 4;
+
+	return decompressZlib(packedStream, 1, unpackedSize, windowBits);
 }
 
 Common::SeekableReadStream *ERFFile::decompressHeaderlessZlib(Common::MemoryReadStream *packedStream,
@@ -793,27 +880,36 @@ Common::SeekableReadStream *ERFFile::decompressHeaderlessZlib(Common::MemoryRead
 
 	/* Decompress using raw inflate. Use the default maximum window size (15). */
 
-	const byte * const compressedData = packedStream->getData();
-	const uint32 packedSize = packedStream->size();
+	return decompressZlib(packedStream, 0, unpackedSize, Common::kWindowBitsMax);
+}
+
+Common::SeekableReadStream *ERFFile::decompressZlib(Common::MemoryReadStream *packedStream, size_t offset,
+                                                    uint32 unpackedSize, int windowBits) const {
+
+	/* Big resources are inflated on demand, while they're read, so that we never need to
+	 * hold the whole decompressed data in memory. Small resources are decompressed in one
+	 * go, because that's faster and gives users a stream they can cheaply seek around in.
+	 *
+	 * In both cases, use a negative window size to signal not to look for a gzip header. */
 
-	Common::SeekableReadStream *stream = 0;
+	const byte * const compressedData = packedStream->getData() + offset;
+	const size_t packedSize = packedStream->size() - offset;
+
+	if (unpackedSize >= kStreamingDecompressionSize) {
+		packedStream->seek(offset);
+
+		return new Common::InflateReadStream(packedStream, packedSize, unpackedSize, -windowBits, true);
+	}
+
+	const byte *data = 0;
 	try {
-		stream = decompressZlib(compressedData, packedSize, unpackedSize, Common::kWindowBitsMax);
+		data = Common::decompressDeflate(compressedData, packedSize, unpackedSize, -windowBits);
 	} catch (...) {
 		delete packedStream;
 		throw;
 	}
 
 	delete packedStream;
-	return stream;
-}
-
-Common::SeekableReadStream *ERFFile::decompressZlib(const byte *compressedData, uint32 packedSize,
-                                                    uint32 unpackedSize, int windowBits) const {
-
-	// Decompress. Negative window size to signal not to look for a gzip header.
-	const byte *data = Common::decompressDeflate(compressedData, packedSize, unpackedSize, -windowBits);
-
 	return new Common::MemoryReadStream(data, unpackedSize, true);
 }
 
@@ -37,6 +37,7 @@
 
 namespace Common {
 	class SeekableReadStream;
+	class BlowfishKey;
 }
 
 namespace Aurora {
@@ -98,6 +99,12 @@ namespace Aurora {
  */
 class ERFFile : public Archive, public AuroraFile {
 public:
+	enum Compression {
+		kCompressionNone           = 0, ///< No compression as all.
+		kCompressionBioWareZlib    = 1, ///< Compression using DEFLATE with an extra header byte.
+		kCompressionHeaderlessZlib = 7  ///< Compression using DEFLATE with default parameters.
+	};
+
 	/** Take over this stream and read an ERF file out of it.
 	 *
 	 *  When the ERF is encrypted, use this password to decrypt it.
@@ -146,12 +153,6 @@ private:
 		kEncryptionBlowfishNWN = 16  ///< Blowfish encryption as used by Neverwinter Nights (V1.1).
 	};
 
-	enum Compression {
-		kCompressionNone           = 0, ///< No compression as all.
-		kCompressionBioWareZlib    = 1, ///< Compression using DEFLATE with an extra header byte.
-		kCompressionHeaderlessZlib = 7  ///< Compression using DEFLATE with default parameters.
-	};
-
 	/** The header of an ERF file. */
 	struct ERFHeader {
 		uint32 resCount;         ///< Number of resources in this ERF.
@@ -258,17 +259,13 @@ private:
 	void verifyPasswordDigest();
 
 	static Common::MemoryReadStream *decrypt(Common::SeekableReadStream &cryptStream,
-	                                         Encryption encryption, const std::vector<byte> &password);
+	                                         Encryption encryption, const std::vector<byte> &password,
+	                                         size_t threadCount = 1);
 	static Common::MemoryReadStream *decrypt(Common::SeekableReadStream *cryptStream,
 	                                         Encryption encryption, const std::vector<byte> &password);
 
-	static Common::SeekableReadStream *decrypt(Common::SeekableReadStream &erf, size_t pos, size_t size,
-	                                           Encryption encryption, const std::vector<byte> &password);
-	static Common::SeekableReadStream *decrypt(Common::SeekableReadStream &erf, size_t size,
-	                                           Encryption encryption, const std::vector<byte> &password);
-
-	static bool decryptNWNPremiumHeader(Common::SeekableReadStream &erf, ERFHeader &header,
-	                                    const std::vector<byte> &password);
+	static bool decryptNWNPremiumHeader(const byte *encryptedHeader, size_t fileSize, ERFHeader &header,
+	                                    const Common::BlowfishKey &key);
 	static bool findNWNPremiumKey      (Common::SeekableReadStream &erf, ERFHeader &header,
 	                                    const std::vector<byte> &md5, std::vector<byte> &password);
 	static void readNWNPremiumHeader   (Common::SeekableReadStream &erf, ERFHeader &header,
@@ -286,7 +283,7 @@ private:
 	Common::SeekableReadStream *decompressHeaderlessZlib(Common::MemoryReadStream *packedStream,
 	                                                     uint32 unpackedSize) const;
 
-	Common::SeekableReadStream *decompressZlib(const byte *compressedData, uint32 packedSize,
+	Common::SeekableReadStream *decompressZlib(Common::MemoryReadStream *packedStream, size_t offset,
 	                                           uint32 unpackedSize, int windowBits) const;
 	// '---
 
@@ -0,0 +1,300 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's ERFs (encapsulated resource file).
+ */
+
+#include <cstring>
+#include <ctime>
+
+#include "src/common/util.h"
+#include "src/common/strutil.h"
+#include "src/common/error.h"
+#include "src/common/filepath.h"
+#include "src/common/writestream.h"
+#include "src/common/encoding.h"
+#include "src/common/hash.h"
+#include "src/common/md5.h"
+#include "src/common/deflate.h"
+
+#include "src/aurora/erfwriter.h"
+#include "src/aurora/util.h"
+
+static const uint32 kERFID        = MKTAG('E', 'R', 'F', ' ');
+static const uint32 kMODID        = MKTAG('M', 'O', 'D', ' ');
+static const uint32 kHAKID        = MKTAG('H', 'A', 'K', ' ');
+static const uint32 kSAVID        = MKTAG('S', 'A', 'V', ' ');
+static const uint32 kVersion10Tag = MKTAG('V', '1', '.', '0');
+
+static const uint32 kHeaderSizeV10 = 0x000000A0;
+static const uint32 kHeaderSizeV22 = 0x00000038;
+static const uint32 kHeaderSizeV30 = 0x00000030;
+
+static const uint32 kKeySizeV10 = 24;
+static const uint32 kResSizeV10 =  8;
+static const uint32 kResSizeV22 = 76;
+static const uint32 kResSizeV30 = 28;
+
+namespace Aurora {
+
+ERFWriter::ERFWriter(Version version, uint32 id, ERFFile::Compression compression) :
+	_version(version), _id(id), _compression(compression), _dataSize(0) {
+
+	if ((_id != kERFID) && (_id != kMODID) && (_id != kHAKID) && (_id != kSAVID))
+		throw Common::Exception("Invalid ERF ID %s", Common::debugTag(_id).c_str());
+
+	if ((_compression != ERFFile::kCompressionNone) &&
+	    (_compression != ERFFile::kCompressionBioWareZlib) &&
+	    (_compression != ERFFile::kCompressionHeaderlessZlib))
+		throw Common::Exception("Invalid ERF compression %u", (uint) _compression);
+
+	if ((_version == kVersion10) && (_compression != ERFFile::kCompressionNone))
+		throw Common::Exception("ERF V1.0 doesn't support compression");
+}
+
+size_t ERFWriter::getResourceCount() const {
+	return _resources.size();
+}
+
+void ERFWriter::add(const Common::UString &name, FileType type, uint32 packedSize, uint32 unpackedSize) {
+	if (type == kFileTypeNone)
+		throw Common::Exception("Resource \"%s\" has no valid type", name.c_str());
+
+	if        (_version == kVersion10) {
+		if (name.size() > 16)
+			throw Common::Exception("Resource name \"%s\" too long for ERF V1.0", name.c_str());
+	} else if (_version == kVersion22) {
+		if (TypeMan.setFileType(name, type).size() > 32)
+			throw Common::Exception("Resource name \"%s\" too long for ERF V2.2", name.c_str());
+	}
+
+	_resources.push_back(Resource());
+
+	_resources.back().name         = name;
+	_resources.back().type         = type;
+	_resources.back().packedSize   = packedSize;
+	_resources.back().unpackedSize = unpackedSize;
+
+	_dataSize += packedSize;
+}
+
+uint32 ERFWriter::getDataOffset(uint32 &stringTableSize) const {
+	const uint64 resCount = _resources.size();
+
+	stringTableSize = 0;
+
+	uint64 offset = 0;
+	switch (_version) {
+		case kVersion10:
+			offset = kHeaderSizeV10 + resCount * (kKeySizeV10 + kResSizeV10);
+			break;
+
+		case kVersion22:
+			offset = kHeaderSizeV22 + resCount * kResSizeV22;
+			break;
+
+		case kVersion30:
+			for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r)
+				stringTableSize += std::strlen(TypeMan.setFileType(r->name, r->type).c_str()) + 1;
+
+			offset = kHeaderSizeV30 + stringTableSize + resCount * kResSizeV30;
+			break;
+	}
+
+	if ((offset + _dataSize) > 0xFFFFFFFF)
+		throw Common::Exception("ERF too big: resource data exceeds 4GB");
+
+	return (uint32) offset;
+}
+
+void ERFWriter::write(Common::WriteStream &stream) const {
+	uint32 stringTableSize;
+	const uint32 offset = getDataOffset(stringTableSize);
+
+	switch (_version) {
+		case kVersion10:
+			writeV10(stream, offset);
+			break;
+
+		case kVersion22:
+			writeV22(stream, offset);
+			break;
+
+		case kVersion30:
+			writeV30(stream, offset, stringTableSize);
+			break;
+	}
+}
+
+void ERFWriter::writeV10(Common::WriteStream &stream, uint32 offset) const {
+	const uint32 resCount   = _resources.size();
+	const uint32 offKeyList = kHeaderSizeV10;
+	const uint32 offResList = kHeaderSizeV10 + resCount * kKeySizeV10;
+
+	uint32 buildYear, buildDay;
+	getBuildDate(buildYear, buildDay);
+
+	stream.writeUint32BE(_id);
+	stream.writeUint32BE(kVersion10Tag);
+
+	stream.writeUint32LE(0);          // Number of languages for the description
+	stream.writeUint32LE(0);          // Number of bytes in the description
+	stream.writeUint32LE(resCount);   // Number of resources in the ERF
+
+	stream.writeUint32LE(offKeyList); // Offset to the (empty) description
+	stream.writeUint32LE(offKeyList);
+	stream.writeUint32LE(offResList);
+
+	stream.writeUint32LE(buildYear - 1900);
+	stream.writeUint32LE(buildDay);
+
+	stream.writeUint32LE(0xFFFFFFFF); // Description StrRef
+
+	for (size_t i = 0; i < 116; i++)
+		stream.writeByte(0);            // Reserved
+
+	uint32 index = 0;
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r, ++index) {
+		Common::writeStringFixed(stream, r->name, Common::kEncodingASCII, 16);
+		stream.writeUint32LE(index);    // Resource ID
+		stream.writeUint16LE((uint16) r->type);
+		stream.writeUint16LE(0);        // Reserved
+	}
+
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r) {
+		stream.writeUint32LE(offset);
+		stream.writeUint32LE(r->packedSize);
+
+		offset += r->packedSize;
+	}
+}
+
+void ERFWriter::writeV22(Common::WriteStream &stream, uint32 offset) const {
+	uint32 buildYear, buildDay;
+	getBuildDate(buildYear, buildDay);
+
+	Common::writeStringFixed(stream, "ERF V2.2", Common::kEncodingUTF16LE, 16);
+
+	stream.writeUint32LE(_resources.size());
+
+	stream.writeUint32LE(buildYear - 1900);
+	stream.writeUint32LE(buildDay);
+
+	stream.writeUint32LE(0xFFFFFFFF);             // Unknown, always 0xFFFFFFFF?
+	stream.writeUint32LE(_compression << 29);     // Flags: compression, no encryption
+	stream.writeUint32LE(0);                      // Module ID
+
+	for (size_t i = 0; i < Common::kMD5Length; i++)
+		stream.writeByte(0);                        // Password digest
+
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r) {
+		Common::writeStringFixed(stream, TypeMan.setFileType(r->name, r->type),
+		                         Common::kEncodingUTF16LE, 64);
+
+		stream.writeUint32LE(offset);
+		stream.writeUint32LE(r->packedSize);
+		stream.writeUint32LE(r->unpackedSize);
+
+		offset += r->packedSize;
+	}
+}
+
+void ERFWriter::writeV30(Common::WriteStream &stream, uint32 offset, uint32 stringTableSize) const {
+	Common::writeStringFixed(stream, "ERF V3.0", Common::kEncodingUTF16LE, 16);
+
+	stream.writeUint32LE(stringTableSize);
+	stream.writeUint32LE(_resources.size());
+
+	stream.writeUint32LE(_compression << 29);     // Flags: compression, no encryption
+	stream.writeUint32LE(0);                      // Module ID
+
+	for (size_t i = 0; i < Common::kMD5Length; i++)
+		stream.writeByte(0);                        // Password digest
+
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r)
+		Common::writeString(stream, TypeMan.setFileType(r->name, r->type), Common::kEncodingASCII, true);
+
+	uint32 nameOffset = 0;
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r) {
+		const Common::UString fileName  = TypeMan.setFileType(r->name, r->type);
+		const Common::UString extension = Common::FilePath::getExtension(fileName);
+
+		// The extension is hashed without the leading dot, like in FileTypeManager
+		const char *ext = extension.c_str();
+		if (ext[0] == '.')
+			ext++;
+
+		stream.writeSint32LE(nameOffset);
+		stream.writeUint64LE(Common::hashString(fileName.toLower(), Common::kHashFNV64));
+		stream.writeUint32LE(Common::hashString(ext, Common::kHashFNV32));
+
+		stream.writeUint32LE(offset);
+		stream.writeUint32LE(r->packedSize);
+		stream.writeUint32LE(r->unpackedSize);
+
+		nameOffset += std::strlen(fileName.c_str()) + 1;
+		offset     += r->packedSize;
+	}
+}
+
+void ERFWriter::getBuildDate(uint32 &year, uint32 &day) {
+	const std::time_t now = std::time(0);
+	const std::tm *date = std::gmtime(&now);
+
+	year = date ? (date->tm_year + 1900) : 1900;
+	day  = date ?  date->tm_yday         :    0;
+}
+
+byte *ERFWriter::compress(ERFFile::Compression compression, const byte *data, size_t size,
+                          size_t &packedSize) {
+
+	/* Both compression algorithms use raw deflate, i.e. a negative window size,
+	 * with the maximum window size. BioWare's variant additionally stores the
+	 * window size in an extra header byte in front of the compressed data. */
+
+	if (compression == ERFFile::kCompressionNone) {
+		byte *packedData = new byte[size];
+		std::memcpy(packedData, data, size);
+
+		packedSize = size;
+		return packedData;
+	}
+
+	if ((compression != ERFFile::kCompressionBioWareZlib) &&
+	    (compression != ERFFile::kCompressionHeaderlessZlib))
+		throw Common::Exception("Invalid ERF compression %u", (uint) compression);
+
+	byte *compressedData = Common::compressDeflate(data, size, packedSize, Common::kWindowBitsMaxRaw);
+	if (compression == ERFFile::kCompressionHeaderlessZlib)
+		return compressedData;
+
+	byte *packedData = new byte[packedSize + 1];
+
+	packedData[0] = Common::kWindowBitsMax << 4;
+	std::memcpy(packedData + 1, compressedData, packedSize);
+
+	delete[] compressedData;
+
+	packedSize += 1;
+	return packedData;
+}
+
+} // End of namespace Aurora
@@ -0,0 +1,142 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's ERFs (encapsulated resource file).
+ */
+
+#ifndef AURORA_ERFWRITER_H
+#define AURORA_ERFWRITER_H
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/endianness.h"
+#include "src/common/ustring.h"
+
+#include "src/aurora/types.h"
+#include "src/aurora/erffile.h"
+
+namespace Common {
+	class WriteStream;
+}
+
+namespace Aurora {
+
+/** Class to write ERF archive files.
+ *
+ *  The header and the resource tables of an ERF come before the resource
+ *  data, and they contain the sizes and offsets of all resources. So all
+ *  resources have to be known, together with their final (compressed) sizes,
+ *  before anything can be written.
+ *
+ *  Therefore, first add() all resources, then write() the header and tables.
+ *  Afterwards, the caller has to write the data of all resources, exactly
+ *  as given to add(), in the order they were added.
+ *
+ *  Supported versions:
+ *  - 1.0, uncompressed only, with 16 ASCII characters per resource name
+ *  - 2.2, with 32 UTF-16 characters per resource name (including extension)
+ *  - 3.0, with a string table of resource names and their FNV hashes
+ *
+ *  Encryption and localized descriptions are not supported.
+ *
+ *  See also class ERFFile in erffile.h.
+ */
+class ERFWriter {
+public:
+	enum Version {
+		kVersion10,
+		kVersion22,
+		kVersion30
+	};
+
+	/** Create an ERF of this version.
+	 *
+	 *  @param version     The version of the ERF to write.
+	 *  @param id          The ID of the ERF file. Only has an effect on V1.0 ERFs,
+	 *                     and has to be one of 'ERF ', 'MOD ', 'HAK ' or 'SAV '.
+	 *  @param compression The compression to use for the resource data.
+	 *                     V1.0 ERFs can't be compressed.
+	 */
+	ERFWriter(Version version, uint32 id = MKTAG('E', 'R', 'F', ' '),
+	          ERFFile::Compression compression = ERFFile::kCompressionNone);
+
+	/** Return the number of resources added to this ERF. */
+	size_t getResourceCount() const;
+
+	/** Add a resource.
+	 *
+	 *  @param name         The name of the resource, without extension.
+	 *  @param type         The type of the resource.
+	 *  @param packedSize   The size of the resource's data within the ERF.
+	 *  @param unpackedSize The size of the resource's uncompressed data.
+	 */
+	void add(const Common::UString &name, FileType type, uint32 packedSize, uint32 unpackedSize);
+
+	/** Write the ERF header and resource tables. */
+	void write(Common::WriteStream &stream) const;
+
+	/** Compress resource data, ready to be written into an ERF.
+	 *
+	 *  This is completely independent of any other resource data and can
+	 *  safely be called for several resources in parallel.
+	 *
+	 *  @param  compression The compression algorithm to use.
+	 *  @param  data        The data to compress.
+	 *  @param  size        The size of the data in bytes.
+	 *  @param  packedSize  The size of the compressed data in bytes.
+	 *  @return The compressed data, in a new[]'ed buffer.
+	 */
+	static byte *compress(ERFFile::Compression compression, const byte *data, size_t size,
+	                      size_t &packedSize);
+
+private:
+	/** A resource within the ERF. */
+	struct Resource {
+		Common::UString name; ///< The resource's name, without extension.
+		FileType type;        ///< The resource's type.
+
+		uint32 packedSize;    ///< The resource's size within the ERF.
+		uint32 unpackedSize;  ///< The resource's uncompressed size.
+	};
+
+	Version _version;
+	uint32  _id;
+
+	ERFFile::Compression _compression;
+
+	std::vector<Resource> _resources;
+
+	/** The total size of all resource data. */
+	uint64 _dataSize;
+
+	uint32 getDataOffset(uint32 &stringTableSize) const;
+
+	void writeV10(Common::WriteStream &stream, uint32 offset) const;
+	void writeV22(Common::WriteStream &stream, uint32 offset) const;
+	void writeV30(Common::WriteStream &stream, uint32 offset, uint32 stringTableSize) const;
+
+	static void getBuildDate(uint32 &year, uint32 &day);
+};
+
+} // End of namespace Aurora
+
+#endif // AURORA_ERFWRITER_H
@@ -39,6 +39,19 @@ static const uint32 kG2DAID = MKTAG('G', '2', 'D', 'A');
 
 namespace Aurora {
 
+/** Does the cell at this position have the given uint value? */
+struct UintEquals {
+	const std::vector<uint64> &uints;
+	uint64 value;
+
+	UintEquals(const std::vector<uint64> &u, uint64 v) : uints(u), value(v) {
+	}
+
+	bool operator()(uint32 i) const {
+		return uints[i] == value;
+	}
+};
+
 GDAFile::GDAFile(Common::SeekableReadStream *gda) : _columns(0), _rowCount(0) {
 	load(gda);
 }
@@ -90,22 +103,13 @@ size_t GDAFile::findRow(uint32 id) const {
 	if (idColumn == kInvalidColumn)
 		return kInvalidRow;
 
-	// Go through all rows of all GFF4s, and look for the ID
-
-	size_t gff4 = 0;
-	for (size_t i = 0, j = 0; i < _rowCount; i++, j++) {
-		if (j >= _rows[gff4]->size()) {
-			if (++gff4 >= _rows.size())
-				break;
+	const ColumnCache &cache = getRowIndex(idColumn);
 
-			j = 0;
-		}
-
-		if ((*_rows[gff4])[j] && ((*_rows[gff4])[j]->getUint(idColumn) == id))
-			return i;
-	}
+	const uint32 row = cache.rowIndex.find(Common::HashIndex::hash(id), UintEquals(cache.uints, id));
+	if (row == Common::HashIndex::kNone)
+		return kInvalidRow;
 
-	return kInvalidRow;
+	return row;
 }
 
 size_t GDAFile::findColumn(const Common::UString &name) const {
@@ -113,7 +117,7 @@ size_t GDAFile::findColumn(const Common::UString &name) const {
 	if (c != _columnNameMap.end())
 		return c->second;
 
-	size_t column = findColumn(Common::hashStringCRC32(name.toLower(), Common::kEncodingUTF16LE));
+	size_t column = findColumn(getColumnHash(name));
 	_columnNameMap[name] = column;
 
 	return column;
@@ -175,39 +179,160 @@ Common::UString GDAFile::getString(size_t row, const Common::UString &columnName
 }
 
 int32 GDAFile::getInt(size_t row, uint32 columnHash, int32 def) const {
-	size_t gdaColumn;
-	const GFF4Struct *gdaRow = getRowColumn(row, columnHash, gdaColumn);
-	if (!gdaRow)
-		return def;
-
-	return gdaRow->getSint(gdaColumn, def);
+	return getCellInt(row, findColumn(columnHash), def);
 }
 
 int32 GDAFile::getInt(size_t row, const Common::UString &columnName, int32 def) const {
-	size_t gdaColumn;
-	const GFF4Struct *gdaRow = getRowColumn(row, columnName, gdaColumn);
-	if (!gdaRow)
-		return def;
-
-	return gdaRow->getSint(gdaColumn, def);
+	return getCellInt(row, findColumn(columnName), def);
 }
 
 float GDAFile::getFloat(size_t row, uint32 columnHash, float def) const {
-	size_t gdaColumn;
-	const GFF4Struct *gdaRow = getRowColumn(row, columnHash, gdaColumn);
-	if (!gdaRow)
+	return getCellFloat(row, findColumn(columnHash), def);
+}
+
+float GDAFile::getFloat(size_t row, const Common::UString &columnName, float def) const {
+	return getCellFloat(row, findColumn(columnName), def);
+}
+
+int32 GDAFile::getCellInt(size_t row, size_t column, int32 def) const {
+	if ((row >= _rowCount) || (column == kInvalidColumn))
+		return def;
+
+	const ColumnCache &cache = getColumnCache(column, false);
+	if (!cache.hasValue[row])
 		return def;
 
-	return gdaRow->getDouble(gdaColumn, def);
+	return cache.ints[row];
 }
 
-float GDAFile::getFloat(size_t row, const Common::UString &columnName, float def) const {
-	size_t gdaColumn;
-	const GFF4Struct *gdaRow = getRowColumn(row, columnName, gdaColumn);
-	if (!gdaRow)
+float GDAFile::getCellFloat(size_t row, size_t column, float def) const {
+	if ((row >= _rowCount) || (column == kInvalidColumn))
 		return def;
 
-	return gdaRow->getDouble(gdaColumn, def);
+	const ColumnCache &cache = getColumnCache(column, true);
+	if (!cache.hasValue[row])
+		return def;
+
+	return cache.floats[row];
+}
+
+template<>
+const std::vector<int32> &GDAFile::getColumn<int32>(uint32 columnHash) const {
+	const size_t gdaColumn = findColumn(columnHash);
+	if (gdaColumn == kInvalidColumn)
+		throw Common::Exception("GDAFile: No such column %u", columnHash);
+
+	return getColumnCache(gdaColumn, false).ints;
+}
+
+template<>
+const std::vector<float> &GDAFile::getColumn<float>(uint32 columnHash) const {
+	const size_t gdaColumn = findColumn(columnHash);
+	if (gdaColumn == kInvalidColumn)
+		throw Common::Exception("GDAFile: No such column %u", columnHash);
+
+	return getColumnCache(gdaColumn, true).floats;
+}
+
+const GDAFile::ColumnCache &GDAFile::getColumnCache(size_t column, bool floats) const {
+	assert((column >= kGFF4G2DAColumn1) && ((column - kGFF4G2DAColumn1) < _columns->size()));
+
+	_columnCaches.resize(_columns->size());
+
+	ColumnCache &cache = _columnCaches[column - kGFF4G2DAColumn1];
+	if (floats ? cache.hasFloats : cache.hasInts)
+		return cache;
+
+	const bool readValues = cache.hasValue.empty();
+
+	/* Read into temporary arrays, so that we don't leave a half-read cache
+	 * behind should a cell throw. */
+
+	std::vector<bool>  hasValue   (readValues ? _rowCount : 0, false);
+	std::vector<int32> intValues  (floats ? 0 : _rowCount, 0);
+	std::vector<float> floatValues(floats ? _rowCount : 0, 0.0f);
+
+	/* Go through all rows of all GFF4s, and read the cells. A cell that
+	 * doesn't exist gives us back the default value, so we need to check
+	 * with a second default if we got back the first one. */
+
+	size_t row = 0;
+	for (Rows::const_iterator rows = _rows.begin(); rows != _rows.end(); ++rows) {
+		for (GFF4List::const_iterator r = (*rows)->begin(); r != (*rows)->end(); ++r, ++row) {
+			if (!*r)
+				continue;
+
+			if (floats) {
+				const double value = (*r)->getDouble(column, 0.0);
+
+				if (readValues)
+					hasValue[row] = (value != 0.0) || ((*r)->getDouble(column, 1.0) == 0.0);
+
+				floatValues[row] = (float) value;
+			} else {
+				const int64 value = (*r)->getSint(column, 0);
+
+				if (readValues)
+					hasValue[row] = (value != 0) || ((*r)->getSint(column, 1) == 0);
+
+				intValues[row] = (int32) value;
+			}
+		}
+	}
+
+	if (readValues)
+		cache.hasValue.swap(hasValue);
+
+	if (floats) {
+		cache.floats.swap(floatValues);
+		cache.hasFloats = true;
+	} else {
+		cache.ints.swap(intValues);
+		cache.hasInts = true;
+	}
+
+	return cache;
+}
+
+const GDAFile::ColumnCache &GDAFile::getRowIndex(size_t column) const {
+	assert((column >= kGFF4G2DAColumn1) && ((column - kGFF4G2DAColumn1) < _columns->size()));
+
+	_columnCaches.resize(_columns->size());
+
+	ColumnCache &cache = _columnCaches[column - kGFF4G2DAColumn1];
+	if (!cache.rowIndex.empty() || (_rowCount == 0))
+		return cache;
+
+	std::vector<uint64> uints(_rowCount, 0);
+
+	Common::HashIndex index;
+	index.reset(_rowCount);
+
+	/* Go through all rows of all GFF4s, and add them to the index. We only add
+	 * the first row of each value, to mimic the order of a linear search. */
+
+	size_t row = 0;
+	for (Rows::const_iterator rows = _rows.begin(); rows != _rows.end(); ++rows) {
+		for (GFF4List::const_iterator r = (*rows)->begin(); r != (*rows)->end(); ++r, ++row) {
+			if (!*r)
+				continue;
+
+			const uint64 value = (*r)->getUint(column);
+
+			uints[row] = value;
+
+			index.insert(Common::HashIndex::hash(value), row, UintEquals(uints, value));
+		}
+	}
+
+	cache.uints.swap(uints);
+	cache.rowIndex.swap(index);
+
+	return cache;
+}
+
+uint32 GDAFile::getColumnHash(const Common::UString &name) {
+	return Common::hashStringCRC32(name.toLower(), Common::kEncodingUTF16LE);
 }
 
 uint32 GDAFile::identifyType(const Columns &columns, const Row &rows, size_t column) const {
@@ -250,7 +375,7 @@ uint32 GDAFile::identifyType(const Columns &columns, const Row &rows, size_t col
 
 void GDAFile::load(Common::SeekableReadStream *gda) {
 	try {
-		_gff4s.push_back(new GFF4File(gda, kG2DAID));
+		_gff4s.push_back(new GFF4File(gda, kG2DAID, true));
 
 		const GFF4Struct &top = _gff4s.back()->getTopLevel();
 
@@ -280,7 +405,7 @@ void GDAFile::load(Common::SeekableReadStream *gda) {
 
 void GDAFile::add(Common::SeekableReadStream *gda) {
 	try {
-		_gff4s.push_back(new GFF4File(gda, kG2DAID));
+		_gff4s.push_back(new GFF4File(gda, kG2DAID, true));
 
 		const GFF4Struct &top = _gff4s.back()->getTopLevel();
 
@@ -306,6 +431,9 @@ void GDAFile::add(Common::SeekableReadStream *gda) {
 				                        hash1, type1, hash2, type2);
 		}
 
+		// The cached columns and row indices are missing the new rows
+		_columnCaches.clear();
+
 	} catch (Common::Exception &e) {
 		clear();
 
@@ -331,6 +459,8 @@ void GDAFile::clear() {
 
 	_columnHashMap.clear();
 	_columnNameMap.clear();
+
+	_columnCaches.clear();
 }
 
 } // End of namespace Aurora
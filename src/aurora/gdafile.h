@@ -29,6 +29,7 @@
 #include <map>
 
 #include "src/common/ustring.h"
+#include "src/common/hashindex.h"
 
 #include "src/aurora/types.h"
 
@@ -55,6 +56,10 @@ namespace Aurora {
  *  by the Dragon Age games. Within these MGDAs, rows are not anymore
  *  identified by raw row index (since this index is now meaningless),
  *  but by an "ID" column.
+ *
+ *  The int and float values of a column are read out of the GFF4s the
+ *  first time the column is accessed through getInt(), getFloat() or
+ *  getColumn(), and are then kept in a typed array.
  */
 class GDAFile {
 public:
@@ -110,7 +115,11 @@ public:
 	/** Get a row as a GFF4 struct. */
 	const GFF4Struct *getRow(size_t row) const;
 
-	/** Find a row by its ID value. */
+	/** Find a row by its ID value.
+	 *
+	 *  If several rows have the same ID, the first one is returned. The first
+	 *  call builds a hash index of the ID column, which is thrown away by add().
+	 */
 	size_t findRow(uint32 id) const;
 
 	/** Find a column by its name. */
@@ -128,6 +137,22 @@ public:
 	float getFloat(size_t row, uint32 columnHash, float def = 0.0f) const;
 	float getFloat(size_t row, const Common::UString &columnName, float def = 0.0f) const;
 
+	/** Return the values of all cells in a column, as int32 or float.
+	 *
+	 *  The returned array has one entry per row. Cells that don't exist hold 0.
+	 *  The array is read out of the GFF4s on first access, and stays valid
+	 *  until add() is called.
+	 *
+	 *  Only int32 and float are supported for T.
+	 */
+	template<typename T>
+	const std::vector<T> &getColumn(uint32 columnHash) const;
+	/** Return the values of all cells in a column, as int32 or float. */
+	template<typename T>
+	const std::vector<T> &getColumn(const Common::UString &columnName) const {
+		return getColumn<T>(getColumnHash(columnName));
+	}
+
 
 private:
 	typedef std::vector<GFF4File *> GFF4s;
@@ -139,6 +164,24 @@ private:
 	typedef std::map<uint32, size_t> ColumnHashMap;
 	typedef std::map<Common::UString, size_t> ColumnNameMap;
 
+	/** The values of a column, read out of the rows on demand. */
+	struct ColumnCache {
+		bool hasInts;   ///< Have the ints been read?
+		bool hasFloats; ///< Have the floats been read?
+
+		std::vector<bool>  hasValue; ///< Does the cell exist?
+		std::vector<int32> ints;
+		std::vector<float> floats;
+
+		/** Index of the rows, keyed by the cells' uint values. Built on first use. */
+		Common::HashIndex rowIndex;
+		/** The cells' uint values, for the row index. */
+		std::vector<uint64> uints;
+
+		ColumnCache() : hasInts(false), hasFloats(false) { }
+	};
+	typedef std::vector<ColumnCache> ColumnCaches;
+
 
 	GFF4s _gff4s;
 
@@ -154,6 +197,8 @@ private:
 	mutable ColumnHashMap _columnHashMap;
 	mutable ColumnNameMap _columnNameMap;
 
+	mutable ColumnCaches _columnCaches;
+
 
 	void load(Common::SeekableReadStream *gda);
 	void clear();
@@ -162,8 +207,23 @@ private:
 
 	const GFF4Struct *getRowColumn(size_t row, uint32 hash, size_t &column) const;
 	const GFF4Struct *getRowColumn(size_t row, const Common::UString &name, size_t &column) const;
+
+	int32 getCellInt  (size_t row, size_t column, int32 def) const;
+	float getCellFloat(size_t row, size_t column, float def) const;
+
+	/** Return the cache of this column, with its ints or floats read. */
+	const ColumnCache &getColumnCache(size_t column, bool floats) const;
+	/** Return the cache of this column, with its row index built. */
+	const ColumnCache &getRowIndex(size_t column) const;
+
+	static uint32 getColumnHash(const Common::UString &name);
 };
 
+template<>
+const std::vector<int32> &GDAFile::getColumn<int32>(uint32 columnHash) const;
+template<>
+const std::vector<float> &GDAFile::getColumn<float>(uint32 columnHash) const;
+
 } // End of namespace Aurora
 
 #endif // AURORA_GDAFILE_H
@@ -28,8 +28,12 @@
 
 #include <cassert>
 
+#include <cstring>
+#include <algorithm>
+
 #include "src/common/error.h"
 #include "src/common/memreadstream.h"
+#include "src/common/readcursor.h"
 #include "src/common/encoding.h"
 #include "src/common/ustring.h"
 #include "src/common/strutil.h"
@@ -43,6 +47,23 @@ static const uint32 kVersion33 = MKTAG('V', '3', '.', '3'); // Found in The Witc
 
 namespace Aurora {
 
+/** Compare two labels. Any consistent order works, so we just compare the raw strings. */
+static int compareLabels(const Common::UString &a, const Common::UString &b) {
+	return std::strcmp(a.c_str(), b.c_str());
+}
+
+/** Orders indices into a label array by the labels. */
+struct LabelLess {
+	const std::vector<Common::UString> *labels;
+
+	LabelLess(const std::vector<Common::UString> &l) : labels(&l) {
+	}
+
+	bool operator()(uint32 a, uint32 b) const {
+		return compareLabels((*labels)[a], (*labels)[b]) < 0;
+	}
+};
+
 GFF3File::Header::Header() {
 }
 
@@ -63,7 +84,7 @@ void GFF3File::Header::read(Common::SeekableReadStream &gff3) {
 
 
 GFF3File::GFF3File(Common::SeekableReadStream *gff3, uint32 id, bool repairNWNPremium) :
-	_stream(gff3), _repairNWNPremium(repairNWNPremium), _offsetCorrection(0) {
+	_stream(Common::makeMemoryReadStream(gff3)), _repairNWNPremium(repairNWNPremium), _offsetCorrection(0) {
 
 	load(id);
 }
@@ -76,10 +97,12 @@ void GFF3File::clear() {
 	delete _stream;
 	_stream = 0;
 
-	for (StructArray::iterator strct = _structs.begin(); strct != _structs.end(); ++strct)
-		delete *strct;
-
+	_lists.clear();
 	_structs.clear();
+	_fields.clear();
+	_sortedFields.clear();
+	_labels.clear();
+	_labelRanks.clear();
 }
 
 uint32 GFF3File::getType() const {
@@ -96,6 +119,7 @@ void GFF3File::load(uint32 id) {
 	try {
 
 		loadHeader(id);
+		loadLabels();
 		loadStructs();
 		loadLists();
 
@@ -180,12 +204,53 @@ void GFF3File::loadHeader(uint32 id) {
 		throw Common::Exception("GFF3 header broken: section offset points outside stream");
 }
 
+void GFF3File::loadLabels() {
+	static const uint32 kLabelSize = 16;
+
+	/* Read all labels once. The fields reference them by index, so the
+	 * field labels are automatically interned. */
+
+	Common::ReadCursor data = getCursor(_header.labelOffset);
+
+	const uint32 labelCount = MIN<size_t>(_header.labelCount, data.left() / kLabelSize);
+
+	_labels.resize(labelCount);
+	for (uint32 i = 0; i < labelCount; i++) {
+		Common::MemoryReadStream label(data.readPointer(kLabelSize), kLabelSize);
+
+		_labels[i] = Common::readStringFixed(label, Common::kEncodingASCII, kLabelSize);
+	}
+
+	/* Rank the labels, so that the fields of a struct can be sorted by
+	 * comparing integers instead of strings. */
+
+	std::vector<uint32> sorted(labelCount);
+	for (uint32 i = 0; i < labelCount; i++)
+		sorted[i] = i;
+
+	std::sort(sorted.begin(), sorted.end(), LabelLess(_labels));
+
+	_labelRanks.resize(labelCount);
+	for (uint32 i = 0, rank = 0; i < labelCount; i++) {
+		if ((i > 0) && (compareLabels(_labels[sorted[i - 1]], _labels[sorted[i]]) != 0))
+			rank++;
+
+		_labelRanks[sorted[i]] = rank;
+	}
+}
+
 void GFF3File::loadStructs() {
 	static const uint32 kStructSize = 12;
 
+	/* The struct array is only filled here, and never changes afterwards. The
+	 * lists can therefore safely point into it. */
+
 	_structs.reserve(_header.structCount);
+	_fields.reserve(_header.fieldCount);
+	_sortedFields.reserve(_header.fieldCount);
+
 	for (uint32 i = 0; i < _header.structCount; i++)
-		_structs.push_back(new GFF3Struct(*this, _header.structOffset + i * kStructSize));
+		_structs.push_back(GFF3Struct(*this, _header.structOffset + i * kStructSize));
 }
 
 void GFF3File::loadLists() {
@@ -204,13 +269,12 @@ void GFF3File::loadLists() {
 	 * list of lists into a list index.
 	 */
 
-	_stream->seek(_header.listIndicesOffset);
+	Common::ReadCursor data = getCursor(_header.listIndicesOffset);
 
 	// Read list array
 	std::vector<uint32> rawLists;
 	rawLists.resize(_header.listIndicesCount / 4);
-	for (std::vector<uint32>::iterator it = rawLists.begin(); it != rawLists.end(); ++it)
-		*it = _stream->readUint32LE();
+	data.readArrayLE(rawLists);
 
 	// Counting the actual amount of lists
 	uint32 listCount = 0;
@@ -243,7 +307,7 @@ void GFF3File::loadLists() {
 				throw Common::Exception("GFF3: List struct index out of range (%u >= %u)",
 				                        (uint) structIndex, (uint) _structs.size());
 
-			_lists[listIndex][j] = _structs[structIndex];
+			_lists[listIndex][j] = &_structs[structIndex];
 		}
 	}
 }
@@ -254,7 +318,7 @@ const GFF3Struct &GFF3File::getStruct(uint32 i) const {
 	if (i >= _structs.size())
 		throw Common::Exception("GFF3: Struct index out of range (%u >= %u)", i, (uint) _structs.size());
 
-	return *_structs[i];
+	return _structs[i];
 }
 
 const GFF3List &GFF3File::getList(uint32 i) const {
@@ -272,21 +336,31 @@ const GFF3List &GFF3File::getList(uint32 i) const {
 	return _lists[listIndex];
 }
 
+const Common::UString &GFF3File::getLabel(uint32 i) const {
+	assert(i < _labels.size());
+
+	return _labels[i];
+}
+
 Common::SeekableReadStream &GFF3File::getStream(uint32 offset) const {
 	_stream->seek(offset);
 
 	return *_stream;
 }
 
+Common::ReadCursor GFF3File::getCursor(uint32 offset) const {
+	return Common::ReadCursor(_stream->getData(), _stream->size(), offset);
+}
+
 Common::SeekableReadStream &GFF3File::getFieldData() const {
 	return getStream(_header.fieldDataOffset);
 }
 
 
-GFF3Struct::Field::Field() : type(kFieldTypeNone), data(0), extended(false) {
+GFF3Struct::Field::Field() : type(kFieldTypeNone), data(0), label(0), extended(false) {
 }
 
-GFF3Struct::Field::Field(FieldType t, uint32 d) : type(t), data(d) {
+GFF3Struct::Field::Field(FieldType t, uint32 d, uint32 l) : type(t), data(d), label(l) {
 	// These field types need extended field data
 	extended = (type == kFieldTypeUint64     ) ||
 	           (type == kFieldTypeSint64     ) ||
@@ -301,11 +375,23 @@ GFF3Struct::Field::Field(FieldType t, uint32 d) : type(t), data(d) {
 }
 
 
-GFF3Struct::GFF3Struct(const GFF3File &parent, uint32 offset) : _parent(&parent) {
-	load(offset);
-}
+struct GFF3Struct::FieldLabelLess {
+	const GFF3File *gff3;
+
+	FieldLabelLess(const GFF3File &g) : gff3(&g) {
+	}
+
+	bool operator()(uint32 a, uint32 b) const {
+		return gff3->_labelRanks[gff3->_fields[a].label] < gff3->_labelRanks[gff3->_fields[b].label];
+	}
+};
+
 
-GFF3Struct::~GFF3Struct() {
+GFF3Struct::GFF3Struct(GFF3File &parent, uint32 offset) : _parent(&parent),
+	_fieldStart(parent._fields.size()), _fieldCount(0),
+	_sortedStart(parent._sortedFields.size()), _sortedCount(0) {
+
+	load(parent, offset);
 }
 
 uint32 GFF3Struct::getID() const {
@@ -314,51 +400,54 @@ uint32 GFF3Struct::getID() const {
 
 // --- Loader ---
 
-void GFF3Struct::load(uint32 offset) {
-	Common::SeekableReadStream &data = _parent->getStream(offset);
+void GFF3Struct::load(GFF3File &parent, uint32 offset) {
+	Common::ReadCursor data = parent.getCursor(offset);
+
+	_id = data.readUint32LE();
 
-	_id         = data.readUint32LE();
-	_fieldIndex = data.readUint32LE();
-	_fieldCount = data.readUint32LE();
+	const uint32 fieldIndex = data.readUint32LE();
+	const uint32 fieldCount = data.readUint32LE();
 
 	// Read the field(s)
-	if      (_fieldCount == 1)
-		readField (data, _fieldIndex);
-	else if (_fieldCount > 1)
-		readFields(data, _fieldIndex, _fieldCount);
+	if      (fieldCount == 1)
+		readField (parent, data, fieldIndex);
+	else if (fieldCount > 1)
+		readFields(parent, data, fieldIndex, fieldCount);
+
+	sortFields(parent);
 }
 
-void GFF3Struct::readField(Common::SeekableReadStream &data, uint32 index) {
+void GFF3Struct::readField(GFF3File &parent, Common::ReadCursor &data, uint32 index) {
 	// Sanity check
-	if (index > _parent->_header.fieldCount)
+	if (index > parent._header.fieldCount)
 		throw Common::Exception("GFF3: Field index out of range (%d/%d)",
-				index, _parent->_header.fieldCount);
+				index, parent._header.fieldCount);
 
 	// Seek
-	data.seek(_parent->_header.fieldOffset + index * 12);
+	data.seek(parent._header.fieldOffset + index * 12);
 
 	// Read the field data
 	const uint32 fieldType  = data.readUint32LE();
 	const uint32 fieldLabel = data.readUint32LE();
 	const uint32 fieldData  = data.readUint32LE();
 
-	// Read the name
-	Common::UString fieldName = readLabel(data, fieldLabel);
-
-	// And add the field to the map and name list
-	_fields[fieldName] = Field((FieldType) fieldType, fieldData);
+	if (fieldLabel >= parent._labels.size())
+		throw Common::Exception("GFF3: Field label index out of range (%u/%u)",
+		                        fieldLabel, (uint) parent._labels.size());
 
-	_fieldNames.push_back(fieldName);
+	// And add the field to the parent's field array
+	parent._fields.push_back(Field((FieldType) fieldType, fieldData, fieldLabel));
+	_fieldCount++;
 }
 
-void GFF3Struct::readFields(Common::SeekableReadStream &data, uint32 index, uint32 count) {
+void GFF3Struct::readFields(GFF3File &parent, Common::ReadCursor &data, uint32 index, uint32 count) {
 	// Sanity check
-	if (index > _parent->_header.fieldIndicesCount)
+	if (index > parent._header.fieldIndicesCount)
 		throw Common::Exception("GFF3: Field indices index out of range (%d/%d)",
-		                        index , _parent->_header.fieldIndicesCount);
+		                        index , parent._header.fieldIndicesCount);
 
 	// Seek
-	data.seek(_parent->_header.fieldIndicesOffset + index);
+	data.seek(parent._header.fieldIndicesOffset + index);
 
 	// Read the field indices
 	std::vector<uint32> indices;
@@ -366,20 +455,46 @@ void GFF3Struct::readFields(Common::SeekableReadStream &data, uint32 index, uint
 
 	// Read the fields
 	for (std::vector<uint32>::const_iterator i = indices.begin(); i != indices.end(); ++i)
-		readField(data, *i);
+		readField(parent, data, *i);
 }
 
-void GFF3Struct::readIndices(Common::SeekableReadStream &data,
+void GFF3Struct::readIndices(Common::ReadCursor &data,
                              std::vector<uint32> &indices, uint32 count) const {
-	indices.reserve(count);
-	while (count-- > 0)
-		indices.push_back(data.readUint32LE());
+	if (count > (data.left() / 4))
+		throw Common::Exception(Common::kReadError);
+
+	indices.resize(count);
+	data.readArrayLE(indices);
 }
 
-Common::UString GFF3Struct::readLabel(Common::SeekableReadStream &data, uint32 index) const {
-	data.seek(_parent->_header.labelOffset + index * 16);
+void GFF3Struct::sortFields(GFF3File &parent) {
+	/* Sort our fields by label, so that we can binary search them. If a label
+	 * exists several times within the struct, the last field wins. */
+
+	std::vector<uint32> &sorted = parent._sortedFields;
+
+	for (uint32 i = 0; i < _fieldCount; i++)
+		sorted.push_back(_fieldStart + i);
 
-	return Common::readStringFixed(data, Common::kEncodingASCII, 16);
+	std::vector<uint32>::iterator begin = sorted.begin() + _sortedStart;
+	std::vector<uint32>::iterator end   = sorted.end();
+
+	if (_fieldCount > 1)
+		std::stable_sort(begin, end, FieldLabelLess(parent));
+
+	const FieldLabelLess less(parent);
+
+	std::vector<uint32>::iterator out = begin;
+	for (std::vector<uint32>::iterator in = begin; in != end; ++in) {
+		if ((out != begin) && !less(*(out - 1), *in))
+			*(out - 1) = *in;
+		else
+			*out++ = *in;
+	}
+
+	sorted.erase(out, end);
+
+	_sortedCount = sorted.size() - _sortedStart;
 }
 
 Common::SeekableReadStream &GFF3Struct::getData(const Field &field) const {
@@ -394,15 +509,21 @@ Common::SeekableReadStream &GFF3Struct::getData(const Field &field) const {
 // --- Field properties ---
 
 size_t GFF3Struct::getFieldCount() const {
-	return _fields.size();
+	return _sortedCount;
 }
 
 bool GFF3Struct::hasField(const Common::UString &field) const {
 	return getField(field) != 0;
 }
 
-const std::vector<Common::UString> &GFF3Struct::getFieldNames() const {
-	return _fieldNames;
+std::vector<Common::UString> GFF3Struct::getFieldNames() const {
+	std::vector<Common::UString> names;
+
+	names.reserve(_fieldCount);
+	for (uint32 i = 0; i < _fieldCount; i++)
+		names.push_back(_parent->getLabel(_parent->_fields[_fieldStart + i].label));
+
+	return names;
 }
 
 GFF3Struct::FieldType GFF3Struct::getFieldType(const Common::UString &field) const {
@@ -416,11 +537,30 @@ GFF3Struct::FieldType GFF3Struct::getFieldType(const Common::UString &field) con
 // --- Field value reader helpers ---
 
 const GFF3Struct::Field *GFF3Struct::getField(const Common::UString &name) const {
-	FieldMap::const_iterator field = _fields.find(name);
-	if (field == _fields.end())
+	if (_sortedCount == 0)
 		return 0;
 
-	return &field->second;
+	// Binary search through our part of the sorted field array
+
+	const uint32 *sorted = &_parent->_sortedFields[0] + _sortedStart;
+
+	size_t low  = 0;
+	size_t high = _sortedCount;
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+
+		const Field &field = _parent->_fields[sorted[mid]];
+
+		const int cmp = compareLabels(_parent->getLabel(field.label), name);
+		if (cmp < 0)
+			low = mid + 1;
+		else if (cmp > 0)
+			high = mid;
+		else
+			return &field;
+	}
+
+	return 0;
 }
 
 char GFF3Struct::getChar(const Common::UString &field, char def) const {
@@ -28,8 +28,12 @@
 
 #include <cassert>
 
+#include <algorithm>
+
 #include "src/common/error.h"
 #include "src/common/readstream.h"
+#include "src/common/memreadstream.h"
+#include "src/common/readcursor.h"
 #include "src/common/encoding.h"
 #include "src/common/strutil.h"
 
@@ -42,6 +46,19 @@ static const uint32 kVersion41 = MKTAG('V', '4', '.', '1');
 
 namespace Aurora {
 
+/** Does the struct at this position have the given ID? */
+struct StructIDEquals {
+	const std::deque<GFF4Struct> &structs;
+	uint64 id;
+
+	StructIDEquals(const std::deque<GFF4Struct> &s, uint64 i) : structs(s), id(i) {
+	}
+
+	bool operator()(uint32 i) const {
+		return structs[i].getID() == id;
+	}
+};
+
 void GFF4File::Header::read(Common::SeekableReadStream &gff4, uint32 version) {
 	platformID   = gff4.readUint32BE();
 	type         = gff4.readUint32BE();
@@ -62,8 +79,8 @@ void GFF4File::Header::read(Common::SeekableReadStream &gff4, uint32 version) {
 }
 
 
-GFF4File::GFF4File(Common::SeekableReadStream *gff4, uint32 type) :
-	_stream(gff4), _topLevelStruct(0) {
+GFF4File::GFF4File(Common::SeekableReadStream *gff4, uint32 type, bool lazy) :
+	_stream(Common::makeMemoryReadStream(gff4)), _topLevelStruct(0), _lazy(lazy) {
 
 	load(type);
 }
@@ -76,10 +93,10 @@ void GFF4File::clear() {
 	delete _stream;
 	_stream = 0;
 
-	for (StructMap::iterator s = _structs.begin(); s != _structs.end(); ++s)
-		delete s->second;
-
 	_structs.clear();
+	_lists.clear();
+	_structIndex.clear();
+	_genericTemplates.clear();
 	_topLevelStruct = 0;
 }
 
@@ -143,47 +160,52 @@ void GFF4File::loadStructs() {
 	static const uint32 kStructTemplateSize = 16;
 	const uint32 structTemplateStart = _stream->pos();
 
+	Common::ReadCursor data = getCursor(structTemplateStart);
+
 	_structTemplates.resize(_header.structCount);
 	for (uint32 i = 0; i < _header.structCount; i++) {
-		_stream->seek(structTemplateStart + i * kStructTemplateSize);
+		data.seek(structTemplateStart + i * kStructTemplateSize);
 
 		StructTemplate &strct = _structTemplates[i];
 
 		// Read struct properties
 
 		strct.index = i;
-		strct.label = _stream->readUint32BE();
+		strct.label = data.readUint32BE();
 
-		const uint32 fieldCount  = _stream->readUint32LE();
-		const uint32 fieldOffset = _stream->readUint32LE();
+		const uint32 fieldCount  = data.readUint32LE();
+		const uint32 fieldOffset = data.readUint32LE();
 
-		strct.size = _stream->readUint32LE();
+		strct.size = data.readUint32LE();
 
 		// Check if we need to read fields
 		if (fieldOffset == 0xFFFFFFFF) {
 			if (fieldCount != 0)
 				throw Common::Exception("GFF4: fieldOffset NULL, but fieldCount %u", fieldCount);
 
+			strct.finalize();
 			continue;
 		}
 
-		_stream->seek(fieldOffset);
+		data.seek(fieldOffset);
 
 		// Read the field declarations
 
-		strct.fields.resize(fieldCount);
+		strct.fields.reserve(fieldCount);
 		for (uint32 j = 0; j < fieldCount; j++) {
-			StructTemplate::Field &field = strct.fields[j];
+			const uint32 label  = data.readUint32LE();
+			const uint16 type   = data.readUint16LE();
+			const uint16 flags  = data.readUint16LE();
+			const uint32 offset = data.readUint32LE();
 
-			field.label  = _stream->readUint32LE();
-			field.type   = _stream->readUint16LE();
-			field.flags  = _stream->readUint16LE();
-			field.offset = _stream->readUint32LE();
+			strct.addField(label, type, flags, offset);
 		}
+
+		strct.finalize();
 	}
 
-	// And load the top level struct, which itself recurses into field structs
-	_topLevelStruct = new GFF4Struct(*this, _header.dataOffset, _structTemplates[0]);
+	// And load the top level struct, which itself recurses into field structs (unless we're lazy)
+	_topLevelStruct = loadStruct(_header.dataOffset, _structTemplates[0]);
 	_topLevelStruct->_refCount++;
 }
 
@@ -200,24 +222,92 @@ void GFF4File::loadStrings() {
 
 // --- Helpers for GFF4Struct ---
 
-void GFF4File::registerStruct(uint64 id, GFF4Struct *strct) {
-	std::pair<StructMap::iterator, bool> result;
+GFF4Struct *GFF4File::loadStruct(uint32 offset, const StructTemplate &tmplt) {
+	const uint64 id = GFF4Struct::generateID(offset, &tmplt);
+
+	GFF4Struct *strct = findStruct(id);
+	if (strct)
+		return strct;
+
+	const uint32 listStart = _lists.size();
+	_lists.resize(_lists.size() + tmplt.listCount);
+
+	strct = &addStruct(GFF4Struct(*this, id, offset, tmplt, listStart));
+	if (!_lazy)
+		strct->load(*this);
+
+	return strct;
+}
+
+GFF4Struct *GFF4File::loadGeneric(uint32 offset, bool isList, bool isReference) {
+	const uint64 id = GFF4Struct::generateID(offset);
+
+	GFF4Struct *strct = findStruct(id);
+	if (strct)
+		return strct;
+
+	const StructTemplate &tmplt = createGenericTemplate(offset, isList, isReference);
 
-	result = _structs.insert(std::make_pair(id, strct));
-	if (!result.second)
-		throw Common::Exception("GFF4: Duplicate struct");
+	const uint32 listStart = _lists.size();
+	_lists.resize(_lists.size() + tmplt.listCount);
+
+	// The field offsets in a generic's template are absolute
+	strct = &addStruct(GFF4Struct(*this, id, 0, tmplt, listStart));
+	if (!_lazy)
+		strct->load(*this);
+
+	return strct;
 }
 
-void GFF4File::unregisterStruct(uint64 id) {
-	_structs.erase(id);
+const GFF4File::StructTemplate &GFF4File::createGenericTemplate(uint32 offset, bool isList, bool isReference) {
+	static const uint32 kGenericSize = 8;
+
+	_genericTemplates.push_back(StructTemplate());
+	StructTemplate &tmplt = _genericTemplates.back();
+
+	tmplt.index     = 0xFFFFFFFF;
+	tmplt.isGeneric = true;
+
+	Common::ReadCursor data = getCursor(offset);
+
+	const uint32 genericCount = isList ? data.readUint32LE() : 1;
+	const uint32 genericStart = data.pos();
+
+	for (uint32 i = 0; i < genericCount; i++) {
+		data.seek(genericStart + i * kGenericSize);
+
+		const uint16 fieldType   = data.readUint16LE();
+		const uint16 fieldFlags  = data.readUint16LE();
+
+		const uint32 fieldOffset = getDataOffset(isReference, data.pos());
+
+		if (fieldOffset == 0xFFFFFFFF)
+			continue;
+
+		tmplt.addField(i, fieldType, fieldFlags, fieldOffset);
+	}
+
+	tmplt.finalize();
+
+	tmplt.fieldCount = genericCount;
+
+	return tmplt;
 }
 
 GFF4Struct *GFF4File::findStruct(uint64 id) {
-	StructMap::iterator s = _structs.find(id);
-	if (s == _structs.end())
+	const uint32 i = _structIndex.find(Common::HashIndex::hash(id), StructIDEquals(_structs, id));
+	if (i == Common::HashIndex::kNone)
 		return 0;
 
-	return s->second;
+	return &_structs[i];
+}
+
+GFF4Struct &GFF4File::addStruct(const GFF4Struct &strct) {
+	_structs.push_back(strct);
+
+	_structIndex.insert(Common::HashIndex::hash(strct._id), _structs.size() - 1, StructIDEquals(_structs, strct._id));
+
+	return _structs.back();
 }
 
 Common::SeekableReadStream &GFF4File::getStream(uint32 offset) const {
@@ -226,10 +316,25 @@ Common::SeekableReadStream &GFF4File::getStream(uint32 offset) const {
 	return *_stream;
 }
 
+Common::ReadCursor GFF4File::getCursor(uint32 offset) const {
+	return Common::ReadCursor(_stream->getData(), _stream->size(), offset);
+}
+
 uint32 GFF4File::getDataOffset() const {
 	return _header.dataOffset;
 }
 
+uint32 GFF4File::getDataOffset(bool isReference, uint32 offset) const {
+	if (!isReference || (offset == 0xFFFFFFFF))
+		return offset;
+
+	offset = getCursor(offset).readUint32LE();
+	if (offset == 0xFFFFFFFF)
+		return offset;
+
+	return getDataOffset() + offset;
+}
+
 const GFF4File::StructTemplate &GFF4File::getStructTemplate(uint32 i) const {
 	if (i >= _structTemplates.size())
 		throw Common::Exception("GFF4: Struct template out of range (%u >= %u)",
@@ -253,12 +358,12 @@ Common::UString GFF4File::getSharedString(uint32 i) const {
 
 
 GFF4Struct::Field::Field() : label(0), type(kFieldTypeNone), offset(0xFFFFFFFF),
-	isList(false), isReference(false), isGeneric(false), structIndex(0) {
+	isList(false), isReference(false), isGeneric(false), structIndex(0), listIndex(0xFFFFFFFF) {
 
 }
 
 GFF4Struct::Field::Field(uint32 l, uint16 t, uint16 f, uint32 o, bool g) :
-	label(l), offset(o), isGeneric(g) {
+	label(l), offset(o), isGeneric(g), listIndex(0xFFFFFFFF) {
 
 	isList      = (f & 0x8000) != 0;
 	isReference = (f & 0x2000) != 0;
@@ -278,39 +383,95 @@ GFF4Struct::Field::Field(uint32 l, uint16 t, uint16 f, uint32 o, bool g) :
 		isReference = false;
 }
 
-GFF4Struct::Field::~Field() {
+
+GFF4Struct::Template::Template() : index(0), label(0), size(0), isGeneric(false),
+	fieldCount(0), listCount(0) {
+
 }
 
+void GFF4Struct::Template::addField(uint32 l, uint16 t, uint16 f, uint32 o) {
+	fields.push_back(Field());
 
-GFF4Struct::GFF4Struct(GFF4File &parent, uint32 offset, const GFF4File::StructTemplate &tmplt) :
-	_parent(&parent), _label(tmplt.label), _refCount(0), _fieldCount(0) {
+	Field &field = fields.back();
 
-	_id = generateID(offset, &tmplt);
-	parent.registerStruct(_id, this);
+	field.label     = l;
+	field.type      = t;
+	field.flags     = f;
+	field.offset    = o;
+	field.listIndex = 0xFFFFFFFF;
 
-	try {
-		load(parent, offset, tmplt);
-	} catch (...) {
-		parent.unregisterStruct(_id);
-		throw;
-	}
+	fieldLabels.push_back(l);
+
+	/* Fields of structs, and fields of generics in structs (but not in other
+	 * generics), hold a list of structs. Every struct using this template
+	 * needs space for these lists. */
+
+	const bool isStructField  = (f & 0x4000) != 0;
+	const bool isGenericField = !isStructField && (t == (uint16) kFieldTypeGeneric);
+
+	if (isStructField || (isGenericField && !isGeneric))
+		field.listIndex = listCount++;
 }
 
-GFF4Struct::GFF4Struct(GFF4File &parent, const Field &genericParent) :
-	_parent(&parent), _label(0), _refCount(0), _fieldCount(0) {
+/** Orders indices into a template's field array by the fields' labels. */
+struct GFF4Struct::Template::FieldLabelLess {
+	const std::vector<Field> *fields;
 
-	_id = generateID(genericParent.offset);
-	parent.registerStruct(_id, this);
+	FieldLabelLess(const std::vector<Field> &f) : fields(&f) {
+	}
 
-	try {
-		load(parent, genericParent);
-	} catch (...) {
-		parent.unregisterStruct(_id);
-		throw;
+	bool operator()(uint32 a, uint32 b) const {
+		return (*fields)[a].label < (*fields)[b].label;
 	}
+};
+
+void GFF4Struct::Template::finalize() {
+	/* Sort the fields by label, so that we can binary search them. If a label
+	 * exists several times within the template, the last field wins. */
+
+	sortedFields.resize(fields.size());
+	for (size_t i = 0; i < fields.size(); i++)
+		sortedFields[i] = i;
+
+	std::stable_sort(sortedFields.begin(), sortedFields.end(), FieldLabelLess(fields));
+
+	std::vector<uint32>::iterator out = sortedFields.begin();
+	for (std::vector<uint32>::iterator in = sortedFields.begin(); in != sortedFields.end(); ++in) {
+		if ((out != sortedFields.begin()) && (fields[*(out - 1)].label == fields[*in].label))
+			*(out - 1) = *in;
+		else
+			*out++ = *in;
+	}
+
+	sortedFields.erase(out, sortedFields.end());
+
+	fieldCount = sortedFields.size();
 }
 
-GFF4Struct::~GFF4Struct() {
+const GFF4Struct::Template::Field *GFF4Struct::Template::findField(uint32 l) const {
+	size_t low  = 0;
+	size_t high = sortedFields.size();
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+
+		const Field &field = fields[sortedFields[mid]];
+		if      (field.label < l)
+			low = mid + 1;
+		else if (field.label > l)
+			high = mid;
+		else
+			return &field;
+	}
+
+	return 0;
+}
+
+
+GFF4Struct::GFF4Struct(const GFF4File &parent, uint64 id, uint32 offset, const Template &tmplt,
+                       uint32 listStart) :
+	_parent(&parent), _template(&tmplt), _offset(offset), _id(id), _refCount(0), _listStart(listStart),
+	_loaded(false) {
+
 }
 
 uint64 GFF4Struct::getID() const {
@@ -322,121 +483,114 @@ uint32 GFF4Struct::getRefCount() const {
 }
 
 uint32 GFF4Struct::getLabel() const {
-	return _label;
+	return _template->label;
 }
 
 // --- Loader ---
 
-void GFF4Struct::load(GFF4File &parent, uint32 offset, const GFF4File::StructTemplate &tmplt) {
-	for (size_t i = 0; i < tmplt.fields.size(); i++) {
-		const GFF4File::StructTemplate::Field &field = tmplt.fields[i];
+void GFF4Struct::load(GFF4File &parent) {
+	if (_loaded)
+		return;
+
+	if (_template->listCount == 0) {
+		_loaded = true;
+		return;
+	}
+
+	try {
+		for (size_t i = 0; i < _template->fields.size(); i++) {
+			if (_template->fields[i].listIndex == 0xFFFFFFFF)
+				continue;
+
+			Field field;
+			findField(_template->fields[i].label, field);
+
+			/* With duplicate labels, only the last field is visible. No need
+			 * to load the structs of the others. */
+			if (field.listIndex != _template->fields[i].listIndex)
+				continue;
+
+			// Load the field's struct(s)
+			if (field.type == kFieldTypeStruct)
+				loadStructs(parent, field);
+			if (field.type == kFieldTypeGeneric)
+				loadGeneric(parent, field);
+		}
+	} catch (...) {
+		/* Don't leave half-filled lists behind, in case we're asked to load again,
+		 * and take back the references we already added to their structs. */
+		for (uint32 i = 0; i < _template->listCount; i++) {
+			GFF4List &list = parent._lists[_listStart + i];
 
-		_fieldLabels.push_back(field.label);
+			for (GFF4List::iterator l = list.begin(); l != list.end(); ++l)
+				if (*l)
+					const_cast<GFF4Struct *>(*l)->_refCount--;
 
-		// Calculate the offset for the field data, but guard against NULL pointers
-		uint32 fieldOffset = offset + field.offset;
-		if ((offset == 0xFFFFFFFF) || (field.offset == 0xFFFFFFFF))
-			fieldOffset = 0xFFFFFFFF;
+			list.clear();
+		}
 
-		// Load the field and its struct(s), if any
-		Field &f = _fields[field.label] = Field(field.label, field.type, field.flags, fieldOffset);
-		if (f.type == kFieldTypeStruct)
-			loadStructs(parent, f);
-		if (f.type == kFieldTypeGeneric)
-			loadGeneric(parent, f);
+		throw;
 	}
 
-	_fieldCount = _fields.size();
+	_loaded = true;
 }
 
-void GFF4Struct::loadStructs(GFF4File &parent, Field &field) {
+void GFF4Struct::loadStructs(GFF4File &parent, const Field &field) {
 	if (field.offset == 0xFFFFFFFF)
 		return;
 
 	const GFF4File::StructTemplate &tmplt = parent.getStructTemplate(field.structIndex);
 
-	Common::SeekableReadStream &data = parent.getStream(field.offset);
+	Common::ReadCursor data = parent.getCursor(field.offset);
 
 	const uint32 structCount = getListCount(data, field);
 	const uint32 structSize  = field.isReference ? 4 : tmplt.size;
 	const uint32 structStart = data.pos();
 
-	field.structs.resize(structCount, 0);
+	GFF4List &structs = parent._lists[_listStart + field.listIndex];
+
+	structs.resize(structCount, 0);
 	for (uint32 i = 0; i < structCount; i++) {
 		const uint32 offset = getDataOffset(field.isReference, structStart + i * structSize);
 		if (offset == 0xFFFFFFFF)
 			continue;
 
-		GFF4Struct *strct = parent.findStruct(generateID(offset, &tmplt));
-		if (!strct)
-			strct = new GFF4Struct(parent, offset, tmplt);
+		GFF4Struct *strct = parent.loadStruct(offset, tmplt);
 
 		strct->_refCount++;
 
-		field.structs[i] = strct;
+		structs[i] = strct;
 	}
 }
 
-void GFF4Struct::loadGeneric(GFF4File &parent, Field &field) {
-	field.offset = getDataOffset(field.isList, field.offset);
-	if (field.offset == 0xFFFFFFFF)
+void GFF4Struct::loadGeneric(GFF4File &parent, const Field &field) {
+	const uint32 offset = getDataOffset(field.isList, field.offset);
+	if (offset == 0xFFFFFFFF)
 		return;
 
-	GFF4Struct *strct = parent.findStruct(generateID(field.offset));
-	if (!strct)
-		strct = new GFF4Struct(parent, field);
-
-	strct->_refCount++;
-
-	field.structs.push_back(strct);
-}
-
-void GFF4Struct::load(GFF4File &parent, const Field &genericParent) {
-	static const uint32 kGenericSize = 8;
+	GFF4Struct *strct = parent.loadGeneric(offset, field.isList, field.isReference);
 
-	Common::SeekableReadStream &data = parent.getStream(genericParent.offset);
+	parent._lists[_listStart + field.listIndex].push_back(strct);
 
-	const uint32 genericCount = genericParent.isList ? data.readUint32LE() : 1;
-	const uint32 genericStart = data.pos();
-
-	for (uint32 i = 0; i < genericCount; i++) {
-		data.seek(genericStart + i * kGenericSize);
-
-		const uint16 fieldType   = data.readUint16LE();
-		const uint16 fieldFlags  = data.readUint16LE();
-
-		const uint32 fieldOffset = getDataOffset(genericParent.isReference, data.pos());
-
-		if (fieldOffset == 0xFFFFFFFF)
-			continue;
-
-		_fieldLabels.push_back(i);
-
-		// Load the field and its struct(s), if any
-		Field &f = _fields[i] = Field(i, fieldType, fieldFlags, fieldOffset, true);
-		if (f.type == kFieldTypeStruct)
-			loadStructs(parent, f);
-	}
-
-	_fieldCount = genericCount;
+	strct->_refCount++;
 }
 
-uint64 GFF4Struct::generateID(uint32 offset, const GFF4File::StructTemplate *tmplt) {
+uint64 GFF4Struct::generateID(uint32 offset, const Template *tmplt) {
 	return (((uint64) offset) << 32) | (tmplt ? tmplt->index : 0xFFFFFFFF);
 }
 
 // --- Field properties ---
 
 size_t GFF4Struct::getFieldCount() const {
-	return _fieldCount;
+	return _template->fieldCount;
 }
 
 bool GFF4Struct::hasField(uint32 field) const {
-	return getField(field) != 0;
+	return _template->findField(field) != 0;
 }
 
 const std::vector<uint32> &GFF4Struct::getFieldLabels() const {
-	return _fieldLabels;
+	return _template->fieldLabels;
 }
 
 GFF4Struct::FieldType GFF4Struct::getFieldType(uint32 field) const {
@@ -445,48 +599,47 @@ GFF4Struct::FieldType GFF4Struct::getFieldType(uint32 field) const {
 }
 
 GFF4Struct::FieldType GFF4Struct::getFieldType(uint32 field, bool &isList) const {
-	const Field *f = getField(field);
-	if (!f)
+	Field f;
+	if (!findField(field, f))
 		return kFieldTypeNone;
 
-	isList = f->isList;
+	isList = f.isList;
 
-	return f->type;
+	return f.type;
 }
 
 bool GFF4Struct::getFieldProperties(uint32 field, FieldType &type, uint32 &label, bool &isList) const {
-	const Field *f = getField(field);
-	if (!f)
+	Field f;
+	if (!findField(field, f))
 		return false;
 
-	type   = f->type;
-	label  = f->label;
-	isList = f->isList;
+	type   = f.type;
+	label  = f.label;
+	isList = f.isList;
 
 	return true;
 }
 
 // --- Field value reader helpers ---
 
-const GFF4Struct::Field *GFF4Struct::getField(uint32 field) const {
-	FieldMap::const_iterator f = _fields.find(field);
-	if (f == _fields.end())
-		return 0;
-
-	return &f->second;
-}
+bool GFF4Struct::findField(uint32 field, Field &f) const {
+	const Template::Field *tmpltField = _template->findField(field);
+	if (!tmpltField)
+		return false;
 
-uint32 GFF4Struct::getDataOffset(bool isReference, uint32 offset) const {
-	if (!isReference || (offset == 0xFFFFFFFF))
-		return offset;
+	// Calculate the offset for the field data, but guard against NULL pointers
+	uint32 offset = _offset + tmpltField->offset;
+	if ((_offset == 0xFFFFFFFF) || (tmpltField->offset == 0xFFFFFFFF))
+		offset = 0xFFFFFFFF;
 
-	Common::SeekableReadStream &data = _parent->getStream(offset);
+	f = Field(tmpltField->label, tmpltField->type, tmpltField->flags, offset, _template->isGeneric);
+	f.listIndex = tmpltField->listIndex;
 
-	offset = data.readUint32LE();
-	if (offset == 0xFFFFFFFF)
-		return offset;
+	return true;
+}
 
-	return _parent->getDataOffset() + offset;
+uint32 GFF4Struct::getDataOffset(bool isReference, uint32 offset) const {
+	return _parent->getDataOffset(isReference, offset);
 }
 
 uint32 GFF4Struct::getDataOffset(const Field &field) const {
@@ -504,11 +657,23 @@ Common::SeekableReadStream *GFF4Struct::getData(const Field &field) const {
 	return &_parent->getStream(offset);
 }
 
-Common::SeekableReadStream *GFF4Struct::getField(uint32 fieldID, const Field *&field) const {
-	if (!(field = getField(fieldID)))
+Common::SeekableReadStream *GFF4Struct::getField(uint32 fieldID, Field &field) const {
+	if (!findField(fieldID, field))
 		return 0;
 
-	return getData(*field);
+	return getData(field);
+}
+
+const GFF4List &GFF4Struct::getStructList(const Field &field) const {
+	assert(field.listIndex != 0xFFFFFFFF);
+
+	/* In a lazily loaded GFF4, our structs haven't been loaded yet. Neither
+	 * we nor our GFF4File are actually const objects, only the interface
+	 * handed out to users is. */
+	if (!_loaded)
+		const_cast<GFF4Struct &>(*this).load(const_cast<GFF4File &>(*_parent));
+
+	return _parent->_lists[_listStart + field.listIndex];
 }
 
 uint32 GFF4Struct::getVectorMatrixLength(const Field &field, uint32 minLength, uint32 maxLength) const {
@@ -532,7 +697,8 @@ uint32 GFF4Struct::getVectorMatrixLength(const Field &field, uint32 minLength, u
 	return length;
 }
 
-uint32 GFF4Struct::getListCount(Common::SeekableReadStream &data, const Field &field) const {
+template<typename T>
+uint32 GFF4Struct::getListCount(T &data, const Field &field) const {
 	if (!field.isList)
 		return 1;
 
@@ -756,27 +922,27 @@ Common::UString GFF4Struct::getString(Common::SeekableReadStream &data, const Fi
 // --- Single value readers ---
 
 uint64 GFF4Struct::getUint(uint32 field, uint64 def) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return def;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	return getUint(*data, f->type);
+	return getUint(*data, f.type);
 }
 
 int64 GFF4Struct::getSint(uint32 field, int64 def) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return def;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	return getSint(*data, f->type);
+	return getSint(*data, f.type);
 }
 
 bool GFF4Struct::getBool(uint32 field, bool def) const {
@@ -784,41 +950,41 @@ bool GFF4Struct::getBool(uint32 field, bool def) const {
 }
 
 double GFF4Struct::getDouble(uint32 field, double def) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return def;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	return getDouble(*data, f->type);
+	return getDouble(*data, f.type);
 }
 
 float GFF4Struct::getFloat(uint32 field, float def) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return def;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	return getFloat(*data, f->type);
+	return getFloat(*data, f.type);
 }
 
 Common::UString GFF4Struct::getString(uint32 field, Common::Encoding encoding,
                                       const Common::UString &def) const {
 
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return def;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	return getString(*data, *f, encoding);
+	return getString(*data, f, encoding);
 }
 
 Common::UString GFF4Struct::getString(uint32 field, const Common::UString &def) const {
@@ -828,14 +994,14 @@ Common::UString GFF4Struct::getString(uint32 field, const Common::UString &def)
 bool GFF4Struct::getTalkString(uint32 field, Common::Encoding encoding,
                                uint32 &strRef, Common::UString &str) const {
 
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->type != kFieldTypeTlkString)
+	if (f.type != kFieldTypeTlkString)
 		throw Common::Exception("GFF4: Field is not of TalkString type");
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
 	strRef = getUint(*data, kFieldTypeUint32);
@@ -854,15 +1020,15 @@ bool GFF4Struct::getTalkString(uint32 field, uint32 &strRef, Common::UString &st
 }
 
 bool GFF4Struct::getVector3(uint32 field, double &v1, double &v2, double &v3) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	getVectorMatrixLength(*f, 3, 3);
+	getVectorMatrixLength(f, 3, 3);
 
 	v1 = getDouble(*data, kFieldTypeFloat32);
 	v2 = getDouble(*data, kFieldTypeFloat32);
@@ -872,15 +1038,15 @@ bool GFF4Struct::getVector3(uint32 field, double &v1, double &v2, double &v3) co
 }
 
 bool GFF4Struct::getVector3(uint32 field, float &v1, float &v2, float &v3) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	getVectorMatrixLength(*f, 3, 3);
+	getVectorMatrixLength(f, 3, 3);
 
 	v1 = getFloat(*data, kFieldTypeFloat32);
 	v2 = getFloat(*data, kFieldTypeFloat32);
@@ -890,15 +1056,15 @@ bool GFF4Struct::getVector3(uint32 field, float &v1, float &v2, float &v3) const
 }
 
 bool GFF4Struct::getVector4(uint32 field, double &v1, double &v2, double &v3, double &v4) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	getVectorMatrixLength(*f, 4, 4);
+	getVectorMatrixLength(f, 4, 4);
 
 	v1 = getDouble(*data, kFieldTypeFloat32);
 	v2 = getDouble(*data, kFieldTypeFloat32);
@@ -909,15 +1075,15 @@ bool GFF4Struct::getVector4(uint32 field, double &v1, double &v2, double &v3, do
 }
 
 bool GFF4Struct::getVector4(uint32 field, float &v1, float &v2, float &v3, float &v4) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	getVectorMatrixLength(*f, 4, 4);
+	getVectorMatrixLength(f, 4, 4);
 
 	v1 = getFloat(*data, kFieldTypeFloat32);
 	v2 = getFloat(*data, kFieldTypeFloat32);
@@ -928,15 +1094,15 @@ bool GFF4Struct::getVector4(uint32 field, float &v1, float &v2, float &v3, float
 }
 
 bool GFF4Struct::getMatrix4x4(uint32 field, double (&m)[16]) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	const uint32 length = getVectorMatrixLength(*f, 16, 16);
+	const uint32 length = getVectorMatrixLength(f, 16, 16);
 	for (uint32 i = 0; i < length; i++)
 		m[i] = getDouble(*data, kFieldTypeFloat32);
 
@@ -944,15 +1110,15 @@ bool GFF4Struct::getMatrix4x4(uint32 field, double (&m)[16]) const {
 }
 
 bool GFF4Struct::getMatrix4x4(uint32 field, float (&m)[16]) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	const uint32 length = getVectorMatrixLength(*f, 16, 16);
+	const uint32 length = getVectorMatrixLength(f, 16, 16);
 	for (uint32 i = 0; i < length; i++)
 		m[i] = getFloat(*data, kFieldTypeFloat32);
 
@@ -960,15 +1126,15 @@ bool GFF4Struct::getMatrix4x4(uint32 field, float (&m)[16]) const {
 }
 
 bool GFF4Struct::getVectorMatrix(uint32 field, std::vector<double> &vectorMatrix) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	const uint32 length = getVectorMatrixLength(*f, 0, 16);
+	const uint32 length = getVectorMatrixLength(f, 0, 16);
 
 	vectorMatrix.resize(length);
 	for (uint32 i = 0; i < length; i++)
@@ -978,15 +1144,15 @@ bool GFF4Struct::getVectorMatrix(uint32 field, std::vector<double> &vectorMatrix
 }
 
 bool GFF4Struct::getVectorMatrix(uint32 field, std::vector<float> &vectorMatrix) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	const uint32 length = getVectorMatrixLength(*f, 0, 16);
+	const uint32 length = getVectorMatrixLength(f, 0, 16);
 
 	vectorMatrix.resize(length);
 	for (uint32 i = 0; i < length; i++)
@@ -998,76 +1164,76 @@ bool GFF4Struct::getVectorMatrix(uint32 field, std::vector<float> &vectorMatrix)
 // --- List value readers ---
 
 bool GFF4Struct::getUint(uint32 field, std::vector<uint64> &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getUint(*data, f->type);
+		list[i] = getUint(*data, f.type);
 
 	return true;
 }
 
 bool GFF4Struct::getSint(uint32 field, std::vector<int64> &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getSint(*data, f->type);
+		list[i] = getSint(*data, f.type);
 
 	return true;
 }
 
 bool GFF4Struct::getBool(uint32 field, std::vector<bool> &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getUint(*data, f->type) != 0;
+		list[i] = getUint(*data, f.type) != 0;
 
 	return true;
 }
 
 bool GFF4Struct::getDouble(uint32 field, std::vector<double> &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getDouble(*data, f->type);
+		list[i] = getDouble(*data, f.type);
 
 	return true;
 }
 
 bool GFF4Struct::getFloat(uint32 field, std::vector<float> &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getFloat(*data, f->type);
+		list[i] = getFloat(*data, f.type);
 
 	return true;
 }
@@ -1075,10 +1241,11 @@ bool GFF4Struct::getFloat(uint32 field, std::vector<float> &list) const {
 bool GFF4Struct::getString(uint32 field, Common::Encoding encoding,
                            std::vector<Common::UString> &list) const {
 
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data) {
-		if (f && !f->isList) {
+		// The field exists, but it's a NULL string
+		if ((f.type != kFieldTypeNone) && !f.isList) {
 			list.push_back("");
 			return true;
 		}
@@ -1086,11 +1253,11 @@ bool GFF4Struct::getString(uint32 field, Common::Encoding encoding,
 		return false;
 	}
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++)
-		list[i] = getString(*data, *f, encoding);
+		list[i] = getString(*data, f, encoding);
 
 	return true;
 }
@@ -1103,15 +1270,15 @@ bool GFF4Struct::getTalkString(uint32 field, Common::Encoding encoding,
                                std::vector<uint32> &strRefs, std::vector<Common::UString> &strs) const {
 
 
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	if (f->type != kFieldTypeTlkString)
+	if (f.type != kFieldTypeTlkString)
 		throw Common::Exception("GFF4: Field is not of TalkString type");
 
-	const uint32 count = getListCount(*data, *f);
+	const uint32 count = getListCount(*data, f);
 
 	strRefs.resize(count);
 	strs.resize(count);
@@ -1137,13 +1304,13 @@ bool GFF4Struct::getTalkString(uint32 field,
 }
 
 bool GFF4Struct::getVectorMatrix(uint32 field, std::vector< std::vector<double> > &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 length = getVectorMatrixLength(*f, 0, 16);
-	const uint32 count  = getListCount(*data, *f);
+	const uint32 length = getVectorMatrixLength(f, 0, 16);
+	const uint32 count  = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++) {
@@ -1157,13 +1324,13 @@ bool GFF4Struct::getVectorMatrix(uint32 field, std::vector< std::vector<double>
 }
 
 bool GFF4Struct::getVectorMatrix(uint32 field, std::vector< std::vector<float> > &list) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return false;
 
-	const uint32 length = getVectorMatrixLength(*f, 0, 16);
-	const uint32 count  = getListCount(*data, *f);
+	const uint32 length = getVectorMatrixLength(f, 0, 16);
+	const uint32 count  = getListCount(*data, f);
 
 	list.resize(count);
 	for (uint32 i = 0; i < count; i++) {
@@ -1179,17 +1346,18 @@ bool GFF4Struct::getVectorMatrix(uint32 field, std::vector< std::vector<float> >
 // --- Struct reader ---
 
 const GFF4Struct *GFF4Struct::getStruct(uint32 field) const {
-	const Field *f = getField(field);
-	if (!f)
+	Field f;
+	if (!findField(field, f))
 		return 0;
 
-	if (f->type != kFieldTypeStruct)
+	if (f.type != kFieldTypeStruct)
 		throw Common::Exception("GFF4: Field is not of struct type");
-	if (f->isList)
+	if (f.isList)
 		throw Common::Exception("GFF4: Tried reading list as singular value");
 
-	if (!f->structs.empty())
-		return f->structs[0];
+	const GFF4List &structs = getStructList(f);
+	if (!structs.empty())
+		return structs[0];
 
 	return 0;
 }
@@ -1197,15 +1365,20 @@ const GFF4Struct *GFF4Struct::getStruct(uint32 field) const {
 // --- Generic reader ---
 
 const GFF4Struct *GFF4Struct::getGeneric(uint32 field) const {
-	const Field *f = getField(field);
-	if (!f)
+	Field f;
+	if (!findField(field, f))
 		return 0;
 
-	if (f->type != kFieldTypeGeneric)
+	if (f.type != kFieldTypeGeneric)
 		throw Common::Exception("GFF4: Field is not of generic type");
 
-	if (!f->structs.empty())
-		return f->structs[0];
+	// Generics within generics aren't loaded
+	if (f.listIndex == 0xFFFFFFFF)
+		return 0;
+
+	const GFF4List &structs = getStructList(f);
+	if (!structs.empty())
+		return structs[0];
 
 	return 0;
 }
@@ -1213,26 +1386,26 @@ const GFF4Struct *GFF4Struct::getGeneric(uint32 field) const {
 // --- Struct list reader ---
 
 const GFF4List &GFF4Struct::getList(uint32 field) const {
-	const Field *f = getField(field);
-	if (!f)
+	Field f;
+	if (!findField(field, f))
 		throw Common::Exception("GFF4: No such field");
 
-	if (f->type != kFieldTypeStruct)
+	if (f.type != kFieldTypeStruct)
 		throw Common::Exception("GFF4: Field is not of struct type");
 
-	return f->structs;
+	return getStructList(f);
 }
 
 // --- Struct data reader ---
 
 Common::SeekableReadStream *GFF4Struct::getData(uint32 field) const {
-	const Field *f;
+	Field f;
 	Common::SeekableReadStream *data = getField(field, f);
 	if (!data)
 		return 0;
 
-	const uint32 count = getListCount(*data, *f);
-	const uint32 size  = getFieldSize(f->type);
+	const uint32 count = getListCount(*data, f);
+	const uint32 size  = getFieldSize(f.type);
 
 	if ((size == 0) || (count == 0))
 		return 0;
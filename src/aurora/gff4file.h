@@ -26,11 +26,12 @@
 #define AURORA_GFF4FILE_H
 
 #include <vector>
-#include <map>
+#include <deque>
 
 #include "src/common/types.h"
 #include "src/common/ustring.h"
 #include "src/common/encoding.h"
+#include "src/common/hashindex.h"
 
 #include "src/aurora/types.h"
 #include "src/aurora/aurorafile.h"
@@ -38,136 +39,15 @@
 
 namespace Common {
 	class SeekableReadStream;
+	class MemoryReadStream;
+	class ReadCursor;
 }
 
 namespace Aurora {
 
-class GFF4Struct;
-
-/** A GFF (generic file format) V4.0/V4.1 file, found in Dragon Age: Origins,
- *  Dragon Age 2 and Sonic Chronicles: The Dark Brotherhood.
- *
- *  Just like GFF V3.2/V3.3 files, GFF V4.0/V4.1 store hierarchical data,
- *  similar in concept to XML and hold, for example, module and campaign
- *  descriptions. Unlike version 3 of the format, version 4 is optimized
- *  for access speed, with fields indexed by a numerical value instead of
- *  a human-readable string. A collection of currently known field values
- *  and their meanings can be found in gff4fields.h.
- *
- *  GFF V4.0/V4.1 files come in a multitude of types (ARE, DLG, ...), each
- *  with its own 4-byte type ID ('ARE ', 'DLG ', ...). When specified in
- *  the GFF4File constructor, the loader will enforce that it matches, and
- *  throw an exception should it not. Conversely, an ID of 0xFFFFFFFF means
- *  that no such type ID enforcement should be done. In both cases, the type
- *  ID read from the file can get access through getType().
- *
- *  Notes:
- *  - Generics and lists of generics are mapped to structs, with the field ID
- *    being the list element indices (or just 0 on non-list generics).
- *  - Strings are generally encoded in UTF-16LE. One exception is the TLK files
- *    in Sonic, which have strings in a language-specific encoding. For example,
- *    the English, French, Italian, German and Spanish (EFIGS) versions have
- *    the strings in TLK files encoded in Windows CP-1252.
- *
- *  See also: GFF3File in gff3file.h for the earlier V3.2/V3.3 versions of
- *  the GFF format.
- */
-class GFF4File : public AuroraFile {
-public:
-	/** Take over this stream and read a GFF4 file out of it. */
-	GFF4File(Common::SeekableReadStream *gff4, uint32 type = 0xFFFFFFFF);
-	~GFF4File();
-
-	/** Return the GFF4's specific type. */
-	uint32 getType() const;
-	/** Return the GFF4's specific type version. */
-	uint32 getTypeVersion() const;
-	/** Return the platform this GFF4 is for. */
-	uint32 getPlatform() const;
-
-	/** Returns the top-level struct. */
-	const GFF4Struct &getTopLevel() const;
-
-
-private:
-	/** A GFF4 header. */
-	struct Header {
-		uint32 platformID;   ///< ID of the platform this GFF4 is for.
-		uint32 type;         ///< The specific type this GFF4 describes.
-		uint32 typeVersion;  ///< The version of the specific type this GFF4 describes.
-		uint32 structCount;  ///< Number of struct templates in this GFF4.
-		uint32 stringCount;  ///< Number of shared strings (V4.1 only).
-		uint32 stringOffset; ///< Offset to shared strings (V4.1 only).
-		uint32 dataOffset;   ///< Offset to the data portion.
-
-		bool hasSharedStrings;
-
-		void read(Common::SeekableReadStream &gff4, uint32 version);
-	};
-
-	/** A template of a struct, used when loading a struct. */
-	struct StructTemplate {
-		struct Field {
-			uint32 label;
-			uint16 type;
-			uint16 flags;
-			uint32 offset;
-		};
-
-		uint32 index;
-		uint32 label;
-		uint32 size;
-
-		std::vector<Field> fields;
-	};
-
-	typedef std::vector<StructTemplate> StructTemplates;
-	typedef std::vector<Common::UString> SharedStrings;
-	typedef std::map<uint64, GFF4Struct *> StructMap;
-
-
-
-	Common::SeekableReadStream *_stream;
-
-	/** This GFF4's header. */
-	Header          _header;
-	/** All struct templates in this GFF4. */
-	StructTemplates _structTemplates;
-
-	/** The shared strings used in V4.1. */
-	SharedStrings _sharedStrings;
-
-	/** All actual structs in this GFF4. */
-	StructMap   _structs;
-	/** The top-level struct. */
-	GFF4Struct *_topLevelStruct;
-
-
-	// .--- Loading helpers
-	void load(uint32 type);
-	void loadHeader(uint32 type);
-	void loadStructs();
-	void loadStrings();
-
-	void clear();
-	// '---
-
-	// .--- Helper methods called by GFF4Struct
-	void registerStruct(uint64 id, GFF4Struct *strct);
-	void unregisterStruct(uint64 id);
-	GFF4Struct *findStruct(uint64 id);
-
-	Common::SeekableReadStream &getStream(uint32 offset) const;
-	const StructTemplate &getStructTemplate(uint32 i) const;
-	uint32 getDataOffset() const;
-
-	bool hasSharedStrings() const;
-	Common::UString getSharedString(uint32 i) const;
-	// '---
-
-	friend class GFF4Struct;
-};
+class GFF4File;
 
+/** A struct within a GFF4. */
 class GFF4Struct {
 public:
 	/** The type of a GFF4 field. */
@@ -198,7 +78,11 @@ public:
 
 	/** Return the struct's unique ID within the GFF4. */
 	uint64 getID() const;
-	/** Return the number of structs that refer to this struct. */
+	/** Return the number of structs that refer to this struct.
+	 *
+	 *  In a lazily loaded GFF4, only references from structs whose children
+	 *  have already been loaded are counted.
+	 */
 	uint32 getRefCount() const;
 
 	/** Return the struct's label.
@@ -322,60 +206,107 @@ private:
 		bool isReference; ///< Is this field a reference (pointer) to another field?
 		bool isGeneric;   ///< Is this field found in a generic?
 
-		uint16   structIndex; ///< Index of the field's struct type (if kFieldTypeStruct).
-		GFF4List structs;     ///< List of GFF4Struct (if kFieldTypeStruct).
+		uint16 structIndex; ///< Index of the field's struct type (if kFieldTypeStruct).
+		uint32 listIndex;   ///< Index of the field's list of structs within the struct, if any.
 
 		Field();
 		Field(uint32 l, uint16 t, uint16 f, uint32 o, bool g = false);
-		~Field();
 	};
 
-	typedef std::map<uint32, Field> FieldMap;
+	/** A template of a struct, shared by all structs of the same type.
+	 *
+	 *  All structs of a template have the same fields at the same offsets,
+	 *  so the fields are only stored once, here. A struct itself is then
+	 *  not much more than a template and an offset to its data.
+	 */
+	struct Template {
+		/** The declaration of a field in a struct template. */
+		struct Field {
+			uint32 label;
+			uint16 type;
+			uint16 flags;
+			uint32 offset;    ///< Offset of the field's data, relative to the struct's data.
+			uint32 listIndex; ///< Index of the field's list of structs, or 0xFFFFFFFF.
+		};
+
+		uint32 index;
+		uint32 label;
+		uint32 size;
+
+		/** Was this template made up for a generic? */
+		bool isGeneric;
+
+		std::vector<Field> fields;
+
+		/** The labels of all fields, in file order. */
+		std::vector<uint32> fieldLabels;
+		/** Indices into fields, sorted by label, without duplicate labels. */
+		std::vector<uint32> sortedFields;
+
+		/** The number of fields in a struct of this template. */
+		uint32 fieldCount;
+		/** The number of lists of structs a struct of this template holds. */
+		uint32 listCount;
+
+		Template();
+
+		/** Add a field, assigning it a list of structs if it needs one. */
+		void addField(uint32 label, uint16 type, uint16 flags, uint32 offset);
+		/** Create the field lookup table, once all fields have been added. */
+		void finalize();
+
+		/** Find the field with this label. */
+		const Field *findField(uint32 label) const;
+
+	private:
+		struct FieldLabelLess;
+	};
 
 
 	const GFF4File *_parent;
+	/** The template describing our fields. */
+	const Template *_template;
 
-	uint32 _label;
+	/** Offset of our data. The template's field offsets are relative to this. */
+	uint32 _offset;
 
 	uint64 _id;
 	uint32 _refCount;
 
-	size_t _fieldCount;
+	/** Index of our first list of structs in the GFF4's list array. */
+	uint32 _listStart;
 
-	FieldMap _fields;
-
-	/** The labels of all fields in this struct. */
-	std::vector<uint32> _fieldLabels;
+	/** Have the structs referenced by our fields been loaded? */
+	bool _loaded;
 
 
 	// .--- Loader
-	/** Load a GFF4 struct. */
-	GFF4Struct(GFF4File &parent, uint32 offset, const GFF4File::StructTemplate &tmplt);
-	/** Load a GFF4 generic as a struct. */
-	GFF4Struct(GFF4File &parent, const Field &genericParent);
-	~GFF4Struct();
-
-	void load(GFF4File &parent, uint32 offset, const GFF4File::StructTemplate &tmplt);
-	void loadStructs(GFF4File &parent, Field &field);
-	void loadGeneric(GFF4File &parent, Field &field);
+	GFF4Struct(const GFF4File &parent, uint64 id, uint32 offset, const Template &tmplt, uint32 listStart);
 
-	void load(GFF4File &parent, const Field &genericParent);
+	/** Load the structs and generics referenced by our fields, if not already done. */
+	void load(GFF4File &parent);
+	void loadStructs(GFF4File &parent, const Field &field);
+	void loadGeneric(GFF4File &parent, const Field &field);
 
-	static uint64 generateID(uint32 offset, const GFF4File::StructTemplate *tmplt = 0);
+	static uint64 generateID(uint32 offset, const Template *tmplt = 0);
 	// '---
 
 	// .--- Field and field data accessors
-	const Field *getField(uint32 field) const;
+	bool findField(uint32 field, Field &f) const;
 
 	uint32 getDataOffset(bool isReference, uint32 offset) const;
 	uint32 getDataOffset(const Field &field) const;
 
 	Common::SeekableReadStream *getData(const Field &field) const;
-	Common::SeekableReadStream *getField(uint32 fieldID, const Field *&field) const;
+	Common::SeekableReadStream *getField(uint32 fieldID, Field &field) const;
+
+	/** Return the list of structs held by this field, loading it if necessary. */
+	const GFF4List &getStructList(const Field &field) const;
 	// '---
 
 	// .--- Field reader helpers
-	uint32 getListCount(Common::SeekableReadStream &data, const Field &field) const;
+	template<typename T>
+	uint32 getListCount(T &data, const Field &field) const;
 	uint32 getFieldSize(FieldType type) const;
 
 	uint64 getUint(Common::SeekableReadStream &data, FieldType type) const;
@@ -397,6 +328,149 @@ private:
 	friend class GFF4File;
 };
 
+
+/** A GFF (generic file format) V4.0/V4.1 file, found in Dragon Age: Origins,
+ *  Dragon Age 2 and Sonic Chronicles: The Dark Brotherhood.
+ *
+ *  Just like GFF V3.2/V3.3 files, GFF V4.0/V4.1 store hierarchical data,
+ *  similar in concept to XML and hold, for example, module and campaign
+ *  descriptions. Unlike version 3 of the format, version 4 is optimized
+ *  for access speed, with fields indexed by a numerical value instead of
+ *  a human-readable string. A collection of currently known field values
+ *  and their meanings can be found in gff4fields.h.
+ *
+ *  GFF V4.0/V4.1 files come in a multitude of types (ARE, DLG, ...), each
+ *  with its own 4-byte type ID ('ARE ', 'DLG ', ...). When specified in
+ *  the GFF4File constructor, the loader will enforce that it matches, and
+ *  throw an exception should it not. Conversely, an ID of 0xFFFFFFFF means
+ *  that no such type ID enforcement should be done. In both cases, the type
+ *  ID read from the file can get access through getType().
+ *
+ *  Normally, all structs are loaded when the GFF4 is opened. In lazy mode,
+ *  only the top-level struct is loaded then. The structs and generics a
+ *  struct refers to are only loaded when getStruct(), getGeneric() or
+ *  getList() is first called on it. Structs referenced several times are
+ *  still only loaded once. This makes opening a large GFF4 cheap when only
+ *  parts of it are needed, but accessing the structs of a lazily loaded
+ *  GFF4 from several threads at once is not safe.
+ *
+ *  Notes:
+ *  - Generics and lists of generics are mapped to structs, with the field ID
+ *    being the list element indices (or just 0 on non-list generics).
+ *  - Strings are generally encoded in UTF-16LE. One exception is the TLK files
+ *    in Sonic, which have strings in a language-specific encoding. For example,
+ *    the English, French, Italian, German and Spanish (EFIGS) versions have
+ *    the strings in TLK files encoded in Windows CP-1252.
+ *
+ *  See also: GFF3File in gff3file.h for the earlier V3.2/V3.3 versions of
+ *  the GFF format.
+ */
+class GFF4File : public AuroraFile {
+public:
+	/** Take over this stream and read a GFF4 file out of it.
+	 *
+	 *  If lazy is true, structs are only loaded on first access.
+	 */
+	GFF4File(Common::SeekableReadStream *gff4, uint32 type = 0xFFFFFFFF, bool lazy = false);
+	~GFF4File();
+
+	/** Return the GFF4's specific type. */
+	uint32 getType() const;
+	/** Return the GFF4's specific type version. */
+	uint32 getTypeVersion() const;
+	/** Return the platform this GFF4 is for. */
+	uint32 getPlatform() const;
+
+	/** Returns the top-level struct. */
+	const GFF4Struct &getTopLevel() const;
+
+
+private:
+	/** A GFF4 header. */
+	struct Header {
+		uint32 platformID;   ///< ID of the platform this GFF4 is for.
+		uint32 type;         ///< The specific type this GFF4 describes.
+		uint32 typeVersion;  ///< The version of the specific type this GFF4 describes.
+		uint32 structCount;  ///< Number of struct templates in this GFF4.
+		uint32 stringCount;  ///< Number of shared strings (V4.1 only).
+		uint32 stringOffset; ///< Offset to shared strings (V4.1 only).
+		uint32 dataOffset;   ///< Offset to the data portion.
+
+		bool hasSharedStrings;
+
+		void read(Common::SeekableReadStream &gff4, uint32 version);
+	};
+
+	typedef GFF4Struct::Template StructTemplate;
+
+	typedef std::vector<StructTemplate> StructTemplates;
+	typedef std::deque<StructTemplate> GenericTemplates;
+	typedef std::vector<Common::UString> SharedStrings;
+	typedef std::deque<GFF4Struct> StructArray;
+	typedef std::deque<GFF4List> ListArray;
+
+
+
+	Common::MemoryReadStream *_stream;
+
+	/** This GFF4's header. */
+	Header          _header;
+	/** All struct templates in this GFF4. */
+	StructTemplates _structTemplates;
+	/** The templates made up for the generics in this GFF4, one per generic. */
+	GenericTemplates _genericTemplates;
+
+	/** The shared strings used in V4.1. */
+	SharedStrings _sharedStrings;
+
+	/** All actual structs in this GFF4. */
+	StructArray _structs;
+	/** The lists of structs held by the struct and generic fields of all structs. */
+	ListArray   _lists;
+	/** Index of positions within _structs, keyed by the struct ID. */
+	Common::HashIndex _structIndex;
+	/** The top-level struct. */
+	GFF4Struct *_topLevelStruct;
+
+	/** Only load structs when they're first accessed? */
+	bool _lazy;
+
+
+	// .--- Loading helpers
+	void load(uint32 type);
+	void loadHeader(uint32 type);
+	void loadStructs();
+	void loadStrings();
+
+	void clear();
+	// '---
+
+	// .--- Helper methods called by GFF4Struct
+	/** Load the struct at this offset, or return it if it has already been loaded. */
+	GFF4Struct *loadStruct(uint32 offset, const StructTemplate &tmplt);
+	/** Load the generic at this offset as a struct, or return it if it has already been loaded. */
+	GFF4Struct *loadGeneric(uint32 offset, bool isList, bool isReference);
+
+	const StructTemplate &createGenericTemplate(uint32 offset, bool isList, bool isReference);
+
+	GFF4Struct *findStruct(uint64 id);
+	GFF4Struct &addStruct(const GFF4Struct &strct);
+
+	Common::SeekableReadStream &getStream(uint32 offset) const;
+	/** Return a cursor over the GFF4 data. */
+	Common::ReadCursor getCursor(uint32 offset) const;
+	const StructTemplate &getStructTemplate(uint32 i) const;
+	uint32 getDataOffset() const;
+	/** Follow a reference to the data, if isReference is true. */
+	uint32 getDataOffset(bool isReference, uint32 offset) const;
+
+	bool hasSharedStrings() const;
+	Common::UString getSharedString(uint32 i) const;
+	// '---
+
+	friend class GFF4Struct;
+};
+
 } // End of namespace Aurora
 
 #endif // AURORA_GFF4FILE_H
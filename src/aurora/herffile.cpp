@@ -160,12 +160,7 @@ uint32 HERFFile::getResourceSize(uint32 index) const {
 Common::SeekableReadStream *HERFFile::getResource(uint32 index, bool tryNoCopy) const {
 	const IResource &res = getIResource(index);
 
-	if (tryNoCopy)
-		return new Common::SeekableSubReadStream(_herf, res.offset, res.offset + res.size);
-
-	_herf->seek(res.offset);
-
-	return _herf->readStream(res.size);
+	return getArchiveData(*_herf, res.offset, res.size, tryNoCopy);
 }
 
 Common::HashAlgo HERFFile::getNameHashAlgo() const {
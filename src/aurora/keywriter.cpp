@@ -0,0 +1,132 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's KEYs (resource index files).
+ */
+
+#include <cstring>
+#include <ctime>
+
+#include "src/common/util.h"
+#include "src/common/error.h"
+#include "src/common/writestream.h"
+#include "src/common/encoding.h"
+
+#include "src/aurora/keywriter.h"
+
+static const uint32 kKEYID     = MKTAG('K', 'E', 'Y', ' ');
+static const uint32 kVersion1  = MKTAG('V', '1', ' ', ' ');
+
+static const uint32 kHeaderSize = 64;
+static const uint32 kBIFSize    = 12;
+
+namespace Aurora {
+
+KEYWriter::KEYWriter() {
+}
+
+uint32 KEYWriter::addBIF(const Common::UString &fileName, uint32 fileSize) {
+	if (_bifs.size() >= 0xFFF)
+		throw Common::Exception("Too many BIF files in KEY");
+
+	_bifs.push_back(BIF());
+
+	_bifs.back().fileName = fileName;
+	_bifs.back().fileSize = fileSize;
+
+	return _bifs.size() - 1;
+}
+
+void KEYWriter::add(const Common::UString &name, FileType type, uint32 bifIndex, uint32 resIndex) {
+	if (type == kFileTypeNone)
+		throw Common::Exception("Resource \"%s\" has no valid type", name.c_str());
+
+	if (name.size() > 16)
+		throw Common::Exception("Resource name \"%s\" too long for KEY", name.c_str());
+
+	if (bifIndex >= _bifs.size())
+		throw Common::Exception("Invalid BIF index %u", bifIndex);
+
+	if (resIndex > 0xFFFFF)
+		throw Common::Exception("Invalid BIF resource index %u", resIndex);
+
+	_resources.push_back(Resource());
+
+	_resources.back().name = name;
+	_resources.back().type = type;
+	_resources.back().id   = (bifIndex << 20) | resIndex;
+}
+
+void KEYWriter::write(Common::WriteStream &stream) const {
+	const uint32 bifCount = _bifs.size();
+	const uint32 resCount = _resources.size();
+
+	// The BIF names directly follow the file table
+	uint32 namesSize = 0;
+	for (std::vector<BIF>::const_iterator b = _bifs.begin(); b != _bifs.end(); ++b)
+		namesSize += std::strlen(b->fileName.c_str()) + 1;
+
+	const uint32 offFileTable = kHeaderSize;
+	const uint32 offNames     = offFileTable + bifCount * kBIFSize;
+	const uint32 offResTable  = offNames + namesSize;
+
+	const std::time_t now = std::time(0);
+	const std::tm *date = std::gmtime(&now);
+
+	stream.writeUint32BE(kKEYID);
+	stream.writeUint32BE(kVersion1);
+
+	stream.writeUint32LE(bifCount);
+	stream.writeUint32LE(resCount);
+
+	stream.writeUint32LE(offFileTable);
+	stream.writeUint32LE(offResTable);
+
+	stream.writeUint32LE(date ? date->tm_year : 0);
+	stream.writeUint32LE(date ? date->tm_yday : 0);
+
+	for (size_t i = 0; i < 32; i++)
+		stream.writeByte(0); // Reserved
+
+	uint32 nameOffset = offNames;
+	for (std::vector<BIF>::const_iterator b = _bifs.begin(); b != _bifs.end(); ++b) {
+		const uint32 nameSize = std::strlen(b->fileName.c_str()) + 1;
+
+		stream.writeUint32LE(b->fileSize);
+		stream.writeUint32LE(nameOffset);
+		stream.writeUint16LE(nameSize);
+		stream.writeUint16LE(0x0001); // Location of the bif: HD
+
+		nameOffset += nameSize;
+	}
+
+	for (std::vector<BIF>::const_iterator b = _bifs.begin(); b != _bifs.end(); ++b)
+		Common::writeString(stream, b->fileName, Common::kEncodingASCII, true);
+
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r) {
+		Common::writeStringFixed(stream, r->name, Common::kEncodingASCII, 16);
+
+		stream.writeUint16LE((uint16) r->type);
+		stream.writeUint32LE(r->id);
+	}
+}
+
+} // End of namespace Aurora
@@ -0,0 +1,82 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's KEYs (resource index files).
+ */
+
+#ifndef AURORA_KEYWRITER_H
+#define AURORA_KEYWRITER_H
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/ustring.h"
+
+#include "src/aurora/types.h"
+
+namespace Common {
+	class WriteStream;
+}
+
+namespace Aurora {
+
+/** Class to write V1 KEY files.
+ *
+ *  A KEY file only holds the names and types of the resources, and where
+ *  to find them within the BIF files it indexes. The BIF files themselves
+ *  are written by BIFWriter.
+ *
+ *  See also class KEYFile in keyfile.h.
+ */
+class KEYWriter {
+public:
+	KEYWriter();
+
+	/** Add a BIF file with this name (relative to the KEY) and size. Return its index. */
+	uint32 addBIF(const Common::UString &fileName, uint32 fileSize);
+
+	/** Add a resource, found at the resIndex-th entry of the bifIndex-th BIF file. */
+	void add(const Common::UString &name, FileType type, uint32 bifIndex, uint32 resIndex);
+
+	/** Write the complete KEY file. */
+	void write(Common::WriteStream &stream) const;
+
+private:
+	/** A BIF file indexed by the KEY. */
+	struct BIF {
+		Common::UString fileName; ///< The BIF's file name.
+		uint32 fileSize;          ///< The BIF's file size.
+	};
+
+	/** A resource within the KEY. */
+	struct Resource {
+		Common::UString name; ///< The resource's name, without extension.
+		FileType type;        ///< The resource's type.
+		uint32 id;            ///< The resource's ID, its BIF and index within that BIF.
+	};
+
+	std::vector<BIF>      _bifs;
+	std::vector<Resource> _resources;
+};
+
+} // End of namespace Aurora
+
+#endif // AURORA_KEYWRITER_H
@@ -114,12 +114,7 @@ uint32 RIMFile::getResourceSize(uint32 index) const {
 Common::SeekableReadStream *RIMFile::getResource(uint32 index, bool tryNoCopy) const {
 	const IResource &res = getIResource(index);
 
-	if (tryNoCopy)
-		return new Common::SeekableSubReadStream(_rim, res.offset, res.offset + res.size);
-
-	_rim->seek(res.offset);
-
-	return _rim->readStream(res.size);
+	return getArchiveData(*_rim, res.offset, res.size, tryNoCopy);
 }
 
 } // End of namespace Aurora
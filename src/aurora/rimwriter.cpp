@@ -0,0 +1,94 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's RIMs (resource archives).
+ */
+
+#include "src/common/util.h"
+#include "src/common/error.h"
+#include "src/common/writestream.h"
+#include "src/common/encoding.h"
+
+#include "src/aurora/rimwriter.h"
+
+static const uint32 kRIMID     = MKTAG('R', 'I', 'M', ' ');
+static const uint32 kVersion1  = MKTAG('V', '1', '.', '0');
+
+static const uint32 kHeaderSize = 120;
+static const uint32 kResSize    =  32;
+
+namespace Aurora {
+
+RIMWriter::RIMWriter() : _dataSize(0) {
+}
+
+size_t RIMWriter::getResourceCount() const {
+	return _resources.size();
+}
+
+void RIMWriter::add(const Common::UString &name, FileType type, uint32 size) {
+	if (type == kFileTypeNone)
+		throw Common::Exception("Resource \"%s\" has no valid type", name.c_str());
+
+	if (name.size() > 16)
+		throw Common::Exception("Resource name \"%s\" too long for RIM", name.c_str());
+
+	_resources.push_back(Resource());
+
+	_resources.back().name = name;
+	_resources.back().type = type;
+	_resources.back().size = size;
+
+	_dataSize += size;
+}
+
+void RIMWriter::write(Common::WriteStream &stream) const {
+	const uint32 resCount = _resources.size();
+
+	const uint64 offset = kHeaderSize + (uint64)resCount * kResSize;
+	if ((offset + _dataSize) > 0xFFFFFFFF)
+		throw Common::Exception("RIM too big: resource data exceeds 4GB");
+
+	stream.writeUint32BE(kRIMID);
+	stream.writeUint32BE(kVersion1);
+
+	stream.writeUint32LE(0);           // Reserved
+	stream.writeUint32LE(resCount);    // Number of resources in the RIM
+	stream.writeUint32LE(kHeaderSize); // Offset to the resource list
+
+	for (uint32 i = 20; i < kHeaderSize; i++)
+		stream.writeByte(0);             // Reserved
+
+	uint32 dataOffset = offset;
+	uint32 index      = 0;
+	for (std::vector<Resource>::const_iterator r = _resources.begin(); r != _resources.end(); ++r, ++index) {
+		Common::writeStringFixed(stream, r->name, Common::kEncodingASCII, 16);
+
+		stream.writeUint32LE((uint32) r->type);
+		stream.writeUint32LE(index);     // Resource ID
+		stream.writeUint32LE(dataOffset);
+		stream.writeUint32LE(r->size);
+
+		dataOffset += r->size;
+	}
+}
+
+} // End of namespace Aurora
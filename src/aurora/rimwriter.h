@@ -0,0 +1,78 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Writing BioWare's RIMs (resource archives).
+ */
+
+#ifndef AURORA_RIMWRITER_H
+#define AURORA_RIMWRITER_H
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/ustring.h"
+
+#include "src/aurora/types.h"
+
+namespace Common {
+	class WriteStream;
+}
+
+namespace Aurora {
+
+/** Class to write RIM archive files.
+ *
+ *  Just like with ERFWriter, first add() all resources, then write() the
+ *  header and resource table, and afterwards write the data of all
+ *  resources, in the order they were added.
+ *
+ *  See also class RIMFile in rimfile.h.
+ */
+class RIMWriter {
+public:
+	RIMWriter();
+
+	/** Return the number of resources added to this RIM. */
+	size_t getResourceCount() const;
+
+	/** Add a resource with this name (without extension), type and size. */
+	void add(const Common::UString &name, FileType type, uint32 size);
+
+	/** Write the RIM header and resource table. */
+	void write(Common::WriteStream &stream) const;
+
+private:
+	/** A resource within the RIM. */
+	struct Resource {
+		Common::UString name; ///< The resource's name, without extension.
+		FileType type;        ///< The resource's type.
+		uint32 size;          ///< The resource's size.
+	};
+
+	std::vector<Resource> _resources;
+
+	/** The total size of all resource data. */
+	uint64 _dataSize;
+};
+
+} // End of namespace Aurora
+
+#endif // AURORA_RIMWRITER_H
@@ -116,7 +116,7 @@ void TalkTable_GFF::load(Common::SeekableReadStream *tlk) {
 	assert(tlk);
 
 	try {
-		_gff = new GFF4File(tlk, kTLKID);
+		_gff = new GFF4File(tlk, kTLKID, true);
 
 		const GFF4Struct &top = _gff->getTopLevel();
 
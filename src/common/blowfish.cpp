@@ -27,6 +27,7 @@
 #include "src/common/util.h"
 #include "src/common/error.h"
 #include "src/common/memreadstream.h"
+#include "src/common/jobqueue.h"
 #include "src/common/blowfish.h"
 
 namespace Common {
@@ -231,44 +232,44 @@ static const uint32 S[4][256] = {
 	}
 };
 
-static uint32 F(const BlowfishContext &ctx, uint32 x) {
-	const uint16 d = (uint16)(x & 0xFF);
-	x >>= 8;
-	const uint16 c = (uint16)(x & 0xFF);
-	x >>= 8;
-	const uint16 b = (uint16)(x & 0xFF);
-	x >>= 8;
-	const uint16 a = (uint16)(x & 0xFF);
-
-	return ((ctx.S[0][a] + ctx.S[1][b]) ^ ctx.S[2][c]) + ctx.S[3][d];
+static inline uint32 F(const BlowfishContext &ctx, uint32 x) {
+	return ((ctx.S[0][ x >> 24        ] + ctx.S[1][(x >> 16) & 0xFF]) ^
+	         ctx.S[2][(x >>  8) & 0xFF]) + ctx.S[3][ x        & 0xFF];
 }
 
-static void blowfishEnc(BlowfishContext &ctx, uint32 &xl, uint32 &xr) {
-	for (size_t i = 0; i < kRoundCount; i++) {
-		xl = xl ^ ctx.P[i];
-		xr = F(ctx, xl) ^ xr;
+/* The encryption and decryption functions do two rounds per iteration. This
+ * way, the two halves of the block never need to be swapped between rounds. */
 
-		SWAP(xl, xr);
-	}
+static inline void blowfishEnc(const BlowfishContext &ctx, uint32 &xl, uint32 &xr) {
+	uint32 l = xl;
+	uint32 r = xr;
 
-	SWAP(xl, xr);
+	for (size_t i = 0; i < kRoundCount; i += 2) {
+		l ^= ctx.P[i];
+		r ^= F(ctx, l);
 
-	xr = xr ^ ctx.P[kRoundCount];
-	xl = xl ^ ctx.P[kRoundCount + 1];
+		r ^= ctx.P[i + 1];
+		l ^= F(ctx, r);
+	}
+
+	xl = r ^ ctx.P[kRoundCount + 1];
+	xr = l ^ ctx.P[kRoundCount];
 }
 
-static void blowfishDec(BlowfishContext &ctx, uint32 &xl, uint32 &xr) {
-	for (size_t i = kRoundCount + 1; i > 1; i--) {
-		xl = xl ^ ctx.P[i];
-		xr = F(ctx, xl) ^ xr;
+static inline void blowfishDec(const BlowfishContext &ctx, uint32 &xl, uint32 &xr) {
+	uint32 l = xl;
+	uint32 r = xr;
 
-		SWAP(xl, xr);
-	}
+	for (size_t i = kRoundCount + 1; i > 1; i -= 2) {
+		l ^= ctx.P[i];
+		r ^= F(ctx, l);
 
-	SWAP(xl, xr);
+		r ^= ctx.P[i - 1];
+		l ^= F(ctx, r);
+	}
 
-	xr = xr ^ ctx.P[1];
-	xl = xl ^ ctx.P[0];
+	xl = r ^ ctx.P[0];
+	xr = l ^ ctx.P[1];
 }
 
 static void blowfishSetKey(BlowfishContext &ctx, const byte *key, size_t keyLength) {
@@ -313,53 +314,151 @@ static void blowfishSetKey(BlowfishContext &ctx, const byte *key, size_t keyLeng
 	}
 }
 
-static void blowfishECB(BlowfishContext &ctx, Mode mode, const byte *input, byte *output) {
-	uint32 X0 = READ_BE_UINT32(input);
-	uint32 X1 = READ_BE_UINT32(input + 4);
+/** Encrypt or decrypt blockCount consecutive blocks. input and output may be the same. */
+static void blowfishECB(const BlowfishContext &ctx, Mode mode, const byte *input, byte *output,
+                        size_t blockCount) {
+
+	if (mode == kModeDecrypt) {
+		for (size_t i = 0; i < blockCount; i++, input += kBlockSize, output += kBlockSize) {
+			uint32 X0 = READ_BE_UINT32(input);
+			uint32 X1 = READ_BE_UINT32(input + 4);
 
-	switch (mode) {
-		case kModeDecrypt:
 			blowfishDec(ctx, X0, X1);
-			break;
-		case kModeEncrypt:
-			blowfishEnc(ctx, X0, X1);
-			break;
 
-		default:
-			assert(false);
+			WRITE_BE_UINT32(output    , X0);
+			WRITE_BE_UINT32(output + 4, X1);
+		}
+
+		return;
 	}
 
-	WRITE_BE_UINT32(output    , X0);
-	WRITE_BE_UINT32(output + 4, X1);
+	assert(mode == kModeEncrypt);
+
+	for (size_t i = 0; i < blockCount; i++, input += kBlockSize, output += kBlockSize) {
+		uint32 X0 = READ_BE_UINT32(input);
+		uint32 X1 = READ_BE_UINT32(input + 4);
+
+		blowfishEnc(ctx, X0, X1);
+
+		WRITE_BE_UINT32(output    , X0);
+		WRITE_BE_UINT32(output + 4, X1);
+	}
 }
 // '--- Blowfish, based on the implementation from mbed TLS ---'
 
-MemoryReadStream *blowfishEBC(SeekableReadStream &input, const std::vector<byte> &key, Mode mode) {
-	BlowfishContext ctx;
+BlowfishKey::BlowfishKey(const std::vector<byte> &key) : _context(new BlowfishContext) {
+	try {
+		// blowfishSetKey() throws on an empty key before touching it
+		blowfishSetKey(*_context, key.empty() ? 0 : &key[0], key.size());
+	} catch (...) {
+		delete _context;
+		throw;
+	}
+}
+
+BlowfishKey::BlowfishKey(const byte *key, size_t keyLength) : _context(new BlowfishContext) {
+	try {
+		blowfishSetKey(*_context, key, keyLength);
+	} catch (...) {
+		delete _context;
+		throw;
+	}
+}
+
+BlowfishKey::~BlowfishKey() {
+	delete _context;
+}
 
-	blowfishSetKey(ctx, &key[0], key.size());
+/** The number of blocks in one chunk processed by one job of a BlowfishJobs queue. */
+static const size_t kChunkBlockCount = (256 * 1024) / kBlockSize;
+
+/** Encrypting or decrypting big data in parallel, one job per chunk. */
+class BlowfishJobs : public JobQueue {
+public:
+	BlowfishJobs(const BlowfishContext &ctx, Mode mode, const byte *input, byte *output, size_t blockCount) :
+		_ctx(&ctx), _mode(mode), _input(input), _output(output), _blockCount(blockCount) {
+
+	}
+
+	static size_t getJobCount(size_t blockCount) {
+		return (blockCount + kChunkBlockCount - 1) / kChunkBlockCount;
+	}
+
+protected:
+	void runJob(size_t job) {
+		const size_t offset = job * kChunkBlockCount;
+		const size_t count  = MIN<size_t>(_blockCount - offset, kChunkBlockCount);
+
+		blowfishECB(*_ctx, _mode, _input + offset * kBlockSize, _output + offset * kBlockSize, count);
+	}
 
-	size_t inputSize = input.size() - input.pos();
+private:
+	const BlowfishContext *_ctx;
+
+	Mode _mode;
+
+	const byte *_input;
+	byte *_output;
+
+	size_t _blockCount;
+};
+
+static void blowfishEBC(const BlowfishContext &ctx, const byte *input, byte *output, size_t size,
+                        Mode mode, size_t threadCount) {
+
+	if ((size % kBlockSize) != 0)
+		throw Exception("Blowfish operates on blocks of 8 bytes (%u)", (uint) size);
+
+	const size_t blockCount = size / kBlockSize;
+	const size_t jobCount   = BlowfishJobs::getJobCount(blockCount);
+
+	if ((threadCount <= 1) || (jobCount <= 1)) {
+		blowfishECB(ctx, mode, input, output, blockCount);
+		return;
+	}
+
+	BlowfishJobs jobs(ctx, mode, input, output, blockCount);
+
+	jobs.run(jobCount, threadCount);
+}
+
+static void blowfishEBC(const byte *input, byte *output, size_t size, const std::vector<byte> &key,
+                        Mode mode, size_t threadCount) {
+
+	const BlowfishKey blowfishKey(key);
+
+	if (mode == kModeDecrypt)
+		blowfishKey.decrypt(input, output, size, threadCount);
+	else
+		blowfishKey.encrypt(input, output, size, threadCount);
+}
+
+static MemoryReadStream *blowfishEBC(SeekableReadStream &input, const std::vector<byte> &key,
+                                     Mode mode, size_t threadCount) {
+
+	const size_t inputSize = input.size() - input.pos();
 
 	// Round up to the next multiple of the block size
 	const size_t outputSize = ((inputSize + kBlockSize - 1) / kBlockSize) * kBlockSize;
 	byte *output = new byte[outputSize];
 
 	try {
-		byte buffer[kBlockSize];
-		byte *data = output;
-		while (inputSize > 0) {
-			const size_t toRead = MIN<size_t>(inputSize, kBlockSize);
+		MemoryReadStream *memoryInput = dynamic_cast<MemoryReadStream *>(&input);
 
-			if (input.read(buffer, toRead) != toRead)
-				throw Exception(kReadError);
+		if (memoryInput && (inputSize == outputSize)) {
+			// Process the data straight out of the input stream's memory
+			blowfishEBC(memoryInput->getData() + memoryInput->pos(), output, outputSize, key, mode, threadCount);
 
-			std::memset(buffer + toRead, 0, kBlockSize - toRead);
+			memoryInput->seek(0, SeekableReadStream::kOriginEnd);
+
+		} else {
+			// Read the data into the output buffer, and then process it in place
+			if (input.read(output, inputSize) != inputSize)
+				throw Exception(kReadError);
 
-			blowfishECB(ctx, mode, buffer, data);
+			std::memset(output + inputSize, 0, outputSize - inputSize);
 
-			data      += toRead;
-			inputSize -= toRead;
+			blowfishEBC(output, output, outputSize, key, mode, threadCount);
 		}
 
 	} catch (...) {
@@ -370,15 +469,39 @@ MemoryReadStream *blowfishEBC(SeekableReadStream &input, const std::vector<byte>
 	return new MemoryReadStream(output, outputSize, true);
 }
 
-MemoryReadStream *encryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key) {
-	return blowfishEBC(input, key, kModeEncrypt);
+MemoryReadStream *encryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key,
+                                     size_t threadCount) {
+
+	return blowfishEBC(input, key, kModeEncrypt, threadCount);
 }
 
-MemoryReadStream *decryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key) {
+MemoryReadStream *decryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key,
+                                     size_t threadCount) {
+
 	if ((input.size() % 8) != 0)
 		throw Exception("Blowfish operates on blocks of 8 bytes (%u)", (uint) input.size());
 
-	return blowfishEBC(input, key, kModeDecrypt);
+	return blowfishEBC(input, key, kModeDecrypt, threadCount);
+}
+
+void BlowfishKey::encrypt(const byte *input, byte *output, size_t size, size_t threadCount) const {
+	blowfishEBC(*_context, input, output, size, kModeEncrypt, threadCount);
+}
+
+void BlowfishKey::decrypt(const byte *input, byte *output, size_t size, size_t threadCount) const {
+	blowfishEBC(*_context, input, output, size, kModeDecrypt, threadCount);
+}
+
+void encryptBlowfishEBC(const byte *input, byte *output, size_t size, const std::vector<byte> &key,
+                        size_t threadCount) {
+
+	blowfishEBC(input, output, size, key, kModeEncrypt, threadCount);
+}
+
+void decryptBlowfishEBC(const byte *input, byte *output, size_t size, const std::vector<byte> &key,
+                        size_t threadCount) {
+
+	blowfishEBC(input, output, size, key, kModeDecrypt, threadCount);
 }
 
 } // End of namespace Common
@@ -28,16 +28,85 @@
 #include <vector>
 
 #include "src/common/types.h"
+#include "src/common/noncopyable.h"
 
 namespace Common {
 
 class SeekableReadStream;
 class MemoryReadStream;
 
-/** Encrypt the stream with the Blowfish algorithm in EBC mode. */
-MemoryReadStream *encryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key);
-/** Decrypt the stream with the Blowfish algorithm in EBC mode. */
-MemoryReadStream *decryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key);
+struct BlowfishContext;
+
+/** A Blowfish key, together with its precomputed key schedule.
+ *
+ *  Setting up the key schedule is costly: it takes 521 encryptions of a block.
+ *  When the same key is used over and over again, for example when trying a
+ *  list of known keys on many files, it's worth keeping a BlowfishKey around.
+ */
+class BlowfishKey : public NonCopyable {
+public:
+	BlowfishKey(const std::vector<byte> &key);
+	BlowfishKey(const byte *key, size_t keyLength);
+	~BlowfishKey();
+
+	/** Encrypt data in EBC mode. See encryptBlowfishEBC(). */
+	void encrypt(const byte *input, byte *output, size_t size, size_t threadCount = 1) const;
+	/** Decrypt data in EBC mode. See decryptBlowfishEBC(). */
+	void decrypt(const byte *input, byte *output, size_t size, size_t threadCount = 1) const;
+
+private:
+	BlowfishContext *_context;
+};
+
+/** Encrypt the stream with the Blowfish algorithm in EBC mode.
+ *
+ *  The stream is encrypted from its current position to its end. If that's not
+ *  a multiple of the block size of 8 bytes, the last block is padded with 0.
+ *
+ *  With more than one thread, big streams are split into chunks that are
+ *  encrypted in parallel. See encryptBlowfishEBC() below.
+ */
+MemoryReadStream *encryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key,
+                                     size_t threadCount = 1);
+/** Decrypt the stream with the Blowfish algorithm in EBC mode.
+ *
+ *  The stream is decrypted from its current position to its end. The stream's
+ *  size needs to be a multiple of the block size of 8 bytes.
+ *
+ *  With more than one thread, big streams are split into chunks that are
+ *  decrypted in parallel. See decryptBlowfishEBC() below.
+ */
+MemoryReadStream *decryptBlowfishEBC(SeekableReadStream &input, const std::vector<byte> &key,
+                                     size_t threadCount = 1);
+
+/** Encrypt data with the Blowfish algorithm in EBC mode.
+ *
+ *  Every block of 8 bytes is encrypted independently, so big data can be split
+ *  into chunks that are encrypted by threadCount threads in parallel.
+ *
+ *  @param input       The data to encrypt.
+ *  @param output      The buffer to write the encrypted data into. Can be the
+ *                     same as input, to encrypt the data in place.
+ *  @param size        The size of the data. Needs to be a multiple of 8.
+ *  @param key         The key to encrypt with.
+ *  @param threadCount The maximum number of threads to use.
+ */
+void encryptBlowfishEBC(const byte *input, byte *output, size_t size, const std::vector<byte> &key,
+                        size_t threadCount = 1);
+/** Decrypt data with the Blowfish algorithm in EBC mode.
+ *
+ *  Every block of 8 bytes is decrypted independently, so big data can be split
+ *  into chunks that are decrypted by threadCount threads in parallel.
+ *
+ *  @param input       The data to decrypt.
+ *  @param output      The buffer to write the decrypted data into. Can be the
+ *                     same as input, to decrypt the data in place.
+ *  @param size        The size of the data. Needs to be a multiple of 8.
+ *  @param key         The key to decrypt with.
+ *  @param threadCount The maximum number of threads to use.
+ */
+void decryptBlowfishEBC(const byte *input, byte *output, size_t size, const std::vector<byte> &key,
+                        size_t threadCount = 1);
 
 } // End of namespace Common
 
@@ -22,10 +22,14 @@
  *  Compress (deflate) and decompress (inflate) using zlib's DEFLATE algorithm.
  */
 
+#include <cassert>
+#include <cstring>
+
 #include <zlib.h>
 
 #include "src/common/deflate.h"
 #include "src/common/error.h"
+#include "src/common/util.h"
 #include "src/common/memreadstream.h"
 
 namespace Common {
@@ -103,4 +107,312 @@ SeekableReadStream *decompressDeflate(ReadStream &input, size_t inputSize,
 	return new MemoryReadStream(decompressedData, outputSize, true);
 }
 
+byte *compressDeflate(const byte *data, size_t inputSize, size_t &outputSize,
+                      int windowBits, int level) {
+
+	/* Initialize the zlib data stream for compression with our input data.
+	 * See decompressDeflate() above for why the const cast is necessary. */
+
+	z_stream strm;
+	strm.zalloc   = Z_NULL;
+	strm.zfree    = Z_NULL;
+	strm.opaque   = Z_NULL;
+	strm.avail_in = inputSize;
+	strm.next_in  = const_cast<byte *>(data);
+
+	int zResult = deflateInit2(&strm, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+	if (zResult != Z_OK) {
+		deflateEnd(&strm);
+
+		throw Exception("Could not initialize zlib deflate: %s (%d)", zError(zResult), zResult);
+	}
+
+	// The compressed data is guaranteed to fit into this much space
+	const size_t maxOutputSize = deflateBound(&strm, inputSize);
+
+	byte *compressedData = new byte[maxOutputSize];
+
+	strm.avail_out = maxOutputSize;
+	strm.next_out  = compressedData;
+
+	// Compress. Z_FINISH, because we want to compress the whole thing in one go.
+	zResult = deflate(&strm, Z_FINISH);
+
+	if (zResult != Z_STREAM_END) {
+		deflateEnd(&strm);
+		delete[] compressedData;
+
+		throw Exception("Failed to deflate: %s (%d)", zError(zResult), zResult);
+	}
+
+	outputSize = maxOutputSize - strm.avail_out;
+
+	deflateEnd(&strm);
+	return compressedData;
+}
+
+
+/** Size of the decompressed data window of an InflateReadStream. */
+static const size_t kInflateWindowSize = 64 * 1024;
+/** Size of the chunks of compressed data fed to zlib from a non-memory input stream. */
+static const size_t kInflateInputSize  = 16 * 1024;
+/** Maximum size of the chunks of compressed data fed to zlib from a memory input stream. */
+static const size_t kInflateMemoryInputSize = 0x40000000;
+
+struct InflateReadStream::ZStream {
+	z_stream strm;
+};
+
+InflateReadStream::InflateReadStream(SeekableReadStream *input, size_t inputSize, size_t outputSize,
+                                     int windowBits, bool disposeInput) :
+	_input(input), _disposeInput(disposeInput), _inputStart(0), _inputSize(inputSize), _inputPos(0),
+	_inputMemory(0), _inputBuffer(0), _windowBits(windowBits), _zStream(0), _streamEnd(false),
+	_size(outputSize), _pos(0), _eos(false), _window(0), _windowStart(0), _windowSize(0) {
+
+	assert(_input);
+
+	try {
+		_inputStart = _input->pos();
+		if ((_inputStart > _input->size()) || (_inputSize > (_input->size() - _inputStart)))
+			throw Exception(kReadError);
+
+		MemoryReadStream *memory = dynamic_cast<MemoryReadStream *>(_input);
+		if (memory)
+			_inputMemory = memory->getData() + _inputStart;
+		else
+			_inputBuffer = new byte[kInflateInputSize];
+
+		_window = new byte[kInflateWindowSize];
+
+		initZStream();
+
+	} catch (...) {
+		delete[] _window;
+		delete[] _inputBuffer;
+
+		if (_disposeInput)
+			delete _input;
+
+		throw;
+	}
+}
+
+InflateReadStream::~InflateReadStream() {
+	if (_zStream)
+		inflateEnd(&_zStream->strm);
+
+	delete _zStream;
+
+	delete[] _window;
+	delete[] _inputBuffer;
+
+	if (_disposeInput)
+		delete _input;
+}
+
+void InflateReadStream::initZStream() {
+	_zStream = new ZStream;
+
+	z_stream &strm = _zStream->strm;
+	std::memset(&strm, 0, sizeof(strm));
+
+	strm.zalloc = Z_NULL;
+	strm.zfree  = Z_NULL;
+	strm.opaque = Z_NULL;
+
+	const int zResult = inflateInit2(&strm, _windowBits);
+	if (zResult != Z_OK) {
+		inflateEnd(&strm);
+
+		delete _zStream;
+		_zStream = 0;
+
+		throw Exception("Could not initialize zlib inflate: %s (%d)", zError(zResult), zResult);
+	}
+}
+
+void InflateReadStream::rewind() {
+	z_stream &strm = _zStream->strm;
+
+	const int zResult = inflateReset(&strm);
+	if (zResult != Z_OK)
+		throw Exception("Could not reset zlib inflate: %s (%d)", zError(zResult), zResult);
+
+	strm.avail_in = 0;
+	strm.next_in  = Z_NULL;
+
+	_inputPos  = 0;
+	_streamEnd = false;
+
+	_windowStart = 0;
+	_windowSize  = 0;
+}
+
+void InflateReadStream::feedInput() {
+	z_stream &strm = _zStream->strm;
+
+	if (_inputPos >= _inputSize)
+		throw Exception("Failed to inflate: premature end of input data");
+
+	if (_inputMemory) {
+		const size_t chunkSize = MIN(kInflateMemoryInputSize, _inputSize - _inputPos);
+
+		/* The zlib API wants a non-const next_in pointer. See the comment
+		 * in decompressDeflate() above. */
+		strm.avail_in = chunkSize;
+		strm.next_in  = const_cast<byte *>(_inputMemory + _inputPos);
+
+		_inputPos += chunkSize;
+
+	} else {
+		const size_t chunkSize = MIN(kInflateInputSize, _inputSize - _inputPos);
+
+		_input->seek(_inputStart + _inputPos);
+		if (_input->read(_inputBuffer, chunkSize) != chunkSize)
+			throw Exception(kReadError);
+
+		strm.avail_in = chunkSize;
+		strm.next_in  = _inputBuffer;
+
+		_inputPos += chunkSize;
+	}
+}
+
+bool InflateReadStream::fillWindow() {
+	_windowStart += _windowSize;
+	_windowSize   = 0;
+
+	if (_streamEnd)
+		return false;
+
+	size_t windowSize = kInflateWindowSize;
+	if (_size != kSizeInvalid)
+		windowSize = MIN(windowSize, _size - _windowStart);
+
+	if (windowSize == 0) {
+		checkStreamEnd();
+		return false;
+	}
+
+	z_stream &strm = _zStream->strm;
+
+	strm.avail_out = windowSize;
+	strm.next_out  = _window;
+
+	while ((strm.avail_out > 0) && !_streamEnd) {
+		if (strm.avail_in == 0)
+			feedInput();
+
+		const int zResult = inflate(&strm, Z_NO_FLUSH);
+		if (zResult == Z_STREAM_END)
+			_streamEnd = true;
+		else if (zResult != Z_OK)
+			throw Exception("Failed to inflate: %s (%d)", zError(zResult), zResult);
+	}
+
+	_windowSize = windowSize - strm.avail_out;
+
+	// Did the compressed data end before we got everything we were promised?
+	if (_streamEnd && (_size != kSizeInvalid) && ((_windowStart + _windowSize) < _size))
+		throw Exception("Failed to inflate: output buffer not completely filled");
+
+	// Or does it go on after that?
+	if ((_size != kSizeInvalid) && ((_windowStart + _windowSize) == _size))
+		checkStreamEnd();
+
+	return _windowSize > 0;
+}
+
+void InflateReadStream::checkStreamEnd() {
+	if (_streamEnd || (_size == kSizeInvalid))
+		return;
+
+	z_stream &strm = _zStream->strm;
+
+	// Any byte zlib still gives us here is one more than we were promised
+	byte overflow;
+
+	while (!_streamEnd) {
+		if (strm.avail_in == 0)
+			feedInput();
+
+		strm.avail_out = 1;
+		strm.next_out  = &overflow;
+
+		const int zResult = inflate(&strm, Z_NO_FLUSH);
+		if (strm.avail_out == 0)
+			throw Exception("Failed to inflate: premature end of output buffer");
+
+		if (zResult == Z_STREAM_END)
+			_streamEnd = true;
+		else if (zResult != Z_OK)
+			throw Exception("Failed to inflate: %s (%d)", zError(zResult), zResult);
+	}
+}
+
+bool InflateReadStream::eos() const {
+	return _eos;
+}
+
+size_t InflateReadStream::read(void *dataPtr, size_t dataSize) {
+	assert(dataPtr);
+
+	byte *data = reinterpret_cast<byte *>(dataPtr);
+
+	size_t haveRead = 0;
+	while (haveRead < dataSize) {
+		// If the current position is outside the window, we need to decompress more data
+		if ((_pos < _windowStart) || (_pos >= (_windowStart + _windowSize))) {
+			if (_pos < _windowStart)
+				rewind();
+
+			bool haveData = true;
+			while (haveData && (_pos >= (_windowStart + _windowSize)))
+				haveData = fillWindow();
+
+			if (!haveData) {
+				_eos = true;
+				break;
+			}
+		}
+
+		const size_t windowOffset = _pos - _windowStart;
+		const size_t toCopy = MIN(dataSize - haveRead, _windowSize - windowOffset);
+
+		std::memcpy(data + haveRead, _window + windowOffset, toCopy);
+
+		haveRead += toCopy;
+		_pos     += toCopy;
+	}
+
+	return haveRead;
+}
+
+size_t InflateReadStream::pos() const {
+	return _pos;
+}
+
+size_t InflateReadStream::size() const {
+	return _size;
+}
+
+size_t InflateReadStream::seek(ptrdiff_t offset, Origin whence) {
+	if ((whence == kOriginEnd) && (_size == kSizeInvalid))
+		throw Exception(kSeekError);
+
+	const size_t oldPos = _pos;
+	const size_t newPos = evalSeek(offset, whence, _pos, 0, _size);
+	if ((_size != kSizeInvalid) && (newPos > _size))
+		throw Exception(kSeekError);
+
+	/* We only move the position here. The data will be decompressed
+	 * on the next read, where we also find out if we're past the end. */
+	_pos = newPos;
+
+	// Reset end-of-stream flag on a successful seek
+	_eos = false;
+
+	return oldPos;
+}
+
 } // End of namespace Common
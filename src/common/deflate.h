@@ -26,21 +26,16 @@
 #define COMMON_DEFLATE_H
 
 #include "src/common/types.h"
+#include "src/common/readstream.h"
+#include "src/common/noncopyable.h"
 
 namespace Common {
 
-/* TODO (should be need it):
- * - Compression
- * - Decompress dynamically, without needing to know the size
- *   of the decompressed data beforehand
- */
-
-class ReadStream;
-class SeekableReadStream;
-
 static const int kWindowBitsMax    =  15;
 static const int kWindowBitsMaxRaw = -kWindowBitsMax;
 
+static const int kCompressionLevelMax = 9;
+
 /** Decompress (inflate) using zlib's DEFLATE algorithm.
  *
  *  @param  data       The compressed input data.
@@ -73,6 +68,101 @@ byte *decompressDeflate(const byte *data, size_t inputSize,
 SeekableReadStream *decompressDeflate(ReadStream &input, size_t inputSize,
                                       size_t outputSize, int windowBits);
 
+/** Compress (deflate) using zlib's DEFLATE algorithm.
+ *
+ *  @param  data       The input data to compress.
+ *  @param  inputSize  The size of the input data in bytes.
+ *  @param  outputSize The size of the compressed output data in bytes.
+ *  @param windowBits  The base two logarithm of the window size (the size of
+ *                     the history buffer). See the zlib documentation on
+ *                     deflateInit2() for details.
+ *  @param level       The compression level, from 0 (no compression) to
+ *                     kCompressionLevelMax (best compression).
+ *  @return The compressed data, in a new[]'ed buffer.
+ */
+byte *compressDeflate(const byte *data, size_t inputSize, size_t &outputSize,
+                      int windowBits, int level = kCompressionLevelMax);
+
+/** A stream that decompresses (inflates) DEFLATE data on demand.
+ *
+ *  Instead of inflating everything into one big buffer, the data is
+ *  decompressed in fixed-size windows while it is read. The memory used
+ *  is constant, no matter how big the decompressed data is. If the input
+ *  stream is a MemoryReadStream, the compressed data is fed to zlib directly
+ *  out of its memory; otherwise, it's read in fixed-size chunks as well.
+ *
+ *  Reading sequentially is fast. Seeking forward decompresses and throws
+ *  away the data in-between, and seeking backward outside the current window
+ *  has to start decompressing from the beginning again. Users that need
+ *  random access should read the whole stream into memory instead.
+ */
+class InflateReadStream : public SeekableReadStream, public NonCopyable {
+public:
+	/** Create a stream inflating the compressed data found in input.
+	 *
+	 *  @param input        The stream containing the compressed data, starting
+	 *                      at its current position.
+	 *  @param inputSize    The size of the compressed data in bytes.
+	 *  @param outputSize   The size of the decompressed data, or kSizeInvalid
+	 *                      if it's not known beforehand.
+	 *  @param windowBits   The base two logarithm of the window size (the size of
+	 *                      the history buffer). See the zlib documentation on
+	 *                      inflateInit2() for details.
+	 *  @param disposeInput Should the input stream be deleted when this stream is
+	 *                      destroyed (or when the constructor throws)?
+	 */
+	InflateReadStream(SeekableReadStream *input, size_t inputSize, size_t outputSize,
+	                  int windowBits, bool disposeInput = false);
+	~InflateReadStream();
+
+	bool eos() const;
+
+	size_t read(void *dataPtr, size_t dataSize);
+
+	size_t pos() const;
+
+	/** Return the size of the decompressed data, or kSizeInvalid if it's not known. */
+	size_t size() const;
+
+	size_t seek(ptrdiff_t offset, Origin whence = kOriginBegin);
+
+private:
+	struct ZStream;
+
+	SeekableReadStream *_input;
+	bool _disposeInput;
+
+	size_t _inputStart; ///< Start of the compressed data within the input stream.
+	size_t _inputSize;  ///< Size of the compressed data.
+	size_t _inputPos;   ///< Position of the next compressed byte to feed to zlib.
+
+	const byte *_inputMemory; ///< The compressed data, if the input is held in memory.
+	byte *_inputBuffer;       ///< Buffer for feeding zlib from a non-memory input.
+
+	int _windowBits;
+
+	ZStream *_zStream;
+	bool _streamEnd; ///< Has zlib found the end of the compressed data?
+
+	size_t _size; ///< The size of the decompressed data, if known.
+	size_t _pos;  ///< The current position within the decompressed data.
+	bool   _eos;
+
+	byte  *_window;      ///< The current window of decompressed data.
+	size_t _windowStart; ///< The position of the window within the decompressed data.
+	size_t _windowSize;  ///< The number of valid bytes within the window.
+
+	void initZStream();
+	void rewind();
+
+	/** Feed zlib the next chunk of compressed data. */
+	void feedInput();
+	/** Decompress the next window. Returns false if there's no more data. */
+	bool fillWindow();
+	/** Make sure the compressed data ends at the size we were promised. */
+	void checkStreamEnd();
+};
+
 } // End of namespace Common
 
 #endif // COMMON_DEFLATE_H
@@ -28,11 +28,14 @@
 #include <iconv.h>
 
 #include <vector>
+#include <string>
 
 #include "src/common/encoding.h"
 #include "src/common/encoding_strings.h"
+#include "src/common/encoding_tables.h"
 #include "src/common/error.h"
 #include "src/common/singleton.h"
+#include "src/common/mutex.h"
 #include "src/common/ustring.h"
 #include "src/common/memreadstream.h"
 #include "src/common/writestream.h"
@@ -87,6 +90,7 @@ public:
 		if (((size_t) encoding) >= kEncodingMAX)
 			throw Exception("Invalid encoding %d", encoding);
 
+		StackLock lock(_mutex);
 		return convert(_contextFrom[encoding], data, n, kEncodingGrowthFrom[encoding], 1);
 	}
 
@@ -94,6 +98,7 @@ public:
 		if (((size_t) encoding) >= kEncodingMAX)
 			throw Exception("Invalid encoding %d", encoding);
 
+		StackLock lock(_mutex);
 		return convert(_contextTo[encoding], str, kEncodingGrowthTo[encoding],
 		               terminate ? kTerminatorLength[encoding] : 0);
 	}
@@ -102,6 +107,9 @@ private:
 	iconv_t _contextFrom[kEncodingMAX];
 	iconv_t _contextTo  [kEncodingMAX];
 
+	/** The iconv contexts are stateful, so only one thread may use them at a time. */
+	Mutex _mutex;
+
 	byte *doConvert(iconv_t &ctx, byte *data, size_t nIn, size_t nOut, size_t &size) {
 		size_t inBytes  = nIn;
 		size_t outBytes = nOut;
@@ -245,21 +253,190 @@ static void writeFakeChar(std::vector<byte> &output, uint32 c, Encoding encoding
 	}
 }
 
-static UString createString(std::vector<byte> &output, Encoding encoding) {
+/** Return the table for the upper half of a single-byte encoding, or 0 if we don't have one. */
+static const uint16 *getUpperHalfTable(Encoding encoding) {
+	switch (encoding) {
+		case kEncodingLatin9:
+			return kUpperHalfLatin9;
+		case kEncodingCP1250:
+			return kUpperHalfCP1250;
+		case kEncodingCP1251:
+			return kUpperHalfCP1251;
+		case kEncodingCP1252:
+			return kUpperHalfCP1252;
+
+		default:
+			break;
+	}
+
+	return 0;
+}
+
+/** Decode a string in a single-byte encoding into UTF-8, using the encoding's table.
+ *
+ *  Like the iconv path, which converts all the data and then cuts the result
+ *  off at the first '\0', this fails if there are any undefined bytes in the
+ *  whole data, even after a '\0'. In that case, we let iconv handle the data
+ *  instead, to get the exact same error behavior.
+ */
+static bool decodeSingleByte(std::string &str, const byte *data, size_t size, const uint16 *upperHalf) {
+	for (size_t i = 0; i < size; i++)
+		if ((data[i] & 0x80) && (upperHalf[data[i] & 0x7F] == 0))
+			return false;
+
+	const byte *end = reinterpret_cast<const byte *>(std::memchr(data, '\0', size));
+	if (!end)
+		end = data + size;
+
+	str.reserve(end - data);
+
+	while (data < end) {
+		// Copy runs of ASCII characters in one go
+		const byte *run = data;
+		while ((data < end) && !(*data & 0x80))
+			data++;
+
+		str.append(reinterpret_cast<const char *>(run), data - run);
+
+		for (; (data < end) && (*data & 0x80); data++)
+			utf8::unchecked::append(upperHalf[*data & 0x7F], std::back_inserter(str));
+	}
+
+	return true;
+}
+
+/** Decode a UTF-16 string into UTF-8.
+ *
+ *  Like decodeSingleByte(), this fails on any invalid data, i.e. an odd size
+ *  or an unpaired surrogate, so that the iconv path can handle these cases.
+ */
+static bool decodeUTF16(std::string &str, const byte *data, size_t size, bool bigEndian) {
+	if ((size % 2) != 0)
+		return false;
+
+	const size_t count = size / 2;
+
+	std::vector<uint16> units(count);
+	for (size_t i = 0; i < count; i++)
+		units[i] = bigEndian ? READ_BE_UINT16(data + i * 2) : READ_LE_UINT16(data + i * 2);
+
+	// Check that all surrogates are correctly paired
+	for (size_t i = 0; i < count; i++) {
+		if ((units[i] >= 0xDC00) && (units[i] <= 0xDFFF))
+			return false;
+
+		if ((units[i] >= 0xD800) && (units[i] <= 0xDBFF)) {
+			if (((i + 1) >= count) || (units[i + 1] < 0xDC00) || (units[i + 1] > 0xDFFF))
+				return false;
+
+			i++;
+		}
+	}
+
+	str.reserve(count);
+
+	for (size_t i = 0; (i < count) && (units[i] != 0); i++) {
+		uint32 c = units[i];
+
+		if      (c < 0x80)
+			str.push_back((char) c);
+		else if ((c >= 0xD800) && (c <= 0xDBFF))
+			utf8::unchecked::append(0x10000 + ((c - 0xD800) << 10) + (units[++i] - 0xDC00), std::back_inserter(str));
+		else
+			utf8::unchecked::append(c, std::back_inserter(str));
+	}
+
+	return true;
+}
+
+static UString createString(const byte *data, size_t size, Encoding encoding) {
+	if (size == 0)
+		return "";
+
+	std::string str;
+
 	switch (encoding) {
 		case kEncodingASCII:
 		case kEncodingUTF8:
-			output.push_back('\0');
-			return UString(reinterpret_cast<const char *>(&output[0]));
+			{
+				const byte *end = reinterpret_cast<const byte *>(std::memchr(data, '\0', size));
+
+				return UString(reinterpret_cast<const char *>(data), end ? (end - data) : size);
+			}
+
+		case kEncodingLatin9:
+		case kEncodingCP1250:
+		case kEncodingCP1251:
+		case kEncodingCP1252:
+			if (decodeSingleByte(str, data, size, getUpperHalfTable(encoding)))
+				return str;
+			break;
+
+		case kEncodingUTF16LE:
+		case kEncodingUTF16BE:
+			if (decodeUTF16(str, data, size, encoding == kEncodingUTF16BE))
+				return str;
+			break;
 
 		default:
-			return ConvMan.convert(encoding, &output[0], output.size());
+			break;
 	}
 
-	return "";
+	// Let iconv handle everything else, like the CJK encodings
+
+	std::vector<byte> output(data, data + size);
+
+	return ConvMan.convert(encoding, &output[0], output.size());
+}
+
+static UString createString(std::vector<byte> &output, Encoding encoding) {
+	if (output.empty())
+		return createString(0, 0, encoding);
+
+	return createString(&output[0], output.size(), encoding);
+}
+
+/** Read a string terminated by a 0-character out of a memory stream, directly from its memory.
+ *
+ *  This leaves the stream in the same state as reading it character by character would.
+ */
+static UString readString(MemoryReadStream &stream, Encoding encoding, size_t charSize) {
+	const byte  *data = stream.getData() + stream.pos();
+	const size_t size = stream.size()    - stream.pos();
+
+	size_t length = 0;
+	if (charSize == 1) {
+		const byte *end = reinterpret_cast<const byte *>(std::memchr(data, '\0', size));
+
+		length = end ? (end - data) : size;
+	} else
+		while (((length + charSize) <= size) && ((data[length] != 0) || (data[length + 1] != 0)))
+			length += charSize;
+
+	if ((length + charSize) <= size) {
+		// Skip past the terminator
+		stream.skip(length + charSize);
+	} else {
+		// No terminator. Run into the end of the stream, to set its EOS flag
+		byte dummy[2];
+
+		stream.seek(0, SeekableReadStream::kOriginEnd);
+		stream.read(dummy, 1);
+	}
+
+	return createString(data, length, encoding);
 }
 
 UString readString(SeekableReadStream &stream, Encoding encoding) {
+	MemoryReadStream *memoryStream = dynamic_cast<MemoryReadStream *>(&stream);
+	if (memoryStream) {
+		if ((encoding == kEncodingUTF16LE) || (encoding == kEncodingUTF16BE))
+			return readString(*memoryStream, encoding, 2);
+
+		if (((size_t) encoding) < kEncodingMAX)
+			return readString(*memoryStream, encoding, 1);
+	}
+
 	std::vector<byte> output;
 
 	uint32 c;
@@ -300,15 +477,7 @@ UString readStringLine(SeekableReadStream &stream, Encoding encoding) {
 }
 
 UString readString(const byte *data, size_t size, Encoding encoding) {
-	if (size == 0)
-		return "";
-
-	std::vector<byte> output;
-	output.resize(size);
-
-	std::memcpy(&output[0], data, size);
-
-	return createString(output, encoding);
+	return createString(data, size, encoding);
 }
 
 size_t writeString(WriteStream &stream, const Common::UString &str, Encoding encoding, bool terminate) {
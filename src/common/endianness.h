@@ -487,4 +487,38 @@ static inline uint16 SWAP_BYTES_16(const uint16 a) {
 
 #endif // if defined(XOREOS_LITTLE_ENDIAN)
 
+/* Functions for converting whole arrays of integers into native endianness, in place.
+ * When no conversion is necessary, the compiler will optimize them away completely,
+ * and otherwise the loops are simple enough to be vectorized. */
+
+static inline void FROM_LE_ARRAY_16(uint16 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_LE_16(data[i]);
+}
+
+static inline void FROM_LE_ARRAY_32(uint32 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_LE_32(data[i]);
+}
+
+static inline void FROM_LE_ARRAY_64(uint64 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_LE_64(data[i]);
+}
+
+static inline void FROM_BE_ARRAY_16(uint16 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_BE_16(data[i]);
+}
+
+static inline void FROM_BE_ARRAY_32(uint32 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_BE_32(data[i]);
+}
+
+static inline void FROM_BE_ARRAY_64(uint64 *data, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = FROM_BE_64(data[i]);
+}
+
 #endif // COMMON_ENDIAN_H
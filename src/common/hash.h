@@ -50,6 +50,15 @@ static inline uint32 hashDJB2(uint32 hash, uint32 c) {
 static inline uint32 hashStringDJB2(const UString &string) {
 	uint32 hash = 5381;
 
+	// The bytes of an ASCII string are its codepoints, no need to decode them
+	if (string.isASCII()) {
+		const char *str = string.c_str();
+		for (size_t i = 0; i < string.size(); i++)
+			hash = hashDJB2(hash, (byte) str[i]);
+
+		return hash;
+	}
+
 	for (UString::iterator it = string.begin(); it != string.end(); ++it)
 		hash = hashDJB2(hash, *it);
 
@@ -80,6 +89,15 @@ static inline uint32 hashFNV32(uint32 hash, uint32 c) {
 static inline uint32 hashStringFNV32(const UString &string) {
 	uint32 hash = 0x811C9DC5;
 
+	// See hashStringDJB2()
+	if (string.isASCII()) {
+		const char *str = string.c_str();
+		for (size_t i = 0; i < string.size(); i++)
+			hash = hashFNV32(hash, (byte) str[i]);
+
+		return hash;
+	}
+
 	for (UString::iterator it = string.begin(); it != string.end(); ++it)
 		hash = hashFNV32(hash, *it);
 
@@ -110,6 +128,15 @@ static inline uint64 hashFNV64(uint64 hash, uint32 c) {
 static inline uint64 hashStringFNV64(const UString &string) {
 	uint64 hash = 0xCBF29CE484222325LL;
 
+	// See hashStringDJB2()
+	if (string.isASCII()) {
+		const char *str = string.c_str();
+		for (size_t i = 0; i < string.size(); i++)
+			hash = hashFNV64(hash, (byte) str[i]);
+
+		return hash;
+	}
+
 	for (UString::iterator it = string.begin(); it != string.end(); ++it)
 		hash = hashFNV64(hash, *it);
 
@@ -195,6 +222,15 @@ static inline uint32 hashCRC32(uint32 hash, uint32 c) {
 static inline uint32 hashStringCRC32(const UString &string) {
 	uint32 hash = 0xFFFFFFFF;
 
+	// See hashStringDJB2()
+	if (string.isASCII()) {
+		const char *str = string.c_str();
+		for (size_t i = 0; i < string.size(); i++)
+			hash = hashCRC32(hash, (byte) str[i]);
+
+		return hash ^ 0xFFFFFFFF;
+	}
+
 	for (UString::iterator it = string.begin(); it != string.end(); ++it)
 		hash = hashCRC32(hash, *it);
 
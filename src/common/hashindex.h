@@ -0,0 +1,168 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  A hash index into an external list of items.
+ */
+
+#ifndef COMMON_HASHINDEX_H
+#define COMMON_HASHINDEX_H
+
+#include <cstddef>
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/util.h"
+
+namespace Common {
+
+/** A hash index into an external list of items.
+ *
+ *  The index itself only maps hash values to item numbers, using open
+ *  addressing with linear probing. The items are owned by the caller, who
+ *  also decides when two items are equal: find() and insert() take a
+ *  predicate that's called with the number of an item with a matching hash,
+ *  and returns whether that item is the one looked for.
+ *
+ *  Only the first item of each key is indexed, so a lookup finds the same
+ *  item a linear search would. This also keeps lots of equal keys from
+ *  degenerating the index into one long probe sequence.
+ *
+ *  The index is kept at most half full, growing as necessary.
+ */
+class HashIndex {
+public:
+	/** The item number returned when no item was found. */
+	static const uint32 kNone = 0xFFFFFFFF;
+
+	HashIndex() : _count(0) {
+	}
+
+	/** Is the index empty? */
+	bool empty() const {
+		return _count == 0;
+	}
+
+	/** Remove all items from the index, and free its memory. */
+	void clear() {
+		std::vector<Slot>().swap(_slots);
+		_count = 0;
+	}
+
+	/** Exchange the contents of this index with another. */
+	void swap(HashIndex &index) {
+		_slots.swap(index._slots);
+		SWAP(_count, index._count);
+	}
+
+	/** Remove all items from the index, and make room for count items. */
+	void reset(size_t count) {
+		_slots.assign(getTableSize(count), Slot());
+		_count = 0;
+	}
+
+	/** Return the number of the first indexed item with this hash that the predicate accepts. */
+	template<typename Predicate>
+	uint32 find(uint32 hash, const Predicate &predicate) const {
+		if (_slots.empty())
+			return kNone;
+
+		const size_t mask = _slots.size() - 1;
+
+		for (size_t slot = hash & mask; _slots[slot].item != kNone; slot = (slot + 1) & mask)
+			if ((_slots[slot].hash == hash) && predicate(_slots[slot].item))
+				return _slots[slot].item;
+
+		return kNone;
+	}
+
+	/** Add an item to the index, unless the predicate accepts an already indexed item.
+	 *
+	 *  @return The number of the item now indexed for this key.
+	 */
+	template<typename Predicate>
+	uint32 insert(uint32 hash, uint32 item, const Predicate &predicate) {
+		const uint32 found = find(hash, predicate);
+		if (found != kNone)
+			return found;
+
+		if (((_count + 1) * 2) > _slots.size())
+			grow(_count + 1);
+
+		place(hash, item);
+		_count++;
+
+		return item;
+	}
+
+	/** Mix the bits of a 64-bit value into a hash value. */
+	static uint32 hash(uint64 value) {
+		value ^= value >> 33;
+		value *= 0xFF51AFD7ED558CCDULL;
+		value ^= value >> 33;
+
+		return (uint32) value;
+	}
+
+private:
+	struct Slot {
+		uint32 hash;
+		uint32 item;
+
+		Slot() : hash(0), item(kNone) {
+		}
+	};
+
+	std::vector<Slot> _slots;
+	size_t _count;
+
+	static size_t getTableSize(size_t count) {
+		size_t size = 16;
+		while (size < (count * 2))
+			size *= 2;
+
+		return size;
+	}
+
+	void place(uint32 hash, uint32 item) {
+		const size_t mask = _slots.size() - 1;
+
+		size_t slot = hash & mask;
+		while (_slots[slot].item != kNone)
+			slot = (slot + 1) & mask;
+
+		_slots[slot].hash = hash;
+		_slots[slot].item = item;
+	}
+
+	void grow(size_t count) {
+		std::vector<Slot> slots(MAX(getTableSize(count), _slots.size() * 2), Slot());
+		_slots.swap(slots);
+
+		for (std::vector<Slot>::const_iterator s = slots.begin(); s != slots.end(); ++s)
+			if (s->item != kNone)
+				place(s->hash, s->item);
+	}
+};
+
+} // End of namespace Common
+
+#endif // COMMON_HASHINDEX_H
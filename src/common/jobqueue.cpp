@@ -0,0 +1,200 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  A queue of independent jobs, processed by a pool of worker threads.
+ */
+
+#include <exception>
+
+#include "src/common/jobqueue.h"
+#include "src/common/util.h"
+#include "src/common/thread.h"
+
+namespace Common {
+
+class JobQueue::Worker : public Thread {
+public:
+	Worker(JobQueue &queue) : _queue(&queue) {
+	}
+
+	~Worker() {
+		joinThread();
+	}
+
+private:
+	JobQueue *_queue;
+
+	void threadMethod() {
+		_queue->work();
+	}
+};
+
+
+JobQueue::JobQueue() : _jobCount(0), _nextJob(0), _failed(false), _failedJob(0) {
+}
+
+JobQueue::~JobQueue() {
+}
+
+void JobQueue::finishJob(size_t UNUSED(job)) {
+}
+
+size_t JobQueue::getThreadCount(size_t jobCount, size_t maxThreadCount) {
+	return MAX<size_t>(MIN<size_t>(jobCount, maxThreadCount), 1);
+}
+
+void JobQueue::setFailure(size_t job, const Exception &e) {
+	StackLock lock(_mutex);
+
+	// Keep the exception of the first failed job, to be independent of the thread timing
+	if (_failed && (_failedJob < job))
+		return;
+
+	_failed    = true;
+	_failedJob = job;
+	_failure   = e;
+}
+
+void JobQueue::runOneJob(size_t job) {
+	try {
+		runJob(job);
+	} catch (Exception &e) {
+		setFailure(job, e);
+	} catch (std::exception &e) {
+		setFailure(job, Exception(e));
+	} catch (...) {
+		setFailure(job, Exception("Unknown exception caught"));
+	}
+}
+
+void JobQueue::work() {
+	while (true) {
+		size_t job;
+
+		{
+			StackLock lock(_mutex);
+
+			if (_nextJob >= _jobCount)
+				return;
+
+			job = _nextJob++;
+		}
+
+		runOneJob(job);
+
+		{
+			StackLock lock(_mutex);
+
+			_done[job] = true;
+			_jobDone.broadcast();
+		}
+	}
+}
+
+void JobQueue::rethrowFailure() {
+	if (!_failed)
+		return;
+
+	_failed = false;
+
+	throw _failure;
+}
+
+void JobQueue::run(size_t jobCount, size_t threadCount) {
+	_jobCount = jobCount;
+	_nextJob  = 0;
+	_failed   = false;
+
+	threadCount = getThreadCount(jobCount, threadCount);
+
+	if (threadCount <= 1) {
+		_nextJob = _jobCount;
+
+		for (size_t i = 0; i < jobCount; i++) {
+			runOneJob(i);
+			finishJob(i);
+		}
+
+		rethrowFailure();
+		return;
+	}
+
+	_done.assign(jobCount, false);
+
+	std::vector<Worker *> workers;
+	workers.reserve(threadCount);
+
+	for (size_t i = 0; i < threadCount; i++) {
+		Worker *worker = new Worker(*this);
+
+		try {
+			worker->createThread();
+		} catch (...) {
+			// Make do with the threads we already have
+			delete worker;
+			break;
+		}
+
+		workers.push_back(worker);
+	}
+
+	// No threads at all, do everything ourselves
+	if (workers.empty())
+		work();
+
+	try {
+		for (size_t i = 0; i < jobCount; i++) {
+			{
+				StackLock lock(_mutex);
+
+				while (!_done[i])
+					_jobDone.wait(_mutex);
+			}
+
+			finishJob(i);
+		}
+	} catch (...) {
+		// Don't start any more jobs, and wait for the ones already running
+		{
+			StackLock lock(_mutex);
+
+			_nextJob = _jobCount;
+		}
+
+		deleteWorkers(workers);
+		throw;
+	}
+
+	deleteWorkers(workers);
+
+	rethrowFailure();
+}
+
+void JobQueue::deleteWorkers(std::vector<Worker *> &workers) {
+	for (std::vector<Worker *>::iterator w = workers.begin(); w != workers.end(); ++w)
+		delete *w;
+
+	workers.clear();
+
+	_done.clear();
+}
+
+} // End of namespace Common
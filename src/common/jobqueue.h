@@ -0,0 +1,104 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  A queue of independent jobs, processed by a pool of worker threads.
+ */
+
+#ifndef COMMON_JOBQUEUE_H
+#define COMMON_JOBQUEUE_H
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/noncopyable.h"
+#include "src/common/mutex.h"
+#include "src/common/error.h"
+
+namespace Common {
+
+/** A batch of independent jobs, processed by a pool of worker threads.
+ *
+ *  Subclasses implement runJob(), which is called exactly once for every
+ *  job index in [0, jobCount). The jobs are handed out to the worker
+ *  threads in ascending order, so runJob() needs to be thread-safe.
+ *
+ *  finishJob() is called on the thread that called run(), in ascending
+ *  job order, as soon as a job and all the jobs before it are done. Doing
+ *  any output there keeps it deterministic, no matter the number of threads.
+ *
+ *  With a thread count of 1, no threads are created at all. Every job is
+ *  run and finished directly, one after the other, on the calling thread.
+ */
+class JobQueue : public NonCopyable {
+public:
+	JobQueue();
+	virtual ~JobQueue();
+
+	/** Process jobCount jobs with threadCount worker threads.
+	 *
+	 *  If runJob() throws for any job, the remaining jobs are still run and
+	 *  finished, and then the exception of the first failed job is rethrown.
+	 *  If finishJob() throws, no further jobs are started, and the exception
+	 *  is passed on as soon as the jobs already running are done.
+	 */
+	void run(size_t jobCount, size_t threadCount = 1);
+
+	/** Return a sensible number of worker threads for the given number of jobs. */
+	static size_t getThreadCount(size_t jobCount, size_t maxThreadCount);
+
+protected:
+	/** Process a job. Called from a worker thread. */
+	virtual void runJob(size_t job) = 0;
+
+	/** Finish a processed job. Called from the thread that called run(). */
+	virtual void finishJob(size_t job);
+
+private:
+	class Worker;
+
+	Mutex     _mutex;
+	Condition _jobDone;
+
+	size_t _jobCount;
+	size_t _nextJob;
+
+	std::vector<bool> _done;
+
+	bool      _failed;
+	size_t    _failedJob;
+	Exception _failure;
+
+	void work();
+
+	/** Wait for all worker threads to end and free them. */
+	void deleteWorkers(std::vector<Worker *> &workers);
+
+	void runOneJob(size_t job);
+
+	void setFailure(size_t job, const Exception &e);
+	void rethrowFailure();
+
+	friend class Worker;
+};
+
+} // End of namespace Common
+
+#endif // COMMON_JOBQUEUE_H
@@ -0,0 +1,75 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Implementing the stream reading interfaces for memory-mapped files.
+ */
+
+#include "src/common/mappedreadfile.h"
+#include "src/common/error.h"
+#include "src/common/ustring.h"
+#include "src/common/platform.h"
+#include "src/common/readfile.h"
+
+namespace Common {
+
+FileMapping::FileMapping(const UString &fileName) : _mapData(0), _mapSize(0), _mapped(false) {
+	_mapData = Platform::mapFile(fileName, _mapSize);
+	if (_mapData) {
+		_mapped = true;
+		return;
+	}
+
+	// Can't map the file, read it instead
+
+	ReadFile file(fileName);
+
+	_mapSize = file.size();
+
+	byte *data = new byte[_mapSize];
+	if (file.read(data, _mapSize) != _mapSize) {
+		delete[] data;
+		throw Exception(kReadError);
+	}
+
+	_mapData = data;
+}
+
+FileMapping::~FileMapping() {
+	if (_mapped)
+		Platform::unmapFile(_mapData, _mapSize);
+	else
+		delete[] _mapData;
+}
+
+bool FileMapping::isMapped() const {
+	return _mapped;
+}
+
+
+MappedReadFile::MappedReadFile(const UString &fileName) :
+	FileMapping(fileName), MemoryReadStream(_mapData, _mapSize) {
+
+}
+
+MappedReadFile::~MappedReadFile() {
+}
+
+} // End of namespace Common
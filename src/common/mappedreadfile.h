@@ -0,0 +1,76 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Implementing the stream reading interfaces for memory-mapped files.
+ */
+
+#ifndef COMMON_MAPPEDREADFILE_H
+#define COMMON_MAPPEDREADFILE_H
+
+#include "src/common/types.h"
+#include "src/common/memreadstream.h"
+#include "src/common/noncopyable.h"
+
+namespace Common {
+
+class UString;
+
+/** A read-only mapping of a whole file into memory.
+ *
+ *  If the file can't be mapped (for example, because it's not a regular
+ *  file), its contents are read into a memory buffer instead.
+ */
+class FileMapping : public NonCopyable {
+public:
+	/** Map the file with the given fileName. Throws on failure. */
+	FileMapping(const UString &fileName);
+	~FileMapping();
+
+	/** Was the file actually mapped, or did we have to read it into memory? */
+	bool isMapped() const;
+
+protected:
+	const byte *_mapData; ///< The file's contents.
+	size_t      _mapSize; ///< The file's size.
+
+	bool _mapped; ///< Did the OS map the file for us?
+};
+
+/** A file, mapped into memory and read through the MemoryReadStream interface.
+ *
+ *  Since the whole file is available as a contiguous block of memory, users
+ *  can create cheap MemoryReadStream views into parts of the file with
+ *  getData(), without copying and without disturbing the position of this
+ *  stream. The archive classes do this automatically for their resources.
+ *
+ *  Note that, unlike ReadFile::readIntoMemory(), the file's contents are not
+ *  copied. Modifying or truncating the file while it's mapped leads to
+ *  undefined behaviour.
+ */
+class MappedReadFile : private FileMapping, public MemoryReadStream {
+public:
+	MappedReadFile(const UString &fileName);
+	~MappedReadFile();
+};
+
+} // End of namespace Common
+
+#endif // COMMON_MAPPEDREADFILE_H
@@ -126,4 +126,30 @@ MemoryReadStreamEndian::MemoryReadStreamEndian(const byte *dataPtr, size_t dataS
 MemoryReadStreamEndian::~MemoryReadStreamEndian() {
 }
 
+
+MemoryReadStream *makeMemoryReadStream(SeekableReadStream *stream) {
+	assert(stream);
+
+	MemoryReadStream *memory = dynamic_cast<MemoryReadStream *>(stream);
+	if (memory)
+		return memory;
+
+	try {
+		const size_t pos = stream->pos();
+
+		stream->seek(0);
+		memory = stream->readStream(stream->size());
+
+		memory->seek(pos);
+
+	} catch (...) {
+		delete memory;
+		delete stream;
+		throw;
+	}
+
+	delete stream;
+	return memory;
+}
+
 } // End of namespace Common
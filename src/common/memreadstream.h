@@ -139,6 +139,17 @@ public:
 	}
 };
 
+/** Make sure the data of a stream is held in memory.
+ *
+ *  If the stream is a MemoryReadStream already, it is returned as is.
+ *  Otherwise, the whole stream is read into a new MemoryReadStream, which
+ *  is positioned at the same place as the old stream, and the old stream
+ *  is deleted.
+ *
+ *  This function takes over the ownership of the stream, even if it throws.
+ */
+MemoryReadStream *makeMemoryReadStream(SeekableReadStream *stream);
+
 } // End of namespace Common
 
 #endif // COMMON_MEMREADSTREAM_H
@@ -0,0 +1,154 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Thread mutex classes.
+ */
+
+#include "src/common/system.h"
+
+#if defined(WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include "src/common/mutex.h"
+#include "src/common/error.h"
+
+namespace Common {
+
+#if defined(WIN32)
+
+struct Mutex::Implementation {
+	CRITICAL_SECTION section;
+};
+
+struct Condition::Implementation {
+	CONDITION_VARIABLE variable;
+};
+
+Mutex::Mutex() : _mutex(new Implementation) {
+	InitializeCriticalSection(&_mutex->section);
+}
+
+Mutex::~Mutex() {
+	DeleteCriticalSection(&_mutex->section);
+
+	delete _mutex;
+}
+
+void Mutex::lock() {
+	EnterCriticalSection(&_mutex->section);
+}
+
+void Mutex::unlock() {
+	LeaveCriticalSection(&_mutex->section);
+}
+
+Condition::Condition() : _condition(new Implementation) {
+	InitializeConditionVariable(&_condition->variable);
+}
+
+Condition::~Condition() {
+	delete _condition;
+}
+
+void Condition::wait(Mutex &mutex) {
+	SleepConditionVariableCS(&_condition->variable, &mutex._mutex->section, INFINITE);
+}
+
+void Condition::signal() {
+	WakeConditionVariable(&_condition->variable);
+}
+
+void Condition::broadcast() {
+	WakeAllConditionVariable(&_condition->variable);
+}
+
+#else
+
+struct Mutex::Implementation {
+	pthread_mutex_t mutex;
+};
+
+struct Condition::Implementation {
+	pthread_cond_t condition;
+};
+
+Mutex::Mutex() : _mutex(new Implementation) {
+	if (pthread_mutex_init(&_mutex->mutex, 0) != 0) {
+		delete _mutex;
+		throw Exception("Failed to create mutex");
+	}
+}
+
+Mutex::~Mutex() {
+	pthread_mutex_destroy(&_mutex->mutex);
+
+	delete _mutex;
+}
+
+void Mutex::lock() {
+	pthread_mutex_lock(&_mutex->mutex);
+}
+
+void Mutex::unlock() {
+	pthread_mutex_unlock(&_mutex->mutex);
+}
+
+Condition::Condition() : _condition(new Implementation) {
+	if (pthread_cond_init(&_condition->condition, 0) != 0) {
+		delete _condition;
+		throw Exception("Failed to create condition variable");
+	}
+}
+
+Condition::~Condition() {
+	pthread_cond_destroy(&_condition->condition);
+
+	delete _condition;
+}
+
+void Condition::wait(Mutex &mutex) {
+	pthread_cond_wait(&_condition->condition, &mutex._mutex->mutex);
+}
+
+void Condition::signal() {
+	pthread_cond_signal(&_condition->condition);
+}
+
+void Condition::broadcast() {
+	pthread_cond_broadcast(&_condition->condition);
+}
+
+#endif
+
+
+StackLock::StackLock(Mutex &mutex) : _mutex(&mutex) {
+	_mutex->lock();
+}
+
+StackLock::~StackLock() {
+	_mutex->unlock();
+}
+
+} // End of namespace Common
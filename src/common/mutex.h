@@ -0,0 +1,87 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Thread mutex classes.
+ */
+
+#ifndef COMMON_MUTEX_H
+#define COMMON_MUTEX_H
+
+#include "src/common/types.h"
+#include "src/common/noncopyable.h"
+
+namespace Common {
+
+/** A mutex. */
+class Mutex : public NonCopyable {
+public:
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+
+private:
+	struct Implementation;
+
+	Implementation *_mutex;
+
+	friend class Condition;
+};
+
+/** A condition variable, always used together with a Mutex. */
+class Condition : public NonCopyable {
+public:
+	Condition();
+	~Condition();
+
+	/** Atomically unlock the (locked) mutex and wait for a signal. The mutex
+	 *  is locked again when this returns.
+	 *
+	 *  Like all condition variables, this can wake up spuriously. The caller
+	 *  needs to check its actual condition in a loop.
+	 */
+	void wait(Mutex &mutex);
+
+	/** Wake up one waiting thread. */
+	void signal();
+	/** Wake up all waiting threads. */
+	void broadcast();
+
+private:
+	struct Implementation;
+
+	Implementation *_condition;
+};
+
+/** Convenience class that locks a mutex on creation and unlocks it on destruction. */
+class StackLock : public NonCopyable {
+public:
+	StackLock(Mutex &mutex);
+	~StackLock();
+
+private:
+	Mutex *_mutex;
+};
+
+} // End of namespace Common
+
+#endif // COMMON_MUTEX_H
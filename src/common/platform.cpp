@@ -29,6 +29,13 @@
 	#include <windows.h>
 	#include <shellapi.h>
 	#include <wchar.h>
+#elif defined(UNIX)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #endif
 
 #include <cassert>
@@ -100,4 +107,250 @@ std::FILE *Platform::openFile(const UString &fileName, FileMode mode) {
 }
 // '--- openFile() ---'
 
+// .--- mapFile() ---.
+/** Dummy mapping for empty files, which can't actually be mapped. */
+static const byte kEmptyMapping[1] = { 0 };
+
+#if defined(WIN32)
+
+const byte *Platform::mapFile(const UString &fileName, size_t &size) {
+	size = 0;
+
+	MemoryReadStream *utf16Name = convertString(fileName, kEncodingUTF16LE);
+
+	HANDLE file = CreateFileW(reinterpret_cast<const wchar_t *>(utf16Name->getData()), GENERIC_READ,
+	                          FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+	delete utf16Name;
+
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart < 0) ||
+	    ((uint64)fileSize.QuadPart > (uint64)SIZE_MAX)) {
+
+		CloseHandle(file);
+		return 0;
+	}
+
+	if (fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return kEmptyMapping;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(file);
+
+	if (!mapping)
+		return 0;
+
+	// The view keeps the mapping object alive, so we can close its handle right away
+	const byte *data = static_cast<const byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping);
+
+	if (!data)
+		return 0;
+
+	size = (size_t)fileSize.QuadPart;
+	return data;
+}
+
+void Platform::unmapFile(const byte *data, size_t UNUSED(size)) {
+	if (!data || (data == kEmptyMapping))
+		return;
+
+	UnmapViewOfFile(data);
+}
+
+#elif defined(UNIX)
+
+const byte *Platform::mapFile(const UString &fileName, size_t &size) {
+	size = 0;
+
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	struct stat fileStat;
+	if ((fstat(fd, &fileStat) != 0) || !S_ISREG(fileStat.st_mode) ||
+	    (fileStat.st_size < 0) || ((uint64)fileStat.st_size > (uint64)SIZE_MAX)) {
+
+		::close(fd);
+		return 0;
+	}
+
+	if (fileStat.st_size == 0) {
+		::close(fd);
+		return kEmptyMapping;
+	}
+
+	// The mapping stays valid after closing the file descriptor
+	void *data = mmap(0, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED)
+		return 0;
+
+	size = (size_t)fileStat.st_size;
+	return static_cast<const byte *>(data);
+}
+
+void Platform::unmapFile(const byte *data, size_t size) {
+	if (!data || (data == kEmptyMapping))
+		return;
+
+	munmap(const_cast<byte *>(data), size);
+}
+
+#else
+
+// No way to map files here. MappedReadFile falls back to reading the file
+const byte *Platform::mapFile(const UString &UNUSED(fileName), size_t &size) {
+	size = 0;
+
+	return 0;
+}
+
+void Platform::unmapFile(const byte *UNUSED(data), size_t UNUSED(size)) {
+}
+
+#endif
+// '--- mapFile() ---'
+
+// .--- getFileInfo() ---.
+#if defined(WIN32)
+
+bool Platform::getFileInfo(const UString &fileName, uint64 &size, uint64 &time) {
+	size = 0;
+	time = 0;
+
+	MemoryReadStream *utf16Name = convertString(fileName, kEncodingUTF16LE);
+
+	WIN32_FILE_ATTRIBUTE_DATA fileData;
+	BOOL result = GetFileAttributesExW(reinterpret_cast<const wchar_t *>(utf16Name->getData()),
+	                                   GetFileExInfoStandard, &fileData);
+
+	delete utf16Name;
+
+	if (!result || (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+
+	size = (((uint64) fileData.nFileSizeHigh) << 32) | fileData.nFileSizeLow;
+	time = (((uint64) fileData.ftLastWriteTime.dwHighDateTime) << 32) |
+	                  fileData.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+#elif defined(UNIX)
+
+bool Platform::getFileInfo(const UString &fileName, uint64 &size, uint64 &time) {
+	size = 0;
+	time = 0;
+
+	struct stat fileStat;
+	if ((stat(fileName.c_str(), &fileStat) != 0) || !S_ISREG(fileStat.st_mode) || (fileStat.st_size < 0))
+		return false;
+
+	size = (uint64) fileStat.st_size;
+
+	// Use the modification time in nanoseconds, if available
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+	time = ((uint64) fileStat.st_mtim.tv_sec) * 1000000000 + (uint64) fileStat.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+	time = ((uint64) fileStat.st_mtimespec.tv_sec) * 1000000000 + (uint64) fileStat.st_mtimespec.tv_nsec;
+#else
+	time = (uint64) fileStat.st_mtime;
+#endif
+
+	return true;
+}
+
+#else
+
+// Without a way to get the modification time, only the size is available
+bool Platform::getFileInfo(const UString &fileName, uint64 &size, uint64 &time) {
+	size = 0;
+	time = 0;
+
+	std::FILE *file = openFile(fileName, kFileModeRead);
+	if (!file)
+		return false;
+
+	long fileSize = -1;
+	if (std::fseek(file, 0, SEEK_END) == 0)
+		fileSize = std::ftell(file);
+
+	std::fclose(file);
+
+	if (fileSize < 0)
+		return false;
+
+	size = (uint64) fileSize;
+	return true;
+}
+
+#endif
+// '--- getFileInfo() ---'
+
+// .--- getDirectoryFiles() ---.
+#if defined(WIN32)
+
+bool Platform::getDirectoryFiles(const UString &directory, std::vector<UString> &files) {
+	MemoryReadStream *utf16Pattern = convertString(directory + "\\*", kEncodingUTF16LE);
+
+	WIN32_FIND_DATAW fileData;
+	HANDLE find = FindFirstFileW(reinterpret_cast<const wchar_t *>(utf16Pattern->getData()), &fileData);
+
+	delete utf16Pattern;
+
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+
+	do {
+		if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		files.push_back(readString(reinterpret_cast<const byte *>(fileData.cFileName),
+		                           wcslen(fileData.cFileName) * 2, kEncodingUTF16LE));
+
+	} while (FindNextFileW(find, &fileData));
+
+	FindClose(find);
+	return true;
+}
+
+#elif defined(UNIX)
+
+bool Platform::getDirectoryFiles(const UString &directory, std::vector<UString> &files) {
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+		return false;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		const UString name = entry->d_name;
+
+		struct stat fileStat;
+		if ((stat((directory + "/" + name).c_str(), &fileStat) != 0) || !S_ISREG(fileStat.st_mode))
+			continue;
+
+		files.push_back(name);
+	}
+
+	closedir(dir);
+	return true;
+}
+
+#else
+
+// No way to list directories here
+bool Platform::getDirectoryFiles(const UString &UNUSED(directory), std::vector<UString> &UNUSED(files)) {
+	return false;
+}
+
+#endif
+// '--- getDirectoryFiles() ---'
+
 } // End of namespace Common
@@ -29,6 +29,7 @@
 
 #include <vector>
 
+#include "src/common/types.h"
 #include "src/common/ustring.h"
 
 namespace Common {
@@ -47,6 +48,42 @@ public:
 
 	/** Open a file with an UTF-8 encoded name. */
 	static std::FILE *openFile(const UString &fileName, FileMode mode);
+
+	/** Map a file with an UTF-8 encoded name read-only into memory.
+	 *
+	 *  @param  fileName The name of the file to map.
+	 *  @param  size Will be set to the size of the mapped file.
+	 *  @return A pointer to the mapped file data, or 0 if mapping failed. A
+	 *          successful mapping of an empty file returns a non-0 pointer
+	 *          with a size of 0.
+	 */
+	static const byte *mapFile(const UString &fileName, size_t &size);
+
+	/** Unmap a file previously mapped with mapFile(). */
+	static void unmapFile(const byte *data, size_t size);
+
+	/** Get information about a file with an UTF-8 encoded name.
+	 *
+	 *  The modification time is in an unspecified, platform-dependent unit.
+	 *  It's only meant to be compared against other values returned here.
+	 *
+	 *  @param  fileName The name of the file to look at.
+	 *  @param  size Will be set to the size of the file.
+	 *  @param  time Will be set to the time of the file's last modification.
+	 *  @return true if the file exists and is a regular file, false otherwise.
+	 */
+	static bool getFileInfo(const UString &fileName, uint64 &size, uint64 &time);
+
+	/** Collect the names of all regular files in a directory with an UTF-8 encoded name.
+	 *
+	 *  Only the names of the files themselves are added, without the directory,
+	 *  and in no particular order. Subdirectories are not searched.
+	 *
+	 *  @param  directory The directory to look into.
+	 *  @param  files The names of the files will be added to this list.
+	 *  @return true if the directory could be read, false otherwise.
+	 */
+	static bool getDirectoryFiles(const UString &directory, std::vector<UString> &files);
 };
 
 } // End of namespace Common
@@ -0,0 +1,99 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  A light-weight cursor for decoding data held in memory.
+ */
+
+#include "src/common/readcursor.h"
+#include "src/common/readstream.h"
+#include "src/common/memreadstream.h"
+
+namespace Common {
+
+ReadCursor::ReadCursor(SeekableReadStream &stream, std::vector<byte> &buffer) : _data(0), _size(0), _pos(0) {
+	const size_t pos = stream.pos();
+
+	const MemoryReadStream *memory = dynamic_cast<const MemoryReadStream *>(&stream);
+	if (memory) {
+		_data = memory->getData();
+		_size = memory->size();
+		_pos  = pos;
+
+		return;
+	}
+
+	buffer.resize(stream.size());
+
+	stream.seek(0);
+	if (!buffer.empty() && (stream.read(&buffer[0], buffer.size()) != buffer.size()))
+		throw Exception(kReadError);
+
+	stream.seek(pos);
+
+	_data = buffer.empty() ? 0 : &buffer[0];
+	_size = buffer.size();
+	_pos  = pos;
+}
+
+void ReadCursor::readArrayRaw(void *data, size_t count, size_t size) {
+	if (count > ((_size - _pos) / size))
+		throw Exception(kReadError);
+
+	read(data, count * size);
+}
+
+void ReadCursor::readArrayLE(uint16 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint16));
+
+	FROM_LE_ARRAY_16(data, count);
+}
+
+void ReadCursor::readArrayLE(uint32 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint32));
+
+	FROM_LE_ARRAY_32(data, count);
+}
+
+void ReadCursor::readArrayLE(uint64 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint64));
+
+	FROM_LE_ARRAY_64(data, count);
+}
+
+void ReadCursor::readArrayBE(uint16 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint16));
+
+	FROM_BE_ARRAY_16(data, count);
+}
+
+void ReadCursor::readArrayBE(uint32 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint32));
+
+	FROM_BE_ARRAY_32(data, count);
+}
+
+void ReadCursor::readArrayBE(uint64 *data, size_t count) {
+	readArrayRaw(data, count, sizeof(uint64));
+
+	FROM_BE_ARRAY_64(data, count);
+}
+
+} // End of namespace Common
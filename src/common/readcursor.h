@@ -0,0 +1,236 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  A light-weight cursor for decoding data held in memory.
+ */
+
+#ifndef COMMON_READCURSOR_H
+#define COMMON_READCURSOR_H
+
+#include <cstring>
+
+#include <vector>
+
+#include "src/common/types.h"
+#include "src/common/endianness.h"
+#include "src/common/util.h"
+#include "src/common/error.h"
+
+namespace Common {
+
+class SeekableReadStream;
+
+/** A cursor for reading little and big endian data out of a block of memory.
+ *
+ *  Contrary to the ReadStream interface, nothing in here is virtual, and
+ *  all the single-value read methods are inline. This makes the cursor
+ *  suitable for the tight loops found in the format loaders, which read
+ *  lots of small, fixed-size records.
+ *
+ *  The cursor does not own the memory it reads from, and it is cheap to
+ *  copy. Like ReadStream, reading past the end throws a kReadError exception,
+ *  and seeking past the end throws a kSeekError exception.
+ */
+class ReadCursor {
+public:
+	/** Create a cursor over a block of memory, starting at position pos. */
+	ReadCursor(const byte *data, size_t size, size_t pos = 0) : _data(data), _size(size), _pos(pos) {
+		if (_pos > _size)
+			throw Exception(kSeekError);
+	}
+
+	/** Create a cursor over a whole stream, starting at the stream's current position.
+	 *
+	 *  If the stream is a MemoryReadStream, the cursor reads directly out of its
+	 *  memory. Otherwise, the stream's contents are read into buffer first, and the
+	 *  cursor reads from there. In both cases, the stream or the buffer need to
+	 *  outlive the cursor.
+	 */
+	ReadCursor(SeekableReadStream &stream, std::vector<byte> &buffer);
+
+	/** Return the current position of the cursor. */
+	size_t pos() const {
+		return _pos;
+	}
+
+	/** Return the size of the memory block the cursor reads from. */
+	size_t size() const {
+		return _size;
+	}
+
+	/** Return the number of bytes left to read. */
+	size_t left() const {
+		return _size - _pos;
+	}
+
+	/** Return the memory block the cursor reads from. */
+	const byte *getData() const {
+		return _data;
+	}
+
+	/** Move the cursor to an absolute position. */
+	void seek(size_t pos) {
+		if (pos > _size)
+			throw Exception(kSeekError);
+
+		_pos = pos;
+	}
+
+	/** Move the cursor forward by the specified number of bytes. */
+	void skip(size_t count) {
+		if (count > (_size - _pos))
+			throw Exception(kSeekError);
+
+		_pos += count;
+	}
+
+	/** Return a pointer to the next dataSize bytes and move the cursor past them. */
+	const byte *readPointer(size_t dataSize) {
+		if (dataSize > (_size - _pos))
+			throw Exception(kReadError);
+
+		const byte *ptr = _data + _pos;
+		_pos += dataSize;
+
+		return ptr;
+	}
+
+	/** Copy the next dataSize bytes into dataPtr.
+	 *
+	 *  Unlike ReadStream::read(), this never reads partially: if not
+	 *  enough data is left, a kReadError exception is thrown.
+	 */
+	void read(void *dataPtr, size_t dataSize) {
+		std::memcpy(dataPtr, readPointer(dataSize), dataSize);
+	}
+
+	byte readByte() {
+		return *readPointer(1);
+	}
+
+	int8 readSByte() {
+		return (int8) readByte();
+	}
+
+	uint16 readUint16LE() {
+		return READ_LE_UINT16(readPointer(2));
+	}
+
+	uint32 readUint32LE() {
+		return READ_LE_UINT32(readPointer(4));
+	}
+
+	uint64 readUint64LE() {
+		return READ_LE_UINT64(readPointer(8));
+	}
+
+	uint16 readUint16BE() {
+		return READ_BE_UINT16(readPointer(2));
+	}
+
+	uint32 readUint32BE() {
+		return READ_BE_UINT32(readPointer(4));
+	}
+
+	uint64 readUint64BE() {
+		return READ_BE_UINT64(readPointer(8));
+	}
+
+	int16 readSint16LE() {
+		return (int16) readUint16LE();
+	}
+
+	int32 readSint32LE() {
+		return (int32) readUint32LE();
+	}
+
+	int64 readSint64LE() {
+		return (int64) readUint64LE();
+	}
+
+	int16 readSint16BE() {
+		return (int16) readUint16BE();
+	}
+
+	int32 readSint32BE() {
+		return (int32) readUint32BE();
+	}
+
+	int64 readSint64BE() {
+		return (int64) readUint64BE();
+	}
+
+	float readIEEEFloatLE() {
+		return convertIEEEFloat(readUint32LE());
+	}
+
+	float readIEEEFloatBE() {
+		return convertIEEEFloat(readUint32BE());
+	}
+
+	double readIEEEDoubleLE() {
+		return convertIEEEDouble(readUint64LE());
+	}
+
+	double readIEEEDoubleBE() {
+		return convertIEEEDouble(readUint64BE());
+	}
+
+	/** Read count unsigned 16-bit words stored in little endian order into the array data. */
+	void readArrayLE(uint16 *data, size_t count);
+	/** Read count unsigned 32-bit words stored in little endian order into the array data. */
+	void readArrayLE(uint32 *data, size_t count);
+	/** Read count unsigned 64-bit words stored in little endian order into the array data. */
+	void readArrayLE(uint64 *data, size_t count);
+
+	/** Read count unsigned 16-bit words stored in big endian order into the array data. */
+	void readArrayBE(uint16 *data, size_t count);
+	/** Read count unsigned 32-bit words stored in big endian order into the array data. */
+	void readArrayBE(uint32 *data, size_t count);
+	/** Read count unsigned 64-bit words stored in big endian order into the array data. */
+	void readArrayBE(uint64 *data, size_t count);
+
+	/** Fill the whole vector with values stored in little endian order. */
+	template<typename T>
+	void readArrayLE(std::vector<T> &data) {
+		if (!data.empty())
+			readArrayLE(&data[0], data.size());
+	}
+
+	/** Fill the whole vector with values stored in big endian order. */
+	template<typename T>
+	void readArrayBE(std::vector<T> &data) {
+		if (!data.empty())
+			readArrayBE(&data[0], data.size());
+	}
+
+private:
+	const byte *_data;
+	size_t _size;
+	size_t _pos;
+
+	/** Copy count values of the given size into data. */
+	void readArrayRaw(void *data, size_t count, size_t size);
+};
+
+} // End of namespace Common
+
+#endif // COMMON_READCURSOR_H
@@ -23,8 +23,10 @@
  */
 
 #include <cassert>
+#include <cstring>
 
 #include "src/common/readfile.h"
+#include "src/common/memreadstream.h"
 #include "src/common/error.h"
 #include "src/common/ustring.h"
 #include "src/common/platform.h"
@@ -140,9 +142,30 @@ size_t ReadFile::read(void *dataPtr, size_t dataSize) {
 }
 
 MemoryReadStream *ReadFile::readIntoMemory(const UString &fileName) {
-	ReadFile file(fileName);
+	/* Copy the contents out of a memory mapping of the file, if possible.
+	 * This saves us the detour through the stdio buffers, while the caller
+	 * still gets a copy that's independent of the file on disk. */
 
-	return file.readStream(file.size());
+	size_t size = 0;
+	const byte *mapData = Platform::mapFile(fileName, size);
+	if (!mapData) {
+		ReadFile file(fileName);
+
+		return file.readStream(file.size());
+	}
+
+	byte *data = 0;
+	try {
+		data = new byte[size];
+	} catch (...) {
+		Platform::unmapFile(mapData, size);
+		throw;
+	}
+
+	std::memcpy(data, mapData, size);
+	Platform::unmapFile(mapData, size);
+
+	return new MemoryReadStream(data, size, true);
 }
 
 } // End of namespace Common
@@ -61,6 +61,47 @@ ReadStream::ReadStream() {
 ReadStream::~ReadStream() {
 }
 
+void ReadStream::readArrayRaw(void *data, size_t dataSize) {
+	if (read(data, dataSize) != dataSize)
+		throw Exception(kReadError);
+}
+
+void ReadStream::readArrayLE(uint16 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint16));
+
+	FROM_LE_ARRAY_16(data, count);
+}
+
+void ReadStream::readArrayLE(uint32 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint32));
+
+	FROM_LE_ARRAY_32(data, count);
+}
+
+void ReadStream::readArrayLE(uint64 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint64));
+
+	FROM_LE_ARRAY_64(data, count);
+}
+
+void ReadStream::readArrayBE(uint16 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint16));
+
+	FROM_BE_ARRAY_16(data, count);
+}
+
+void ReadStream::readArrayBE(uint32 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint32));
+
+	FROM_BE_ARRAY_32(data, count);
+}
+
+void ReadStream::readArrayBE(uint64 *data, size_t count) {
+	readArrayRaw(data, count * sizeof(uint64));
+
+	FROM_BE_ARRAY_64(data, count);
+}
+
 MemoryReadStream *ReadStream::readStream(size_t dataSize) {
 	byte *buf = new byte[dataSize];
 
@@ -251,12 +251,53 @@ public:
 		return convertIEEEDouble(readUint64BE());
 	}
 
+	/* Read multiple values at once.
+	 *
+	 * These need only a single call to read() and are a lot faster than
+	 * calling the single-value read methods in a loop. When reading fails,
+	 * a kReadError exception is thrown.
+	 */
+
+	/** Read count unsigned 16-bit words stored in little endian (LSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayLE(uint16 *data, size_t count);
+
+	/** Read count unsigned 32-bit words stored in little endian (LSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayLE(uint32 *data, size_t count);
+
+	/** Read count unsigned 64-bit words stored in little endian (LSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayLE(uint64 *data, size_t count);
+
+	/** Read count unsigned 16-bit words stored in big endian (MSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayBE(uint16 *data, size_t count);
+
+	/** Read count unsigned 32-bit words stored in big endian (MSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayBE(uint32 *data, size_t count);
+
+	/** Read count unsigned 64-bit words stored in big endian (MSB first) order
+	 *  from the stream into the array data.
+	 */
+	void readArrayBE(uint64 *data, size_t count);
+
 	/** Read the specified amount of data into a new[]'ed buffer
 	 *  which then is wrapped into a MemoryReadStream.
 	 *
 	 *  When reading fails, a kReadError exception is thrown.
 	 */
 	MemoryReadStream *readStream(size_t dataSize);
+
+private:
+	/** Read exactly dataSize bytes, or throw a kReadError exception. */
+	void readArrayRaw(void *data, size_t dataSize);
 };
 
 
@@ -0,0 +1,154 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Threading system helpers.
+ */
+
+#include "src/common/system.h"
+
+#if defined(WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+#include "src/common/util.h"
+#include "src/common/error.h"
+#include "src/common/thread.h"
+
+namespace Common {
+
+#if defined(WIN32)
+
+struct Thread::Implementation {
+	HANDLE handle;
+
+	static unsigned __stdcall start(void *thread) {
+		Thread::runThread(static_cast<Thread *>(thread));
+		return 0;
+	}
+};
+
+#else
+
+struct Thread::Implementation {
+	pthread_t handle;
+
+	static void *start(void *thread) {
+		Thread::runThread(static_cast<Thread *>(thread));
+		return 0;
+	}
+};
+
+#endif
+
+Thread::Thread() : _thread(0) {
+}
+
+Thread::~Thread() {
+	joinThread();
+}
+
+void Thread::runThread(Thread *thread) {
+	try {
+		thread->threadMethod();
+	} catch (...) {
+		exceptionDispatcherWarnAndIgnore("Uncaught exception in thread");
+	}
+}
+
+bool Thread::isRunning() const {
+	return _thread != 0;
+}
+
+#if defined(WIN32)
+
+void Thread::createThread() {
+	if (_thread)
+		throw Exception("Thread already running");
+
+	_thread = new Implementation;
+
+	_thread->handle = (HANDLE) _beginthreadex(0, 0, &Implementation::start, this, 0, 0);
+	if (!_thread->handle) {
+		delete _thread;
+		_thread = 0;
+
+		throw Exception("Failed to create thread");
+	}
+}
+
+void Thread::joinThread() {
+	if (!_thread)
+		return;
+
+	WaitForSingleObject(_thread->handle, INFINITE);
+	CloseHandle(_thread->handle);
+
+	delete _thread;
+	_thread = 0;
+}
+
+uint Thread::getCPUCount() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return MAX<uint>(info.dwNumberOfProcessors, 1);
+}
+
+#else
+
+void Thread::createThread() {
+	if (_thread)
+		throw Exception("Thread already running");
+
+	_thread = new Implementation;
+
+	if (pthread_create(&_thread->handle, 0, &Implementation::start, this) != 0) {
+		delete _thread;
+		_thread = 0;
+
+		throw Exception("Failed to create thread");
+	}
+}
+
+void Thread::joinThread() {
+	if (!_thread)
+		return;
+
+	pthread_join(_thread->handle, 0);
+
+	delete _thread;
+	_thread = 0;
+}
+
+uint Thread::getCPUCount() {
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? (uint)count : 1;
+}
+
+#endif
+
+} // End of namespace Common
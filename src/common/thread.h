@@ -0,0 +1,73 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Threading system helpers.
+ */
+
+#ifndef COMMON_THREAD_H
+#define COMMON_THREAD_H
+
+#include "src/common/types.h"
+#include "src/common/noncopyable.h"
+
+namespace Common {
+
+/** A class that creates its own thread.
+ *
+ *  Subclasses implement threadMethod(), which is run in the new thread
+ *  after createThread() is called. Subclasses need to call joinThread()
+ *  in their own destructor, since threadMethod() is not available
+ *  anymore by the time ~Thread() runs.
+ */
+class Thread : public NonCopyable {
+public:
+	Thread();
+	virtual ~Thread();
+
+	/** Create and start the thread. Throws on failure. */
+	void createThread();
+
+	/** Wait for the thread to finish. Does nothing if the thread is not running. */
+	void joinThread();
+
+	/** Was the thread created and not yet joined? */
+	bool isRunning() const;
+
+	/** Return the number of CPU cores available to this process. */
+	static uint getCPUCount();
+
+protected:
+	/** The method to run within the thread. It must not throw. */
+	virtual void threadMethod() = 0;
+
+private:
+	struct Implementation;
+
+	Implementation *_thread;
+
+	static void runThread(Thread *thread);
+
+	friend struct Implementation;
+};
+
+} // End of namespace Common
+
+#endif // COMMON_THREAD_H
@@ -25,6 +25,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cctype>
+#include <cstring>
 
 #include "src/common/ustring.h"
 #include "src/common/error.h"
@@ -32,7 +33,124 @@
 
 namespace Common {
 
-UString::UString() : _size(0) {
+static const uint64 kHighBits = 0x8080808080808080ULL;
+static const uint64 kLowBits  = 0x0101010101010101ULL;
+
+/** Read 8 bytes of string data as one word, regardless of alignment. */
+static inline uint64 readWord(const char *data) {
+	uint64 word;
+	std::memcpy(&word, data, sizeof(word));
+
+	return word;
+}
+
+/** Does this string data only consist of ASCII characters? */
+static bool isASCIIData(const char *data, size_t size) {
+	// Look at 8 bytes at a time
+	size_t i = 0;
+	for (; (i + 8) <= size; i += 8)
+		if (readWord(data + i) & kHighBits)
+			return false;
+
+	for (; i < size; i++)
+		if (data[i] & 0x80)
+			return false;
+
+	return true;
+}
+
+/** Count the characters in UTF-8 data, while validating it.
+ *
+ *  This applies the same rules as utf8cpp: no stray continuation bytes, no
+ *  truncated or overlong sequences, no surrogates and nothing above U+10FFFF.
+ *  Returns false if the data is not valid UTF-8.
+ */
+static bool countUTF8(const char *str, size_t size, size_t &count) {
+	const byte *data = reinterpret_cast<const byte *>(str);
+
+	count = 0;
+
+	size_t i = 0;
+	while (i < size) {
+		// Skip over ASCII characters, 8 bytes at a time
+		if (((i + 8) <= size) && !(readWord(str + i) & kHighBits)) {
+			i     += 8;
+			count += 8;
+			continue;
+		}
+
+		const byte c = data[i];
+		if (c < 0x80) {
+			i++;
+			count++;
+			continue;
+		}
+
+		size_t length;
+		uint32 codepoint;
+
+		if        ((c & 0xE0) == 0xC0) {
+			length    = 2;
+			codepoint = c & 0x1F;
+		} else if ((c & 0xF0) == 0xE0) {
+			length    = 3;
+			codepoint = c & 0x0F;
+		} else if ((c & 0xF8) == 0xF0) {
+			length    = 4;
+			codepoint = c & 0x07;
+		} else
+			return false;
+
+		if ((i + length) > size)
+			return false;
+
+		for (size_t j = 1; j < length; j++) {
+			if ((data[i + j] & 0xC0) != 0x80)
+				return false;
+
+			codepoint = (codepoint << 6) | (data[i + j] & 0x3F);
+		}
+
+		if (((length == 2) && (codepoint < 0x80)) ||
+		    ((length == 3) && (codepoint < 0x800)) ||
+		    ((length == 4) && (codepoint < 0x10000)))
+			return false;
+
+		if (((codepoint >= 0xD800) && (codepoint <= 0xDFFF)) || (codepoint > 0x10FFFF))
+			return false;
+
+		i += length;
+		count++;
+	}
+
+	return true;
+}
+
+/** Lowercase a single ASCII byte. Other bytes are left alone. */
+static inline byte lowerASCII(byte c) {
+	return ((c >= 'A') && (c <= 'Z')) ? (c + ('a' - 'A')) : c;
+}
+
+/** Uppercase a single ASCII byte. Other bytes are left alone. */
+static inline byte upperASCII(byte c) {
+	return ((c >= 'a') && (c <= 'z')) ? (c - ('a' - 'A')) : c;
+}
+
+/** Lowercase all 8 bytes in a word at once. Only valid if they're all ASCII. */
+static inline uint64 lowerASCIIWord(uint64 word) {
+	/* With all bytes below 0x80, none of these additions can carry over into
+	 * the next byte. The high bit of each byte then tells whether the byte is
+	 * >= 'A' and > 'Z', respectively. */
+
+	const uint64 aboveA = word + (0x80 - 'A'    ) * kLowBits;
+	const uint64 aboveZ = word + (0x80 - 'Z' - 1) * kLowBits;
+
+	// For the upper case letters, set the 0x20 bit
+	return word | (((aboveA & ~aboveZ) & kHighBits) >> 2);
+}
+
+
+UString::UString() : _size(0), _ascii(true) {
 }
 
 UString::UString(const UString &str) {
@@ -51,12 +169,12 @@ UString::UString(const char *str, size_t n) {
 	*this = std::string(str, n);
 }
 
-UString::UString(uint32 c, size_t n) : _size(0) {
+UString::UString(uint32 c, size_t n) : _size(0), _ascii(true) {
 	while (n-- > 0)
 		*this += c;
 }
 
-UString::UString(iterator sBegin, iterator sEnd) : _size(0) {
+UString::UString(iterator sBegin, iterator sEnd) : _size(0), _ascii(true) {
 	for (; (sBegin != sEnd) && *sBegin; ++sBegin)
 		*this += *sBegin;
 }
@@ -67,6 +185,7 @@ UString::~UString() {
 UString &UString::operator=(const UString &str) {
 	_string = str._string;
 	_size   = str._size;
+	_ascii  = str._ascii;
 
 	return *this;
 }
@@ -86,11 +205,11 @@ UString &UString::operator=(const char *str) {
 }
 
 bool UString::operator==(const UString &str) const {
-	return strcmp(str) == 0;
+	return _string == str._string;
 }
 
 bool UString::operator!=(const UString &str) const {
-	return strcmp(str) != 0;
+	return _string != str._string;
 }
 
 bool UString::operator<(const UString &str) const {
@@ -136,6 +255,7 @@ UString UString::operator+(uint32 c) const {
 UString &UString::operator+=(const UString &str) {
 	_string += str._string;
 	_size   += str._size;
+	_ascii   = _ascii && str._ascii;
 
 	return *this;
 }
@@ -153,6 +273,14 @@ UString &UString::operator+=(const char *str) {
 }
 
 UString &UString::operator+=(uint32 c) {
+	if (isASCII(c)) {
+		// An ASCII character is always a single byte in UTF-8
+		_string.push_back((char) c);
+		_size++;
+
+		return *this;
+	}
+
 	try {
 		utf8::append(c, std::back_inserter(_string));
 	} catch (const std::exception &se) {
@@ -161,38 +289,52 @@ UString &UString::operator+=(uint32 c) {
 	}
 
 	_size++;
+	_ascii = false;
 
 	return *this;
 }
 
 int UString::strcmp(const UString &str) const {
-	UString::iterator it1 = begin();
-	UString::iterator it2 = str.begin();
-	for (; (it1 != end()) && (it2 != str.end()); ++it1, ++it2) {
-		uint32 c1 = *it1;
-		uint32 c2 = *it2;
-
-		if (c1 < c2)
-			return -1;
-		if (c1 > c2)
-			return  1;
-	}
-
-	if ((it1 == end()) && (it2 == str.end()))
-		return 0;
+	/* A byte-wise comparison of UTF-8 data orders the same way a comparison
+	 * of the decoded codepoints does. No need to decode anything. */
 
-	if (it1 == end())
-		return -1;
+	const int result = _string.compare(str._string);
 
-	return 1;
+	return (result < 0) ? -1 : ((result > 0) ? 1 : 0);
 }
 
 int UString::stricmp(const UString &str) const {
-	UString::iterator it1 = begin();
-	UString::iterator it2 = str.begin();
-	for (; (it1 != end()) && (it2 != str.end()); ++it1, ++it2) {
-		uint32 c1 = toLower(*it1);
-		uint32 c2 = toLower(*it2);
+	/* We only lowercase ASCII characters (see toLower()), and the bytes of a
+	 * multi-byte UTF-8 sequence are never in the ASCII range. So we can also
+	 * compare byte-wise here, lowercasing only ASCII bytes, and still get the
+	 * same result as comparing lowercased codepoints.
+	 *
+	 * Since most strings are pure ASCII, we first compare whole words of
+	 * 8 bytes, until we find a word that differs after lowercasing (or that
+	 * contains non-ASCII bytes). The rest is then compared byte by byte. */
+
+	const char *data1 = _string.data();
+	const char *data2 = str._string.data();
+
+	const size_t size1 = _string.size();
+	const size_t size2 = str._string.size();
+	const size_t size  = MIN(size1, size2);
+
+	size_t i = 0;
+	for (; (i + 8) <= size; i += 8) {
+		const uint64 word1 = readWord(data1 + i);
+		const uint64 word2 = readWord(data2 + i);
+
+		if (word1 == word2)
+			continue;
+
+		if (((word1 | word2) & kHighBits) || (lowerASCIIWord(word1) != lowerASCIIWord(word2)))
+			break;
+	}
+
+	for (; i < size; i++) {
+		const byte c1 = lowerASCII(data1[i]);
+		const byte c2 = lowerASCII(data2[i]);
 
 		if (c1 < c2)
 			return -1;
@@ -200,13 +342,10 @@ int UString::stricmp(const UString &str) const {
 			return  1;
 	}
 
-	if ((it1 == end()) && (it2 == str.end()))
+	if (size1 == size2)
 		return 0;
 
-	if (it1 == end())
-		return -1;
-
-	return 1;
+	return (size1 < size2) ? -1 : 1;
 }
 
 bool UString::equals(const UString &str) const {
@@ -228,18 +367,24 @@ bool UString::lessIgnoreCase(const UString &str) const {
 void UString::swap(UString &str) {
 	_string.swap(str._string);
 
-	SWAP(_size, str._size);
+	SWAP(_size , str._size );
+	SWAP(_ascii, str._ascii);
 }
 
 void UString::clear() {
 	_string.clear();
-	_size = 0;
+	_size  = 0;
+	_ascii = true;
 }
 
 size_t UString::size() const {
 	return _size;
 }
 
+bool UString::isASCII() const {
+	return _ascii;
+}
+
 bool UString::empty() const {
 	return _string.empty() || (_string[0] == '\0');
 }
@@ -257,6 +402,15 @@ UString::iterator UString::end() const {
 }
 
 UString::iterator UString::findFirst(uint32 c) const {
+	if (isASCII(c)) {
+		// An ASCII byte can't be part of a multi-byte UTF-8 sequence, so just look for the byte
+		const size_t index = _string.find((char) c);
+		if (index == std::string::npos)
+			return end();
+
+		return iterator(_string.begin() + index, _string.begin(), _string.end());
+	}
+
 	for (iterator it = begin(); it != end(); ++it)
 		if (*it == c)
 			return it;
@@ -297,17 +451,11 @@ bool UString::beginsWith(const UString &with) const {
 	if (empty())
 		return false;
 
-	UString::iterator myIt   = begin();
-	UString::iterator withIt = with.begin();
-
-	while ((myIt != end()) && (withIt != with.end()))
-		if (*myIt++ != *withIt++)
-			return false;
-
-	if ((myIt == end()) && (withIt != with.end()))
+	// The UTF-8 data of a prefix is a prefix of the UTF-8 data
+	if (with._string.size() > _string.size())
 		return false;
 
-	return true;
+	return _string.compare(0, with._string.size(), with._string) == 0;
 }
 
 bool UString::endsWith(const UString &with) const {
@@ -317,17 +465,12 @@ bool UString::endsWith(const UString &with) const {
 	if (empty())
 		return false;
 
-	UString::iterator myIt   = --end();
-	UString::iterator withIt = --with.end();
-
-	while ((myIt != begin()) && (withIt != with.begin()))
-		if (*myIt-- != *withIt--)
-			return false;
-
-	if (withIt == with.begin())
-		return (*myIt == *withIt);
+	/* Likewise for suffixes, since with starts with a complete UTF-8 sequence.
+	 * A match therefore always starts at a character boundary. */
+	if (with._string.size() > _string.size())
+		return false;
 
-	return false;
+	return _string.compare(_string.size() - with._string.size(), with._string.size(), with._string) == 0;
 }
 
 bool UString::contains(const UString &what) const {
@@ -351,6 +494,14 @@ void UString::truncate(size_t n) {
 	if (n >= _size)
 		return;
 
+	if (_ascii) {
+		// Every character is a single byte
+		_string.resize(n);
+		_size = n;
+
+		return;
+	}
+
 	UString temp;
 
 	for (iterator it = begin(); n > 0; ++it, n--)
@@ -457,6 +608,7 @@ void UString::replaceAll(uint32 what, uint32 with) {
 
 		// And set the new string's contents
 		_string.swap(newString);
+		_ascii = isASCIIData(_string.data(), _string.size());
 
 	} catch (const std::exception &se) {
 		Exception e(se);
@@ -473,26 +625,34 @@ void UString::makeUpper() {
 }
 
 UString UString::toLower() const {
-	UString str;
+	/* Only ASCII characters change, and those are single bytes that never
+	 * appear within multi-byte UTF-8 sequences. So we can work on the bytes. */
 
-	str._string.reserve(_string.size());
-	for (iterator it = begin(); it != end(); ++it)
-		str += toLower(*it);
+	UString str(*this);
+	for (std::string::iterator c = str._string.begin(); c != str._string.end(); ++c)
+		*c = (char) lowerASCII(*c);
 
 	return str;
 }
 
 UString UString::toUpper() const {
-	UString str;
+	// See toLower()
 
-	str._string.reserve(_string.size());
-	for (iterator it = begin(); it != end(); ++it)
-		str += toUpper(*it);
+	UString str(*this);
+	for (std::string::iterator c = str._string.begin(); c != str._string.end(); ++c)
+		*c = (char) upperASCII(*c);
 
 	return str;
 }
 
 UString::iterator UString::getPosition(size_t n) const {
+	if (_ascii) {
+		// Every character is a single byte
+		std::string::const_iterator it = _string.begin() + MIN(n, _string.size());
+
+		return iterator(it, _string.begin(), _string.end());
+	}
+
 	iterator it = begin();
 	for (size_t i = 0; (i < n) && (it != end()); i++, ++it);
 	return it;
@@ -748,6 +908,17 @@ size_t UString::split(const UString &text, uint32 delim, std::vector<UString> &t
 }
 
 void UString::recalculateSize() {
+	// For pure ASCII data, the size in characters is the size in bytes
+	_ascii = isASCIIData(_string.data(), _string.size());
+	if (_ascii) {
+		_size = _string.size();
+		return;
+	}
+
+	if (countUTF8(_string.data(), _string.size(), _size))
+		return;
+
+	// Invalid UTF-8. Let utf8cpp throw the appropriate exception
 	try {
 		// Calculate the "distance" in characters from the beginning and end
 		_size = utf8::distance(_string.begin(), _string.end());
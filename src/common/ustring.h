@@ -114,6 +114,9 @@ public:
 	/** Return the size of the string, in characters. */
 	size_t size() const;
 
+	/** Does the string only consist of ASCII characters? */
+	bool isASCII() const;
+
 	/** Is the string empty? */
 	bool empty() const;
 
@@ -198,7 +201,8 @@ public:
 private:
 	std::string _string; ///< Internal string holding the actual data.
 
-	size_t _size;
+	size_t _size;  ///< The size of the string, in characters.
+	bool   _ascii; ///< Does the string only consist of ASCII characters?
 
 	void recalculateSize();
 };
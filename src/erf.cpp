@@ -0,0 +1,377 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Tool to pack ERF archives.
+ */
+
+#include <cstring>
+#include <cstdio>
+
+#include "src/common/version.h"
+#include "src/common/ustring.h"
+#include "src/common/error.h"
+#include "src/common/platform.h"
+#include "src/common/filepath.h"
+#include "src/common/writefile.h"
+#include "src/common/jobqueue.h"
+
+#include "src/aurora/util.h"
+#include "src/aurora/erffile.h"
+#include "src/aurora/erfwriter.h"
+
+#include "src/util.h"
+
+void printUsage(FILE *stream, const Common::UString &name);
+bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
+                      Common::UString &archive, std::vector<Common::UString> &files,
+                      Aurora::ERFWriter::Version &version, bool &compress, uint &jobs);
+
+uint32 getERFID(const Common::UString &archive);
+Aurora::ERFFile::Compression getCompression(Aurora::ERFWriter::Version version, bool compress);
+
+void packFiles(const Common::UString &archive, const std::vector<Common::UString> &fileNames,
+               Aurora::ERFWriter::Version version, bool compress, uint jobs);
+
+int main(int argc, char **argv) {
+	try {
+		std::vector<Common::UString> args;
+		Common::Platform::getParameters(argc, argv, args);
+
+		Aurora::ERFWriter::Version version = Aurora::ERFWriter::kVersion10;
+
+		int returnValue = 1;
+		Common::UString archive;
+		std::vector<Common::UString> files;
+		bool compress = false;
+		uint jobs = 1;
+
+		if (!parseCommandLine(args, returnValue, archive, files, version, compress, jobs))
+			return returnValue;
+
+		packFiles(archive, files, version, compress, jobs);
+
+	} catch (...) {
+		Common::exceptionDispatcherError();
+	}
+
+	return 0;
+}
+
+bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
+                      Common::UString &archive, std::vector<Common::UString> &files,
+                      Aurora::ERFWriter::Version &version, bool &compress, uint &jobs) {
+
+	archive.clear();
+	files.clear();
+
+	std::vector<Common::UString> args;
+
+	bool optionsEnd = false;
+	for (size_t i = 1; i < argv.size(); i++) {
+		bool isOption = false;
+
+		// A "--" marks an end to all options
+		if (argv[i] == "--") {
+			optionsEnd = true;
+			continue;
+		}
+
+		// We're still handling options
+		if (!optionsEnd) {
+			// Help text
+			if ((argv[i] == "-h") || (argv[i] == "--help")) {
+				printUsage(stdout, argv[0]);
+				returnValue = 0;
+
+				return false;
+			}
+
+			if (argv[i] == "--version") {
+				printVersion();
+				returnValue = 0;
+
+				return false;
+			}
+
+			if        (argv[i] == "--v10") {
+				isOption = true;
+				version  = Aurora::ERFWriter::kVersion10;
+			} else if (argv[i] == "--v22") {
+				isOption = true;
+				version  = Aurora::ERFWriter::kVersion22;
+			} else if (argv[i] == "--v30") {
+				isOption = true;
+				version  = Aurora::ERFWriter::kVersion30;
+			} else if ((argv[i] == "-c") || (argv[i] == "--compress")) {
+				isOption = true;
+				compress = true;
+			} else if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				isOption = true;
+
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+
+			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
+			  // An options, but we already checked for all known ones
+
+				printUsage(stderr, argv[0]);
+				returnValue = 1;
+
+				return false;
+			}
+		}
+
+		// Was this a valid option? If so, don't try to use it as a file
+		if (isOption)
+			continue;
+
+		args.push_back(argv[i]);
+	}
+
+	if (args.size() < 2) {
+		printUsage(stderr, argv[0]);
+		returnValue = 1;
+
+		return false;
+	}
+
+	// V1.0 ERFs can't be compressed
+	if (compress && (version == Aurora::ERFWriter::kVersion10)) {
+		std::fprintf(stderr, "Compression is only supported for V2.2 and V3.0 ERFs\n\n");
+		printUsage(stderr, argv[0]);
+		returnValue = 1;
+
+		return false;
+	}
+
+	archive = args[0];
+	files.assign(args.begin() + 1, args.end());
+
+	return true;
+}
+
+void printUsage(FILE *stream, const Common::UString &name) {
+	std::fprintf(stream, "BioWare ERF archive packer\n\n");
+	std::fprintf(stream, "Usage: %s [<options>] <archive> <file> [<file> [...]]\n\n", name.c_str());
+	std::fprintf(stream, "Options:\n");
+	std::fprintf(stream, "  -h      --help        This help text\n");
+	std::fprintf(stream, "          --version     Display version information\n");
+	std::fprintf(stream, "          --v10         Create a V1.0 ERF (Neverwinter Nights, KotOR) (default)\n");
+	std::fprintf(stream, "          --v22         Create a V2.2 ERF (Dragon Age: Origins)\n");
+	std::fprintf(stream, "          --v30         Create a V3.0 ERF (Dragon Age II)\n");
+	std::fprintf(stream, "  -c      --compress    Compress the resources (V2.2 and V3.0 only)\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>    Compress with n parallel jobs (0: one per CPU core)\n\n");
+	std::fprintf(stream, "The ID of a V1.0 ERF is chosen by the extension of the archive:\n");
+	std::fprintf(stream, ".mod, .hak and .sav files get their respective IDs, all others are \"ERF \".\n");
+}
+
+uint32 getERFID(const Common::UString &archive) {
+	const Common::UString extension = Common::FilePath::getExtension(archive);
+
+	if (extension.equalsIgnoreCase(".mod"))
+		return MKTAG('M', 'O', 'D', ' ');
+	if (extension.equalsIgnoreCase(".hak"))
+		return MKTAG('H', 'A', 'K', ' ');
+	if (extension.equalsIgnoreCase(".sav"))
+		return MKTAG('S', 'A', 'V', ' ');
+
+	return MKTAG('E', 'R', 'F', ' ');
+}
+
+Aurora::ERFFile::Compression getCompression(Aurora::ERFWriter::Version version, bool compress) {
+	if (!compress)
+		return Aurora::ERFFile::kCompressionNone;
+
+	// Use the same compression the respective games use
+	if (version == Aurora::ERFWriter::kVersion30)
+		return Aurora::ERFFile::kCompressionHeaderlessZlib;
+
+	return Aurora::ERFFile::kCompressionBioWareZlib;
+}
+
+/** Compressing files to pack, one job per file.
+ *
+ *  Every file is compressed independently of all the others, so this scales
+ *  with the number of CPU cores. The compressed data is kept in memory until
+ *  it is written into the archive, after the resource tables.
+ */
+class CompressJobs : public Common::JobQueue {
+public:
+	CompressJobs(const std::vector<PackFile> &files, Aurora::ERFFile::Compression compression) :
+		_files(&files), _compression(compression), _data(files.size(), 0), _sizes(files.size(), 0),
+		_errors(files.size(), 0), _errorCount(0) {
+
+	}
+
+	~CompressJobs() {
+		for (std::vector<byte *>::iterator d = _data.begin(); d != _data.end(); ++d)
+			delete[] *d;
+
+		for (std::vector<Common::Exception *>::iterator e = _errors.begin(); e != _errors.end(); ++e)
+			delete *e;
+	}
+
+	/** Return the number of files that failed to compress. */
+	size_t getErrorCount() const {
+		return _errorCount;
+	}
+
+	/** Return the compressed data of a file. */
+	const byte *getData(size_t file) const {
+		return _data[file];
+	}
+
+	/** Return the size of the compressed data of a file. */
+	uint32 getSize(size_t file) const {
+		return _sizes[file];
+	}
+
+	/** Free the compressed data of a file. */
+	void freeData(size_t file) {
+		delete[] _data[file];
+		_data[file] = 0;
+	}
+
+protected:
+	void runJob(size_t job) {
+		try {
+			compressFile(job);
+		} catch (Common::Exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (std::exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (...) {
+			_errors[job] = new Common::Exception("Unknown exception caught");
+		}
+	}
+
+	void finishJob(size_t job) {
+		const PackFile &file = (*_files)[job];
+
+		std::printf("Compressing %u/%u: %s ... ", (uint)(job + 1), (uint)_files->size(), file.fileName.c_str());
+
+		if (_errors[job]) {
+			std::fflush(stdout);
+			Common::printException(*_errors[job], "");
+
+			delete _errors[job];
+			_errors[job] = 0;
+
+			_errorCount++;
+			return;
+		}
+
+		std::printf("Done\n");
+	}
+
+private:
+	const std::vector<PackFile> *_files;
+
+	Aurora::ERFFile::Compression _compression;
+
+	std::vector<byte *> _data;
+	std::vector<uint32> _sizes;
+
+	/** The error that occurred while compressing each file, if any. */
+	std::vector<Common::Exception *> _errors;
+	size_t _errorCount;
+
+
+	void compressFile(size_t job) {
+		const PackFile &file = (*_files)[job];
+
+		byte *data = readPackFile(file);
+
+		size_t packedSize = 0;
+		try {
+			_data[job] = Aurora::ERFWriter::compress(_compression, data, file.size, packedSize);
+		} catch (...) {
+			delete[] data;
+			throw;
+		}
+
+		delete[] data;
+
+		if ((uint64)packedSize > 0xFFFFFFFF)
+			throw Common::Exception("Compressed file \"%s\" too big", file.fileName.c_str());
+
+		_sizes[job] = packedSize;
+	}
+};
+
+void packFiles(const Common::UString &archive, const std::vector<Common::UString> &fileNames,
+               Aurora::ERFWriter::Version version, bool compress, uint jobs) {
+
+	std::vector<PackFile> files;
+	getPackFiles(fileNames, files);
+
+	std::printf("Number of files: %u\n\n", (uint)files.size());
+
+	const Aurora::ERFFile::Compression compression = getCompression(version, compress);
+
+	CompressJobs compressJobs(files, compression);
+	if (compression != Aurora::ERFFile::kCompressionNone) {
+		compressJobs.run(files.size(), jobs);
+
+		std::printf("\n");
+
+		if (compressJobs.getErrorCount() > 0)
+			throw Common::Exception("Failed to compress %u file(s)", (uint)compressJobs.getErrorCount());
+	}
+
+	Aurora::ERFWriter erf(version, getERFID(archive), compression);
+	for (size_t i = 0; i < files.size(); i++) {
+		const uint32 packedSize = compress ? compressJobs.getSize(i) : files[i].size;
+
+		erf.add(files[i].name, files[i].type, packedSize, files[i].size);
+	}
+
+	Common::WriteFile file;
+	if (!file.open(archive))
+		throw Common::Exception(Common::kOpenError);
+
+	erf.write(file);
+
+	for (size_t i = 0; i < files.size(); i++) {
+		std::printf("Packing %u/%u: %s ... ", (uint)(i + 1), (uint)files.size(), files[i].fileName.c_str());
+		std::fflush(stdout);
+
+		if (compress) {
+			if (file.write(compressJobs.getData(i), compressJobs.getSize(i)) != compressJobs.getSize(i))
+				throw Common::Exception(Common::kWriteError);
+
+			compressJobs.freeData(i);
+		} else
+			writePackFile(file, files[i]);
+
+		std::printf("Done\n");
+	}
+
+	file.flush();
+	file.close();
+}
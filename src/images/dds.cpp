@@ -77,8 +77,8 @@ void DDS::load(Common::SeekableReadStream &dds) {
 		throw;
 	}
 
-	// In xoreos-tools, we always want decompressed images
-	decompress();
+	// In xoreos-tools, we always want decompressed images. Each mip map is decompressed when it's needed
+	deferDecompression();
 }
 
 void DDS::readHeader(Common::SeekableReadStream &dds, DataType &dataType) {
@@ -26,7 +26,8 @@
 
 #include "src/common/util.h"
 #include "src/common/error.h"
-#include "src/common/memreadstream.h"
+#include "src/common/thread.h"
+#include "src/common/jobqueue.h"
 
 #include "src/images/decoder.h"
 #include "src/images/util.h"
@@ -35,6 +36,64 @@
 
 namespace Images {
 
+/** Pending operations on a mip map that's decompressed lazily. */
+enum PendingOperation {
+	kPendingDecompress      = 1 << 0,
+	kPendingFlipHorizontal  = 1 << 1,
+	kPendingFlipVertical    = 1 << 2
+};
+
+/** The number of compressed blocks in one chunk processed by one job of a DecompressJobs queue. */
+static const size_t kChunkBlockCount = 4096;
+
+typedef void (*DecompressFunc)(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch);
+
+/** Decompressing a big mip map in parallel, one job per chunk of block rows.
+ *
+ *  The DXT decompressors walk through the blocks row by row, so a chunk
+ *  of whole block rows can be decompressed as if it was an image of its
+ *  own, with a correspondingly smaller height.
+ *
+ *  This only holds for chunks at least 4 pixels high, though. Images less
+ *  than one block high are addressed differently. So the last job takes
+ *  all the rows left over, and a trailing partial block row never gets a
+ *  job of its own.
+ */
+class DecompressJobs : public Common::JobQueue {
+public:
+	DecompressJobs(DecompressFunc func, Decoder::MipMap &out, const Decoder::MipMap &in,
+	               size_t blockSize, uint32 chunkRows, size_t jobCount) :
+		_func(func), _out(&out), _in(&in), _blockSize(blockSize), _chunkRows(chunkRows), _jobCount(jobCount) {
+
+	}
+
+protected:
+	void runJob(size_t job) {
+		const uint32 blocksPerRow = (_out->width + 3) / 4;
+		const bool   lastJob      = job == (_jobCount - 1);
+
+		const uint32 firstRow  = job * _chunkRows;
+		const uint32 height    = lastJob ? (_out->height - firstRow * 4) : (_chunkRows * 4);
+		const size_t offset    = MIN<size_t>((size_t) firstRow * blocksPerRow * _blockSize, _in->size);
+		const size_t chunkSize = lastJob ? (_in->size - offset) : ((size_t) _chunkRows * blocksPerRow * _blockSize);
+		const uint32 pitch     = _out->width * 4;
+
+		(*_func)(_out->data + firstRow * 4 * pitch, _in->data + offset, MIN<size_t>(_in->size - offset, chunkSize),
+		         _out->width, height, pitch);
+	}
+
+private:
+	DecompressFunc _func;
+
+	Decoder::MipMap *_out;
+	const Decoder::MipMap *_in;
+
+	size_t _blockSize;
+	uint32 _chunkRows;
+	size_t _jobCount;
+};
+
+
 Decoder::MipMap::MipMap() : width(0), height(0), size(0), data(0) {
 }
 
@@ -70,7 +129,8 @@ void Decoder::MipMap::swap(MipMap &right) {
 }
 
 
-Decoder::Decoder() : _format(kPixelFormatR8G8B8A8), _layerCount(1), _isCubeMap(false) {
+Decoder::Decoder() : _format(kPixelFormatR8G8B8A8), _layerCount(1), _isCubeMap(false),
+	_compressedFormat(kPixelFormatR8G8B8A8) {
 }
 
 Decoder::Decoder(const Decoder &decoder) {
@@ -94,6 +154,9 @@ Decoder &Decoder::operator=(const Decoder &decoder) {
 	for (std::vector<MipMap *>::const_iterator m = decoder._mipMaps.begin(); m != decoder._mipMaps.end(); ++m)
 		_mipMaps.push_back(new MipMap(**m));
 
+	_compressedFormat = decoder._compressedFormat;
+	_pending          = decoder._pending;
+
 	return *this;
 }
 
@@ -135,9 +198,33 @@ const Decoder::MipMap &Decoder::getMipMap(size_t mipMap, size_t layer) const {
 
 	assert(index < _mipMaps.size());
 
+	if (isPending(index))
+		decompressMipMap(index);
+
 	return *_mipMaps[index];
 }
 
+bool Decoder::isPending(size_t index) const {
+	return (index < _pending.size()) && (_pending[index] & kPendingDecompress);
+}
+
+void Decoder::decompressMipMap(size_t index) const {
+	MipMap &mipMap = *_mipMaps[index];
+
+	MipMap decompressed;
+	decompress(decompressed, mipMap, _compressedFormat);
+	decompressed.swap(mipMap);
+
+	const int bpp = getBPP(kPixelFormatR8G8B8A8);
+
+	if (_pending[index] & kPendingFlipHorizontal)
+		::Images::flipHorizontally(mipMap.data, mipMap.width, mipMap.height, bpp);
+	if (_pending[index] & kPendingFlipVertical)
+		::Images::flipVertically(mipMap.data, mipMap.width, mipMap.height, bpp);
+
+	_pending[index] = 0;
+}
+
 void Decoder::decompress(MipMap &out, const MipMap &in, PixelFormat format) {
 	if ((format != kPixelFormatDXT1) &&
 	    (format != kPixelFormatDXT3) &&
@@ -154,60 +241,102 @@ void Decoder::decompress(MipMap &out, const MipMap &in, PixelFormat format) {
 	out.size   = MAX(out.width * out.height * 4, 64);
 	out.data   = new byte[out.size];
 
-	Common::MemoryReadStream *stream = new Common::MemoryReadStream(in.data, in.size);
+	DecompressFunc func      = decompressDXT1;
+	size_t         blockSize = 8;
+
+	if        (format == kPixelFormatDXT3) {
+		func      = decompressDXT3;
+		blockSize = 16;
+	} else if (format == kPixelFormatDXT5) {
+		func      = decompressDXT5;
+		blockSize = 16;
+	}
+
+	const uint32 blocksPerRow = (out.width  + 3) / 4;
+	const uint32 blockRows    = (out.height + 3) / 4;
+
+	const uint32 chunkRows = MAX<uint32>(kChunkBlockCount / MAX<uint32>(blocksPerRow, 1), 1);
+
+	size_t jobCount = (blockRows + chunkRows - 1) / chunkRows;
+
+	// A last chunk of only a partial block row goes into the chunk before it
+	if ((jobCount > 1) && ((out.height - (jobCount - 1) * chunkRows * 4) < 4))
+		jobCount--;
+
+	const size_t threadCount = Common::Thread::getCPUCount();
+
+	if ((threadCount <= 1) || (jobCount <= 1)) {
+		(*func)(out.data, in.data, in.size, out.width, out.height, out.width * 4);
+		return;
+	}
 
-	if      (format == kPixelFormatDXT1)
-		decompressDXT1(out.data, *stream, out.width, out.height, out.width * 4);
-	else if (format == kPixelFormatDXT3)
-		decompressDXT3(out.data, *stream, out.width, out.height, out.width * 4);
-	else if (format == kPixelFormatDXT5)
-		decompressDXT5(out.data, *stream, out.width, out.height, out.width * 4);
+	DecompressJobs jobs(func, out, in, blockSize, chunkRows, jobCount);
 
-	delete stream;
+	jobs.run(jobCount, threadCount);
 }
 
 void Decoder::decompress() {
-	if (!isCompressed())
-		return;
+	deferDecompression();
 
-	for (std::vector<MipMap *>::iterator m = _mipMaps.begin(); m != _mipMaps.end(); ++m) {
-		MipMap decompressed;
+	for (size_t i = 0; i < _mipMaps.size(); i++)
+		if (isPending(i))
+			decompressMipMap(i);
+}
 
-		decompress(decompressed, **m, _format);
+void Decoder::deferDecompression() {
+	if (!isCompressed())
+		return;
 
-		decompressed.swap(**m);
-	}
+	_compressedFormat = _format;
+	_pending.assign(_mipMaps.size(), kPendingDecompress);
 
 	_format = kPixelFormatR8G8B8A8;
 }
 
-void Decoder::dumpTGA(const Common::UString &fileName) const {
+void Decoder::dumpTGA(const Common::UString &fileName, bool rle) const {
 	if (_mipMaps.size() < 1)
 		throw Common::Exception("Image contains no mip maps");
 
 	if (!isCompressed()) {
-		Images::dumpTGA(fileName, *this);
+		Images::dumpTGA(fileName, *this, rle);
 		return;
 	}
 
+	// Only the mip maps that are actually written will be decompressed
 	Decoder decoder(*this);
-	decoder.decompress();
+	decoder.deferDecompression();
 
-	Images::dumpTGA(fileName, decoder);
+	Images::dumpTGA(fileName, decoder, rle);
 }
 
 void Decoder::flipHorizontally() {
-	decompress();
+	deferDecompression();
 
-	for (std::vector<MipMap *>::iterator m = _mipMaps.begin(); m != _mipMaps.end(); ++m)
-		::Images::flipHorizontally((*m)->data, (*m)->width, (*m)->height, getBPP(_format));
+	for (size_t i = 0; i < _mipMaps.size(); i++) {
+		if (isPending(i)) {
+			// Flip it once it's decompressed
+			_pending[i] ^= kPendingFlipHorizontal;
+			continue;
+		}
+
+		MipMap &m = *_mipMaps[i];
+		::Images::flipHorizontally(m.data, m.width, m.height, getBPP(_format));
+	}
 }
 
 void Decoder::flipVertically() {
-	decompress();
+	deferDecompression();
 
-	for (std::vector<MipMap *>::iterator m = _mipMaps.begin(); m != _mipMaps.end(); ++m)
-		::Images::flipVertically((*m)->data, (*m)->width, (*m)->height, getBPP(_format));
+	for (size_t i = 0; i < _mipMaps.size(); i++) {
+		if (isPending(i)) {
+			// Flip it once it's decompressed
+			_pending[i] ^= kPendingFlipVertical;
+			continue;
+		}
+
+		MipMap &m = *_mipMaps[i];
+		::Images::flipVertically(m.data, m.width, m.height, getBPP(_format));
+	}
 }
 
 } // End of namespace Images
@@ -74,14 +74,18 @@ public:
 	/** Is this image a cube map? */
 	bool isCubeMap() const;
 
-	/** Return a mip map. */
+	/** Return a mip map.
+	 *
+	 *  If the image is decompressed lazily, this decompresses the mip map
+	 *  first. This is not thread-safe.
+	 */
 	const MipMap &getMipMap(size_t mipMap, size_t layer = 0) const;
 
 	/** Return TXI data, if embedded in the image. */
 	virtual Common::SeekableReadStream *getTXI() const;
 
-	/** Dump the image into a TGA. */
-	void dumpTGA(const Common::UString &fileName) const;
+	/** Dump the image into a TGA, optionally run-length encoded. */
+	void dumpTGA(const Common::UString &fileName, bool rle = false) const;
 
 	/** Flip the whole image horizontally. */
 	void flipHorizontally();
@@ -103,8 +107,22 @@ protected:
 
 	/** Manually decompress the texture image data. */
 	void decompress();
+	/** Decompress the texture image data lazily, each mip map when it's first accessed. */
+	void deferDecompression();
 
 	static void decompress(MipMap &out, const MipMap &in, PixelFormat format);
+
+private:
+	/** The format of the mip maps that are still waiting to be decompressed. */
+	PixelFormat _compressedFormat;
+
+	/** For each mip map, the decompression and flips still to be done on it. */
+	mutable std::vector<byte> _pending;
+
+	/** Does this mip map still need to be decompressed? */
+	bool isPending(size_t index) const;
+	/** Decompress a mip map and apply its pending flips. */
+	void decompressMipMap(size_t index) const;
 };
 
 } // End of namespace Images
@@ -23,73 +23,173 @@
  */
 
 #include <cstdio>
+#include <cstring>
 
+#include <vector>
+
+#include "src/common/util.h"
 #include "src/common/error.h"
 #include "src/common/ustring.h"
 #include "src/common/writefile.h"
 
 #include "src/images/decoder.h"
+#include "src/images/dumptga.h"
 
 namespace Images {
 
-static void writePixel(Common::WriteStream &file, const byte *&data, PixelFormat format) {
-	if (format == kPixelFormatR8G8B8) {
-		file.writeByte(data[2]);
-		file.writeByte(data[1]);
-		file.writeByte(data[0]);
-		file.writeByte(0xFF);
-		data += 3;
-	} else if (format == kPixelFormatB8G8R8) {
-		file.writeByte(data[0]);
-		file.writeByte(data[1]);
-		file.writeByte(data[2]);
-		file.writeByte(0xFF);
-		data += 3;
-	} else if (format == kPixelFormatR8G8B8A8) {
-		file.writeByte(data[2]);
-		file.writeByte(data[1]);
-		file.writeByte(data[0]);
-		file.writeByte(data[3]);
-		data += 4;
-	} else if (format == kPixelFormatB8G8R8A8) {
-		file.writeByte(data[0]);
-		file.writeByte(data[1]);
-		file.writeByte(data[2]);
-		file.writeByte(data[3]);
-		data += 4;
-	} else if (format == kPixelFormatR5G6B5) {
-		uint16 color = READ_LE_UINT16(data);
-		file.writeByte( color & 0x001F);
-		file.writeByte((color & 0x07E0) >>  5);
-		file.writeByte((color & 0xF800) >> 11);
-		file.writeByte(0xFF);
-		data += 2;
-	} else if (format == kPixelFormatA1R5G5B5) {
-		uint16 color = READ_LE_UINT16(data);
-		file.writeByte( color & 0x001F);
-		file.writeByte((color & 0x03E0) >>  5);
-		file.writeByte((color & 0x7C00) >> 10);
-		file.writeByte((color & 0x8000) ? 0xFF : 0x00);
-		data += 2;
-	} else if (format == kPixelFormatDepth16) {
-		uint16 color = READ_LE_UINT16(data);
-		file.writeByte(color / 128);
-		file.writeByte(color / 128);
-		file.writeByte(color / 128);
-		file.writeByte((color >= 0x7FFF) ? 0x00 : 0xFF);
-
-		data += 2;
-	} else
-		throw Common::Exception("Unsupported pixel format: %d", (int) format);
+static const byte kImageTypeTrueColor    =  2;
+static const byte kImageTypeRLETrueColor = 10;
+
+/** The maximum number of pixels in one TGA RLE packet. */
+static const uint32 kMaxRLEPacketSize = 128;
+
+/** Convert a row of pixels into the B8G8R8A8 we write into the TGA. */
+static void convertRow(byte *dest, const byte *src, uint32 width, PixelFormat format) {
+	switch (format) {
+		case kPixelFormatR8G8B8:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 3) {
+				dest[0] = src[2];
+				dest[1] = src[1];
+				dest[2] = src[0];
+				dest[3] = 0xFF;
+			}
+			break;
+
+		case kPixelFormatB8G8R8:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 3) {
+				dest[0] = src[0];
+				dest[1] = src[1];
+				dest[2] = src[2];
+				dest[3] = 0xFF;
+			}
+			break;
+
+		case kPixelFormatR8G8B8A8:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 4) {
+				const uint32 pixel = READ_LE_UINT32(src);
+
+				WRITE_LE_UINT32(dest, (pixel & 0xFF00FF00) | ((pixel >> 16) & 0x000000FF) | ((pixel << 16) & 0x00FF0000));
+			}
+			break;
+
+		case kPixelFormatB8G8R8A8:
+			std::memcpy(dest, src, width * 4);
+			break;
+
+		case kPixelFormatR5G6B5:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 2) {
+				const uint16 color = READ_LE_UINT16(src);
+
+				dest[0] =  color & 0x001F;
+				dest[1] = (color & 0x07E0) >>  5;
+				dest[2] = (color & 0xF800) >> 11;
+				dest[3] = 0xFF;
+			}
+			break;
+
+		case kPixelFormatA1R5G5B5:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 2) {
+				const uint16 color = READ_LE_UINT16(src);
+
+				dest[0] =  color & 0x001F;
+				dest[1] = (color & 0x03E0) >>  5;
+				dest[2] = (color & 0x7C00) >> 10;
+				dest[3] = (color & 0x8000) ? 0xFF : 0x00;
+			}
+			break;
+
+		case kPixelFormatDepth16:
+			for (uint32 i = 0; i < width; i++, dest += 4, src += 2) {
+				const uint16 color = READ_LE_UINT16(src);
+
+				dest[0] = dest[1] = dest[2] = color / 128;
+				dest[3] = (color >= 0x7FFF) ? 0x00 : 0xFF;
+			}
+			break;
+
+		default:
+			throw Common::Exception("Unsupported pixel format: %d", (int) format);
+	}
+}
+
+/** Return the number of bytes a pixel takes up in this format. */
+static uint32 getPixelSize(PixelFormat format) {
+	switch (format) {
+		case kPixelFormatR8G8B8:
+		case kPixelFormatB8G8R8:
+			return 3;
+
+		case kPixelFormatR8G8B8A8:
+		case kPixelFormatB8G8R8A8:
+			return 4;
+
+		case kPixelFormatR5G6B5:
+		case kPixelFormatA1R5G5B5:
+		case kPixelFormatDepth16:
+			return 2;
+
+		default:
+			break;
+	}
+
+	throw Common::Exception("Unsupported pixel format: %d", (int) format);
+}
+
+static inline bool isSamePixel(const byte *a, const byte *b) {
+	return std::memcmp(a, b, 4) == 0;
+}
+
+/** Compress a row of B8G8R8A8 pixels with TGA's RLE scheme.
+ *
+ *  Runs of at least 2 equal pixels become run-length packets, everything
+ *  else is collected into raw packets. Packets never cross rows.
+ */
+static size_t compressRow(byte *dest, const byte *src, uint32 width) {
+	byte *start = dest;
+
+	uint32 i = 0;
+	while (i < width) {
+		// Count the equal pixels starting here
+		uint32 run = 1;
+		while (((i + run) < width) && (run < kMaxRLEPacketSize) && isSamePixel(src + i * 4, src + (i + run) * 4))
+			run++;
+
+		if (run > 1) {
+			*dest++ = 0x80 | (run - 1);
+
+			std::memcpy(dest, src + i * 4, 4);
+			dest += 4;
+
+			i += run;
+			continue;
+		}
+
+		// Collect pixels until the next run of equal pixels starts
+		uint32 count = 1;
+		while (((i + count) < width) && (count < kMaxRLEPacketSize)) {
+			if (((i + count + 1) < width) && isSamePixel(src + (i + count) * 4, src + (i + count + 1) * 4))
+				break;
+
+			count++;
+		}
+
+		*dest++ = count - 1;
+
+		std::memcpy(dest, src + i * 4, count * 4);
+		dest += count * 4;
 
+		i += count;
+	}
+
+	return dest - start;
 }
 
-static Common::WriteStream *openTGA(const Common::UString &fileName, int width, int height) {
+static Common::WriteStream *openTGA(const Common::UString &fileName, int width, int height, bool rle) {
 	Common::WriteFile *file = new Common::WriteFile(fileName);
 
 	file->writeByte(0);     // ID Length
 	file->writeByte(0);     // Palette size
-	file->writeByte(2);     // Unmapped RGB
+	file->writeByte(rle ? kImageTypeRLETrueColor : kImageTypeTrueColor);
 	file->writeUint32LE(0); // Color map
 	file->writeByte(0);     // Color map
 	file->writeUint16LE(0); // X
@@ -105,15 +205,38 @@ static Common::WriteStream *openTGA(const Common::UString &fileName, int width,
 	return file;
 }
 
-static void writeMipMap(Common::WriteStream &stream, const Decoder::MipMap &mipMap, PixelFormat format) {
+static void writeMipMap(Common::WriteStream &stream, const Decoder::MipMap &mipMap, PixelFormat format, bool rle,
+                        std::vector<byte> &row, std::vector<byte> &packed) {
+
+	const uint32 width  = mipMap.width;
+	const uint32 height = mipMap.height;
+
+	const uint32 pixelSize = getPixelSize(format);
+	if ((width == 0) || (height == 0))
+		return;
+
+	// A raw packet header per 128 pixels is the worst case
+	row.resize(width * 4);
+	packed.resize(width * 4 + (width + kMaxRLEPacketSize - 1) / kMaxRLEPacketSize);
+
 	const byte *data = mipMap.data;
+	for (uint32 y = 0; y < height; y++, data += width * pixelSize) {
+		convertRow(&row[0], data, width, format);
 
-	uint32 count = mipMap.width * mipMap.height;
-	while (count-- > 0)
-		writePixel(stream, data, format);
+		const byte  *rowData = &row[0];
+		size_t       rowSize = width * 4;
+
+		if (rle) {
+			rowData = &packed[0];
+			rowSize = compressRow(&packed[0], &row[0], width);
+		}
+
+		if (stream.write(rowData, rowSize) != rowSize)
+			throw Common::Exception(Common::kWriteError);
+	}
 }
 
-void dumpTGA(const Common::UString &fileName, const Decoder &image) {
+void dumpTGA(const Common::UString &fileName, const Decoder &image, bool rle) {
 	if ((image.getLayerCount() < 1) || (image.getMipMapCount() < 1))
 		throw Common::Exception("No image");
 
@@ -129,12 +252,20 @@ void dumpTGA(const Common::UString &fileName, const Decoder &image) {
 		height += mipMap.height;
 	}
 
-	Common::WriteStream *file = openTGA(fileName, width, height);
+	Common::WriteStream *file = openTGA(fileName, width, height, rle);
 
-	for (size_t i = 0; i < image.getLayerCount(); i++)
-		writeMipMap(*file, image.getMipMap(0, i), image.getFormat());
+	try {
+		std::vector<byte> row, packed;
+
+		for (size_t i = 0; i < image.getLayerCount(); i++)
+			writeMipMap(*file, image.getMipMap(0, i), image.getFormat(), rle, row, packed);
+
+		file->flush();
+	} catch (...) {
+		delete file;
+		throw;
+	}
 
-	file->flush();
 	delete file;
 }
 
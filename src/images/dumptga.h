@@ -37,8 +37,11 @@ namespace Images {
 
 class Decoder;
 
-/** Dump image into a TGA file. */
-void dumpTGA(const Common::UString &fileName, const Decoder &image);
+/** Dump image into a TGA file.
+ *
+ *  If rle is true, the pixel data is written run-length encoded.
+ */
+void dumpTGA(const Common::UString &fileName, const Decoder &image, bool rle = false);
 
 } // End of namespace Images
 
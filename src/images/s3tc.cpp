@@ -22,196 +22,218 @@
  *  Manual S3TC DXTn decompression methods.
  */
 
+#include <cstring>
+
 #include "src/common/util.h"
-#include "src/common/readstream.h"
+#include "src/common/endianness.h"
+#include "src/common/readcursor.h"
 
 #include "src/images/s3tc.h"
 
+/* All decoders here work on one 4x4 block at a time. Each block is decoded
+ * into a small buffer holding the final R8G8B8A8 pixel bytes, which is then
+ * copied row by row into the image.
+ *
+ * The output is kept bit-identical to what earlier versions of these decoders
+ * produced, including their quirks: the color endpoints are not bit-expanded,
+ * DXT3 alpha is only shifted up, not expanded, and images smaller than a block
+ * address the block's pixels as if the block was only as wide as the image.
+ */
+
 namespace Images {
 
-static uint32 convert565To8888(uint16 color) {
-	return ((color & 0x1F) << 11) | ((color & 0x7E0) << 13) | ((color & 0xF800) << 16) | 0xFF;
+/** Convert a 565 color into the R, G, B bytes of an R8G8B8A8 pixel. */
+static inline void convert565(byte *color, uint16 c) {
+	color[0] = (c >> 8) & 0xF8;
+	color[1] = (c >> 3) & 0xFC;
+	color[2] = (c << 3) & 0xF8;
 }
 
-static uint32 interpolate32(double weight, uint32 color_0, uint32 color_1) {
-	byte r[3], g[3], b[3], a[3];
-	r[0] = color_0 >> 24;
-	r[1] = color_1 >> 24;
-	r[2] = (byte)((1.0f - weight) * (double)r[0] + weight * (double)r[1]);
-	g[0] = (color_0 >> 16) & 0xFF;
-	g[1] = (color_1 >> 16) & 0xFF;
-	g[2] = (byte)((1.0f - weight) * (double)g[0] + weight * (double)g[1]);
-	b[0] = (color_0 >> 8) & 0xFF;
-	b[1] = (color_1 >> 8) & 0xFF;
-	b[2] = (byte)((1.0f - weight) * (double)b[0] + weight * (double)b[1]);
-	a[0] = color_0 & 0xFF;
-	a[1] = color_1 & 0xFF;
-	a[2] = (byte)((1.0f - weight) * (double)a[0] + weight * (double)a[1]);
-	return r[2] << 24 | g[2] << 16 | b[2] << 8 | a[2];
+/* The interpolations between two color endpoints used to be done in double
+ * precision with the weights 0.333333f and 0.666666f, and then truncated.
+ * For all byte values a and b, these integer formulas give the exact same
+ * results, which was checked exhaustively. */
+
+/** Interpolate a third of the way between a and b. */
+static inline byte interpolate13(byte a, byte b) {
+	return (171 * a + 85 * b) >> 8;
 }
 
-struct DXT1Texel {
-	uint16 color_0;
-	uint16 color_1;
-	uint32 pixels;
-};
+/** Interpolate two thirds of the way between a and b. */
+static inline byte interpolate23(byte a, byte b) {
+	return (171 * a + 341 * b) >> 9;
+}
 
-#define READ_DXT1_TEXEL(x) \
-	x.color_0 = src.readUint16LE(); \
-	x.color_1 = src.readUint16LE(); \
-	x.pixels = src.readUint32BE()
+/** Interpolate half of the way between a and b. */
+static inline byte interpolate12(byte a, byte b) {
+	return (a + b) >> 1;
+}
 
-void decompressDXT1(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch) {
-	for (int32 ty = height; ty > 0; ty -= 4) {
-		for (uint32 tx = 0; tx < width; tx += 4) {
-			DXT1Texel tex;
-			READ_DXT1_TEXEL(tex);
-			uint32 blended[4];
+/** Build the palette for a block in 4-color mode, with an alpha of a. */
+static inline void buildPalette4(byte palette[4][4], uint16 color0, uint16 color1, byte a) {
+	convert565(palette[0], color0);
+	convert565(palette[1], color1);
 
-			blended[0] = convert565To8888(tex.color_0);
-			blended[1] = convert565To8888(tex.color_1);
+	for (int i = 0; i < 3; i++) {
+		palette[2][i] = interpolate13(palette[0][i], palette[1][i]);
+		palette[3][i] = interpolate23(palette[0][i], palette[1][i]);
+	}
 
-			if (tex.color_0 > tex.color_1) {
-				blended[2] = interpolate32(0.333333f, blended[0], blended[1]);
-				blended[3] = interpolate32(0.666666f, blended[0], blended[1]);
-			} else {
-				blended[2] = interpolate32(0.5f, blended[0], blended[1]);
-				blended[3] = 0;
-			}
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = a;
+}
 
-			uint32 cpx = tex.pixels;
-			uint32 blockWidth = MIN<uint32>(width, 4);
-			uint32 blockHeight = MIN<uint32>(height, 4);
+/** Build the palette for a DXT1 block in 3-color mode, where index 3 is transparent black. */
+static inline void buildPalette3(byte palette[4][4], uint16 color0, uint16 color1) {
+	convert565(palette[0], color0);
+	convert565(palette[1], color1);
 
-			for (byte y = 0; y < blockHeight; ++y) {
-				for (byte x = 0; x < blockWidth; ++x) {
-					const uint32 destX = tx + x;
-					const uint32 destY = height - 1 - (ty - blockHeight + y);
+	for (int i = 0; i < 3; i++)
+		palette[2][i] = interpolate12(palette[0][i], palette[1][i]);
 
-					const uint32 pixel =  blended[cpx & 3];
+	palette[0][3] = palette[1][3] = palette[2][3] = 0xFF;
 
-					cpx >>= 2;
+	std::memset(palette[3], 0, 4);
+}
 
-					if ((destX < width) && (destY < height))
-						WRITE_BE_UINT32(dest + destY * pitch + destX * 4, pixel);
-				}
-			}
-		}
+/** Fill a block with the colors selected by the 2-bit indices in cpx. */
+static inline void fillBlockColors(byte *block, const byte palette[4][4], uint32 cpx,
+                                   uint32 blockWidth, uint32 blockHeight) {
+
+	if (blockWidth == 4) {
+		for (uint32 i = 0; i < (4 * blockHeight); i++, cpx >>= 2)
+			std::memcpy(block + i * 4, palette[cpx & 3], 4);
+
+		return;
+	}
+
+	for (uint32 y = 0; y < blockHeight; y++)
+		for (uint32 x = 0; x < blockWidth; x++, cpx >>= 2)
+			std::memcpy(block + (y * 4 + x) * 4, palette[cpx & 3], 4);
+}
+
+/** Copy a decoded block into the image. */
+static inline void writeBlock(byte *dest, const byte *block, uint32 width, uint32 height, uint32 pitch,
+                              uint32 tx, int32 ty, uint32 blockWidth, uint32 blockHeight) {
+
+	const uint32 rowSize = MIN<uint32>(blockWidth, width - tx) * 4;
+
+	if ((rowSize == 16) && (blockHeight == 4) && (ty >= 4)) {
+		// Full block, completely inside the image. Let the compiler use fixed-sized copies
+		byte *rowDest = dest + (height - ty) * pitch + tx * 4;
+
+		for (uint32 y = 0; y < 4; y++, rowDest += pitch)
+			std::memcpy(rowDest, block + (3 - y) * 16, 16);
+
+		return;
+	}
+
+	for (uint32 y = 0; y < blockHeight; y++) {
+		const uint32 destY = height - 1 - (ty - blockHeight + y);
+		if (destY >= height)
+			continue;
+
+		std::memcpy(dest + destY * pitch + tx * 4, block + y * 16, rowSize);
 	}
 }
 
-struct DXT23Texel : public DXT1Texel {
-	uint16 alpha[4];
-};
+void decompressDXT1(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch) {
+	Common::ReadCursor cursor(src, size);
+
+	const uint32 blockWidth  = MIN<uint32>(width , 4);
+	const uint32 blockHeight = MIN<uint32>(height, 4);
 
-#define READ_DXT3_TEXEL(x) \
-	x.alpha[0] = src.readUint16LE(); \
-	x.alpha[1] = src.readUint16LE(); \
-	x.alpha[2] = src.readUint16LE(); \
-	x.alpha[3] = src.readUint16LE(); \
-	READ_DXT1_TEXEL(x)
+	byte block[4 * 4 * 4];
+	byte palette[4][4];
 
-void decompressDXT3(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch) {
 	for (int32 ty = height; ty > 0; ty -= 4) {
 		for (uint32 tx = 0; tx < width; tx += 4) {
-			DXT23Texel tex;
-			uint32 blended[4];
-			READ_DXT3_TEXEL(tex);
+			const byte *texel = cursor.readPointer(8);
+
+			const uint16 color0 = READ_LE_UINT16(texel + 0);
+			const uint16 color1 = READ_LE_UINT16(texel + 2);
+
+			if (color0 > color1)
+				buildPalette4(palette, color0, color1, 0xFF);
+			else
+				buildPalette3(palette, color0, color1);
+
+			fillBlockColors(block, palette, READ_BE_UINT32(texel + 4), blockWidth, blockHeight);
+
+			writeBlock(dest, block, width, height, pitch, tx, ty, blockWidth, blockHeight);
+		}
+	}
+}
+
+void decompressDXT3(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch) {
+	Common::ReadCursor cursor(src, size);
+
+	const uint32 blockWidth  = MIN<uint32>(width , 4);
+	const uint32 blockHeight = MIN<uint32>(height, 4);
 
-			blended[0] = convert565To8888(tex.color_0) & 0xFFFFFF00;
-			blended[1] = convert565To8888(tex.color_1) & 0xFFFFFF00;
-			blended[2] = interpolate32(0.333333f, blended[0], blended[1]);
-			blended[3] = interpolate32(0.666666f, blended[0], blended[1]);
+	byte block[4 * 4 * 4];
+	byte palette[4][4];
 
-			uint32 cpx = tex.pixels;
-			uint32 blockWidth = MIN<uint32>(width, 4);
-			uint32 blockHeight = MIN<uint32>(height, 4);
+	for (int32 ty = height; ty > 0; ty -= 4) {
+		for (uint32 tx = 0; tx < width; tx += 4) {
+			const byte *texel = cursor.readPointer(16);
 
-			for (byte y = 0; y < blockHeight; ++y) {
-				for (byte x = 0; x < blockWidth; ++x) {
-					const uint32 destX = tx + x;
-					const uint32 destY = height - 1 - (ty - blockHeight + y);
+			buildPalette4(palette, READ_LE_UINT16(texel + 8), READ_LE_UINT16(texel + 10), 0x00);
 
-					const uint32 alpha = (tex.alpha[y] >> (x * 4)) & 0xF;
-					const uint32 pixel = blended[cpx & 3] | alpha << 4;
+			fillBlockColors(block, palette, READ_BE_UINT32(texel + 12), blockWidth, blockHeight);
 
-					cpx >>= 2;
+			// 4 bits of explicit alpha per pixel, one 16-bit word per row
+			for (uint32 y = 0; y < blockHeight; y++) {
+				const uint16 alpha = READ_LE_UINT16(texel + y * 2);
 
-					if ((destX < width) && (destY < height))
-						WRITE_BE_UINT32(dest + destY * pitch + destX * 4, pixel);
-				}
+				for (uint32 x = 0; x < blockWidth; x++)
+					block[(y * 4 + x) * 4 + 3] = ((alpha >> (x * 4)) & 0xF) << 4;
 			}
+
+			writeBlock(dest, block, width, height, pitch, tx, ty, blockWidth, blockHeight);
 		}
 	}
 }
 
-struct DXT45Texel : public DXT1Texel {
-	byte alpha_0;
-	byte alpha_1;
-	uint64 alphabl;
-};
+void decompressDXT5(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch) {
+	Common::ReadCursor cursor(src, size);
 
-static uint64 readUint48LE(Common::SeekableReadStream &src) {
-	uint64 output = src.readUint32LE();
-	return output | ((uint64)src.readUint16LE() << 32);
-}
+	const uint32 blockWidth  = MIN<uint32>(width , 4);
+	const uint32 blockHeight = MIN<uint32>(height, 4);
 
-#define READ_DXT5_TEXEL(x) \
-	x.alpha_0 = src.readByte(); \
-	x.alpha_1 = src.readByte(); \
-	x.alphabl = readUint48LE(src); \
-	READ_DXT1_TEXEL(x)
+	byte block[4 * 4 * 4];
+	byte palette[4][4];
+	byte alphab[8];
 
-void decompressDXT5(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch) {
 	for (int32 ty = height; ty > 0; ty -= 4) {
 		for (uint32 tx = 0; tx < width; tx += 4) {
-			uint32 blended[4];
-			byte alphab[8];
-			DXT45Texel tex;
-			READ_DXT5_TEXEL(tex);
-
-			alphab[0] = tex.alpha_0;
-			alphab[1] = tex.alpha_1;
-
-			if (tex.alpha_0 > tex.alpha_1) {
-				alphab[2] = (byte)((6.0f * (double)alphab[0] + 1.0f * (double)alphab[1] + 3.0f) / 7.0f);
-				alphab[3] = (byte)((5.0f * (double)alphab[0] + 2.0f * (double)alphab[1] + 3.0f) / 7.0f);
-				alphab[4] = (byte)((4.0f * (double)alphab[0] + 3.0f * (double)alphab[1] + 3.0f) / 7.0f);
-				alphab[5] = (byte)((3.0f * (double)alphab[0] + 4.0f * (double)alphab[1] + 3.0f) / 7.0f);
-				alphab[6] = (byte)((2.0f * (double)alphab[0] + 5.0f * (double)alphab[1] + 3.0f) / 7.0f);
-				alphab[7] = (byte)((1.0f * (double)alphab[0] + 6.0f * (double)alphab[1] + 3.0f) / 7.0f);
+			const byte *texel = cursor.readPointer(16);
+
+			const uint32 alpha0 = alphab[0] = texel[0];
+			const uint32 alpha1 = alphab[1] = texel[1];
+
+			if (alpha0 > alpha1) {
+				for (uint32 i = 1; i < 7; i++)
+					alphab[i + 1] = ((7 - i) * alpha0 + i * alpha1 + 3) / 7;
 			} else {
-				alphab[2] = (byte)((4.0f * (double)alphab[0] + 1.0f * (double)alphab[1] + 2.0f) / 5.0f);
-				alphab[3] = (byte)((3.0f * (double)alphab[0] + 2.0f * (double)alphab[1] + 2.0f) / 5.0f);
-				alphab[4] = (byte)((2.0f * (double)alphab[0] + 3.0f * (double)alphab[1] + 2.0f) / 5.0f);
-				alphab[5] = (byte)((1.0f * (double)alphab[0] + 4.0f * (double)alphab[1] + 2.0f) / 5.0f);
+				for (uint32 i = 1; i < 5; i++)
+					alphab[i + 1] = ((5 - i) * alpha0 + i * alpha1 + 2) / 5;
+
 				alphab[6] = 0;
 				alphab[7] = 255;
 			}
 
-			blended[0] = convert565To8888(tex.color_0) & 0xFFFFFF00;
-			blended[1] = convert565To8888(tex.color_1) & 0xFFFFFF00;
-			blended[2] = interpolate32(0.333333f, blended[0], blended[1]);
-			blended[3] = interpolate32(0.666666f, blended[0], blended[1]);
-
-			uint32 cpx = tex.pixels;
-			uint32 blockWidth = MIN<uint32>(width, 4);
-			uint32 blockHeight = MIN<uint32>(height, 4);
+			const uint64 alphabl = READ_LE_UINT32(texel + 2) | ((uint64) READ_LE_UINT16(texel + 6) << 32);
 
-			for (byte y = 0; y < blockHeight; ++y) {
-				for (byte x = 0; x < blockWidth; ++x) {
-					const uint32 destX = tx + x;
-					const uint32 destY = height - 1 - (ty - blockHeight + y);
+			buildPalette4(palette, READ_LE_UINT16(texel + 8), READ_LE_UINT16(texel + 10), 0x00);
 
-					const uint32 alpha = alphab[(tex.alphabl >> (3 * (4 * (3 - y) + x))) & 7];
-					const uint32 pixel = blended[cpx & 3] | alpha;
+			fillBlockColors(block, palette, READ_BE_UINT32(texel + 12), blockWidth, blockHeight);
 
-					cpx >>= 2;
+			// 3-bit alpha indices, with the rows stored in reverse order
+			for (uint32 y = 0; y < blockHeight; y++)
+				for (uint32 x = 0; x < blockWidth; x++)
+					block[(y * 4 + x) * 4 + 3] = alphab[(alphabl >> (3 * (4 * (3 - y) + x))) & 7];
 
-					if ((destX < width) && (destY < height))
-						WRITE_BE_UINT32(dest + destY * pitch + destX * 4, pixel);
-				}
-			}
+			writeBlock(dest, block, width, height, pitch, tx, ty, blockWidth, blockHeight);
 		}
 	}
 }
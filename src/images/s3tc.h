@@ -27,15 +27,17 @@
 
 #include "src/common/types.h"
 
-namespace Common {
-	class SeekableReadStream;
-}
-
 namespace Images {
 
-void decompressDXT1(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch);
-void decompressDXT3(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch);
-void decompressDXT5(byte *dest, Common::SeekableReadStream &src, uint32 width, uint32 height, uint32 pitch);
+/** Decompress DXT1 data of the given size into an R8G8B8A8 image.
+ *
+ *  Throws a kReadError exception if the data doesn't hold enough blocks.
+ */
+void decompressDXT1(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch);
+/** Decompress DXT3 data of the given size into an R8G8B8A8 image. See decompressDXT1(). */
+void decompressDXT3(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch);
+/** Decompress DXT5 data of the given size into an R8G8B8A8 image. See decompressDXT1(). */
+void decompressDXT5(byte *dest, const byte *src, size_t size, uint32 width, uint32 height, uint32 pitch);
 
 } // End of namespace Images
 
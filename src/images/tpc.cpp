@@ -63,8 +63,8 @@ void TPC::load(Common::SeekableReadStream &tpc) {
 		throw;
 	}
 
-	// In xoreos-tools, we always want decompressed images
-	decompress();
+	// In xoreos-tools, we always want decompressed images. Each mip map is decompressed when it's needed
+	deferDecompression();
 }
 
 Common::SeekableReadStream *TPC::getTXI() const {
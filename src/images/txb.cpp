@@ -38,8 +38,8 @@ namespace Images {
 TXB::TXB(Common::SeekableReadStream &txb) : _dataSize(0), _txiData(0), _txiDataSize(0) {
 	load(txb);
 
-	// In xoreos-tools, we always want decompressed images
-	decompress();
+	// In xoreos-tools, we always want decompressed images. Each mip map is decompressed when it's needed
+	deferDecompression();
 }
 
 TXB::~TXB() {
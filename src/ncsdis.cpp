@@ -27,6 +27,8 @@
 #include <cstdio>
 
 #include <vector>
+#include <set>
+#include <algorithm>
 
 #include "src/common/version.h"
 #include "src/common/ustring.h"
@@ -34,13 +36,25 @@
 #include "src/common/error.h"
 #include "src/common/platform.h"
 #include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
+#include "src/common/memwritestream.h"
 #include "src/common/writefile.h"
 #include "src/common/stdoutstream.h"
+#include "src/common/filepath.h"
+#include "src/common/hash.h"
+#include "src/common/jobqueue.h"
 
 #include "src/aurora/types.h"
+#include "src/aurora/util.h"
+#include "src/aurora/erffile.h"
+#include "src/aurora/rimfile.h"
+#include "src/aurora/keyfile.h"
+#include "src/aurora/biffile.h"
 
 #include "src/nwscript/disassembler.h"
 
+#include "src/util.h"
+
 enum Command {
 	kCommandNone     = -1,
 	kCommandListing  =  0,
@@ -49,15 +63,43 @@ enum Command {
 	kCommandMAX
 };
 
+/** The file extensions of the disassembly files written in batch mode. */
+static const char * const kCommandExtension[kCommandMAX] = { ".lst", ".asm", ".dot" };
+
+/** A script to disassemble in batch mode. */
+struct BatchScript {
+	const Aurora::Archive *archive; ///< The archive containing the script, or 0 for a script file.
+	uint32 index;                   ///< The index of the script within the archive.
+	Common::UString inFile;         ///< The name of the script file, if it's not in an archive.
+	Common::UString outFile;        ///< The name of the file to write the disassembly to.
+
+	BatchScript(const Aurora::Archive *a, uint32 i, const Common::UString &in, const Common::UString &out);
+};
+
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Common::UString &inFile, Common::UString &outFile,
+                      std::vector<Common::UString> &files, Common::UString &batchDir,
                       Aurora::GameID &game, Command &command,
-                      bool &printStack, bool &printControlTypes);
+                      bool &printStack, bool &printControlTypes, uint &jobs);
+
+void writeDisassembly(NWScript::Disassembler &disassembler, Common::WriteStream &out,
+                      Command command, bool printStack, bool printControlTypes);
 
 void disNCS(const Common::UString &inFile, const Common::UString &outFile,
             Aurora::GameID &game, Command &command, bool printStack, bool printControlTypes);
 
+void collectScripts(const Common::UString &directory, std::vector<Common::UString> &files,
+                    const Common::UString &outDir, Command command,
+                    std::vector<BatchScript> &scripts, std::set<Common::UString> &outFiles);
+void collectScripts(const Aurora::Archive &archive, Aurora::GameID game, const Common::UString &outDir,
+                    Command command, std::vector<BatchScript> &scripts, std::set<Common::UString> &outFiles);
+void openBatchInputs(const std::vector<Common::UString> &files, Aurora::GameID game,
+                     const Common::UString &outDir, Command command,
+                     std::vector<Aurora::Archive *> &archives, std::vector<BatchScript> &scripts);
+
+void disNCSBatch(const std::vector<Common::UString> &files, const Common::UString &outDir,
+                 Aurora::GameID game, Command command, bool printStack, bool printControlTypes, uint jobs);
+
 int main(int argc, char **argv) {
 	try {
 		std::vector<Common::UString> args;
@@ -69,12 +111,18 @@ int main(int argc, char **argv) {
 		Command command = kCommandNone;
 		bool printStack = false;
 		bool printControlTypes = false;
-		Common::UString inFile, outFile;
+		uint jobs = 1;
+		std::vector<Common::UString> files;
+		Common::UString batchDir;
 
-		if (!parseCommandLine(args, returnValue, inFile, outFile, game, command, printStack, printControlTypes))
+		if (!parseCommandLine(args, returnValue, files, batchDir, game, command,
+		                      printStack, printControlTypes, jobs))
 			return returnValue;
 
-		disNCS(inFile, outFile, game, command, printStack, printControlTypes);
+		if (!batchDir.empty())
+			disNCSBatch(files, batchDir, game, command, printStack, printControlTypes, jobs);
+		else
+			disNCS(files[0], (files.size() > 1) ? files[1] : "", game, command, printStack, printControlTypes);
 	} catch (...) {
 		Common::exceptionDispatcherError();
 	}
@@ -82,13 +130,17 @@ int main(int argc, char **argv) {
 	return 0;
 }
 
+BatchScript::BatchScript(const Aurora::Archive *a, uint32 i, const Common::UString &in, const Common::UString &out) :
+	archive(a), index(i), inFile(in), outFile(out) {
+}
+
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Common::UString &inFile, Common::UString &outFile,
+                      std::vector<Common::UString> &files, Common::UString &batchDir,
                       Aurora::GameID &game, Command &command,
-                      bool &printStack, bool &printControlTypes) {
+                      bool &printStack, bool &printControlTypes, uint &jobs) {
 
-	inFile.clear();
-	outFile.clear();
+	files.clear();
+	batchDir.clear();
 	std::vector<Common::UString> args;
 
 	command = kCommandListing;
@@ -159,6 +211,32 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 			} else if (argv[i] == "--dragonage2") {
 				isOption = true;
 				game     = Aurora::kGameIDDragonAge2;
+			} else if (argv[i] == "--batch") {
+				isOption = true;
+
+				// Needs the output directory as the next parameter
+				if ((i++ == (argv.size() - 1)) || argv[i].empty()) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				batchDir = argv[i];
+
+			} else if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				isOption = true;
+
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+
 			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -179,17 +257,15 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 
 	assert(command != kCommandNone);
 
-	if ((args.size() < 1) || (args.size() > 2)) {
+	// In batch mode, we take any number of inputs. Otherwise, an input and an optional output
+	if ((args.size() < 1) || (batchDir.empty() && (args.size() > 2))) {
 		printUsage(stderr, argv[0]);
 		returnValue = 1;
 
 		return false;
 	}
 
-	inFile = args[0];
-
-	if (args.size() > 1)
-		outFile = args[1];
+	files.swap(args);
 
 	return true;
 }
@@ -197,6 +273,7 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "BioWare NWScript bytecode disassembler\n\n");
 	std::fprintf(stream, "Usage: %s [<options>] <input file> [<output file>]\n", name.c_str());
+	std::fprintf(stream, "       %s [<options>] --batch <output directory> <input> [...]\n", name.c_str());
 	std::fprintf(stream, "  -h      --help              This help text\n");
 	std::fprintf(stream, "          --version           Display version information\n\n");
 	std::fprintf(stream, "          --list              Create full disassembly listing (default)\n");
@@ -214,7 +291,34 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "          --witcher           This is a The Witcher script\n");
 	std::fprintf(stream, "          --dragonage         This is a Dragon Age script\n");
 	std::fprintf(stream, "          --dragonage2        This is a Dragon Age II script\n\n");
-	std::fprintf(stream, "If no output file is given, the output is written to stdout.\n");
+	std::fprintf(stream, "          --batch <dir>       Disassemble all scripts found in the inputs\n");
+	std::fprintf(stream, "                              into files in this directory\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>          Disassemble with n parallel jobs in batch mode\n");
+	std::fprintf(stream, "                              (0: one per CPU core)\n\n");
+	std::fprintf(stream, "If no output file is given, the output is written to stdout.\n\n");
+	std::fprintf(stream, "In batch mode, an input can be a script, a directory containing scripts,\n");
+	std::fprintf(stream, "an ERF or RIM archive, or a KEY file together with its BIF files.\n");
+}
+
+void writeDisassembly(NWScript::Disassembler &disassembler, Common::WriteStream &out,
+                      Command command, bool printStack, bool printControlTypes) {
+
+	switch (command) {
+		case kCommandListing:
+			disassembler.createListing(out, printStack);
+			break;
+
+		case kCommandAssembly:
+			disassembler.createAssembly(out, printStack);
+			break;
+
+		case kCommandDot:
+			disassembler.createDot(out, printControlTypes);
+			break;
+
+		default:
+			throw Common::Exception("Invalid command %u", (uint)command);
+	}
 }
 
 void disNCS(const Common::UString &inFile, const Common::UString &outFile,
@@ -232,6 +336,10 @@ void disNCS(const Common::UString &inFile, const Common::UString &outFile,
 		status("Disassembling script...");
 		NWScript::Disassembler disassembler(*ncs, game);
 
+		std::vector<Common::Exception> loadWarnings = disassembler.getWarnings();
+		for (std::vector<Common::Exception>::iterator w = loadWarnings.begin(); w != loadWarnings.end(); ++w)
+			Common::printException(*w, "WARNING: ");
+
 		if (game != Aurora::kGameIDUnknown) {
 			try {
 				status("Analyzing script stack...");
@@ -248,22 +356,7 @@ void disNCS(const Common::UString &inFile, const Common::UString &outFile,
 			}
 		}
 
-		switch (command) {
-			case kCommandListing:
-				disassembler.createListing(*out, printStack);
-				break;
-
-			case kCommandAssembly:
-				disassembler.createAssembly(*out, printStack);
-				break;
-
-			case kCommandDot:
-				disassembler.createDot(*out, printControlTypes);
-				break;
-
-			default:
-				throw Common::Exception("Invalid command %u", (uint)command);
-		}
+		writeDisassembly(disassembler, *out, command, printStack, printControlTypes);
 
 	} catch (...) {
 		delete ncs;
@@ -279,3 +372,286 @@ void disNCS(const Common::UString &inFile, const Common::UString &outFile,
 	delete ncs;
 	delete out;
 }
+
+/** Disassembling scripts in batch mode, one job per script. */
+class DisassembleJobs : public Common::JobQueue {
+public:
+	DisassembleJobs(const std::vector<BatchScript> &scripts, Aurora::GameID game, Command command,
+	                bool printStack, bool printControlTypes) :
+		_scripts(&scripts), _game(game), _command(command),
+		_printStack(printStack), _printControlTypes(printControlTypes),
+		_errors(scripts.size(), 0), _warnings(scripts.size()) {
+	}
+
+	~DisassembleJobs() {
+		for (std::vector<Common::Exception *>::iterator e = _errors.begin(); e != _errors.end(); ++e)
+			delete *e;
+	}
+
+protected:
+	void runJob(size_t job) {
+		const BatchScript &script = (*_scripts)[job];
+
+		Common::SeekableReadStream *ncs = 0;
+		try {
+			if (script.archive)
+				ncs = script.archive->getResource(script.index);
+			else
+				ncs = new Common::MappedReadFile(script.inFile);
+
+			NWScript::Disassembler disassembler(*ncs, _game);
+
+			/* Warnings are not printed here, but remembered, to be printed in order in
+			 * finishJob(). This includes the analysis failing, which is not fatal. The
+			 * engine function tables of the game are static and read-only, so all jobs
+			 * can use them at the same time. */
+
+			const std::vector<Common::Exception> &loadWarnings = disassembler.getWarnings();
+			_warnings[job].insert(_warnings[job].end(), loadWarnings.begin(), loadWarnings.end());
+
+			if (_game != Aurora::kGameIDUnknown) {
+				try {
+					disassembler.analyzeStack();
+				} catch (...) {
+					addWarning(job, "Script analysis failed");
+				}
+
+				try {
+					disassembler.analyzeControlFlow();
+				} catch (...) {
+					addWarning(job, "Control flow analysis failed");
+				}
+			}
+
+			/* Render the disassembly into memory first, so that a failure doesn't
+			 * leave a truncated output file behind. */
+			Common::MemoryWriteStreamDynamic disassembly(true);
+			writeDisassembly(disassembler, disassembly, _command, _printStack, _printControlTypes);
+
+			Common::WriteFile out(script.outFile);
+
+			if (disassembly.size() > 0)
+				if (out.write(disassembly.getData(), disassembly.size()) != disassembly.size())
+					throw Common::Exception(Common::kWriteError);
+
+			out.flush();
+
+		} catch (Common::Exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (std::exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (...) {
+			_errors[job] = new Common::Exception("Unknown exception caught");
+		}
+
+		delete ncs;
+	}
+
+	void finishJob(size_t job) {
+		const BatchScript &script = (*_scripts)[job];
+
+		std::printf("Disassembling %u/%u: %s ... ", (uint)(job + 1), (uint)_scripts->size(), script.outFile.c_str());
+
+		if (_errors[job]) {
+			std::fflush(stdout);
+			Common::printException(*_errors[job], "");
+
+			delete _errors[job];
+			_errors[job] = 0;
+
+			return;
+		}
+
+		std::printf("Done\n");
+		std::fflush(stdout);
+
+		for (std::vector<Common::Exception>::iterator w = _warnings[job].begin(); w != _warnings[job].end(); ++w)
+			Common::printException(*w, "WARNING: ");
+
+		_warnings[job].clear();
+	}
+
+private:
+	const std::vector<BatchScript> *_scripts;
+
+	Aurora::GameID _game;
+	Command _command;
+
+	bool _printStack;
+	bool _printControlTypes;
+
+	/** The error that occurred while disassembling each script, if any. */
+	std::vector<Common::Exception *> _errors;
+	/** The non-fatal analysis failures of each script. */
+	std::vector< std::vector<Common::Exception> > _warnings;
+
+	/** Remember the exception currently being handled as a warning, like
+	 *  Common::exceptionDispatcherWarnAndIgnore() would print it. */
+	void addWarning(size_t job, const char *reason) {
+		try {
+			throw;
+		} catch (Common::Exception &e) {
+			_warnings[job].push_back(e);
+			_warnings[job].back().add("%s", reason);
+		} catch (std::exception &e) {
+			_warnings[job].push_back(Common::Exception(e));
+			_warnings[job].back().add("%s", reason);
+		} catch (...) {
+			_warnings[job].push_back(Common::Exception("%s", reason));
+		}
+	}
+};
+
+static Common::UString getBatchOutFile(const Common::UString &outDir, const Common::UString &name, Command command) {
+	return outDir + "/" + name + kCommandExtension[command];
+}
+
+/** Add a script to the batch, unless we already have one that writes to the same file. */
+static void addScript(const BatchScript &script, std::vector<BatchScript> &scripts,
+                      std::set<Common::UString> &outFiles) {
+
+	// Archives can contain the same script, and file names might not be case-sensitive
+	if (!outFiles.insert(script.outFile.toLower()).second) {
+		warning("Skipping duplicate script \"%s\"", script.outFile.c_str());
+		return;
+	}
+
+	scripts.push_back(script);
+}
+
+void collectScripts(const Common::UString &directory, std::vector<Common::UString> &files,
+                    const Common::UString &outDir, Command command,
+                    std::vector<BatchScript> &scripts, std::set<Common::UString> &outFiles) {
+
+	std::sort(files.begin(), files.end());
+
+	for (std::vector<Common::UString>::const_iterator f = files.begin(); f != files.end(); ++f) {
+		if (TypeMan.getFileType(*f) != Aurora::kFileTypeNCS)
+			continue;
+
+		const Common::UString outFile = getBatchOutFile(outDir, Common::FilePath::getStem(*f), command);
+
+		addScript(BatchScript(0, 0, directory + "/" + *f, outFile), scripts, outFiles);
+	}
+}
+
+void collectScripts(const Aurora::Archive &archive, Aurora::GameID game, const Common::UString &outDir,
+                    Command command, std::vector<BatchScript> &scripts, std::set<Common::UString> &outFiles) {
+
+	const Aurora::Archive::ResourceList &resources = archive.getResources();
+	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r) {
+		if (TypeMan.aliasFileType(r->type, game) != Aurora::kFileTypeNCS)
+			continue;
+
+		const Common::UString name    = r->name.empty() ? Common::formatHash(r->hash) : r->name;
+		const Common::UString outFile = getBatchOutFile(outDir, name, command);
+
+		addScript(BatchScript(&archive, r->index, "", outFile), scripts, outFiles);
+	}
+}
+
+void openBatchInputs(const std::vector<Common::UString> &files, Aurora::GameID game,
+                     const Common::UString &outDir, Command command,
+                     std::vector<Aurora::Archive *> &archives, std::vector<BatchScript> &scripts) {
+
+	std::set<Common::UString> outFiles;
+
+	std::vector<Aurora::KEYFile *> keys;
+	std::vector<Aurora::BIFFile *> bifs;
+	std::vector<Common::UString> bifFiles;
+
+	try {
+		for (std::vector<Common::UString>::const_iterator f = files.begin(); f != files.end(); ++f) {
+			std::vector<Common::UString> dirFiles;
+			if (Common::Platform::getDirectoryFiles(*f, dirFiles)) {
+				collectScripts(*f, dirFiles, outDir, command, scripts, outFiles);
+				continue;
+			}
+
+			uint32 id;
+			{
+				Common::ReadFile file(*f);
+				id = file.readUint32BE();
+			}
+
+			if        (id == MKTAG('N', 'C', 'S', ' ')) {
+				const Common::UString outFile = getBatchOutFile(outDir, Common::FilePath::getStem(*f), command);
+
+				addScript(BatchScript(0, 0, *f, outFile), scripts, outFiles);
+
+			} else if (id == MKTAG('K', 'E', 'Y', ' ')) {
+				Common::ReadFile key(*f);
+
+				keys.push_back(new Aurora::KEYFile(key));
+
+			} else if (id == MKTAG('B', 'I', 'F', 'F')) {
+				// BIFs need their KEYs to know their resources, so they're handled last
+
+				bifs.push_back(new Aurora::BIFFile(new Common::MappedReadFile(*f)));
+				bifFiles.push_back(*f);
+
+				archives.push_back(bifs.back());
+
+			} else {
+				try {
+					if (id == MKTAG('R', 'I', 'M', ' '))
+						archives.push_back(new Aurora::RIMFile(new Common::MappedReadFile(*f)));
+					else
+						archives.push_back(new Aurora::ERFFile(new Common::MappedReadFile(*f)));
+				} catch (Common::Exception &e) {
+					e.add("\"%s\" is neither a script, nor a directory or a known archive", f->c_str());
+					throw;
+				}
+
+				collectScripts(*archives.back(), game, outDir, command, scripts, outFiles);
+			}
+		}
+
+		// Merge the KEYs into the BIFs they index
+		for (std::vector<Aurora::KEYFile *>::iterator k = keys.begin(); k != keys.end(); ++k) {
+			const Aurora::KEYFile::BIFList &keyBifs = (*k)->getBIFs();
+
+			for (uint kb = 0; kb < keyBifs.size(); kb++)
+				for (uint b = 0; b < bifFiles.size(); b++)
+					if (Common::FilePath::getFile(keyBifs[kb]).equalsIgnoreCase(Common::FilePath::getFile(bifFiles[b])))
+						bifs[b]->mergeKEY(**k, kb);
+		}
+
+		for (std::vector<Aurora::BIFFile *>::iterator b = bifs.begin(); b != bifs.end(); ++b)
+			collectScripts(**b, game, outDir, command, scripts, outFiles);
+
+	} catch (...) {
+		for (std::vector<Aurora::KEYFile *>::iterator k = keys.begin(); k != keys.end(); ++k)
+			delete *k;
+
+		throw;
+	}
+
+	for (std::vector<Aurora::KEYFile *>::iterator k = keys.begin(); k != keys.end(); ++k)
+		delete *k;
+}
+
+void disNCSBatch(const std::vector<Common::UString> &files, const Common::UString &outDir,
+                 Aurora::GameID game, Command command, bool printStack, bool printControlTypes, uint jobs) {
+
+	std::vector<Aurora::Archive *> archives;
+
+	try {
+		std::vector<BatchScript> scripts;
+		openBatchInputs(files, game, outDir, command, archives, scripts);
+
+		std::printf("Disassembling %u scripts into \"%s\"\n\n", (uint)scripts.size(), outDir.c_str());
+
+		DisassembleJobs disassembleJobs(scripts, game, command, printStack, printControlTypes);
+		disassembleJobs.run(scripts.size(), jobs);
+
+	} catch (...) {
+		for (std::vector<Aurora::Archive *>::iterator a = archives.begin(); a != archives.end(); ++a)
+			delete *a;
+
+		throw;
+	}
+
+	for (std::vector<Aurora::Archive *>::iterator a = archives.begin(); a != archives.end(); ++a)
+		delete *a;
+}
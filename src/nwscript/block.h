@@ -38,7 +38,7 @@ struct Instruction;
 struct Block;
 struct SubRoutine;
 
-typedef std::deque<Instruction> Instructions;
+typedef std::vector<Instruction> Instructions;
 
 /** The types of an edge between blocks. */
 enum BlockEdgeType {
@@ -159,16 +159,6 @@ static bool isReturnControl(const Block &block, bool checkChildren = false) {
 	return false;
 }
 
-/** Given a vector of pointers to blocks, return the block that has the earliest, lowest address. */
-static const Block *getEarliestBlock(const std::vector<const Block *> &blocks) {
-	const Block *result = 0;
-	for (std::vector<const Block *>::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
-		if (!result || ((*b)->address < result->address))
-			result = *b;
-
-	return result;
-}
-
 /** Given a vector of pointers to blocks, return the block that has the latest, largest address. */
 static const Block *getLatestBlock(const std::vector<const Block *> &blocks) {
 	const Block *result = 0;
@@ -179,45 +169,202 @@ static const Block *getLatestBlock(const std::vector<const Block *> &blocks) {
 	return result;
 }
 
-/** Recursive internal convenience function to be used by findPathMerge(). */
-static void findPathMergeRec(std::vector<const Block *> &merges, std::set<uint32> &visited,
-                             const Block &block1, const Block &block2) {
+/** Pre-calculated information about the linear paths between blocks.
+ *
+ *  A linear path, as checked by hasLinearPath(), only ever moves forward
+ *  to blocks with larger addresses and never follows subroutine calls.
+ *  So there can't be any cycles, and we can collect the set of all blocks
+ *  reachable from each block in a single pass over the blocks in reverse
+ *  address order. Afterwards, checking for a linear path or finding where
+ *  two paths merge again is a cheap bitset operation, instead of a new
+ *  recursive search through the graph each time.
+ *
+ *  Two blocks can only be connected by a linear path if they're in the same
+ *  connected component (which is usually a subroutine), so we give each
+ *  component its own reachability matrix, to keep the memory usage down.
+ */
+class LinearPaths {
+public:
+	LinearPaths(const Blocks &blocks);
 
-	/* We hold the earlier block and recursively descend into the children
-	 * of the later block. If at any point, there is a linear path between
-	 * the earlier block and the later block (or one of its children), we
-	 * have found a merge point. */
+	/** Is there a linear path between these two blocks? */
+	bool hasPath(const Block &block1, const Block &block2) const;
 
-	// Remember which blocks we already visited, so we don't process them twice
-	visited.insert(block2.address);
+	/** Find the block where the paths of these two blocks come back together. */
+	const Block *findMerge(const Block &block1, const Block &block2) const;
 
-	// We moved past the destination => no merge here
-	if (block1.address > block2.address)
-		return;
+	/** Find the block directly following a block. */
+	const Block *getNextBlock(const Block &block) const;
 
-	// There's a linear path => we found a merge point
-	if (hasLinearPath(block1, block2)) {
-		merges.push_back(&block2);
-		return;
+private:
+	/** A connected component of blocks. */
+	struct Component {
+		/** IDs of the blocks in this component, ordered by address. */
+		std::vector<size_t> blocks;
+
+		/** Number of words in each row of the reachability matrix. */
+		size_t rowSize;
+		/** For each block, a bitset of all blocks reachable from it. */
+		std::vector<uint64> reachable;
+
+		const uint64 *getRow(size_t index) const {
+			return &reachable[index * rowSize];
+		}
+
+		uint64 *getRow(size_t index) {
+			return &reachable[index * rowSize];
+		}
+	};
+
+	/** All blocks, ordered by address. A block's ID is its index in here. */
+	std::vector<const Block *> _blocks;
+
+	/** The component of each block. */
+	std::vector<size_t> _component;
+	/** The index of each block within its component. */
+	std::vector<size_t> _index;
+
+	std::vector<Component> _components;
+
+
+	size_t getID(const Block &block) const;
+
+	/** Collect the IDs of all children that can be reached by a linear path. */
+	void findLinearChildren(const Block &block, std::vector<size_t> &children) const;
+
+	void createComponents();
+	void fillComponent(Component &component);
+};
+
+static bool compareBlockAddress(const Block *a, const Block *b) {
+	return a->address < b->address;
+}
+
+LinearPaths::LinearPaths(const Blocks &blocks) {
+	_blocks.reserve(blocks.size());
+	for (Blocks::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
+		_blocks.push_back(&*b);
+
+	std::sort(_blocks.begin(), _blocks.end(), compareBlockAddress);
+
+	createComponents();
+
+	for (std::vector<Component>::iterator c = _components.begin(); c != _components.end(); ++c)
+		fillComponent(*c);
+}
+
+size_t LinearPaths::getID(const Block &block) const {
+	std::vector<const Block *>::const_iterator b =
+		std::lower_bound(_blocks.begin(), _blocks.end(), &block, compareBlockAddress);
+
+	if ((b == _blocks.end()) || (*b != &block))
+		throw Common::Exception("Can't find block %08X", block.address);
+
+	return b - _blocks.begin();
+}
+
+void LinearPaths::findLinearChildren(const Block &block, std::vector<size_t> &children) const {
+	assert(block.children.size() == block.childrenTypes.size());
+
+	children.clear();
+
+	// Don't follow subroutine calls and don't jump backwards
+	for (size_t i = 0; i < block.children.size(); i++)
+		if (!isSubRoutineCall(block.childrenTypes[i]) && (block.children[i]->address > block.address))
+			children.push_back(getID(*block.children[i]));
+}
+
+/** Find the representative of this block's set in a union-find structure. */
+static size_t findSet(std::vector<size_t> &parent, size_t id) {
+	while (parent[id] != id) {
+		parent[id] = parent[parent[id]];
+		id = parent[id];
 	}
 
-	// Continue along the children
-	assert(block2.children.size() == block2.childrenTypes.size());
+	return id;
+}
 
-	for (size_t i = 0; i < block2.children.size(); i++) {
-		const Block        &child = *block2.children[i];
-		const BlockEdgeType type  =  block2.childrenTypes[i];
+void LinearPaths::createComponents() {
+	/* Join all blocks connected by linear edges into the same sets, then
+	 * assign each set a component, in the order of their first block. */
 
-		// Don't follow subroutine calls, don't jump backwards and don't visit blocks twice
-		if (!isSubRoutineCall(type) && (child.address > block2.address))
-			if (visited.find(child.address) == visited.end())
-				findPathMergeRec(merges, visited, block1, child);
+	std::vector<size_t> parent(_blocks.size());
+	for (size_t i = 0; i < parent.size(); i++)
+		parent[i] = i;
+
+	std::vector<size_t> children;
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		findLinearChildren(*_blocks[i], children);
+
+		for (std::vector<size_t>::const_iterator c = children.begin(); c != children.end(); ++c)
+			parent[findSet(parent, *c)] = findSet(parent, i);
+	}
+
+	std::vector<size_t> setComponent(_blocks.size(), SIZE_MAX);
+
+	_component.resize(_blocks.size());
+	_index.resize(_blocks.size());
+
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		const size_t set = findSet(parent, i);
+
+		if (setComponent[set] == SIZE_MAX) {
+			setComponent[set] = _components.size();
+			_components.push_back(Component());
+		}
+
+		Component &component = _components[setComponent[set]];
+
+		_component[i] = setComponent[set];
+		_index[i]     = component.blocks.size();
+
+		component.blocks.push_back(i);
 	}
 }
 
+void LinearPaths::fillComponent(Component &component) {
+	/* Blocks are only reachable from blocks with smaller addresses. So if we go
+	 * through the blocks backwards, all children have already been filled in. */
+
+	component.rowSize = (component.blocks.size() + 63) / 64;
+	component.reachable.resize(component.blocks.size() * component.rowSize, 0);
+
+	std::vector<size_t> children;
+	for (size_t i = component.blocks.size(); i-- > 0; ) {
+		uint64 *row = component.getRow(i);
+
+		row[i / 64] |= ((uint64) 1) << (i % 64);
+
+		findLinearChildren(*_blocks[component.blocks[i]], children);
+
+		for (std::vector<size_t>::const_iterator c = children.begin(); c != children.end(); ++c) {
+			const uint64 *childRow = component.getRow(_index[*c]);
+
+			for (size_t j = 0; j < component.rowSize; j++)
+				row[j] |= childRow[j];
+		}
+	}
+}
+
+bool LinearPaths::hasPath(const Block &block1, const Block &block2) const {
+	size_t id1 = getID(block1), id2 = getID(block2);
+
+	// Correctly order the two blocks we want to check
+	if (id1 > id2)
+		std::swap(id1, id2);
+
+	if (_component[id1] != _component[id2])
+		return false;
+
+	const Component &component = _components[_component[id1]];
+
+	const size_t index = _index[id2];
+	return (component.getRow(_index[id1])[index / 64] & (((uint64) 1) << (index % 64))) != 0;
+}
+
 /** Find the block where the paths of these two blocks come back together.
  *
- *  For example, when given the two blocks at (1) and (2), findPathMerge()
+ *  For example, when given the two blocks at (1) and (2), findMerge()
  *  will find the block at (3).
  *
  *                .
@@ -252,22 +399,46 @@ static void findPathMergeRec(std::vector<const Block *> &merges, std::set<uint32
  *          |
  *          '
  */
-static const Block *findPathMerge(const Block &block1, const Block &block2) {
-	std::vector<const Block *> merges;
-	std::set<uint32> visited;
+const Block *LinearPaths::findMerge(const Block &block1, const Block &block2) const {
+	/* The blocks reachable from both blocks are exactly the set of possible
+	 * merge points. We're only interested in the earliest merge point,
+	 * which is the lowest bit set in both rows. */
 
-	// Correctly order the two blocks we want to check
-	if (block1.address < block2.address)
-		findPathMergeRec(merges, visited, block1, block2);
-	else
-		findPathMergeRec(merges, visited, block2, block1);
+	const size_t id1 = getID(block1), id2 = getID(block2);
+	if (_component[id1] != _component[id2])
+		return 0;
+
+	const Component &component = _components[_component[id1]];
+
+	const uint64 *row1 = component.getRow(_index[id1]);
+	const uint64 *row2 = component.getRow(_index[id2]);
 
-	// We're only interested in the earliest merge point
-	return getEarliestBlock(merges);
+	for (size_t i = 0; i < component.rowSize; i++) {
+		uint64 merges = row1[i] & row2[i];
+		if (!merges)
+			continue;
+
+		size_t index = i * 64;
+		while (!(merges & 1)) {
+			merges >>= 1;
+			index++;
+		}
+
+		return _blocks[component.blocks[index]];
+	}
+
+	return 0;
 }
 
+const Block *LinearPaths::getNextBlock(const Block &block) const {
+	const size_t id = getID(block);
 
-static void detectDoWhile(Blocks &blocks) {
+	return ((id + 1) < _blocks.size()) ? _blocks[id + 1] : 0;
+}
+
+
+
+static void detectDoWhile(Blocks &blocks, const LinearPaths &paths) {
 	/* Find all do-while loops. A do-while loop has a tail block that
 	 * only has a single JMP that jumps back to the loop head.
 	 *
@@ -314,7 +485,7 @@ static void detectDoWhile(Blocks &blocks) {
 		if (!tail || tail->hasMainControl())
 			continue;
 
-		Block *next = const_cast<Block *>(getNextBlock(blocks, *tail));
+		Block *next = const_cast<Block *>(paths.getNextBlock(*tail));
 		if (!next)
 			throw Common::Exception("Can't find a block following the do-while loop");
 
@@ -325,7 +496,7 @@ static void detectDoWhile(Blocks &blocks) {
 	}
 }
 
-static void detectWhile(Blocks &blocks) {
+static void detectWhile(Blocks &blocks, const LinearPaths &paths) {
 	/* Find all while loops. A while loop has a tail block that isn't a
 	 * do-while loop tail, that jumps back to the loop head.
 	 *
@@ -376,7 +547,7 @@ static void detectWhile(Blocks &blocks) {
 		if (!tail || tail ->hasMainControl())
 			continue;
 
-		Block *next = const_cast<Block *>(getNextBlock(blocks, *tail));
+		Block *next = const_cast<Block *>(paths.getNextBlock(*tail));
 		if (!next)
 			throw Common::Exception("Can't find a block following the do-while loop");
 
@@ -639,7 +810,7 @@ static void detectReturn(Blocks &blocks) {
 	}
 }
 
-static void detectIf(Blocks &blocks) {
+static void detectIf(Blocks &blocks, const LinearPaths &paths) {
 	/* Detect if and if-else statements. An if starts with a yet undetermined block
 	 * that contains a conditional jump (JZ or JNZ).
 	 *
@@ -689,7 +860,7 @@ static void detectIf(Blocks &blocks) {
 			continue;
 
 		// If there's no direct linear path between the two branches, this is an if-else
-		const bool isIfElse = !hasLinearPath(*ifCond->children[0], *ifCond->children[1]);
+		const bool isIfElse = !paths.hasPath(*ifCond->children[0], *ifCond->children[1]);
 
 		Block *ifTrue = 0, *ifElse = 0, *ifNext = 0;
 
@@ -700,7 +871,7 @@ static void detectIf(Blocks &blocks) {
 
 			// If we have both, try to find the block where the code flow unites again
 			if (ifTrue && ifElse)
-				ifNext = const_cast<Block *>(findPathMerge(*ifTrue, *ifElse));
+				ifNext = const_cast<Block *>(paths.findMerge(*ifTrue, *ifElse));
 
 		} else {
 			// The if branch has the smaller address, and the flow continues at the larger address
@@ -797,7 +968,7 @@ static void verifyLoopBlocks(std::set<uint32> &visited, const Block &block,
 	}
 }
 
-static void verifyLoop(const Block &head, const Block &tail, const Block &next) {
+static void verifyLoop(const LinearPaths &paths, const Block &head, const Block &tail, const Block &next) {
 	/* Verify the loop assumption by making sure that the critical loop
 	 * blocks are ordered correctly, that there is a path between them,
 	 * and that all blocks within the loop jump to valid locations. */
@@ -806,7 +977,7 @@ static void verifyLoop(const Block &head, const Block &tail, const Block &next)
 		throw Common::Exception("Loop blocks out of order: %08X, %08X, %08X",
 		                        head.address, tail.address, next.address);
 
-	if (!hasLinearPath(head, tail) || !hasLinearPath(head, next))
+	if (!paths.hasPath(head, tail) || !paths.hasPath(head, next))
 	   throw Common::Exception("Loop blocks have no linear path: %08X, %08X, %08X",
 	                           head.address, tail.address, next.address);
 
@@ -814,65 +985,70 @@ static void verifyLoop(const Block &head, const Block &tail, const Block &next)
 	verifyLoopBlocks(visited, head, head, tail, next);
 }
 
-static void verifyLoops(const std::vector<const ControlStructure *> &loops) {
+static void verifyLoops(const LinearPaths &paths, const std::vector<const ControlStructure *> &loops) {
 	for (std::vector<const ControlStructure *>::const_iterator l = loops.begin(); l != loops.end(); ++l)
-		verifyLoop(*(*l)->loopHead, *(*l)->loopTail, *(*l)->loopNext);
+		verifyLoop(paths, *(*l)->loopHead, *(*l)->loopTail, *(*l)->loopNext);
 }
 
-static void verifyLoops(const Blocks &blocks) {
+static void verifyLoops(const Blocks &blocks, const LinearPaths &paths) {
 	std::vector<const ControlStructure *> doWhileLoops = collectControls(blocks, kControlTypeDoWhileHead);
-	verifyLoops(doWhileLoops);
+	verifyLoops(paths, doWhileLoops);
 
 	std::vector<const ControlStructure *> whileLoops   = collectControls(blocks, kControlTypeWhileHead);
-	verifyLoops(whileLoops);
+	verifyLoops(paths, whileLoops);
 }
 
-static void verifyIf(const Block *ifCond, const Block *ifTrue, const Block *ifElse, const Block *ifNext) {
+static void verifyIf(const LinearPaths &paths, const Block *ifCond, const Block *ifTrue,
+                     const Block *ifElse, const Block *ifNext) {
 	/* Verify the if assumption by making sure that there is a path between
 	 * the critical blocks of the if condition. */
 
 	assert(ifCond && ifTrue);
 
 	if (ifTrue && ifNext)
-		if (!hasLinearPath(*ifTrue, *ifNext))
+		if (!paths.hasPath(*ifTrue, *ifNext))
 			throw Common::Exception("If blocks true and next have no linear path: %08X, %08X, %08X",
 			                        ifCond->address, ifTrue->address, ifNext->address);
 
 	if (ifElse && ifNext)
-		if (!hasLinearPath(*ifElse, *ifNext))
+		if (!paths.hasPath(*ifElse, *ifNext))
 			throw Common::Exception("If blocks else and next have no linear path: %08X, %08X, %08X",
 			                        ifCond->address, ifTrue->address, ifNext->address);
 }
 
-static void verifyIf(const Blocks &blocks) {
+static void verifyIf(const Blocks &blocks, const LinearPaths &paths) {
 	std::vector<const ControlStructure *> ifs = collectControls(blocks, kControlTypeIfCond);
 	for (std::vector<const ControlStructure *>::const_iterator i = ifs.begin(); i != ifs.end(); ++i)
-		verifyIf((*i)->ifCond, (*i)->ifTrue, (*i)->ifElse, (*i)->ifNext);
+		verifyIf(paths, (*i)->ifCond, (*i)->ifTrue, (*i)->ifElse, (*i)->ifNext);
 }
 
 
-static void detectControlFlow(Blocks &blocks) {
+static void detectControlFlow(Blocks &blocks, const LinearPaths &paths) {
 	// The order is important!
-	detectDoWhile (blocks);
-	detectWhile   (blocks);
+	detectDoWhile (blocks, paths);
+	detectWhile   (blocks, paths);
 	detectBreak   (blocks);
 	detectContinue(blocks);
 	detectReturn  (blocks);
-	detectIf      (blocks);
+	detectIf      (blocks, paths);
 }
 
-static void verifyControlFlow(const Blocks &blocks) {
+static void verifyControlFlow(const Blocks &blocks, const LinearPaths &paths) {
 	verifyBlocks(blocks);
-	verifyLoops (blocks);
-	verifyIf    (blocks);
+	verifyLoops (blocks, paths);
+	verifyIf    (blocks, paths);
 }
 
 
 void analyzeControlFlow(Blocks &blocks) {
-	/* Analyze the control flow to detect (and verify) different control structures. */
+	/* Analyze the control flow to detect (and verify) different control structures.
+	 * The block graph itself doesn't change while we do that, so we can figure out
+	 * the linear paths through it once beforehand. */
+
+	const LinearPaths paths(blocks);
 
-	detectControlFlow(blocks);
-	verifyControlFlow(blocks);
+	detectControlFlow(blocks, paths);
+	verifyControlFlow(blocks, paths);
 }
 
 } // End of namespace NWScript
@@ -63,6 +63,10 @@ Disassembler::~Disassembler() {
 	delete _ncs;
 }
 
+const std::vector<Common::Exception> &Disassembler::getWarnings() const {
+	return _ncs->getWarnings();
+}
+
 void Disassembler::analyzeStack() {
 	_ncs->analyzeStack();
 }
@@ -393,11 +397,12 @@ void Disassembler::writeStack(Common::WriteStream &out, const Instruction &instr
 	out.writeString(Common::UString(' ', indent));
 	out.writeString(Common::UString::format("; .--- Stack: %4s ---\n", stackSize.c_str()));
 
-	for (size_t s = 0; s < instr.stack.size(); s++) {
-		const Variable &var = *instr.stack[s].variable;
+	size_t s = 0;
+	for (Stack::const_iterator v = instr.stack.begin(); v != instr.stack.end(); ++v, s++) {
+		const Variable &var = *v->variable;
 
 		Common::UString siblings;
-		for (std::set<const Variable *>::const_iterator sib = var.siblings.begin();
+		for (VariableSet::const_iterator sib = var.siblings.begin();
 		     sib != var.siblings.end(); ++sib) {
 
 			if (!siblings.empty())
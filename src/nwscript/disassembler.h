@@ -29,6 +29,7 @@
 
 #include "src/common/types.h"
 #include "src/common/ustring.h"
+#include "src/common/error.h"
 
 #include "src/aurora/types.h"
 
@@ -51,6 +52,9 @@ public:
 	Disassembler(NCSFile *ncs);
 	~Disassembler();
 
+	/** Return the non-fatal problems found while loading the script. */
+	const std::vector<Common::Exception> &getWarnings() const;
+
 	/** Perform a deep analysis of the script stack, so that more information is available. */
 	void analyzeStack();
 	/** Perform a deep analysis of the control flow, so that more information is available. */
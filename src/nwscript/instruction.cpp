@@ -26,7 +26,7 @@
 
 #include "src/common/util.h"
 #include "src/common/error.h"
-#include "src/common/readstream.h"
+#include "src/common/readcursor.h"
 
 #include "src/nwscript/instruction.h"
 #include "src/nwscript/util.h"
@@ -42,22 +42,14 @@ static void setAddressType(Instruction *instr, AddressType type) {
 	instr->addressType = type;
 }
 
-static Instruction *findInstruction(Instructions &instructions, uint32 address) {
-	Instructions::iterator it = std::lower_bound(instructions.begin(), instructions.end(), address);
-	if ((it == instructions.end()) || (it->address != address))
-		return 0;
-
-	return &*it;
-}
 
+typedef void (*ParseFunc)(Instruction &instr, Common::ReadCursor &ncs);
 
-typedef void (*ParseFunc)(Instruction &instr, Common::SeekableReadStream &ncs);
-
-static void parseOpcodeConst  (Instruction &instr, Common::SeekableReadStream &ncs);
-static void parseOpcodeEq     (Instruction &instr, Common::SeekableReadStream &ncs);
-static void parseOpcodeNEq    (Instruction &instr, Common::SeekableReadStream &ncs);
-static void parseOpcodeStore  (Instruction &instr, Common::SeekableReadStream &ncs);
-static void parseOpcodeDefault(Instruction &instr, Common::SeekableReadStream &ncs);
+static void parseOpcodeConst  (Instruction &instr, Common::ReadCursor &ncs);
+static void parseOpcodeEq     (Instruction &instr, Common::ReadCursor &ncs);
+static void parseOpcodeNEq    (Instruction &instr, Common::ReadCursor &ncs);
+static void parseOpcodeStore  (Instruction &instr, Common::ReadCursor &ncs);
+static void parseOpcodeDefault(Instruction &instr, Common::ReadCursor &ncs);
 
 static const ParseFunc kParseFunc[kOpcodeMAX] = {
 	// 0x00
@@ -146,7 +138,7 @@ static const ParseFunc kParseFunc[kOpcodeMAX] = {
 	/* SCRIPTSIZE    */ parseOpcodeDefault
 };
 
-static Common::UString readStringQuoting(Common::SeekableReadStream &ncs, size_t length) {
+static Common::UString readStringQuoting(Common::ReadCursor &ncs, size_t length) {
 	Common::UString str;
 
 	while (length-- > 0) {
@@ -177,7 +169,7 @@ static Common::UString readStringQuoting(Common::SeekableReadStream &ncs, size_t
 }
 
 
-void parseOpcodeConst(Instruction &instr, Common::SeekableReadStream &ncs) {
+void parseOpcodeConst(Instruction &instr, Common::ReadCursor &ncs) {
 	switch (instr.type) {
 		case kInstTypeInt:
 			instr.constValueInt = ncs.readSint32BE();
@@ -205,7 +197,7 @@ void parseOpcodeConst(Instruction &instr, Common::SeekableReadStream &ncs) {
 	instr.argCount = 1;
 }
 
-void parseOpcodeEq(Instruction &instr, Common::SeekableReadStream &ncs) {
+void parseOpcodeEq(Instruction &instr, Common::ReadCursor &ncs) {
 	if (instr.type != kInstTypeStructStruct)
 		return;
 
@@ -215,7 +207,7 @@ void parseOpcodeEq(Instruction &instr, Common::SeekableReadStream &ncs) {
 	instr.argCount = 1;
 }
 
-void parseOpcodeNEq(Instruction &instr, Common::SeekableReadStream &ncs) {
+void parseOpcodeNEq(Instruction &instr, Common::ReadCursor &ncs) {
 	if (instr.type != kInstTypeStructStruct)
 		return;
 
@@ -225,7 +217,7 @@ void parseOpcodeNEq(Instruction &instr, Common::SeekableReadStream &ncs) {
 	instr.argCount = 1;
 }
 
-void parseOpcodeStore(Instruction &instr, Common::SeekableReadStream &ncs) {
+void parseOpcodeStore(Instruction &instr, Common::ReadCursor &ncs) {
 	instr.args[0] = (uint8) instr.type;
 	instr.args[1] = ncs.readUint32BE();
 	instr.args[2] = ncs.readUint32BE();
@@ -239,7 +231,7 @@ void parseOpcodeStore(Instruction &instr, Common::SeekableReadStream &ncs) {
 	instr.type = kInstTypeDirect;
 }
 
-void parseOpcodeDefault(Instruction &instr, Common::SeekableReadStream &ncs) {
+void parseOpcodeDefault(Instruction &instr, Common::ReadCursor &ncs) {
 	instr.argCount = getDirectArgumentCount(instr.opcode);
 
 	const OpcodeArgument * const args = getDirectArguments(instr.opcode);
@@ -274,18 +266,15 @@ void parseOpcodeDefault(Instruction &instr, Common::SeekableReadStream &ncs) {
 }
 
 
-bool parseInstruction(Common::SeekableReadStream &ncs, Instruction &instr) {
+bool parseInstruction(Common::ReadCursor &ncs, Instruction &instr) {
 	instr.address = ncs.pos();
 
-	try {
-		instr.opcode = (Opcode)          ncs.readByte();
-		instr.type   = (InstructionType) ncs.readByte();
-	} catch (...) {
-		if (ncs.eos())
-			return false;
+	// Not enough data left for another instruction: we're done
+	if (ncs.left() < 2)
+		return false;
 
-		throw;
-	}
+	instr.opcode = (Opcode)          ncs.readByte();
+	instr.type   = (InstructionType) ncs.readByte();
 
 	if (((size_t)instr.opcode >= ARRAYSIZE(kParseFunc)) || !kParseFunc[(size_t)instr.opcode])
 		throw Common::Exception("Invalid opcode 0x%02X", (uint8)instr.opcode);
@@ -296,7 +285,40 @@ bool parseInstruction(Common::SeekableReadStream &ncs, Instruction &instr) {
 	return true;
 }
 
-void linkInstructionBranches(Instructions &instructions) {
+void indexInstructions(InstructionIndex &index, const Instructions &instructions) {
+	/* Instructions are ordered by address, so the last one determines how
+	 * large the address space is. NCS files are small enough that a flat
+	 * table over all addresses is feasible, and it turns every address
+	 * lookup into a simple array access. */
+
+	index.clear();
+	if (instructions.empty())
+		return;
+
+	if (instructions.size() >= kInstructionIndexNone)
+		throw Common::Exception("Too many instructions (%u)", (uint)instructions.size());
+
+	index.resize(instructions.back().address + 1, kInstructionIndexNone);
+
+	for (size_t i = 0; i < instructions.size(); i++)
+		index[instructions[i].address] = i;
+}
+
+Instruction *findInstruction(Instructions &instructions, const InstructionIndex &index, uint32 address) {
+	if ((address >= index.size()) || (index[address] == kInstructionIndexNone))
+		return 0;
+
+	return &instructions[index[address]];
+}
+
+const Instruction *findInstruction(const Instructions &instructions, const InstructionIndex &index, uint32 address) {
+	if ((address >= index.size()) || (index[address] == kInstructionIndexNone))
+		return 0;
+
+	return &instructions[index[address]];
+}
+
+void linkInstructionBranches(Instructions &instructions, const InstructionIndex &index) {
 	/* Go through all instructions and link them according to the flow graph.
 	 *
 	 * In specifics, link each instruction's follower, the instruction that
@@ -322,7 +344,7 @@ void linkInstructionBranches(Instructions &instructions) {
 		if ((i->opcode == kOpcodeJMP) || (i->opcode == kOpcodeJSR) || (i->opcode == kOpcodeSTORESTATE)) {
 			assert(((i->opcode == kOpcodeSTORESTATE) && (i->argCount == 3)) || (i->argCount == 1));
 
-			Instruction *branch = findInstruction(instructions, i->address + i->args[0]);
+			Instruction *branch = findInstruction(instructions, index, i->address + i->args[0]);
 			if (!branch)
 				throw Common::Exception("Can't find destination of unconditional branch");
 
@@ -347,7 +369,7 @@ void linkInstructionBranches(Instructions &instructions) {
 			if (!i->follower)
 				throw Common::Exception("Conditional branch has no false destination");
 
-			Instruction *branch = findInstruction(instructions, i->address + i->args[0]);
+			Instruction *branch = findInstruction(instructions, index, i->address + i->args[0]);
 			if (!branch)
 				throw Common::Exception("Can't find destination of conditional branch");
 
@@ -26,7 +26,6 @@
 #define NWSCRIPT_INSTRUCTION_H
 
 #include <vector>
-#include <deque>
 
 #include "src/common/types.h"
 #include "src/common/ustring.h"
@@ -34,7 +33,7 @@
 #include "src/nwscript/stack.h"
 
 namespace Common {
-	class SeekableReadStream;
+	class ReadCursor;
 }
 
 namespace NWScript {
@@ -248,20 +247,31 @@ struct Instruction {
 	bool operator<(const Instruction &right) const {
 		return address < right.address;
 	}
-
-	bool operator<(uint32 right) const {
-		return address < right;
-	}
 };
 
 /** The whole set of instructions found in a script. */
-typedef std::deque<Instruction> Instructions;
+typedef std::vector<Instruction> Instructions;
+
+/** For each byte address in a script, the index of the instruction at this address.
+ *
+ *  Addresses that don't start an instruction map to kInstructionIndexNone.
+ */
+typedef std::vector<uint32> InstructionIndex;
+
+static const uint32 kInstructionIndexNone = 0xFFFFFFFF;
+
+/** Parse an instruction out of the NCS data. */
+bool parseInstruction(Common::ReadCursor &ncs, Instruction &instr);
+
+/** Create an address index for a whole set of script instructions. */
+void indexInstructions(InstructionIndex &index, const Instructions &instructions);
 
-/** Parse an instruction out of the NCS stream. */
-bool parseInstruction(Common::SeekableReadStream &ncs, Instruction &instr);
+/** Find the instruction at this address, or return 0 if there is none. */
+Instruction *findInstruction(Instructions &instructions, const InstructionIndex &index, uint32 address);
+const Instruction *findInstruction(const Instructions &instructions, const InstructionIndex &index, uint32 address);
 
 /** Given a whole set of script instructions, interlink branching instructions. */
-void linkInstructionBranches(Instructions &instructions);
+void linkInstructionBranches(Instructions &instructions, const InstructionIndex &index);
 
 } // End of namespace NWScript
 
@@ -22,13 +22,12 @@
  *  Handling BioWare's NCS, compiled NWScript bytecode.
  */
 
-#include <algorithm>
-
 #include "src/common/util.h"
 #include "src/common/strutil.h"
 #include "src/common/error.h"
 #include "src/common/encoding.h"
 #include "src/common/readstream.h"
+#include "src/common/readcursor.h"
 
 #include "src/nwscript/ncsfile.h"
 #include "src/nwscript/util.h"
@@ -96,11 +95,7 @@ const SubRoutine *NCSFile::getMainSubRoutine() const {
 }
 
 const Instruction *NCSFile::findInstruction(uint32 address) const {
-	Instructions::const_iterator it = std::lower_bound(_instructions.begin(), _instructions.end(), address);
-	if ((it == _instructions.end()) || (it->address != address))
-		return 0;
-
-	return &*it;
+	return NWScript::findInstruction(_instructions, _instructionIndex, address);
 }
 
 void NCSFile::load(Common::SeekableReadStream &ncs) {
@@ -122,7 +117,8 @@ void NCSFile::load(Common::SeekableReadStream &ncs) {
 			throw Common::Exception("Script size %u > stream size %u", (uint)_size, (uint)ncs.size());
 
 		if (_size < ncs.size())
-			warning("Script size %u < stream size %u", (uint)_size, (uint)ncs.size());
+			_warnings.push_back(Common::Exception("Script size %u < stream size %u",
+			                                      (uint)_size, (uint)ncs.size()));
 
 		parse(ncs);
 
@@ -144,12 +140,21 @@ const Stack &NCSFile::getGlobals() const {
 	return _globals;
 }
 
+const std::vector<Common::Exception> &NCSFile::getWarnings() const {
+	return _warnings;
+}
+
 void NCSFile::parse(Common::SeekableReadStream &ncs) {
-	while (parseStep(ncs))
+	std::vector<byte> buffer;
+	Common::ReadCursor data(ncs, buffer);
+
+	while (parseStep(data))
 		;
+
+	indexInstructions(_instructionIndex, _instructions);
 }
 
-bool NCSFile::parseStep(Common::SeekableReadStream &ncs) {
+bool NCSFile::parseStep(Common::ReadCursor &ncs) {
 	Instruction instr;
 
 	if (!parseInstruction(ncs, instr))
@@ -164,7 +169,7 @@ void NCSFile::analyzeBlocks() {
 	/* Analyze the instructions on a block level. */
 
 	// Link branching instructions to their destination instructions
-	linkInstructionBranches(_instructions);
+	linkInstructionBranches(_instructions, _instructionIndex);
 	// Construct a block graph by following the code flow
 	constructBlocks(_blocks, _instructions);
 	// Mark logically dead block edges
@@ -184,8 +189,11 @@ void NCSFile::analyzeSubRoutines() {
 	// Now analyze the subroutine types and see if we can identify a few special ones
 	try {
 		_specialSubRoutines = analyzeSubRoutineTypes(_subRoutines);
+	} catch (Common::Exception &e) {
+		_warnings.push_back(e);
+	} catch (std::exception &e) {
+		_warnings.push_back(Common::Exception(e));
 	} catch (...) {
-		Common::exceptionDispatcherWarnAndIgnore();
 	}
 }
 
@@ -25,8 +25,11 @@
 #ifndef NWSCRIPT_NCSFILE_H
 #define NWSCRIPT_NCSFILE_H
 
+#include <vector>
+
 #include "src/common/types.h"
 #include "src/common/ustring.h"
+#include "src/common/error.h"
 
 #include "src/aurora/types.h"
 #include "src/aurora/aurorafile.h"
@@ -39,6 +42,7 @@
 
 namespace Common {
 	class SeekableReadStream;
+	class ReadCursor;
 }
 
 namespace NWScript {
@@ -118,15 +122,23 @@ public:
 	/** Return the global variables we found while analyzing this script. */
 	const Stack &getGlobals() const;
 
+	/** Return the non-fatal problems found while loading this script.
+	 *
+	 *  These are not printed, so that the caller can decide when and how to
+	 *  report them. This is important when loading scripts in parallel.
+	 */
+	const std::vector<Common::Exception> &getWarnings() const;
+
 
 private:
 	Aurora::GameID _game;
 
 	size_t _size;
 
-	Instructions _instructions;
-	Blocks       _blocks;
-	SubRoutines  _subRoutines;
+	Instructions     _instructions;
+	InstructionIndex _instructionIndex;
+	Blocks           _blocks;
+	SubRoutines      _subRoutines;
 
 	SpecialSubRoutines _specialSubRoutines;
 
@@ -136,11 +148,13 @@ private:
 	VariableSpace _variables;
 	Stack _globals;
 
+	std::vector<Common::Exception> _warnings;
+
 
 	void load(Common::SeekableReadStream &ncs);
 	void parse(Common::SeekableReadStream &ncs);
 
-	bool parseStep(Common::SeekableReadStream &ncs);
+	bool parseStep(Common::ReadCursor &ncs);
 
 	void analyzeBlocks();
 	void analyzeSubRoutines();
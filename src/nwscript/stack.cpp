@@ -23,6 +23,11 @@
  */
 
 #include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <list>
+#include <map>
 
 #include "src/common/util.h"
 #include "src/common/error.h"
@@ -36,8 +41,123 @@
 
 namespace NWScript {
 
+Stack::Stack() : _top(0), _size(0) {
+}
+
+Stack::Stack(const Stack &stack) : _top(stack._top), _size(stack._size) {
+	if (_top)
+		_top->refCount++;
+}
+
+Stack::~Stack() {
+	release(_top);
+}
+
+Stack &Stack::operator=(const Stack &stack) {
+	assignTop(stack, stack._size);
+
+	return *this;
+}
+
+void Stack::clear() {
+	release(_top);
+
+	_top  = 0;
+	_size = 0;
+}
+
+const StackVariable &Stack::operator[](size_t n) const {
+	assert(n < _size);
+
+	const Node *node = _top;
+	while (n-- > 0)
+		node = node->next;
+
+	return node->variable;
+}
+
+const StackVariable &Stack::front() const {
+	assert(_top && (_size > 0));
+
+	return _top->variable;
+}
+
+void Stack::push_front(const StackVariable &var) {
+	// The new node takes over our reference to the old top node
+	_top = new Node(var, _top);
+	_size++;
+}
+
+void Stack::pop_front() {
+	assert(_top && (_size > 0));
+
+	eraseTop(1);
+}
+
+void Stack::eraseTop(size_t n) {
+	n = MIN(n, _size);
+
+	Node *top = _top;
+	for (size_t i = 0; i < n; i++)
+		top = top->next;
+
+	_size -= n;
+	if (_size == 0)
+		top = 0;
+
+	if (top)
+		top->refCount++;
+
+	release(_top);
+	_top = top;
+}
+
+void Stack::eraseBottom(size_t n) {
+	_size -= MIN(n, _size);
+
+	if (_size == 0)
+		clear();
+}
+
+void Stack::assignTop(const Stack &stack, size_t n) {
+	n = MIN(n, stack._size);
+
+	Node *top = (n > 0) ? stack._top : 0;
+	if (top)
+		top->refCount++;
+
+	release(_top);
+
+	_top  = top;
+	_size = n;
+}
+
+void Stack::release(Node *node) {
+	/* Drop a reference to a node. If that was the last one, the node goes
+	 * away, and with it its reference to the next node. We do this in a
+	 * loop, because a long stack would overflow the native stack otherwise. */
+
+	while (node && (--node->refCount == 0)) {
+		Node *next = node->next;
+
+		delete node;
+		node = next;
+	}
+}
+
+
 static const size_t kDummyStackFrameSize = 32;
 
+static bool compareVariableID(const Variable *a, const Variable *b) {
+	return a->id < b->id;
+}
+
+static void insertVariable(VariableSet &set, const Variable *var) {
+	VariableSet::iterator it = std::lower_bound(set.begin(), set.end(), var, compareVariableID);
+	if ((it == set.end()) || (*it != var))
+		set.insert(it, var);
+}
+
 /** The current analysis mode. */
 enum AnalyzeMode {
 	/** Analyze the stack of the _global method, in isolation. No subroutine call will be followed. */
@@ -46,14 +166,70 @@ enum AnalyzeMode {
 	kAnalyzeStackSubRoutine
 };
 
+struct AnalyzeStackCall;
+
+/** A visit of a block during stack analysis, or of the rest of a block.
+ *
+ *  A visit without a block marks the point where all blocks of the call's
+ *  subroutine have been visited instead.
+ */
+struct AnalyzeStackVisit {
+	AnalyzeStackCall *call; ///< The subroutine call this visit happens in.
+
+	Block *block;       ///< The block to visit.
+	size_t instruction; ///< The index of the first instruction to analyze in this block.
+
+	Stack stack;     ///< The stack at the start of the visit.
+	size_t subStack; ///< The size of the subroutine's stack frame at the start of the visit.
+
+	/** Does this visit continue a block that has been put aside? */
+	bool resumed;
+
+
+	AnalyzeStackVisit(AnalyzeStackCall *c = 0, Block *b = 0, size_t i = 0,
+	                  const Stack &st = Stack(), size_t sub = 0, bool r = false) :
+		call(c), block(b), instruction(i), stack(st), subStack(sub), resumed(r) {
+
+	}
+};
+
+/** The analysis of a subroutine, started by the first call into it. */
+struct AnalyzeStackCall {
+	SubRoutine *sub;
+
+	/** The visit that called the subroutine, to be continued with the instruction
+	 *  after the call once the subroutine is done. It has no block if this is the
+	 *  subroutine the analysis started with. */
+	AnalyzeStackVisit caller;
+
+	bool subRETN;      ///< Have we already seen a RETN in this subroutine?
+	Stack returnStack; ///< The stack after the first RETN.
+
+	/** Recursive calls into this subroutine, waiting for its first RETN. */
+	std::vector<AnalyzeStackVisit> recursions;
+
+	size_t waiting; ///< The number of visits in this subroutine waiting on a recursive call.
+	bool parked;    ///< Did we run out of blocks to visit while visits were still waiting?
+
+
+	AnalyzeStackCall(SubRoutine &s, const AnalyzeStackVisit &c) :
+		sub(&s), caller(c), subRETN(false), waiting(0), parked(false) {
+
+	}
+};
+
 /** The context during stack analysis. */
 struct AnalyzeStackContext {
 	AnalyzeMode mode;
 
+	AnalyzeStackCall *call;
+
 	SubRoutine *sub;
 	Block *block;
 	Instruction *instruction;
 
+	size_t instructionIndex; ///< The index of the current instruction within its block.
+
 	VariableSpace *variables;
 
 	Aurora::GameID game;
@@ -62,18 +238,33 @@ struct AnalyzeStackContext {
 	Stack *globals;
 
 	size_t subStack;
-	bool subRETN;
 
-	Stack returnStack;
+	/** Has the current instruction put the rest of the current visit aside? */
+	bool suspended;
+
+	/** The visits we still need to do, last one first. */
+	std::vector<AnalyzeStackVisit> work;
+
+	/** All subroutine calls we followed. */
+	std::list<AnalyzeStackCall> calls;
+	/** The subroutine calls by subroutine. */
+	std::map<const SubRoutine *, AnalyzeStackCall *> subCalls;
 
 
 	AnalyzeStackContext(AnalyzeMode m, SubRoutine &s, VariableSpace &vars,
 	                    Aurora::GameID g = Aurora::kGameIDUnknown) :
-		mode(m), sub(&s), block(0), instruction(0), variables(&vars), game(g),
-		stack(0), globals(0), subStack(0), subRETN(false) {
+		mode(m), call(0), sub(&s), block(0), instruction(0), instructionIndex(0), variables(&vars),
+		game(g), stack(0), globals(0), subStack(0), suspended(false) {
 
 	}
 
+	/** Return a visit continuing the current block at this instruction index. */
+	AnalyzeStackVisit getVisit(size_t index) const {
+		assert(stack);
+
+		return AnalyzeStackVisit(call, block, index, *stack, subStack, true);
+	}
+
 	size_t getSubStackSize() const {
 		if (!stack)
 			return 0;
@@ -151,17 +342,24 @@ struct AnalyzeStackContext {
 		return var;
 	}
 
-	void connectSets(const Variable *v1, const Variable *v2,
-	                 std::set<const Variable *> &s1, std::set<const Variable *> &s2) {
+	void connectSets(const Variable *v1, const Variable *v2, VariableSet &s1, VariableSet &s2) {
+		/* Both sets become the union of the two sets and the two variables,
+		 * each without the variable it belongs to. */
+
+		VariableSet merged;
+		merged.reserve(s1.size() + s2.size() + 2);
 
-		s1.insert(v2);
-		s2.insert(v1);
+		std::set_union(s1.begin(), s1.end(), s2.begin(), s2.end(),
+		               std::back_inserter(merged), compareVariableID);
 
-		s1.insert(s2.begin(), s2.end());
-		s2.insert(s1.begin(), s1.end());
+		insertVariable(merged, v1);
+		insertVariable(merged, v2);
 
-		s1.erase(v1);
-		s2.erase(v2);
+		s1 = merged;
+		s2.swap(merged);
+
+		s1.erase(std::lower_bound(s1.begin(), s1.end(), v1, compareVariableID));
+		s2.erase(std::lower_bound(s2.begin(), s2.end(), v2, compareVariableID));
 	}
 
 	void duplicateVariable(size_t offset, VariableUse use = kVariableUseUnknown) {
@@ -352,170 +550,232 @@ static void fixupDuplicateTypes(VariableSpace &variables) {
 	for (VariableSpace::iterator v = variables.begin(); v != variables.end(); ++v) {
 		VariableType type = v->type;
 
-		for (std::set<const Variable *>::iterator d = v->duplicates.begin(); d != v->duplicates.end(); ++d)
+		for (VariableSet::iterator d = v->duplicates.begin(); d != v->duplicates.end(); ++d)
 			if ((*d)->type != kTypeAny)
 				type = (*d)->type;
 
 		v->type = type;
-		for (std::set<const Variable *>::iterator d = v->duplicates.begin(); d != v->duplicates.end(); ++d)
+		for (VariableSet::iterator d = v->duplicates.begin(); d != v->duplicates.end(); ++d)
 			const_cast<Variable *>(*d)->type = type;
 	}
 }
 
 
-static void analyzeStackBlock      (AnalyzeStackContext &ctx);
 static void analyzeStackInstruction(AnalyzeStackContext &ctx);
 
-static void analyzeStackSubRoutine(AnalyzeStackContext &ctx, bool ignoreRecursion = false) {
-	assert(ctx.sub);
+static void startSubRoutine(AnalyzeStackContext &ctx, SubRoutine &sub, const AnalyzeStackVisit &caller) {
+	/* Start analyzing a subroutine, beginning with its first block and the stack
+	 * of the caller. The following blocks and their subroutine calls will be
+	 * followed from there. After all of them, the marker visit without a block
+	 * finishes the subroutine and continues with the caller. */
 
-	if (ctx.sub->stackAnalyzeState == kStackAnalyzeStateFinished) {
-		/* If we already analyzed this subroutine previously, don't do it again.
-		 *
-		 * Instead, we make sure the types of the parameters and return values
-		 * are congruent between each other. */
+	ctx.calls.push_back(AnalyzeStackCall(sub, caller));
 
-		if (ctx.getSubStackSize() < ctx.sub->params.size())
-			throw Common::Exception("analyzeStackSubRoutine(): @%08X: Stack underrun", ctx.instruction->address);
+	AnalyzeStackCall &call = ctx.calls.back();
+	ctx.subCalls[&sub] = &call;
 
-		for (size_t i = 0; i < ctx.sub->params.size(); i++) {
-			Variable *var1 = const_cast<Variable *>(ctx.sub->params[i]);
-			Variable *var2 = const_cast<Variable *>(ctx.stack->front().variable);
+	sub.stackAnalyzeState = kStackAnalyzeStateStart;
 
-			var2->use = kVariableUseParameter;
+	ctx.work.push_back(AnalyzeStackVisit(&call));
 
-			ctx.sameVariableType(var1, var2);
-			ctx.popVariable(false);
-		}
+	if (!sub.blocks.empty()) {
+		assert(sub.blocks.front());
 
-		for (size_t i = 0; i < ctx.sub->returns.size(); i++) {
-			Variable *var1 = const_cast<Variable *>(ctx.sub->returns[i]);
-			Variable *var2 = const_cast<Variable *>((*ctx.stack)[i].variable);
+		ctx.work.push_back(AnalyzeStackVisit(&call, const_cast<Block *>(sub.blocks.front()), 0, caller.stack));
+	}
+}
 
-			var2->use = kVariableUseReturn;
+static void finishSubRoutineCall(AnalyzeStackContext &ctx, const SubRoutine &sub) {
+	/* The stack after a subroutine call. Parameters have been removed, and the
+	 * return values have been filled in. */
 
-			ctx.sameVariableType(var1, var2);
-		}
+	if ((sub.params.size() + sub.returns.size()) > ctx.stack->size())
+		throw Common::Exception("analyzeStackJSR(): @%08X: Stack underrun", ctx.instruction->address);
+
+	for (size_t i = 0; i < (sub.params.size() + sub.returns.size()); i++)
+		ctx.modifiesVariable(i);
+}
+
+static void finishSubRoutine(AnalyzeStackContext &ctx, AnalyzeStackCall &call) {
+	/* We visited all blocks of this subroutine we could. */
 
+	if (!call.subRETN && (call.waiting > 0)) {
+		/* All remaining paths through this subroutine are waiting on recursive calls
+		 * to return, so we don't know yet how the subroutine returns. We're trying
+		 * again once this subroutine does hit its first RETN. */
+
+		call.parked = true;
 		return;
 	}
 
-	// Are we currently already in the process of analyzing this very same subroutine?
-	if (ctx.sub->stackAnalyzeState == kStackAnalyzeStateStart) {
-		/* Are we currently already in the process of analyzing this very same
-		 * subroutine?  Then we've walked into a recursing subroutine. Yay.
-		 *
-		 * If we've been told to ignore recursion, simply return. Note that this
-		 * leaves the stack in a broken state, because the recursing subroutine may
-		 * take parameters it should have cleared off the stack. So we can only do
-		 * that in cases where the stack afterwards doesn't mater, namely as the
-		 * very last instructions of a STORESTATE subroutine.
-		 *
-		 * In all other cases, this is a fatal. It is impossible to analyze
-		 * recursion in the way we go about things. Unless we can find a dirty
-		 * trick to guess the number of parameters the recursing subroutine
-		 * takes without having to analyze it to the end, we need to error out.
-		 */
+	call.parked = false;
+	call.sub->stackAnalyzeState = kStackAnalyzeStateFinished;
 
-		if (ignoreRecursion)
-			return;
+	// Now make sure the types of all variables that have been duplicated are the same
+	fixupDuplicateTypes(*ctx.variables);
 
-		throw Common::Exception("Recursion detected in subroutine %08X", ctx.sub->address);
-	}
+	if (!call.caller.block)
+		return;
 
-	ctx.sub->stackAnalyzeState = kStackAnalyzeStateStart;
+	/* Continue the caller after the call instruction, with the stack as it was
+	 * after the subroutine returned, minus the parameters. */
 
-	if (!ctx.sub->blocks.empty()) {
-		/* Start analyzing the control flow of this subroutine with its
-		 * first block. The following blocks and their subroutine calls
-		 * will be recursively followed. */
+	AnalyzeStackVisit visit(call.caller);
 
-		assert(ctx.sub->blocks.front());
+	visit.stack     = call.returnStack;
+	visit.subStack -= call.sub->params.size();
 
-		AnalyzeStackContext oldCtx(ctx);
+	assert(visit.instruction > 0);
 
-		ctx.block    = const_cast<Block *>(ctx.sub->blocks.front());
-		ctx.subStack = 0;
-		ctx.subRETN  = false;
-		ctx.returnStack.clear();
+	ctx.call        = visit.call;
+	ctx.sub         = visit.call->sub;
+	ctx.block       = visit.block;
+	ctx.instruction = const_cast<Instruction *>(visit.block->instructions[visit.instruction - 1]);
+	ctx.stack       = &visit.stack;
+	ctx.subStack    = visit.subStack;
 
-		analyzeStackBlock(ctx);
+	finishSubRoutineCall(ctx, *call.sub);
 
-		*oldCtx.stack = ctx.returnStack;
+	ctx.instruction = 0;
+	ctx.stack       = 0;
 
-		ctx = oldCtx;
+	ctx.work.push_back(visit);
+}
 
-		ctx.subStack -= ctx.sub->params.size();
-	}
+static void releaseRecursions(AnalyzeStackContext &ctx, AnalyzeStackCall &call) {
+	/* This subroutine hit its first RETN, so we know how it returns now.
+	 * All recursive calls waiting on this can now continue. */
 
-	ctx.sub->stackAnalyzeState = kStackAnalyzeStateFinished;
+	if (call.parked)
+		ctx.work.push_back(AnalyzeStackVisit(&call));
 
-	// Now make sure the types of all variables that have been duplicated are the same
-	fixupDuplicateTypes(*ctx.variables);
+	for (std::vector<AnalyzeStackVisit>::reverse_iterator r = call.recursions.rbegin();
+	     r != call.recursions.rend(); ++r) {
+
+		assert(r->call && (r->call->waiting > 0));
+
+		r->call->waiting--;
+		ctx.work.push_back(*r);
+	}
+
+	call.recursions.clear();
 }
 
-static void analyzeStackBlock(AnalyzeStackContext &ctx) {
-	assert(ctx.block);
+static void analyzeStackCalledSubRoutine(AnalyzeStackContext &ctx, const SubRoutine &sub) {
+	/* We have already analyzed this subroutine, or at least we know how it returns.
+	 * Instead of following it again, we make sure the types of the parameters and
+	 * return values are congruent between each other. */
 
-	if (ctx.block->stackAnalyzeState == kStackAnalyzeStateFinished) {
-		/* If we already analyzed this block previously, don't do it again.
-		 * However, we're going to connect the variables on the stack now
-		 * with the variables on the stack then. Different variables on
-		 * the same stack space are obviously "siblings", essentially the
-		 * same logical variable. */
+	if (ctx.getSubStackSize() < sub.params.size())
+		throw Common::Exception("analyzeStackSubRoutine(): @%08X: Stack underrun", ctx.instruction->address);
 
-		if (!ctx.block->instructions.empty() && ctx.block->instructions.front()) {
-			const Instruction &instr = *ctx.block->instructions.front();
+	for (size_t i = 0; i < sub.params.size(); i++) {
+		Variable *var1 = const_cast<Variable *>(sub.params[i]);
+		Variable *var2 = ctx.stack->front().variable;
 
-			// Make sure the stack is balanced between the two merging nodes
-			if (ctx.subStack != instr.stack.size())
-				throw Common::Exception("Unbalanced stack in block fork merge @%08X: %u != %u",
-				                        instr.address, (uint)ctx.subStack, (uint)instr.stack.size());
+		var2->use = kVariableUseParameter;
 
-			// Now connect the siblings, until we reached a point where the stack is identical again
-			for (size_t i = 0; i < ctx.subStack; i++) {
-				Variable *var1 = instr.stack[i].variable;
-				Variable *var2 = (*ctx.stack)[i].variable;
+		ctx.sameVariableType(var1, var2);
+		ctx.popVariable(false);
+	}
 
-				if (!var1 || !var2 || (var1 == var2) || (var1->id == var2->id))
-					break;
+	if (sub.returns.size() > ctx.stack->size())
+		throw Common::Exception("analyzeStackSubRoutine(): @%08X: Stack underrun", ctx.instruction->address);
 
-				ctx.connectSiblings(*var1, *var2);
-			}
-		}
+	Stack::const_iterator s = ctx.stack->begin();
+	for (size_t i = 0; i < sub.returns.size(); i++, ++s) {
+		Variable *var1 = const_cast<Variable *>(sub.returns[i]);
+		Variable *var2 = s->variable;
+
+		var2->use = kVariableUseReturn;
+
+		ctx.sameVariableType(var1, var2);
+	}
+}
+
+static void analyzeStackMerge(AnalyzeStackContext &ctx) {
+	/* We already analyzed this block previously, so we don't do it again.
+	 * However, we're going to connect the variables on the stack now
+	 * with the variables on the stack then. Different variables on
+	 * the same stack space are obviously "siblings", essentially the
+	 * same logical variable. */
 
+	if (ctx.block->instructions.empty() || !ctx.block->instructions.front())
 		return;
+
+	const Instruction &instr = *ctx.block->instructions.front();
+
+	// Make sure the stack is balanced between the two merging nodes
+	if (ctx.subStack != instr.stack.size())
+		throw Common::Exception("Unbalanced stack in block fork merge @%08X: %u != %u",
+		                        instr.address, (uint)ctx.subStack, (uint)instr.stack.size());
+
+	// Now connect the siblings, until we reached a point where the stack is identical again
+	Stack::const_iterator s1 = instr.stack.begin();
+	Stack::const_iterator s2 = ctx.stack->begin();
+	for (size_t i = 0; i < ctx.subStack; i++, ++s1, ++s2) {
+		Variable *var1 = s1->variable;
+		Variable *var2 = s2->variable;
+
+		if (!var1 || !var2 || (var1 == var2) || (var1->id == var2->id))
+			break;
+
+		ctx.connectSiblings(*var1, *var2);
 	}
+}
 
-	// Are we currently already in the process of analyzing this very same block?
-	if (ctx.block->stackAnalyzeState == kStackAnalyzeStateStart)
-		throw Common::Exception("Recursion detected in block %08X", ctx.block->address);
+static void analyzeStackVisit(AnalyzeStackContext &ctx, AnalyzeStackVisit &visit) {
+	assert(visit.call && visit.block);
 
-	ctx.block->stackAnalyzeState = kStackAnalyzeStateStart;
+	ctx.call      = visit.call;
+	ctx.sub       = visit.call->sub;
+	ctx.block     = visit.block;
+	ctx.stack     = &visit.stack;
+	ctx.subStack  = visit.subStack;
+	ctx.suspended = false;
 
-	for (std::vector<const Instruction *>::const_iterator i = ctx.block->instructions.begin();
-	     i != ctx.block->instructions.end(); ++i) {
+	if (!visit.resumed) {
+		if (ctx.block->stackAnalyzeState == kStackAnalyzeStateFinished) {
+			analyzeStackMerge(ctx);
+			return;
+		}
+
+		// Are we currently already in the process of analyzing this very same block?
+		if (ctx.block->stackAnalyzeState == kStackAnalyzeStateStart)
+			throw Common::Exception("Recursion detected in block %08X", ctx.block->address);
 
-		/* Analyze all the instructions in this block.
-		 * Subroutine calls will be followed recursively. */
+		ctx.block->stackAnalyzeState = kStackAnalyzeStateStart;
+	}
 
-		assert(*i);
+	for (size_t i = visit.instruction; i < ctx.block->instructions.size(); i++) {
+		/* Analyze all the instructions in this block. A subroutine call
+		 * puts the rest of the block aside until the subroutine is done. */
 
-		ctx.instruction = const_cast<Instruction *>(*i);
+		assert(ctx.block->instructions[i]);
+
+		ctx.instruction      = const_cast<Instruction *>(ctx.block->instructions[i]);
+		ctx.instructionIndex = i;
 
 		analyzeStackInstruction(ctx);
 
 		ctx.instruction = 0;
+
+		if (ctx.suspended) {
+			/* Other paths can merge into this block while it's put aside. They can
+			 * already do that, since they only need the block's starting stack. */
+			ctx.block->stackAnalyzeState = kStackAnalyzeStateFinished;
+			return;
+		}
 	}
 
 	ctx.block->stackAnalyzeState = kStackAnalyzeStateFinished;
 
 	assert(ctx.block->children.size() == ctx.block->childrenTypes.size());
 
-	for (size_t i = 0; i < ctx.block->children.size(); i++) {
-		/* Recurse into the child blocks, but not into subroutines or STORESTATEs.
-		 * Don't follow logically dead edges either. */
+	/* Visit the child blocks next, in order, each with its own copy of the stack.
+	 * Don't follow subroutines or STORESTATEs, nor logically dead edges. */
 
+	for (size_t i = ctx.block->children.size(); i-- > 0; ) {
 		if ((ctx.block->childrenTypes[i] == kBlockEdgeTypeSubRoutineCall ) ||
 		    (ctx.block->childrenTypes[i] == kBlockEdgeTypeSubRoutineStore) ||
 		    (ctx.block->childrenTypes[i] == kBlockEdgeTypeDead           ))
@@ -523,32 +783,43 @@ static void analyzeStackBlock(AnalyzeStackContext &ctx) {
 
 		assert(ctx.block->children[i]);
 
-		AnalyzeStackContext oldCtx(ctx);
-		Stack cStack(*ctx.stack);
+		ctx.work.push_back(AnalyzeStackVisit(ctx.call, const_cast<Block *>(ctx.block->children[i]),
+		                                     0, *ctx.stack, ctx.subStack));
+	}
+}
 
-		ctx.block = const_cast<Block *>(ctx.block->children[i]);
-		ctx.stack = &cStack;
+static void analyzeStack(AnalyzeStackContext &ctx) {
+	/* Analyze the stack throughout the context's subroutine, and all subroutines
+	 * it calls. Instead of recursing, we keep a worklist of block visits, which we
+	 * go through last-in first-out. This way, the blocks are visited depth-first,
+	 * in the order of the control flow. */
 
-		analyzeStackBlock(ctx);
-		if (ctx.subRETN)
-			oldCtx.subRETN = true;
+	assert(ctx.sub && ctx.stack);
 
-		if (!ctx.returnStack.empty())
-			oldCtx.returnStack = ctx.returnStack;
+	if (ctx.sub->stackAnalyzeState != kStackAnalyzeStateNone)
+		return;
+
+	startSubRoutine(ctx, *ctx.sub, AnalyzeStackVisit(0, 0, 0, *ctx.stack, ctx.subStack));
+
+	while (!ctx.work.empty()) {
+		AnalyzeStackVisit visit(ctx.work.back());
+		ctx.work.pop_back();
 
-		ctx = oldCtx;
+		if (visit.block)
+			analyzeStackVisit(ctx, visit);
+		else
+			finishSubRoutine(ctx, *visit.call);
 	}
+
+	// Subroutines that are still waiting for themselves to return never will
+	for (std::list<AnalyzeStackCall>::const_iterator c = ctx.calls.begin(); c != ctx.calls.end(); ++c)
+		if (c->parked || !c->recursions.empty())
+			throw Common::Exception("Recursion detected in subroutine %08X", c->sub->address);
 }
 
 static void analyzeStackInstruction(AnalyzeStackContext &ctx) {
-	ctx.instruction->stack = *ctx.stack;
-
 	// For the instruction stack, only keep the stack frame of the current subroutine
-	if (ctx.instruction->stack.size() > ctx.subStack) {
-		const size_t outsideSize = ctx.instruction->stack.size() - ctx.subStack;
-
-		ctx.instruction->stack.erase(ctx.instruction->stack.end() - outsideSize, ctx.instruction->stack.end());
-	}
+	ctx.instruction->stack.assignTop(*ctx.stack, ctx.subStack);
 
 	// Call the specific stack analyze function for this opcode
 
@@ -619,29 +890,49 @@ static void analyzeStackJSR(AnalyzeStackContext &ctx) {
 	                       (ctx.instruction->opcode == kOpcodeJSR) &&
 	                       (ctx.instruction->follower->opcode == kOpcodeRETN);
 
-	AnalyzeStackContext oldCtx(ctx);
+	if (sub->stackAnalyzeState == kStackAnalyzeStateNone) {
+		/* We haven't analyzed this subroutine yet. Do so now, and continue with
+		 * the rest of this block once the subroutine is done. */
 
-	ctx.sub = sub;
+		startSubRoutine(ctx, *sub, ctx.getVisit(ctx.instructionIndex + 1));
+
+		ctx.suspended = true;
+		return;
+	}
 
-	analyzeStackSubRoutine(ctx, isStoreStateTail);
+	if (sub->stackAnalyzeState == kStackAnalyzeStateStart) {
+		/* We're currently already in the process of analyzing this very same
+		 * subroutine, so we've walked into a recursing subroutine. Yay.
+		 *
+		 * To continue, we need to know the parameters the subroutine takes, and
+		 * we only know these for certain once we've seen the subroutine return.
+		 * If we haven't yet, we put this path aside until then. */
 
-	if ((sub->params.size() + sub->returns.size()) > oldCtx.stack->size())
-		throw Common::Exception("analyzeStackJSR(): @%08X: Stack underrun", ctx.instruction->address);
+		if (isStoreStateTail) {
+			finishSubRoutineCall(ctx, *sub);
+			return;
+		}
 
-	for (size_t i = 0; i < (sub->params.size() + sub->returns.size()); i++)
-		oldCtx.modifiesVariable(i);
+		assert(ctx.subCalls.find(sub) != ctx.subCalls.end());
 
-	oldCtx.subStack = ctx.subStack;
+		AnalyzeStackCall &call = *ctx.subCalls[sub];
+		if (!call.subRETN) {
+			call.recursions.push_back(ctx.getVisit(ctx.instructionIndex));
+			ctx.call->waiting++;
 
-	ctx = oldCtx;
+			ctx.suspended = true;
+			return;
+		}
+	}
 
-	assert(ctx.stack);
+	analyzeStackCalledSubRoutine(ctx, *sub);
+	finishSubRoutineCall(ctx, *sub);
 }
 
 static void analyzeStackRETN(AnalyzeStackContext &ctx) {
 	/* A RETN instruction, returning from a subroutine call. */
 
-	if (ctx.subRETN)
+	if (ctx.call->subRETN)
 		return;
 
 	if (ctx.sub->type == kSubRoutineTypeStoreState) {
@@ -652,12 +943,12 @@ static void analyzeStackRETN(AnalyzeStackContext &ctx) {
 		ctx.sub->params.clear();
 		ctx.sub->returns.clear();
 
-		ctx.returnStack = *ctx.stack;
+		ctx.call->returnStack = *ctx.stack;
 
-		if (ctx.subStack > ctx.returnStack.size())
+		if (ctx.subStack > ctx.call->returnStack.size())
 			throw Common::Exception("analyzeStackRETN(): @%08X: Stack underrun", ctx.instruction->address);
 
-		ctx.returnStack.erase(ctx.returnStack.begin(), ctx.returnStack.begin() + ctx.subStack);
+		ctx.call->returnStack.eraseTop(ctx.subStack);
 
 	} else {
 		/* If the subroutine accessed return values, these are in the same stack space
@@ -669,7 +960,7 @@ static void analyzeStackRETN(AnalyzeStackContext &ctx) {
 
 		ctx.sub->returns.erase(ctx.sub->returns.begin(), ctx.sub->returns.begin() + subParams);
 
-		ctx.returnStack = *ctx.stack;
+		ctx.call->returnStack = *ctx.stack;
 
 		// Mark the variables uses
 
@@ -688,7 +979,9 @@ static void analyzeStackRETN(AnalyzeStackContext &ctx) {
 		}
 	}
 
-	ctx.subRETN = true;
+	ctx.call->subRETN = true;
+
+	releaseRecursions(ctx, *ctx.call);
 }
 
 static void analyzeStackCPTOPSP(AnalyzeStackContext &ctx) {
@@ -743,7 +1036,7 @@ static void analyzeStackCPDOWNSP(AnalyzeStackContext &ctx) {
 		ctx.modifiesVariable(pos);
 		ctx.modifiesVariable(offset);
 
-		if (!ctx.subRETN && ((size_t)offset >= ctx.subStack)) {
+		if (!ctx.call->subRETN && ((size_t)offset >= ctx.subStack)) {
 			/* If we see an underrun during a CPDOWNSP instruction, this means the subroutine
 			 * into either the return placeholder, or the parameters, both of which have been
 			 * created by the caller.
@@ -1121,7 +1414,7 @@ static void analyzeStackDestruct(AnalyzeStackContext &ctx) {
 	if (ctx.getSubStackSize() < (((size_t)stackSize) / 4))
 		throw Common::Exception("analyzeStackDestruct(): @%08X: Stack underrun", ctx.instruction->address);
 
-	Stack tmp;
+	std::vector<StackVariable> tmp;
 
 	while (stackSize > 0) {
 
@@ -1139,7 +1432,7 @@ static void analyzeStackDestruct(AnalyzeStackContext &ctx) {
 		stackSize -= 4;
 	}
 
-	for (Stack::reverse_iterator t = tmp.rbegin(); t != tmp.rend(); ++t) {
+	for (std::vector<StackVariable>::reverse_iterator t = tmp.rbegin(); t != tmp.rend(); ++t) {
 		ctx.subStack++;
 		ctx.stack->push_front(*t);
 	}
@@ -1166,10 +1459,10 @@ static void analyzeStackSAVEBP(AnalyzeStackContext &ctx) {
 
 	// Remove the dummy stack frame from the globals stack
 	const size_t dummySize = MIN<size_t>(ctx.globals->size(), kDummyStackFrameSize);
-	ctx.globals->erase(ctx.globals->end() - dummySize, ctx.globals->end());
+	ctx.globals->eraseBottom(dummySize);
 
-	for (Stack::iterator g = ctx.globals->begin(); g != ctx.globals->end(); ++g)
-		g->variable->use = kVariableUseGlobal;
+	for (size_t i = 0; i < ctx.globals->size(); i++)
+		(*ctx.globals)[i].variable->use = kVariableUseGlobal;
 
 	// SAVEBP pushes the current BP value onto the stack
 	ctx.modifiesVariable(ctx.pushVariable(kTypeInt, kVariableUseLocal));
@@ -1364,7 +1657,7 @@ void analyzeStackGlobals(SubRoutine &sub, VariableSpace &variables, Aurora::Game
 	for (size_t i = 0; i < kDummyStackFrameSize; i++)
 		ctx.pushVariable(kTypeAny);
 
-	analyzeStackSubRoutine(ctx);
+	analyzeStack(ctx);
 }
 
 void analyzeStackSubRoutine(SubRoutine &sub, VariableSpace &variables, Aurora::GameID game, Stack *globals) {
@@ -1378,7 +1671,7 @@ void analyzeStackSubRoutine(SubRoutine &sub, VariableSpace &variables, Aurora::G
 	for (size_t i = 0; i < kDummyStackFrameSize; i++)
 		ctx.pushVariable(kTypeAny);
 
-	analyzeStackSubRoutine(ctx);
+	analyzeStack(ctx);
 }
 
 } // End of namespace NWScript
@@ -25,8 +25,6 @@
 #ifndef NWSCRIPT_STACK_H
 #define NWSCRIPT_STACK_H
 
-#include <deque>
-
 #include "src/aurora/types.h"
 
 #include "src/nwscript/variable.h"
@@ -51,8 +49,113 @@ struct StackVariable {
 	}
 };
 
-/** A stack frame in a script. */
-typedef std::deque<StackVariable> Stack;
+/** A stack frame in a script.
+ *
+ *  Element 0 is the top of the stack. The elements are kept in a singly
+ *  linked list of reference-counted nodes, from the top down, and copies of
+ *  a stack share these nodes. Copying, pushing and popping are therefore
+ *  cheap, while accessing an element has to walk down from the top.
+ *
+ *  A stack only sees the top size() nodes of its list, so cutting off the
+ *  bottom of a stack is cheap as well.
+ */
+class Stack {
+private:
+	struct Node {
+		StackVariable variable;
+		Node *next;
+
+		size_t refCount;
+
+
+		Node(const StackVariable &var, Node *n) : variable(var), next(n), refCount(1) {
+		}
+	};
+
+public:
+	/** Iterate over the elements of a stack, from the top down. */
+	class const_iterator {
+	public:
+		const_iterator() : _node(0), _left(0) {
+		}
+
+		const StackVariable &operator*() const {
+			return _node->variable;
+		}
+
+		const StackVariable *operator->() const {
+			return &_node->variable;
+		}
+
+		const_iterator &operator++() {
+			_node = (--_left > 0) ? _node->next : 0;
+			return *this;
+		}
+
+		bool operator==(const const_iterator &right) const {
+			return _node == right._node;
+		}
+
+		bool operator!=(const const_iterator &right) const {
+			return _node != right._node;
+		}
+
+	private:
+		const Node *_node;
+		size_t _left;
+
+		const_iterator(const Node *node, size_t left) : _node(left ? node : 0), _left(left) {
+		}
+
+		friend class Stack;
+	};
+
+	Stack();
+	Stack(const Stack &stack);
+	~Stack();
+
+	Stack &operator=(const Stack &stack);
+
+	bool empty() const {
+		return _size == 0;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	void clear();
+
+	const_iterator begin() const {
+		return const_iterator(_top, _size);
+	}
+
+	const_iterator end() const {
+		return const_iterator();
+	}
+
+	/** Return the nth element from the top. */
+	const StackVariable &operator[](size_t n) const;
+
+	const StackVariable &front() const;
+
+	void push_front(const StackVariable &var);
+	void pop_front();
+
+	/** Remove the n top-most elements. */
+	void eraseTop(size_t n);
+	/** Remove the n bottom-most elements. */
+	void eraseBottom(size_t n);
+
+	/** Replace this stack with the n top-most elements of another stack. */
+	void assignTop(const Stack &stack, size_t n);
+
+private:
+	Node *_top;
+	size_t _size;
+
+	static void release(Node *node);
+};
 
 /** Analyze the stack of this "_global"-type subroutine.
  *
@@ -71,14 +174,14 @@ void analyzeStackGlobals(SubRoutine &sub, VariableSpace &variables, Aurora::Game
  *
  *  Every single instruction in every single block of this subroutine will be
  *  analyzed, and its stack information updated. Subroutines that are called
- *  will be recursed into and also updated. Each unique variable created
- *  during this process will have a Variable object added to the variables
- *  parameter.
+ *  will be followed and also updated. Each unique variable created during
+ *  this process will have a Variable object added to the variables parameter.
  *
  *  The game the subroutine's script is from needs to be set to a valid value.
  *
- *  Subroutines that themselves recurse are not supported and will lead to
- *  an analysis failure.
+ *  Subroutines that themselves recurse are supported, as long as they have
+ *  a path that returns without recursing. Recursive calls are analyzed once
+ *  such a path has been found.
  *
  *  Should the analysis fail for any reason, an exception will be thrown.
  */
@@ -24,6 +24,8 @@
 
 #include <algorithm>
 
+#include "src/common/util.h"
+
 #include "src/nwscript/variable.h"
 
 namespace NWScript {
@@ -33,7 +35,7 @@ std::vector<size_t> Variable::getSiblingGroup() const {
 
 	sib.reserve(siblings.size() + 1);
 
-	for (std::set<const Variable *>::const_iterator s = siblings.begin(); s != siblings.end(); ++s)
+	for (VariableSet::const_iterator s = siblings.begin(); s != siblings.end(); ++s)
 			sib.push_back((*s)->id);
 	sib.push_back(id);
 
@@ -43,7 +45,10 @@ std::vector<size_t> Variable::getSiblingGroup() const {
 }
 
 size_t Variable::getLowestSibling() const {
-	return getSiblingGroup().front();
+	if (siblings.empty())
+		return id;
+
+	return MIN(siblings.front()->id, id);
 }
 
 } // End of namespace NWScript
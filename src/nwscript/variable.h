@@ -27,7 +27,6 @@
 
 #include <vector>
 #include <deque>
-#include <set>
 
 #include "src/common/types.h"
 
@@ -122,6 +121,11 @@ enum VariableUse {
 	kVariableUseReturn     ///< This is a subroutine return value.
 };
 
+struct Variable;
+
+/** A set of variables, kept as a vector sorted by variable ID. */
+typedef std::vector<const Variable *> VariableSet;
+
 /** A struct describing how the type of a variable was inferred. */
 struct TypeInference {
 	/** The type we inferred. */
@@ -153,7 +157,7 @@ struct Variable {
 	std::vector<const Instruction *> writers;
 
 	/** Variables that were created by duplicating this variable. */
-	std::set<const Variable *> duplicates;
+	VariableSet duplicates;
 
 	/** Variables that are logically the very same variable as this one.
 	 *
@@ -161,10 +165,10 @@ struct Variable {
 	 *  variables that occupy the same stack space. They are logically the
 	 *  same variable, only created through a different potential path.
 	 */
-	std::set<const Variable *> siblings;
+	VariableSet siblings;
 
 	/** Instructions that helped to infer the type of this variable. */
-	std::deque<TypeInference> typeInference;
+	std::vector<TypeInference> typeInference;
 
 
 	Variable(size_t i, VariableType t, VariableUse u = kVariableUseUnknown) :
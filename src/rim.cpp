@@ -0,0 +1,159 @@
+/* xoreos-tools - Tools to help with xoreos development
+ *
+ * xoreos-tools is the legal property of its developers, whose names
+ * can be found in the AUTHORS file distributed with this source
+ * distribution.
+ *
+ * xoreos-tools is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * xoreos-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with xoreos-tools. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ *  Tool to pack RIM archives.
+ */
+
+#include <cstring>
+#include <cstdio>
+
+#include "src/common/version.h"
+#include "src/common/ustring.h"
+#include "src/common/error.h"
+#include "src/common/platform.h"
+#include "src/common/writefile.h"
+
+#include "src/aurora/rimwriter.h"
+
+#include "src/util.h"
+
+void printUsage(FILE *stream, const Common::UString &name);
+bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
+                      Common::UString &archive, std::vector<Common::UString> &files);
+
+void packFiles(const Common::UString &archive, const std::vector<Common::UString> &fileNames);
+
+int main(int argc, char **argv) {
+	try {
+		std::vector<Common::UString> args;
+		Common::Platform::getParameters(argc, argv, args);
+
+		int returnValue = 1;
+		Common::UString archive;
+		std::vector<Common::UString> files;
+
+		if (!parseCommandLine(args, returnValue, archive, files))
+			return returnValue;
+
+		packFiles(archive, files);
+
+	} catch (...) {
+		Common::exceptionDispatcherError();
+	}
+
+	return 0;
+}
+
+bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
+                      Common::UString &archive, std::vector<Common::UString> &files) {
+
+	archive.clear();
+	files.clear();
+
+	std::vector<Common::UString> args;
+
+	bool optionsEnd = false;
+	for (size_t i = 1; i < argv.size(); i++) {
+		// A "--" marks an end to all options
+		if (argv[i] == "--") {
+			optionsEnd = true;
+			continue;
+		}
+
+		// We're still handling options
+		if (!optionsEnd) {
+			// Help text
+			if ((argv[i] == "-h") || (argv[i] == "--help")) {
+				printUsage(stdout, argv[0]);
+				returnValue = 0;
+
+				return false;
+			}
+
+			if (argv[i] == "--version") {
+				printVersion();
+				returnValue = 0;
+
+				return false;
+			}
+
+			if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
+			  // An options, but we already checked for all known ones
+
+				printUsage(stderr, argv[0]);
+				returnValue = 1;
+
+				return false;
+			}
+		}
+
+		args.push_back(argv[i]);
+	}
+
+	if (args.size() < 2) {
+		printUsage(stderr, argv[0]);
+		returnValue = 1;
+
+		return false;
+	}
+
+	archive = args[0];
+	files.assign(args.begin() + 1, args.end());
+
+	return true;
+}
+
+void printUsage(FILE *stream, const Common::UString &name) {
+	std::fprintf(stream, "BioWare RIM archive packer\n\n");
+	std::fprintf(stream, "Usage: %s [<options>] <archive> <file> [<file> [...]]\n\n", name.c_str());
+	std::fprintf(stream, "Options:\n");
+	std::fprintf(stream, "  -h      --help        This help text\n");
+	std::fprintf(stream, "          --version     Display version information\n");
+}
+
+void packFiles(const Common::UString &archive, const std::vector<Common::UString> &fileNames) {
+	std::vector<PackFile> files;
+	getPackFiles(fileNames, files);
+
+	std::printf("Number of files: %u\n\n", (uint)files.size());
+
+	Aurora::RIMWriter rim;
+	for (std::vector<PackFile>::const_iterator f = files.begin(); f != files.end(); ++f)
+		rim.add(f->name, f->type, f->size);
+
+	Common::WriteFile file;
+	if (!file.open(archive))
+		throw Common::Exception(Common::kOpenError);
+
+	rim.write(file);
+
+	for (size_t i = 0; i < files.size(); i++) {
+		std::printf("Packing %u/%u: %s ... ", (uint)(i + 1), (uint)files.size(), files[i].fileName.c_str());
+		std::fflush(stdout);
+
+		writePackFile(file, files[i]);
+
+		std::printf("Done\n");
+	}
+
+	file.flush();
+	file.close();
+}
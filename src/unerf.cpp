@@ -36,6 +36,7 @@
 #include "src/common/memreadstream.h"
 #include "src/common/memwritestream.h"
 #include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
 #include "src/common/filepath.h"
 #include "src/common/hash.h"
 #include "src/common/md5.h"
@@ -66,7 +67,8 @@ const char *kCommandChar[kCommandMAX] = { "i", "l", "v", "e", "s" };
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
                       Command &command, Common::UString &archive, std::set<Common::UString> &files,
-                      Aurora::GameID &game, std::vector<byte> &password);
+                      Aurora::GameID &game, std::vector<byte> &password, uint &jobs,
+                      Common::UString &cacheFile);
 
 bool findHashedName(uint64 hash, Common::UString &name);
 
@@ -77,7 +79,8 @@ void displayInfo(Aurora::ERFFile &erf);
 void listFiles(Aurora::ERFFile &erf, Aurora::GameID game);
 void listVerboseFiles(Aurora::ERFFile &erf, Aurora::GameID game);
 void extractFiles(Aurora::ERFFile &erf, Aurora::GameID game,
-                  std::set<Common::UString> &files, ExtractMode mode);
+                  std::set<Common::UString> &files, ExtractMode mode, uint jobs,
+                  const Common::UString &archive, const Common::UString &cacheFile);
 
 int main(int argc, char **argv) {
 	try {
@@ -91,11 +94,13 @@ int main(int argc, char **argv) {
 		Common::UString archive;
 		std::set<Common::UString> files;
 		std::vector<byte> password;
+		uint jobs = 1;
+		Common::UString cacheFile;
 
-		if (!parseCommandLine(args, returnValue, command, archive, files, game, password))
+		if (!parseCommandLine(args, returnValue, command, archive, files, game, password, jobs, cacheFile))
 			return returnValue;
 
-		Aurora::ERFFile erf(new Common::ReadFile(archive), password);
+		Aurora::ERFFile erf(new Common::MappedReadFile(archive), password);
 
 		if      (command == kCommandInfo)
 			displayInfo(erf);
@@ -104,9 +109,9 @@ int main(int argc, char **argv) {
 		else if (command == kCommandListVerbose)
 			listVerboseFiles(erf, game);
 		else if (command == kCommandExtract)
-			extractFiles(erf, game, files, kExtractModeStrip);
+			extractFiles(erf, game, files, kExtractModeStrip, jobs, archive, cacheFile);
 		else if (command == kCommandExtractSub)
-			extractFiles(erf, game, files, kExtractModeSubstitute);
+			extractFiles(erf, game, files, kExtractModeSubstitute, jobs, archive, cacheFile);
 
 	} catch (...) {
 		Common::exceptionDispatcherError();
@@ -154,7 +159,8 @@ void readNWMMD5(const Common::UString &arg, std::vector<byte> &password) {
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
                       Command &command, Common::UString &archive, std::set<Common::UString> &files,
-                      Aurora::GameID &game, std::vector<byte> &password) {
+                      Aurora::GameID &game, std::vector<byte> &password, uint &jobs,
+                      Common::UString &cacheFile) {
 
 	archive.clear();
 	files.clear();
@@ -220,6 +226,32 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 
 				readNWMMD5(argv[i], password);
 
+			} else if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				isOption = true;
+
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+
+			} else if (argv[i] == "--cache") {
+				isOption = true;
+
+				// Needs the cache file as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				cacheFile = argv[i];
+
 			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -280,7 +312,11 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "        --pass <hex>  Decryption password, if required, in hex notation\n");
 	std::fprintf(stream, "                      (e.g. \"4CF223AB\")\n");
 	std::fprintf(stream, "        --nwm <file>  Neverwinter Nights premium module file\n");
-	std::fprintf(stream, "                      (for decrypting their HAK file\n\n");
+	std::fprintf(stream, "                      (for decrypting their HAK file\n");
+	std::fprintf(stream, "  -j <n> --jobs <n>   Extract with n parallel jobs (0: one per CPU core)\n");
+	std::fprintf(stream, "        --cache <file>\n");
+	std::fprintf(stream, "                      Skip files unchanged since the last extraction,\n");
+	std::fprintf(stream, "                      as recorded in this cache file\n\n");
 	std::fprintf(stream, "Commands:\n");
 	std::fprintf(stream, "  i          Display meta-information\n");
 	std::fprintf(stream, "  l          List archive\n");
@@ -392,13 +428,17 @@ void listVerboseFiles(Aurora::ERFFile &erf, Aurora::GameID game) {
 }
 
 void extractFiles(Aurora::ERFFile &erf, Aurora::GameID game,
-                  std::set<Common::UString> &files, ExtractMode mode) {
+                  std::set<Common::UString> &files, ExtractMode mode, uint jobs,
+                  const Common::UString &archive, const Common::UString &cacheFile) {
 
 	const Aurora::Archive::ResourceList &resources = erf.getResources();
 	const size_t fileCount = resources.size();
 
 	std::printf("Number of files: %u\n\n", (uint)fileCount);
 
+	std::vector<ExtractFile> toExtract;
+	toExtract.reserve(fileCount);
+
 	size_t i = 1;
 	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r, ++i) {
 		Common::UString name = r->name;
@@ -419,20 +459,14 @@ void extractFiles(Aurora::ERFFile &erf, Aurora::GameID game,
 		if (mode == kExtractModeSubstitute)
 			fileName.replaceAll('/', '=');
 
-		std::printf("Extracting %u/%u: %s ... ", (uint)i, (uint)fileCount, fileName.c_str());
-
-		Common::SeekableReadStream *stream = 0;
-		try {
-			stream = erf.getResource(r->index);
-
-			dumpStream(*stream, fileName);
-
-			std::printf("Done\n");
-		} catch (Common::Exception &e) {
-			Common::printException(e, "");
-		}
+		toExtract.push_back(ExtractFile(r->index, i, fileName));
+	}
 
-		delete stream;
+	if (cacheFile.empty()) {
+		extractFiles(erf, toExtract, fileCount, jobs);
+		return;
 	}
 
+	ExtractCache cache(cacheFile);
+	extractFiles(erf, toExtract, fileCount, jobs, &cache, archive);
 }
@@ -32,7 +32,7 @@
 #include "src/common/error.h"
 #include "src/common/platform.h"
 #include "src/common/readstream.h"
-#include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
 #include "src/common/filepath.h"
 #include "src/common/hash.h"
 
@@ -53,12 +53,12 @@ const char *kCommandChar[kCommandMAX] = { "l", "e" };
 
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file);
+                      Command &command, Common::UString &file, uint &jobs);
 
 bool findHashedName(uint32 hash, Common::UString &name, Common::UString &ext);
 
 void listFiles(Aurora::HERFFile &rim);
-void extractFiles(Aurora::HERFFile &rim);
+void extractFiles(Aurora::HERFFile &herf, uint jobs);
 
 int main(int argc, char **argv) {
 	try {
@@ -68,16 +68,17 @@ int main(int argc, char **argv) {
 		int returnValue = 1;
 		Command command = kCommandNone;
 		Common::UString file;
+		uint jobs = 1;
 
-		if (!parseCommandLine(args, returnValue, command, file))
+		if (!parseCommandLine(args, returnValue, command, file, jobs))
 			return returnValue;
 
-		Aurora::HERFFile herf(new Common::ReadFile(file));
+		Aurora::HERFFile herf(new Common::MappedReadFile(file));
 
 		if      (command == kCommandList)
 			listFiles(herf);
 		else if (command == kCommandExtract)
-			extractFiles(herf);
+			extractFiles(herf, jobs);
 
 	} catch (...) {
 		Common::exceptionDispatcherError();
@@ -87,7 +88,7 @@ int main(int argc, char **argv) {
 }
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file) {
+                      Command &command, Common::UString &file, uint &jobs) {
 
 	file.clear();
 	std::vector<Common::UString> args;
@@ -117,6 +118,19 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 				return false;
 			}
 
+			if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+				continue;
+			}
+
 			if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -161,7 +175,8 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "Usage: %s [<options>] <command> <file>\n\n", name.c_str());
 	std::fprintf(stream, "Options:\n");
 	std::fprintf(stream, "  -h      --help              This help text\n");
-	std::fprintf(stream, "          --version           Display version information\n\n");
+	std::fprintf(stream, "          --version           Display version information\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>          Extract with n parallel jobs (0: one per CPU core)\n\n");
 	std::fprintf(stream, "Commands:\n");
 	std::fprintf(stream, "  l          List archive\n");
 	std::fprintf(stream, "  e          Extract files to current directory\n");
@@ -198,12 +213,15 @@ void listFiles(Aurora::HERFFile &herf) {
 	}
 }
 
-void extractFiles(Aurora::HERFFile &herf) {
+void extractFiles(Aurora::HERFFile &herf, uint jobs) {
 	const Aurora::Archive::ResourceList &resources = herf.getResources();
 	const size_t fileCount = resources.size();
 
 	std::printf("Number of files: %u\n\n", (uint)fileCount);
 
+	std::vector<ExtractFile> files;
+	files.reserve(fileCount);
+
 	size_t i = 1;
 	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r, ++i) {
 		Common::UString fileName = r->name, fileExt = TypeMan.setFileType("", r->type);
@@ -212,20 +230,8 @@ void extractFiles(Aurora::HERFFile &herf) {
 
 		fileName = fileName + fileExt;
 
-		std::printf("Extracting %u/%u: %s ... ", (uint)i, (uint)fileCount, fileName.c_str());
-
-		Common::SeekableReadStream *stream = 0;
-		try {
-			stream = herf.getResource(r->index);
-
-			dumpStream(*stream, fileName);
-
-			std::printf("Done\n");
-		} catch (Common::Exception &e) {
-			Common::printException(e, "");
-		}
-
-		delete stream;
+		files.push_back(ExtractFile(r->index, i, fileName));
 	}
 
+	extractFiles(herf, files, fileCount, jobs);
 }
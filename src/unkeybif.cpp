@@ -34,6 +34,7 @@
 #include "src/common/platform.h"
 #include "src/common/readstream.h"
 #include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
 #include "src/common/filepath.h"
 
 #include "src/aurora/util.h"
@@ -53,7 +54,8 @@ const char *kCommandChar[kCommandMAX] = { "l", "e" };
 
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, std::list<Common::UString> &files, Aurora::GameID &game);
+                      Command &command, std::list<Common::UString> &files, Aurora::GameID &game,
+                      uint &jobs, Common::UString &cacheFile);
 
 uint32 getFileID(const Common::UString &fileName);
 void identifyFiles(const std::list<Common::UString> &files, std::vector<Common::UString> &keyFiles,
@@ -67,8 +69,10 @@ void mergeKEYBIF(std::vector<Aurora::KEYFile *> &keys, std::vector<Aurora::BIFFi
 
 void listFiles(const Aurora::KEYFile &key, Aurora::GameID game);
 void listFiles(const std::vector<Aurora::KEYFile *> &keys, const std::vector<Common::UString> &keyFiles, Aurora::GameID game);
-void extractFiles(const Aurora::BIFFile &bif, Aurora::GameID game);
-void extractFiles(const std::vector<Aurora::BIFFile *> &bifs, const std::vector<Common::UString> &bifFiles, Aurora::GameID game);
+void extractFiles(const Aurora::BIFFile &bif, Aurora::GameID game, uint jobs,
+                  ExtractCache *cache, const Common::UString &bifFile);
+void extractFiles(const std::vector<Aurora::BIFFile *> &bifs, const std::vector<Common::UString> &bifFiles,
+                  Aurora::GameID game, uint jobs, const Common::UString &cacheFile);
 
 int main(int argc, char **argv) {
 	std::vector<Aurora::KEYFile *> keys;
@@ -83,8 +87,10 @@ int main(int argc, char **argv) {
 		int returnValue = 1;
 		Command command = kCommandNone;
 		std::list<Common::UString> files;
+		uint jobs = 1;
+		Common::UString cacheFile;
 
-		if (!parseCommandLine(args, returnValue, command, files, game))
+		if (!parseCommandLine(args, returnValue, command, files, game, jobs, cacheFile))
 			return returnValue;
 
 		std::vector<Common::UString> keyFiles, bifFiles;
@@ -99,7 +105,7 @@ int main(int argc, char **argv) {
 		if      (command == kCommandList)
 			listFiles(keys, keyFiles, game);
 		else if (command == kCommandExtract)
-			extractFiles(bifs, bifFiles, game);
+			extractFiles(bifs, bifFiles, game, jobs, cacheFile);
 
 	} catch (...) {
 		for (std::vector<Aurora::KEYFile *>::iterator k = keys.begin(); k != keys.end(); ++k)
@@ -119,7 +125,8 @@ int main(int argc, char **argv) {
 }
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, std::list<Common::UString> &files, Aurora::GameID &game) {
+                      Command &command, std::list<Common::UString> &files, Aurora::GameID &game,
+                      uint &jobs, Common::UString &cacheFile) {
 
 	files.clear();
 	std::vector<Common::UString> args;
@@ -157,6 +164,32 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 			} else if (argv[i] == "--jade") {
 				isOption = true;
 			  game     = Aurora::kGameIDJade;
+			} else if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				isOption = true;
+
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+
+			} else if (argv[i] == "--cache") {
+				isOption = true;
+
+				// Needs the cache file as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				cacheFile = argv[i];
+
 			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -207,10 +240,14 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "BioWare KEY/BIF archive extractor\n\n");
 	std::fprintf(stream, "Usage: %s [<options>] <command> <file> [...]\n\n", name.c_str());
 	std::fprintf(stream, "Options:\n");
-	std::fprintf(stream, "  -h      --help     This help text\n");
-	std::fprintf(stream, "          --version  Display version information\n");
-	std::fprintf(stream, "          --nwn2     Alias file types according to Neverwinter Nights 2 rules\n");
-	std::fprintf(stream, "          --jade     Alias file types according to Jade Empire rules\n\n");
+	std::fprintf(stream, "  -h      --help        This help text\n");
+	std::fprintf(stream, "          --version     Display version information\n");
+	std::fprintf(stream, "          --nwn2        Alias file types according to Neverwinter Nights 2 rules\n");
+	std::fprintf(stream, "          --jade        Alias file types according to Jade Empire rules\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>    Extract with n parallel jobs (0: one per CPU core)\n");
+	std::fprintf(stream, "          --cache <file>\n");
+	std::fprintf(stream, "                        Skip files unchanged since the last extraction,\n");
+	std::fprintf(stream, "                        as recorded in this cache file\n\n");
 	std::fprintf(stream, "Commands:\n");
 	std::fprintf(stream, "  l          List files indexed in KEY archive(s)\n");
 	std::fprintf(stream, "  e          Extract BIF archive(s). Needs KEY file(s) indexing these BIF.\n\n");
@@ -260,7 +297,7 @@ void openBIFs(const std::vector<Common::UString> &bifFiles, std::vector<Aurora::
 	bifs.reserve(bifFiles.size());
 
 	for (std::vector<Common::UString>::const_iterator f = bifFiles.begin(); f != bifFiles.end(); ++f)
-		bifs.push_back(new Aurora::BIFFile(new Common::ReadFile(*f)));
+		bifs.push_back(new Aurora::BIFFile(new Common::MappedReadFile(*f)));
 }
 
 void mergeKEYBIF(std::vector<Aurora::KEYFile *> &keys, std::vector<Aurora::BIFFile *> &bifs,
@@ -323,40 +360,43 @@ void listFiles(const std::vector<Aurora::KEYFile *> &keys, const std::vector<Com
 	}
 }
 
-void extractFiles(const Aurora::BIFFile &bif, Aurora::GameID game) {
+void extractFiles(const Aurora::BIFFile &bif, Aurora::GameID game, uint jobs,
+                  ExtractCache *cache, const Common::UString &bifFile) {
 	const Aurora::Archive::ResourceList &resources = bif.getResources();
 
+	std::vector<ExtractFile> files;
+	files.reserve(resources.size());
+
 	uint i = 1;
 	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r, ++i) {
 		const Aurora::FileType type     = TypeMan.aliasFileType(r->type, game);
 		const Common::UString  fileName = TypeMan.setFileType(r->name, type);
 
-		std::printf("Extracting %u/%u: %s ... ", i, (uint) resources.size(), fileName.c_str());
-
-		Common::SeekableReadStream *stream = 0;
-		try {
-			stream = bif.getResource(r->index);
-
-			dumpStream(*stream, fileName);
-
-			std::printf("Done\n");
-		} catch (Common::Exception &e) {
-			Common::printException(e, "");
-		}
-
-		delete stream;
+		files.push_back(ExtractFile(r->index, i, fileName));
 	}
 
+	extractFiles(bif, files, resources.size(), jobs, cache, bifFile);
 }
 
-void extractFiles(const std::vector<Aurora::BIFFile *> &bifs, const std::vector<Common::UString> &bifFiles, Aurora::GameID game) {
-	for (uint i = 0; i < bifs.size(); i++) {
-		std::printf("%s: %u indexed files (of %u)\n\n", bifFiles[i].c_str(), (uint)bifs[i]->getResources().size(),
-                bifs[i]->getInternalResourceCount());
+void extractFiles(const std::vector<Aurora::BIFFile *> &bifs, const std::vector<Common::UString> &bifFiles,
+                  Aurora::GameID game, uint jobs, const Common::UString &cacheFile) {
 
-		extractFiles(*bifs[i], game);
+	ExtractCache *cache = cacheFile.empty() ? 0 : new ExtractCache(cacheFile);
 
-		if (i < (bifs.size() - 1))
-			std::printf("\n");
+	try {
+		for (uint i = 0; i < bifs.size(); i++) {
+			std::printf("%s: %u indexed files (of %u)\n\n", bifFiles[i].c_str(), (uint)bifs[i]->getResources().size(),
+			            bifs[i]->getInternalResourceCount());
+
+			extractFiles(*bifs[i], game, jobs, cache, bifFiles[i]);
+
+			if (i < (bifs.size() - 1))
+				std::printf("\n");
+		}
+	} catch (...) {
+		delete cache;
+		throw;
 	}
+
+	delete cache;
 }
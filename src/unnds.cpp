@@ -30,7 +30,7 @@
 #include "src/common/error.h"
 #include "src/common/platform.h"
 #include "src/common/readstream.h"
-#include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
 
 #include "src/aurora/util.h"
 #include "src/aurora/ndsrom.h"
@@ -49,11 +49,11 @@ const char *kCommandChar[kCommandMAX] = { "i", "l", "e" };
 
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file);
+                      Command &command, Common::UString &file, uint &jobs);
 
 void displayInfo(Aurora::NDSFile &nds);
 void listFiles(Aurora::NDSFile &nds);
-void extractFiles(Aurora::NDSFile &nds);
+void extractFiles(Aurora::NDSFile &nds, uint jobs);
 
 int main(int argc, char **argv) {
 	try {
@@ -63,18 +63,19 @@ int main(int argc, char **argv) {
 		int returnValue = 1;
 		Command command = kCommandNone;
 		Common::UString file;
+		uint jobs = 1;
 
-		if (!parseCommandLine(args, returnValue, command, file))
+		if (!parseCommandLine(args, returnValue, command, file, jobs))
 			return returnValue;
 
-		Aurora::NDSFile nds(new Common::ReadFile(file));
+		Aurora::NDSFile nds(new Common::MappedReadFile(file));
 
 		if      (command == kCommandInfo)
 			displayInfo(nds);
 		else if (command == kCommandList)
 			listFiles(nds);
 		else if (command == kCommandExtract)
-			extractFiles(nds);
+			extractFiles(nds, jobs);
 
 	} catch (...) {
 		Common::exceptionDispatcherError();
@@ -84,7 +85,7 @@ int main(int argc, char **argv) {
 }
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file) {
+                      Command &command, Common::UString &file, uint &jobs) {
 
 	file.clear();
 	std::vector<Common::UString> args;
@@ -114,6 +115,19 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 				return false;
 			}
 
+			if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+				continue;
+			}
+
 			if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -158,7 +172,8 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "Usage: %s [<options>] <command> <file>\n\n", name.c_str());
 	std::fprintf(stream, "Options:\n");
 	std::fprintf(stream, "  -h      --help              This help text\n");
-	std::fprintf(stream, "          --version           Display version information\n\n");
+	std::fprintf(stream, "          --version           Display version information\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>          Extract with n parallel jobs (0: one per CPU core)\n\n");
 	std::fprintf(stream, "Commands:\n");
 	std::fprintf(stream, "  i          Display meta-information\n");
 	std::fprintf(stream, "  l          List archive\n");
@@ -188,31 +203,22 @@ void listFiles(Aurora::NDSFile &nds) {
 	}
 }
 
-void extractFiles(Aurora::NDSFile &nds) {
+void extractFiles(Aurora::NDSFile &nds, uint jobs) {
 	const Aurora::Archive::ResourceList &resources = nds.getResources();
 	const size_t fileCount = resources.size();
 
 	std::printf("Number of files: %u\n\n", (uint)fileCount);
 
+	std::vector<ExtractFile> files;
+	files.reserve(fileCount);
+
 	size_t i = 1;
 	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r, ++i) {
 		const Aurora::FileType type     = TypeMan.aliasFileType(r->type);
 		const Common::UString fileName = TypeMan.setFileType(r->name, type);
 
-		std::printf("Extracting %u/%u: %s ... ", (uint)i, (uint)fileCount, fileName.c_str());
-
-		Common::SeekableReadStream *stream = 0;
-		try {
-			stream = nds.getResource(r->index);
-
-			dumpStream(*stream, fileName);
-
-			std::printf("Done\n");
-		} catch (Common::Exception &e) {
-			Common::printException(e, "");
-		}
-
-		delete stream;
+		files.push_back(ExtractFile(r->index, i, fileName));
 	}
 
+	extractFiles(nds, files, fileCount, jobs);
 }
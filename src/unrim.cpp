@@ -30,7 +30,7 @@
 #include "src/common/error.h"
 #include "src/common/platform.h"
 #include "src/common/readstream.h"
-#include "src/common/readfile.h"
+#include "src/common/mappedreadfile.h"
 
 #include "src/aurora/util.h"
 #include "src/aurora/rimfile.h"
@@ -48,10 +48,12 @@ const char *kCommandChar[kCommandMAX] = { "l", "e" };
 
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file, Aurora::GameID &game);
+                      Command &command, Common::UString &file, Aurora::GameID &game, uint &jobs,
+                      Common::UString &cacheFile);
 
 void listFiles(Aurora::RIMFile &rim, Aurora::GameID game);
-void extractFiles(Aurora::RIMFile &rim, Aurora::GameID);
+void extractFiles(Aurora::RIMFile &rim, Aurora::GameID game, uint jobs,
+                  const Common::UString &file, const Common::UString &cacheFile);
 
 int main(int argc, char **argv) {
 	try {
@@ -63,16 +65,18 @@ int main(int argc, char **argv) {
 		int returnValue = 1;
 		Command command = kCommandNone;
 		Common::UString file;
+		uint jobs = 1;
+		Common::UString cacheFile;
 
-		if (!parseCommandLine(args, returnValue, command, file, game))
+		if (!parseCommandLine(args, returnValue, command, file, game, jobs, cacheFile))
 			return returnValue;
 
-		Aurora::RIMFile rim(new Common::ReadFile(file));
+		Aurora::RIMFile rim(new Common::MappedReadFile(file));
 
 		if      (command == kCommandList)
 			listFiles(rim, game);
 		else if (command == kCommandExtract)
-			extractFiles(rim, game);
+			extractFiles(rim, game, jobs, file, cacheFile);
 
 	} catch (...) {
 		Common::exceptionDispatcherError();
@@ -82,7 +86,8 @@ int main(int argc, char **argv) {
 }
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
-                      Command &command, Common::UString &file, Aurora::GameID &game) {
+                      Command &command, Common::UString &file, Aurora::GameID &game, uint &jobs,
+                      Common::UString &cacheFile) {
 
 	file.clear();
 	std::vector<Common::UString> args;
@@ -120,6 +125,32 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 			} else if (argv[i] == "--jade") {
 				isOption = true;
 			  game     = Aurora::kGameIDJade;
+			} else if ((argv[i] == "-j") || (argv[i] == "--jobs")) {
+				isOption = true;
+
+				// Needs the number of jobs as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				jobs = parseJobCount(argv[i]);
+
+			} else if (argv[i] == "--cache") {
+				isOption = true;
+
+				// Needs the cache file as the next parameter
+				if (i++ == (argv.size() - 1)) {
+					printUsage(stderr, argv[0]);
+					returnValue = 1;
+
+					return false;
+				}
+
+				cacheFile = argv[i];
+
 			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -167,10 +198,14 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "BioWare RIM archive extractor\n\n");
 	std::fprintf(stream, "Usage: %s [<options>] <command> <file>\n\n", name.c_str());
 	std::fprintf(stream, "Options:\n");
-	std::fprintf(stream, "  -h      --help     This help text\n");
-	std::fprintf(stream, "          --version  Display version information\n");
-	std::fprintf(stream, "          --nwn2     Alias file types according to Neverwinter Nights 2 rules\n");
-	std::fprintf(stream, "          --jade     Alias file types according to Jade Empire rules\n\n");
+	std::fprintf(stream, "  -h      --help        This help text\n");
+	std::fprintf(stream, "          --version     Display version information\n");
+	std::fprintf(stream, "          --nwn2        Alias file types according to Neverwinter Nights 2 rules\n");
+	std::fprintf(stream, "          --jade        Alias file types according to Jade Empire rules\n");
+	std::fprintf(stream, "  -j <n>  --jobs <n>    Extract with n parallel jobs (0: one per CPU core)\n");
+	std::fprintf(stream, "          --cache <file>\n");
+	std::fprintf(stream, "                        Skip files unchanged since the last extraction,\n");
+	std::fprintf(stream, "                        as recorded in this cache file\n\n");
 	std::fprintf(stream, "Commands:\n");
 	std::fprintf(stream, "  l          List archive\n");
 	std::fprintf(stream, "  e          Extract files to current directory\n");
@@ -193,31 +228,29 @@ void listFiles(Aurora::RIMFile &rim, Aurora::GameID game) {
 	}
 }
 
-void extractFiles(Aurora::RIMFile &rim, Aurora::GameID game) {
+void extractFiles(Aurora::RIMFile &rim, Aurora::GameID game, uint jobs,
+                  const Common::UString &file, const Common::UString &cacheFile) {
 	const Aurora::Archive::ResourceList &resources = rim.getResources();
 	const size_t fileCount = resources.size();
 
 	std::printf("Number of files: %u\n\n", (uint)fileCount);
 
+	std::vector<ExtractFile> files;
+	files.reserve(fileCount);
+
 	size_t i = 1;
 	for (Aurora::Archive::ResourceList::const_iterator r = resources.begin(); r != resources.end(); ++r, ++i) {
 		const Aurora::FileType type     = TypeMan.aliasFileType(r->type, game);
 		const Common::UString  fileName = TypeMan.setFileType(r->name, type);
 
-		std::printf("Extracting %u/%u: %s ... ", (uint)i, (uint)fileCount, fileName.c_str());
-
-		Common::SeekableReadStream *stream = 0;
-		try {
-			stream = rim.getResource(r->index);
-
-			dumpStream(*stream, fileName);
-
-			std::printf("Done\n");
-		} catch (Common::Exception &e) {
-			Common::printException(e, "");
-		}
+		files.push_back(ExtractFile(r->index, i, fileName));
+	}
 
-		delete stream;
+	if (cacheFile.empty()) {
+		extractFiles(rim, files, fileCount, jobs);
+		return;
 	}
 
+	ExtractCache cache(cacheFile);
+	extractFiles(rim, files, fileCount, jobs, &cache, file);
 }
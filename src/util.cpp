@@ -22,13 +22,32 @@
  *  General tool utility functions.
  */
 
+#include <cstdio>
+
 #include "src/common/error.h"
 #include "src/common/ustring.h"
+#include "src/common/strutil.h"
+#include "src/common/encoding.h"
+#include "src/common/hash.h"
+#include "src/common/platform.h"
 #include "src/common/readstream.h"
+#include "src/common/readfile.h"
 #include "src/common/writefile.h"
+#include "src/common/filepath.h"
+#include "src/common/thread.h"
+#include "src/common/jobqueue.h"
+
+#include "src/aurora/util.h"
+#include "src/aurora/archive.h"
 
 #include "src/util.h"
 
+ExtractFile::ExtractFile(uint32 i, size_t n, const Common::UString &f) : index(i), number(n), fileName(f) {
+}
+
+PackFile::PackFile(const Common::UString &f) : fileName(f), type(Aurora::kFileTypeNone), size(0) {
+}
+
 void dumpStream(Common::SeekableReadStream &stream, const Common::UString &fileName) {
 	Common::WriteFile file;
 	if (!file.open(fileName))
@@ -39,3 +58,354 @@ void dumpStream(Common::SeekableReadStream &stream, const Common::UString &fileN
 
 	file.close();
 }
+
+uint parseJobCount(const Common::UString &arg) {
+	uint jobs = 0;
+	Common::parseString(arg, jobs);
+
+	if (jobs == 0)
+		jobs = Common::Thread::getCPUCount();
+
+	return jobs;
+}
+
+ExtractCache::ExtractCache(const Common::UString &fileName) : _fileName(fileName) {
+	load();
+}
+
+static const char * const kExtractCacheID = "xoreos-tools extraction cache V1";
+
+void ExtractCache::load() {
+	Common::ReadFile file;
+	if (!file.open(_fileName))
+		return;
+
+	if (Common::readStringLine(file, Common::kEncodingUTF8) != kExtractCacheID)
+		throw Common::Exception("\"%s\" is not an extraction cache", _fileName.c_str());
+
+	/* Each line is a list of tab-separated fields. An archive line is followed
+	 * by the file lines of all resources extracted out of that archive.
+	 *
+	 * A <size> <time> <archive file name>
+	 * F <resource index> <resource size> <resource hash> <file size> <file time> <file name> */
+
+	Archive *archive = 0;
+	while (!file.eos()) {
+		const Common::UString line = Common::readStringLine(file, Common::kEncodingUTF8);
+		if (line.empty())
+			continue;
+
+		std::vector<Common::UString> fields;
+		Common::UString::split(line, '\t', fields);
+
+		if        ((fields.size() == 4) && (fields[0] == "A")) {
+			archive = &_archives[fields[3]];
+
+			Common::parseString(fields[1], archive->size);
+			Common::parseString(fields[2], archive->time);
+
+		} else if ((fields.size() == 7) && (fields[0] == "F") && archive) {
+			File &cacheFile = archive->files[fields[6]];
+
+			Common::parseString(fields[1], cacheFile.resourceIndex);
+			Common::parseString(fields[2], cacheFile.resourceSize);
+			Common::parseString(fields[3], cacheFile.resourceHash);
+			Common::parseString(fields[4], cacheFile.fileSize);
+			Common::parseString(fields[5], cacheFile.fileTime);
+
+		} else
+			throw Common::Exception("Broken extraction cache \"%s\"", _fileName.c_str());
+	}
+}
+
+void ExtractCache::save() const {
+	Common::WriteFile file;
+	if (!file.open(_fileName))
+		throw Common::Exception(Common::kOpenError);
+
+	file.writeString(kExtractCacheID);
+	file.writeString("\n");
+
+	for (ArchiveMap::const_iterator a = _archives.begin(); a != _archives.end(); ++a) {
+		file.writeString(Common::UString::format("A\t%s\t%s\t%s\n",
+				Common::composeString(a->second.size).c_str(),
+				Common::composeString(a->second.time).c_str(), a->first.c_str()));
+
+		for (FileMap::const_iterator f = a->second.files.begin(); f != a->second.files.end(); ++f)
+			file.writeString(Common::UString::format("F\t%s\t%s\t%s\t%s\t%s\t%s\n",
+					Common::composeString(f->second.resourceIndex).c_str(),
+					Common::composeString(f->second.resourceSize).c_str(),
+					Common::composeString(f->second.resourceHash).c_str(),
+					Common::composeString(f->second.fileSize).c_str(),
+					Common::composeString(f->second.fileTime).c_str(), f->first.c_str()));
+	}
+
+	file.flush();
+	file.close();
+}
+
+ExtractCache::FileMap &ExtractCache::getFiles(const Common::UString &archiveFile, bool &unchanged) {
+	uint64 size, time;
+	if (!Common::Platform::getFileInfo(archiveFile, size, time))
+		throw Common::Exception("Can't stat archive \"%s\"", archiveFile.c_str());
+
+	std::pair<ArchiveMap::iterator, bool> result = _archives.insert(std::make_pair(archiveFile, Archive()));
+
+	Archive &archive = result.first->second;
+
+	unchanged = !result.second && (archive.size == size) && (archive.time == time);
+
+	archive.size = size;
+	archive.time = time;
+
+	return archive.files;
+}
+
+bool ExtractCache::isFileUnchanged(const Common::UString &fileName, const File &file) {
+	uint64 size, time;
+	if (!Common::Platform::getFileInfo(fileName, size, time))
+		return false;
+
+	return (size == file.fileSize) && (time == file.fileTime);
+}
+
+uint64 ExtractCache::hashStream(Common::SeekableReadStream &stream) {
+	uint64 hash = 0xCBF29CE484222325LL;
+
+	byte buffer[4096];
+
+	size_t n;
+	while ((n = stream.read(buffer, sizeof(buffer))) > 0)
+		for (size_t i = 0; i < n; i++)
+			hash = Common::hashFNV64(hash, buffer[i]);
+
+	return hash;
+}
+
+/** Extracting archive resources, one job per resource. */
+class ExtractJobs : public Common::JobQueue {
+public:
+	ExtractJobs(const Aurora::Archive &archive, const std::vector<ExtractFile> &files, size_t fileCount,
+	            const ExtractCache::FileMap *oldCacheFiles = 0, ExtractCache::FileMap *cacheFiles = 0,
+	            bool archiveUnchanged = false) :
+		_archive(&archive), _files(&files), _fileCount(fileCount),
+		_cacheFiles(cacheFiles), _archiveUnchanged(archiveUnchanged),
+		_cached(files.size()), _isCached(files.size(), false), _results(files.size()), _states(files.size(), kStateWritten),
+		_errors(files.size(), 0) {
+
+		/* Look up all resources in the cache now. The worker threads can then use copies
+		 * of these entries without touching any map, while the new entries are set in
+		 * finishJob(). */
+
+		if (oldCacheFiles) {
+			for (size_t i = 0; i < files.size(); i++) {
+				ExtractCache::FileMap::const_iterator f = oldCacheFiles->find(files[i].fileName);
+				if (f == oldCacheFiles->end())
+					continue;
+
+				_cached  [i] = f->second;
+				_isCached[i] = true;
+			}
+		}
+	}
+
+	~ExtractJobs() {
+		for (std::vector<Common::Exception *>::iterator e = _errors.begin(); e != _errors.end(); ++e)
+			delete *e;
+	}
+
+protected:
+	void runJob(size_t job) {
+		const ExtractFile &file = (*_files)[job];
+
+		Common::SeekableReadStream *stream = 0;
+		try {
+			if (!_cacheFiles) {
+				stream = _archive->getResource(file.index);
+
+				dumpStream(*stream, file.fileName);
+			} else
+				extractCached(job, stream);
+
+		} catch (Common::Exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (std::exception &e) {
+			_errors[job] = new Common::Exception(e);
+		} catch (...) {
+			_errors[job] = new Common::Exception("Unknown exception caught");
+		}
+
+		delete stream;
+	}
+
+	void finishJob(size_t job) {
+		const ExtractFile &file = (*_files)[job];
+
+		std::printf("Extracting %u/%u: %s ... ", (uint)file.number, (uint)_fileCount, file.fileName.c_str());
+
+		if (_errors[job]) {
+			Common::printException(*_errors[job], "");
+
+			delete _errors[job];
+			_errors[job] = 0;
+
+			// We don't know what state the file is in now
+			if (_cacheFiles)
+				_cacheFiles->erase(file.fileName);
+
+			return;
+		}
+
+		if (_cacheFiles)
+			(*_cacheFiles)[file.fileName] = _results[job];
+
+		std::printf("%s\n", (_states[job] == kStateWritten) ? "Done" : "Unchanged");
+	}
+
+private:
+	enum State {
+		kStateWritten,  ///< The resource was written into the file.
+		kStateSkipped,  ///< The resource wasn't even read, since the archive is unchanged.
+		kStateIdentical ///< The resource was read, but is identical to the file.
+	};
+
+	const Aurora::Archive *_archive;
+	const std::vector<ExtractFile> *_files;
+
+	size_t _fileCount;
+
+	/** The cached resources of this archive, if we're using a cache. */
+	ExtractCache::FileMap *_cacheFiles;
+	/** Has the archive not changed since the last extraction? */
+	bool _archiveUnchanged;
+
+	/** The cache entry for each resource. */
+	std::vector<ExtractCache::File> _cached;
+	/** Does a resource have a cache entry? */
+	std::vector<bool> _isCached;
+	/** The new cache entry for each resource. */
+	std::vector<ExtractCache::File> _results;
+	/** What happened to each resource. */
+	std::vector<State> _states;
+
+	/** The error that occurred while extracting each resource, if any. */
+	std::vector<Common::Exception *> _errors;
+
+	void extractCached(size_t job, Common::SeekableReadStream *&stream) {
+		const ExtractFile &file = (*_files)[job];
+		const ExtractCache::File *cached = _isCached[job] ? &_cached[job] : 0;
+
+		if (cached && _archiveUnchanged && (cached->resourceIndex == file.index) &&
+		    (cached->resourceSize == _archive->getResourceSize(file.index)) &&
+		    ExtractCache::isFileUnchanged(file.fileName, *cached)) {
+
+			_results[job] = *cached;
+			_states [job] = kStateSkipped;
+			return;
+		}
+
+		stream = _archive->getResource(file.index);
+
+		ExtractCache::File &result = _results[job];
+
+		result.resourceIndex = file.index;
+		result.resourceSize  = stream->size();
+		result.resourceHash  = ExtractCache::hashStream(*stream);
+
+		if (cached && (cached->resourceSize == result.resourceSize) &&
+		    (cached->resourceHash == result.resourceHash) &&
+		    ExtractCache::isFileUnchanged(file.fileName, *cached)) {
+
+			result.fileSize = cached->fileSize;
+			result.fileTime = cached->fileTime;
+
+			_states[job] = kStateIdentical;
+			return;
+		}
+
+		stream->seek(0);
+		dumpStream(*stream, file.fileName);
+
+		Common::Platform::getFileInfo(file.fileName, result.fileSize, result.fileTime);
+	}
+};
+
+void extractFiles(const Aurora::Archive &archive, const std::vector<ExtractFile> &files,
+                  size_t fileCount, uint jobs, ExtractCache *cache, const Common::UString &archiveFile) {
+
+	if (!cache) {
+		ExtractJobs extractJobs(archive, files, fileCount);
+
+		extractJobs.run(files.size(), jobs);
+		return;
+	}
+
+	bool archiveUnchanged = false;
+	ExtractCache::FileMap &cacheFiles = cache->getFiles(archiveFile, archiveUnchanged);
+
+	/* If the archive changed, the entries of resources we don't extract now are
+	 * stale, so we start with a fresh list. The old entries are still needed to
+	 * find the resources that were changed. */
+
+	ExtractCache::FileMap oldCacheFiles;
+	if (!archiveUnchanged)
+		oldCacheFiles.swap(cacheFiles);
+
+	ExtractJobs extractJobs(archive, files, fileCount,
+	                        archiveUnchanged ? &cacheFiles : &oldCacheFiles, &cacheFiles, archiveUnchanged);
+
+	extractJobs.run(files.size(), jobs);
+
+	cache->save();
+}
+
+void getPackFiles(const std::vector<Common::UString> &fileNames, std::vector<PackFile> &files) {
+	files.reserve(files.size() + fileNames.size());
+
+	for (std::vector<Common::UString>::const_iterator f = fileNames.begin(); f != fileNames.end(); ++f) {
+		PackFile file(*f);
+
+		file.type = TypeMan.getFileType(*f);
+		if (file.type == Aurora::kFileTypeNone)
+			throw Common::Exception("Unknown file type of \"%s\"", f->c_str());
+
+		file.name = Common::FilePath::getStem(*f);
+
+		Common::ReadFile readFile;
+		if (!readFile.open(*f))
+			throw Common::Exception("Can't open file \"%s\"", f->c_str());
+
+		if ((uint64)readFile.size() > 0xFFFFFFFF)
+			throw Common::Exception("File \"%s\" too big", f->c_str());
+
+		file.size = readFile.size();
+
+		files.push_back(file);
+	}
+}
+
+byte *readPackFile(const PackFile &file) {
+	Common::ReadFile readFile;
+	if (!readFile.open(file.fileName))
+		throw Common::Exception(Common::kOpenError);
+
+	if (readFile.size() != file.size)
+		throw Common::Exception("File \"%s\" changed size", file.fileName.c_str());
+
+	byte *data = new byte[file.size];
+	if (readFile.read(data, file.size) != file.size) {
+		delete[] data;
+		throw Common::Exception(Common::kReadError);
+	}
+
+	return data;
+}
+
+void writePackFile(Common::WriteStream &stream, const PackFile &file) {
+	Common::ReadFile readFile;
+	if (!readFile.open(file.fileName))
+		throw Common::Exception(Common::kOpenError);
+
+	if ((readFile.size() != file.size) || (stream.writeStream(readFile) != file.size))
+		throw Common::Exception("File \"%s\" changed size", file.fileName.c_str());
+}
@@ -25,11 +25,141 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <vector>
+#include <map>
+
+#include "src/common/types.h"
+#include "src/common/ustring.h"
+
+#include "src/aurora/types.h"
+
 namespace Common {
-	class UString;
 	class SeekableReadStream;
+	class WriteStream;
+}
+
+namespace Aurora {
+	class Archive;
 }
 
+/** A resource to extract out of an archive. */
+struct ExtractFile {
+	uint32 index;             ///< The index of the resource within the archive.
+	size_t number;            ///< The number to show in the progress line, starting at 1.
+	Common::UString fileName; ///< The name of the file to write the resource to.
+
+	ExtractFile(uint32 i, size_t n, const Common::UString &f);
+};
+
+/** An on-disk manifest of resources extracted out of archives.
+ *
+ *  For every archive, the manifest records the archive's size and the time
+ *  of its last modification. For every resource extracted out of it, the
+ *  manifest records the resource's index, size and hash, and the size and
+ *  time of the last modification of the file the resource was extracted into.
+ *
+ *  This lets repeated extractions skip resources that haven't changed. As
+ *  long as a file extracted earlier is still untouched, its resource isn't
+ *  even read if the archive is unchanged. If the archive did change, the
+ *  resource is read and hashed, and only written if the hash differs.
+ */
+class ExtractCache {
+public:
+	/** A resource that was extracted into a file. */
+	struct File {
+		uint64 resourceIndex; ///< The index of the resource within the archive.
+		uint64 resourceSize;  ///< The size of the resource.
+		uint64 resourceHash;  ///< The hash of the resource's data.
+		uint64 fileSize;      ///< The size of the file on disk.
+		uint64 fileTime;      ///< The time of the file's last modification.
+	};
+
+	/** The resources extracted out of an archive, by the names of the files. */
+	typedef std::map<Common::UString, File> FileMap;
+
+	/** Open the manifest with this name. If the file doesn't exist, start an empty one. */
+	ExtractCache(const Common::UString &fileName);
+
+	/** Write the manifest back to disk. */
+	void save() const;
+
+	/** Return the resources previously extracted out of this archive.
+	 *
+	 *  @param  archiveFile The name of the archive file.
+	 *  @param  unchanged Will be set to true if the archive hasn't changed
+	 *                    since the last extraction.
+	 */
+	FileMap &getFiles(const Common::UString &archiveFile, bool &unchanged);
+
+	/** Is this file still exactly the way it was when its resource was extracted? */
+	static bool isFileUnchanged(const Common::UString &fileName, const File &file);
+
+	/** Hash the complete (remaining) contents of a stream. */
+	static uint64 hashStream(Common::SeekableReadStream &stream);
+
+private:
+	/** An archive resources were extracted out of. */
+	struct Archive {
+		uint64 size; ///< The size of the archive file.
+		uint64 time; ///< The time of the archive file's last modification.
+
+		FileMap files;
+	};
+
+	typedef std::map<Common::UString, Archive> ArchiveMap;
+
+	Common::UString _fileName;
+
+	ArchiveMap _archives;
+
+	void load();
+};
+
+/** A file to pack into an archive. */
+struct PackFile {
+	Common::UString fileName; ///< The name of the file on disk.
+	Common::UString name;     ///< The name of the resource, without path and extension.
+	Aurora::FileType type;    ///< The type of the resource, derived from the file's extension.
+	uint32 size;              ///< The size of the file.
+
+	PackFile(const Common::UString &f);
+};
+
 void dumpStream(Common::SeekableReadStream &stream, const Common::UString &fileName);
 
+/** Parse the parameter of a --jobs option. A value of 0 means one job per CPU core. */
+uint parseJobCount(const Common::UString &arg);
+
+/** Extract resources out of an archive into files.
+ *
+ *  Reading, decrypting, decompressing and writing the resources is done by
+ *  jobs worker threads in parallel. The "Extracting" progress lines are still
+ *  printed in order, exactly like a single-threaded extraction would.
+ *
+ *  If a cache is given, resources that haven't changed since the last
+ *  extraction of the same archive are skipped, and the cache is updated.
+ *
+ *  @param archive     The archive to extract from.
+ *  @param files       The resources to extract.
+ *  @param fileCount   The total number of files to show in the progress lines.
+ *  @param jobs        The number of worker threads to use.
+ *  @param cache       The extraction cache to use, if any.
+ *  @param archiveFile The name of the archive file, to look it up in the cache.
+ */
+void extractFiles(const Aurora::Archive &archive, const std::vector<ExtractFile> &files,
+                  size_t fileCount, uint jobs, ExtractCache *cache = 0,
+                  const Common::UString &archiveFile = "");
+
+/** Collect the files to pack into an archive.
+ *
+ *  Throws if a file can't be opened or its type is unknown.
+ */
+void getPackFiles(const std::vector<Common::UString> &fileNames, std::vector<PackFile> &files);
+
+/** Read a file to pack into an archive completely into a new[]'ed buffer. */
+byte *readPackFile(const PackFile &file);
+
+/** Write a file to pack into an archive, streamed from disk. */
+void writePackFile(Common::WriteStream &stream, const PackFile &file);
+
 #endif // UTIL_H
@@ -274,7 +274,7 @@ void GFF3Dumper::dumpStruct(const Aurora::GFF3Struct &strct, const Common::UStri
 	if (strct.getFieldCount() > 0)
 		_xml->breakLine();
 
-	const std::vector<Common::UString> &fields = strct.getFieldNames();
+	const std::vector<Common::UString> fields = strct.getFieldNames();
 
 	for (std::vector<Common::UString>::const_iterator f = fields.begin(); f != fields.end(); ++f)
 		dumpField(strct, *f);
@@ -22,7 +22,11 @@
  *  Utility class for writing XML files.
  */
 
+#include <cstring>
+
 #include "src/common/ustring.h"
+#include "src/common/util.h"
+#include "src/common/error.h"
 #include "src/common/memreadstream.h"
 #include "src/common/writestream.h"
 #include "src/common/base64.h"
@@ -31,90 +35,161 @@
 
 namespace XML {
 
-XMLWriter::XMLWriter(Common::WriteStream &stream) : _stream(&stream), _needIndent(false) {
+/** Bytes that need special treatment when escaping: the XML special characters,
+ *  the carriage return and the terminating 0.
+ *
+ *  All of them are ASCII, and UTF-8 never uses ASCII bytes within multi-byte
+ *  sequences, so we can safely scan the raw bytes of a string.
+ */
+static const byte kEscapeTable[256] = {
+	1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/** Spaces to indent with, two per level. */
+static const char kIndent[] = "                                                                ";
+static const size_t kIndentLength = sizeof(kIndent) - 1;
+
+XMLWriter::XMLWriter(Common::WriteStream &stream) : _stream(&stream), _depth(0), _needIndent(false) {
+	_buffer.reserve(kBufferSize + 4096);
+
 	writeHeader();
 }
 
 XMLWriter::~XMLWriter() {
-	flush();
+	// Write errors can't be reported from here. Callers need to flush() themselves to see them
+	try {
+		flush();
+	} catch (...) {
+	}
 }
 
 void XMLWriter::flush() {
-	while (!_openTags.empty())
+	while (_depth > 0)
 		closeTag();
 
+	flushBuffer();
 	_stream->flush();
 }
 
 void XMLWriter::writeHeader() {
-	_stream->writeString("<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\n");
+	static const char kHeader[] = "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\n";
+
+	write(kHeader, sizeof(kHeader) - 1);
 	flush();
 }
 
+void XMLWriter::write(const char *str, size_t length) {
+	_buffer.append(str, length);
+
+	if (_buffer.size() >= kBufferSize)
+		flushBuffer();
+}
+
+void XMLWriter::write(const std::string &str) {
+	write(str.c_str(), str.size());
+}
+
+void XMLWriter::flushBuffer() {
+	if (_buffer.empty())
+		return;
+
+	const size_t size    = _buffer.size();
+	const size_t written = _stream->write(_buffer.c_str(), size);
+
+	_buffer.clear();
+
+	if (written != size)
+		throw Common::Exception(Common::kWriteError);
+}
+
 void XMLWriter::openTag(const Common::UString &name) {
-	if (!_openTags.empty()) {
-		_openTags.back().empty = false;
+	if (_depth > 0) {
+		_tags[_depth - 1].empty = false;
 
-		indent(_openTags.size());
+		indent(_depth);
 		writeTag();
 	}
 
-	_openTags.push_back(Tag());
+	if (_depth == _tags.size())
+		_tags.push_back(Tag());
 
-	Tag &tag = _openTags.back();
+	Tag &tag = _tags[_depth++];
 
-	tag.name  = name;
-	tag.empty = true;
+	tag.name = name.c_str();
+
+	tag.properties.clear();
+	tag.contents.clear();
+	tag.base64.clear();
+
+	tag.written = false;
+	tag.empty   = true;
 }
 
 void XMLWriter::closeTag() {
-	if (_openTags.empty())
+	if (_depth == 0)
 		return;
 
 	writeTag();
 
-	const Tag &tag = _openTags.back();
+	const Tag &tag = _tags[_depth - 1];
 
 	if (!tag.empty) {
-		indent(_openTags.size() - 1);
-		_stream->writeString("</" + tag.name + ">");
+		indent(_depth - 1);
+
+		write("</", 2);
+		write(tag.name);
+		write(">", 1);
 	}
 
-	_openTags.pop_back();
+	_depth--;
 }
 
 void XMLWriter::writeTag() {
-	if (_openTags.empty() || _openTags.back().written)
+	if ((_depth == 0) || _tags[_depth - 1].written)
 		return;
 
-	Tag &tag = _openTags.back();
+	Tag &tag = _tags[_depth - 1];
 
 	tag.written = true;
 
-	_stream->writeString("<" + tag.name);
-
-	for (std::list<Property>::const_iterator p = tag.properties.begin(); p != tag.properties.end(); ++p)
-		_stream->writeString(" " + p->name + "=\"" + escape(p->value) + "\"");
+	write("<", 1);
+	write(tag.name);
+	write(tag.properties);
 
 	if (tag.empty)
-		_stream->writeString("/");
+		write("/", 1);
 
-	_stream->writeString(">");
+	write(">", 1);
 
 	if (!tag.empty) {
 		if (!tag.base64.empty()) {
 
 			if (tag.base64.size() == 1) {
 
-				_stream->writeString(tag.base64.front());
+				write(tag.base64.front().c_str(), std::strlen(tag.base64.front().c_str()));
 				tag.base64.pop_front();
 
 			} else {
 
 				while (!tag.base64.empty()) {
 					breakLine();
-					indent(_openTags.size());
-					_stream->writeString(tag.base64.front());
+					indent(_depth);
+					write(tag.base64.front().c_str(), std::strlen(tag.base64.front().c_str()));
 					tag.base64.pop_front();
 				}
 				breakLine();
@@ -122,7 +197,7 @@ void XMLWriter::writeTag() {
 			}
 
 		} else
-			_stream->writeString(escape(tag.contents));
+			write(tag.contents);
 	}
 }
 
@@ -130,17 +205,29 @@ void XMLWriter::indent(size_t level) {
 	if (!_needIndent)
 		return;
 
-	while (level-- > 0)
-		_stream->writeString("  ");
+	size_t length = level * 2;
+	while (length > 0) {
+		const size_t n = MIN(length, kIndentLength);
+
+		write(kIndent, n);
+		length -= n;
+	}
 
 	_needIndent = false;
 }
 
-Common::UString XMLWriter::escape(const Common::UString &str) {
-	Common::UString escaped;
+void XMLWriter::escape(std::string &escaped, const Common::UString &str) {
+	const char *s = str.c_str();
+
+	while (true) {
+		// Copy everything up to the next special byte in one go
+		const char *run = s;
+		while (!kEscapeTable[(byte) *s])
+			s++;
 
-	for (Common::UString::iterator s = str.begin(); s != str.end(); ++s) {
-		uint32 c = *s;
+		escaped.append(run, s - run);
+
+		const char c = *s++;
 
 		if      (c == '\"')
 			escaped += "&quot;";
@@ -155,44 +242,42 @@ Common::UString XMLWriter::escape(const Common::UString &str) {
 		else if (c == '\r')
 			escaped += "&#13;";
 		else
-			escaped += c;
-
+			break;
 	}
-
-	return escaped;
 }
 
 void XMLWriter::addProperty(const Common::UString &name, const Common::UString &value) {
-	if (_openTags.empty())
+	if (_depth == 0)
 		return;
 
-	Tag &tag = _openTags.back();
-
-	tag.properties.push_back(Property());
+	Tag &tag = _tags[_depth - 1];
 
-	Property &property = tag.properties.back();
-
-	property.name  = name;
-	property.value = value;
+	tag.properties += ' ';
+	tag.properties += name.c_str();
+	tag.properties += "=\"";
+	escape(tag.properties, value);
+	tag.properties += '\"';
 }
 
 void XMLWriter::setContents(const Common::UString &contents) {
-	if (_openTags.empty())
+	if (_depth == 0)
 		return;
 
-	Tag &tag = _openTags.back();
+	Tag &tag = _tags[_depth - 1];
 
 	tag.base64.clear();
 
-	tag.contents = contents;
-	tag.empty    = false;
+	tag.contents.clear();
+	escape(tag.contents, contents);
+
+	tag.empty = false;
 }
 
 void XMLWriter::setContents(const byte *data, size_t size) {
-	if (_openTags.empty())
+	if (_depth == 0)
 		return;
 
-	Tag &tag = _openTags.back();
+	Tag &tag = _tags[_depth - 1];
 
 	tag.base64.clear();
 	tag.contents.clear();
@@ -204,10 +289,10 @@ void XMLWriter::setContents(const byte *data, size_t size) {
 }
 
 void XMLWriter::setContents(Common::SeekableReadStream &stream) {
-	if (_openTags.empty())
+	if (_depth == 0)
 		return;
 
-	Tag &tag = _openTags.back();
+	Tag &tag = _tags[_depth - 1];
 
 	tag.base64.clear();
 	tag.contents.clear();
@@ -218,12 +303,12 @@ void XMLWriter::setContents(Common::SeekableReadStream &stream) {
 }
 
 void XMLWriter::breakLine() {
-	if (!_openTags.empty()) {
-		_openTags.back().empty = false;
+	if (_depth > 0) {
+		_tags[_depth - 1].empty = false;
 		writeTag();
 	}
 
-	_stream->writeString("\n");
+	write("\n", 1);
 	_needIndent = true;
 }
 
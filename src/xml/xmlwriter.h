@@ -26,7 +26,10 @@
 #define XML_XMLWRITER_H
 
 #include <list>
+#include <vector>
+#include <string>
 
+#include "src/common/types.h"
 #include "src/common/ustring.h"
 
 namespace Common {
@@ -41,7 +44,12 @@ public:
 	XMLWriter(Common::WriteStream &stream);
 	~XMLWriter();
 
-	/** Close all open tags and flush the stream. */
+	/** Close all open tags and flush the stream.
+	 *
+	 *  The output is buffered, so this needs to be called once all the XML
+	 *  has been written, to see any write errors. The destructor flushes
+	 *  as well, but ignores errors.
+	 */
 	void flush();
 
 	/** Open a tag. */
@@ -62,17 +70,17 @@ public:
 	void breakLine();
 
 private:
-	struct Property {
-		Common::UString name;
-		Common::UString value;
-	};
+	/** Size of the output buffer, after which we write it out to the stream. */
+	static const size_t kBufferSize = 64 * 1024;
 
 	struct Tag {
-		Common::UString name;
+		std::string name;
 
-		std::list<Property> properties;
+		/** The properties, already escaped and in their written form. */
+		std::string properties;
 
-		Common::UString contents;
+		/** The contents, already escaped. */
+		std::string contents;
 		std::list<Common::UString> base64;
 
 		bool written;
@@ -81,16 +89,30 @@ private:
 
 	Common::WriteStream *_stream;
 
-	std::list<Tag> _openTags;
+	/** The currently open tags.
+	 *
+	 *  Only the first _depth tags are actually open. The ones after that
+	 *  are left over from earlier, and kept to reuse their memory.
+	 */
+	std::vector<Tag> _tags;
+	size_t _depth;
+
 	bool _needIndent;
 
+	/** Output that hasn't been written to the stream yet. */
+	std::string _buffer;
+
 
 	void writeHeader();
 
 	void indent(size_t level);
 	void writeTag();
 
-	Common::UString escape(const Common::UString &str);
+	void write(const char *str, size_t length);
+	void write(const std::string &str);
+	void flushBuffer();
+
+	static void escape(std::string &escaped, const Common::UString &str);
 };
 
 } // End of namespace XML
@@ -47,10 +47,10 @@
 void printUsage(FILE *stream, const Common::UString &name);
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
                       Common::UString &inFile, Common::UString &outFile,
-                      Aurora::FileType &type, bool &flip);
+                      Aurora::FileType &type, bool &flip, bool &rle);
 
 void convert(const Common::UString &inFile, const Common::UString &outFile,
-             Aurora::FileType type, bool flip);
+             Aurora::FileType type, bool flip, bool rle);
 
 int main(int argc, char **argv) {
 	try {
@@ -61,11 +61,12 @@ int main(int argc, char **argv) {
 		Common::UString inFile, outFile;
 		Aurora::FileType type = Aurora::kFileTypeNone;
 		bool flip = false;
+		bool rle  = false;
 
-		if (!parseCommandLine(args, returnValue, inFile, outFile, type, flip))
+		if (!parseCommandLine(args, returnValue, inFile, outFile, type, flip, rle))
 			return returnValue;
 
-		convert(inFile, outFile, type, flip);
+		convert(inFile, outFile, type, flip, rle);
 	} catch (...) {
 		Common::exceptionDispatcherError();
 	}
@@ -75,7 +76,7 @@ int main(int argc, char **argv) {
 
 bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue,
                       Common::UString &inFile, Common::UString &outFile,
-                      Aurora::FileType &type, bool &flip) {
+                      Aurora::FileType &type, bool &flip, bool &rle) {
 
 	std::vector<Common::UString> files;
 
@@ -127,6 +128,9 @@ bool parseCommandLine(const std::vector<Common::UString> &argv, int &returnValue
 			} else if ((argv[i] == "-f") || (argv[i] == "--flip")) {
 				isOption = true;
 				flip     = true;
+			} else if ((argv[i] == "-r") || (argv[i] == "--rle")) {
+				isOption = true;
+				rle      = true;
 			} else if (argv[i].beginsWith("-") || argv[i].beginsWith("--")) {
 			  // An options, but we already checked for all known ones
 
@@ -163,6 +167,7 @@ void printUsage(FILE *stream, const Common::UString &name) {
 	std::fprintf(stream, "  -h      --help              This help text\n");
 	std::fprintf(stream, "          --version           Display version information\n");
 	std::fprintf(stream, "  -f      --flip              Flip the image vertically\n");
+	std::fprintf(stream, "  -r      --rle               Write a run-length encoded TGA\n");
 	std::fprintf(stream, "          --auto              Autodetect input type (default)\n");
 	std::fprintf(stream, "          --dds               Input file is DDS\n");
 	std::fprintf(stream, "          --sbm               Input file is SBM\n");
@@ -221,7 +226,7 @@ Images::Decoder *openImage(Common::SeekableReadStream &stream, Aurora::FileType
 }
 
 void convert(const Common::UString &inFile, const Common::UString &outFile,
-             Aurora::FileType type, bool flip) {
+             Aurora::FileType type, bool flip, bool rle) {
 
 	Common::ReadFile in(inFile);
 
@@ -243,7 +248,7 @@ void convert(const Common::UString &inFile, const Common::UString &outFile,
 		image->flipVertically();
 
 	try {
-		image->dumpTGA(outFile);
+		image->dumpTGA(outFile, rle);
 	} catch (...) {
 		delete image;
 		throw;